@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "amount.h"
+#include "blockfilter.h"
+#include "streams.h"
+#include "version.h"
+
+static void ConstructGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = static_cast<unsigned char>(i);
+        element[1] = static_cast<unsigned char>(i >> 8);
+        elements.insert(std::move(element));
+    }
+
+    uint64_t siphash_k0 = 0;
+    while (state.KeepRunning()) {
+        GCSFilter filter({siphash_k0, 0, 20, 1 << 20}, elements);
+
+        siphash_k0++;
+    }
+}
+
+static void MatchGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = static_cast<unsigned char>(i);
+        element[1] = static_cast<unsigned char>(i >> 8);
+        elements.insert(std::move(element));
+    }
+    GCSFilter filter({0, 0, 20, 1 << 20}, elements);
+
+    while (state.KeepRunning()) {
+        filter.Match(GCSFilter::Element());
+    }
+}
+
+// Filter of a block, with the scripts of the outputs spent by each input
+// (the undo data is made up: a P2PKH coin per input)
+static void ConstructBlockFilter(benchmark::State& state)
+{
+    CDataStream stream(benchmark::data::block2680960, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    CBlockUndo block_undo;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        CTxUndo tx_undo;
+        for (size_t j = 0; j < block.vtx[i]->vin.size(); j++) {
+            CScript script;
+            script << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)(i + j)) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx_undo.vprevout.emplace_back(CTxOut(COIN, script), 1, false, false);
+        }
+        block_undo.vtxundo.push_back(std::move(tx_undo));
+    }
+
+    while (state.KeepRunning()) {
+        BlockFilter filter(BlockFilterType::BASIC, block, block_undo);
+        assert(filter.GetFilter().GetN() > 0);
+    }
+}
+
+BENCHMARK(ConstructGCSFilter);
+BENCHMARK(MatchGCSFilter);
+BENCHMARK(ConstructBlockFilter);
@@ -20,22 +20,25 @@ static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const int QUEUE_BATCH_SIZE = 128;
-static void CCheckQueueSpeed(benchmark::State& state)
+static const int QUEUE_MAX_THREADS = 16;
+
+struct FakeJobNoWork {
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(FakeJobNoWork& x){};
+};
+
+template <typename Queue>
+static void RunCheckQueueSpeed(benchmark::State& state, Queue& queue)
 {
-    struct FakeJobNoWork {
-        bool operator()()
-        {
-            return true;
-        }
-        void swap(FakeJobNoWork& x){};
-    };
-    CCheckQueue<FakeJobNoWork> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
-        CCheckQueueControl<FakeJobNoWork> control(&queue);
+        CCheckQueueControl<FakeJobNoWork, Queue> control(&queue);
 
         // We call Add a number of times to simulate the behavior of adding
         // a block of transactions at once.
@@ -61,22 +64,23 @@ static void CCheckQueueSpeed(benchmark::State& state)
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+struct PrevectorJob {
+    prevector<PREVECTOR_SIZE, uint8_t> p;
+    PrevectorJob(){
+    }
+    PrevectorJob(FastRandomContext& insecure_rand){
+        p.resize(insecure_rand.rand32() % (PREVECTOR_SIZE*2));
+    }
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(PrevectorJob& x){p.swap(x.p);};
+};
+
+template <typename Queue>
+static void RunCheckQueueSpeedPrevectorJob(benchmark::State& state, Queue& queue)
 {
-    struct PrevectorJob {
-        prevector<PREVECTOR_SIZE, uint8_t> p;
-        PrevectorJob(){
-        }
-        PrevectorJob(FastRandomContext& insecure_rand){
-            p.resize(insecure_rand.rand32() % (PREVECTOR_SIZE*2));
-        }
-        bool operator()()
-        {
-            return true;
-        }
-        void swap(PrevectorJob& x){p.swap(x.p);};
-    };
-    CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
        tg.create_thread([&]{queue.Thread();});
@@ -84,7 +88,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     while (state.KeepRunning()) {
         // Make insecure_rand here so that each iteration is identical.
         FastRandomContext insecure_rand(true);
-        CCheckQueueControl<PrevectorJob> control(&queue);
+        CCheckQueueControl<PrevectorJob, Queue> control(&queue);
         std::vector<std::vector<PrevectorJob>> vBatches(BATCHES);
         for (auto& vChecks : vBatches) {
             vChecks.reserve(BATCH_SIZE);
@@ -99,5 +103,84 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark simulates a small block: a few transactions with one or two
+// inputs each, whose checks take some time (like the signature verification
+// of a script check), added one transaction at a time.
+static const size_t SMALL_BLOCK_TXES = 20;
+static const int WORK_JOB_ROUNDS = 2000;
+struct FakeJobWork {
+    uint64_t n{0};
+    FakeJobWork(){
+    }
+    explicit FakeJobWork(uint64_t nIn) : n(nIn) {}
+    bool operator()()
+    {
+        for (int i = 0; i < WORK_JOB_ROUNDS; i++) {
+            n = n * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        return true;
+    }
+    void swap(FakeJobWork& x){ std::swap(n, x.n); };
+};
+
+template <typename Queue>
+static void RunCheckQueueSpeedSmallBlock(benchmark::State& state, Queue& queue)
+{
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()) - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<FakeJobWork, Queue> control(&queue);
+        for (size_t i = 0; i < SMALL_BLOCK_TXES; i++) {
+            std::vector<FakeJobWork> vChecks;
+            vChecks.emplace_back(i);
+            if (i % 2) vChecks.emplace_back(i + 1);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueSpeed(benchmark::State& state)
+{
+    CCheckQueue<FakeJobNoWork> queue {QUEUE_BATCH_SIZE};
+    RunCheckQueueSpeed(state, queue);
+}
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
+    RunCheckQueueSpeedPrevectorJob(state, queue);
+}
+static void CCheckQueueSpeedSmallBlock(benchmark::State& state)
+{
+    CCheckQueue<FakeJobWork> queue {QUEUE_BATCH_SIZE};
+    RunCheckQueueSpeedSmallBlock(state, queue);
+}
+
+// Same workloads, with the work-stealing queue
+static void WorkStealingQueueSpeed(benchmark::State& state)
+{
+    CWorkStealingCheckQueue<FakeJobNoWork> queue {QUEUE_BATCH_SIZE, QUEUE_MAX_THREADS};
+    RunCheckQueueSpeed(state, queue);
+}
+static void WorkStealingQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CWorkStealingCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE, QUEUE_MAX_THREADS};
+    RunCheckQueueSpeedPrevectorJob(state, queue);
+}
+static void WorkStealingQueueSpeedSmallBlock(benchmark::State& state)
+{
+    CWorkStealingCheckQueue<FakeJobWork> queue {QUEUE_BATCH_SIZE, QUEUE_MAX_THREADS};
+    RunCheckQueueSpeedSmallBlock(state, queue);
+}
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueSpeedSmallBlock);
+BENCHMARK(WorkStealingQueueSpeed);
+BENCHMARK(WorkStealingQueueSpeedPrevectorJob);
+BENCHMARK(WorkStealingQueueSpeedSmallBlock);
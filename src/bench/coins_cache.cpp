@@ -0,0 +1,114 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+#include "script/standard.h"
+
+#include <iostream>
+#include <vector>
+
+// Coins added to the cache in each iteration.
+// Throughput in coins/sec (or lookups/sec) is NUM_COINS / (time per iteration).
+static const size_t NUM_COINS = 100000;
+
+static std::vector<COutPoint> CreateOutpoints(size_t nCoins)
+{
+    FastRandomContext rng(true);
+    std::vector<COutPoint> vOutpoints;
+    vOutpoints.reserve(nCoins);
+    for (size_t i = 0; i < nCoins; i++) {
+        vOutpoints.emplace_back(rng.rand256(), (uint32_t) rng.randbits(2));
+    }
+    return vOutpoints;
+}
+
+static Coin CreateCoin()
+{
+    // A P2PKH output, the most common in the UTXO set
+    CTxOut out(50 * COIN, GetScriptForDestination(CKeyID(uint160())));
+    return Coin(std::move(out), 1, false, false);
+}
+
+static void FillCache(CCoinsViewCache& cache, const std::vector<COutPoint>& vOutpoints)
+{
+    const Coin coin = CreateCoin();
+    for (const COutPoint& outpoint : vOutpoints) {
+        cache.AddCoin(outpoint, Coin(coin), false);
+    }
+}
+
+// Fill an empty cache.
+// The memory usage of the filled cache, per coin, is reported on stderr (out of the csv results).
+static void CoinsCacheInsert(benchmark::State& state)
+{
+    const std::vector<COutPoint>& vOutpoints = CreateOutpoints(NUM_COINS);
+    CCoinsView base;
+    size_t nMemoryUsage = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&base);
+        FillCache(cache, vOutpoints);
+        assert(cache.GetCacheSize() == NUM_COINS);
+        nMemoryUsage = cache.DynamicMemoryUsage();
+    }
+    std::cerr << "CoinsCacheInsert: " << nMemoryUsage << " bytes for " << NUM_COINS << " coins, "
+              << nMemoryUsage / NUM_COINS << " bytes per coin\n";
+}
+
+// Look up the coins of a full cache, and as many missing ones
+static void CoinsCacheLookup(benchmark::State& state)
+{
+    const std::vector<COutPoint>& vOutpoints = CreateOutpoints(NUM_COINS);
+    std::vector<COutPoint> vMissing(vOutpoints);
+    for (COutPoint& outpoint : vMissing) outpoint.n += 4;
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    FillCache(cache, vOutpoints);
+    while (state.KeepRunning()) {
+        size_t nFound = 0;
+        for (size_t i = 0; i < NUM_COINS; i++) {
+            nFound += cache.HaveCoin(vOutpoints[i]);
+            nFound += cache.HaveCoin(vMissing[i]);
+        }
+        assert(nFound == NUM_COINS);
+    }
+}
+
+// Add the coins to a cache on top of another one, and spend them all
+static void CoinsCacheSpend(benchmark::State& state)
+{
+    const std::vector<COutPoint>& vOutpoints = CreateOutpoints(NUM_COINS);
+    CCoinsView base;
+    CCoinsViewCache parent(&base);
+    FillCache(parent, vOutpoints);
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&parent);
+        for (const COutPoint& outpoint : vOutpoints) {
+            cache.SpendCoin(outpoint);
+        }
+        assert(cache.GetCacheSize() == NUM_COINS);
+    }
+}
+
+// Fill a cache and flush it to its (empty) parent
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    const std::vector<COutPoint>& vOutpoints = CreateOutpoints(NUM_COINS);
+    CCoinsView base;
+    while (state.KeepRunning()) {
+        CCoinsViewCache parent(&base);
+        CCoinsViewCache cache(&parent);
+        FillCache(cache, vOutpoints);
+        cache.SetBestBlock(uint256S("1"));
+        bool fOk = cache.Flush();
+        assert(fOk && parent.GetCacheSize() == NUM_COINS);
+    }
+}
+
+BENCHMARK(CoinsCacheInsert);
+BENCHMARK(CoinsCacheLookup);
+BENCHMARK(CoinsCacheSpend);
+BENCHMARK(CoinsCacheFlush);
@@ -10,6 +10,7 @@
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utiltime.h"
 
@@ -48,6 +49,33 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+/* Number of 80-byte block headers to hash per iteration */
+static const size_t QUARK_HEADERS = 1000;
+
+static void QuarkHash(benchmark::State& state)
+{
+    std::vector<uint8_t> in(QUARK_HEADERS * 80, 0);
+    for (size_t i = 0; i < in.size(); i++) in[i] = (uint8_t) i;
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < QUARK_HEADERS; i++) {
+            hash = HashQuark(&in[i * 80], &in[i * 80] + 80);
+        }
+    }
+}
+
+static void QuarkHashN(benchmark::State& state)
+{
+    std::vector<uint8_t> in(QUARK_HEADERS * 80, 0);
+    for (size_t i = 0; i < in.size(); i++) in[i] = (uint8_t) i;
+    std::vector<const unsigned char*> vPtrs;
+    for (size_t i = 0; i < QUARK_HEADERS; i++) vPtrs.emplace_back(&in[i * 80]);
+    std::vector<uint256> vHashes(QUARK_HEADERS);
+    while (state.KeepRunning()) {
+        HashQuarkN(vPtrs.data(), 80, QUARK_HEADERS, vHashes.data());
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -74,6 +102,8 @@ BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
+BENCHMARK(QuarkHash);
+BENCHMARK(QuarkHashN);
 
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
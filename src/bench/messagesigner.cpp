@@ -0,0 +1,50 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "messagesigner.h"
+#include "random.h"
+
+// Verification of a tier-two message signature, recovering the public key
+// from the compact signature (what a cache miss costs)
+static void VerifyHashRecover(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    assert(CHashSigner::SignHash(hash, key, vchSig));
+    const CKeyID keyID = key.GetPubKey().GetID();
+
+    while (state.KeepRunning()) {
+        CPubKey pubkeyFromSig;
+        bool ret = pubkeyFromSig.RecoverCompact(hash, vchSig) && pubkeyFromSig.GetID() == keyID;
+        assert(ret);
+    }
+}
+
+// Verification of a message signature already in the cache (a vote relayed
+// again by another peer)
+static void VerifyHashCached(benchmark::State& state)
+{
+    InitMessageSignatureCache();
+
+    CKey key;
+    key.MakeNewKey(true);
+    const uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    assert(CHashSigner::SignHash(hash, key, vchSig));
+    const CKeyID keyID = key.GetPubKey().GetID();
+    std::string strError;
+
+    while (state.KeepRunning()) {
+        bool ret = CHashSigner::VerifyHash(hash, keyID, vchSig, strError);
+        assert(ret);
+    }
+}
+
+BENCHMARK(VerifyHashRecover);
+BENCHMARK(VerifyHashCached);
@@ -0,0 +1,79 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "checkqueue.h"
+#include "keystore.h"
+#include "sapling/sapling_validation.h"
+#include "sapling/transaction_builder.h"
+#include "sapling/zip32.h"
+#include "util/system.h"
+
+#include <boost/thread/thread.hpp>
+
+// Shielded txs verified in each iteration, each one with NUM_TX_OUTPUTS output proofs.
+// Throughput in proofs/sec is (NUM_TXES * NUM_TX_OUTPUTS) / (time per iteration).
+static const size_t NUM_TXES = 16;
+static const size_t NUM_TX_OUTPUTS = 2;
+
+static const std::vector<CTransactionRef>& GetShieldedTxes()
+{
+    static std::vector<CTransactionRef> vTxes;
+    if (!vTxes.empty()) return vTxes;
+
+    initZKSNARKS();
+    const auto& chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    const CScript& scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<unsigned char, secure_allocator<unsigned char>> rawSeed(32);
+    const auto& sk = libzcash::SaplingExtendedSpendingKey::Master(HDSeed(rawSeed));
+    for (size_t i = 0; i < NUM_TXES; i++) {
+        TransactionBuilder builder(chainParams->GetConsensus(), 1, &keystore);
+        builder.SetFee(0);
+        builder.AddTransparentInput(COutPoint(uint256S("01"), i), scriptPubKey, NUM_TX_OUTPUTS * COIN);
+        for (size_t j = 0; j < NUM_TX_OUTPUTS; j++) {
+            builder.AddSaplingOutput(sk.expsk.full_viewing_key().ovk, sk.DefaultAddress(), COIN, {});
+        }
+        vTxes.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()));
+    }
+    return vTxes;
+}
+
+static void SaplingProofsVerification(benchmark::State& state, int nThreads)
+{
+    const std::vector<CTransactionRef>& vTxes = GetShieldedTxes();
+    CCheckQueue<CSaplingProofCheck> queue(1);
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CSaplingProofCheck> control(&queue);
+        std::vector<CSaplingProofCheck> vChecks;
+        for (const auto& tx : vTxes) {
+            vChecks.emplace_back(*tx);
+        }
+        control.Add(vChecks);
+        bool fValid = control.Wait();
+        assert(fValid);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void SaplingProofs_1Thread(benchmark::State& state) { SaplingProofsVerification(state, 1); }
+static void SaplingProofs_2Threads(benchmark::State& state) { SaplingProofsVerification(state, 2); }
+static void SaplingProofs_4Threads(benchmark::State& state) { SaplingProofsVerification(state, 4); }
+static void SaplingProofs_8Threads(benchmark::State& state) { SaplingProofsVerification(state, 8); }
+
+BENCHMARK(SaplingProofs_1Thread);
+BENCHMARK(SaplingProofs_2Threads);
+BENCHMARK(SaplingProofs_4Threads);
+BENCHMARK(SaplingProofs_8Threads);
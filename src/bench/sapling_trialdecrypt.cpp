@@ -0,0 +1,76 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "sapling/address.h"
+#include "sapling/note.h"
+#include "sapling/noteencryption.h"
+#include "sapling/sapling_transaction.h"
+#include "sapling/sapling_trialdecrypt.h"
+#include "util/system.h"
+
+#include <boost/thread/thread.hpp>
+
+// Outputs trial-decrypted in each iteration (roughly a block full of shielded txs).
+// Throughput in outputs/sec is NUM_OUTPUTS / (time per iteration).
+static const size_t NUM_OUTPUTS = 64;
+
+static std::vector<OutputDescription> CreateOutputs(size_t nOutputs)
+{
+    std::vector<OutputDescription> vOutputs(nOutputs);
+    std::array<unsigned char, ZC_MEMO_SIZE> memo = {{0xF6}};
+    for (OutputDescription& output : vOutputs) {
+        // Outputs sent to a foreign address: every key is tried (common case when scanning)
+        const libzcash::SaplingPaymentAddress& addr = libzcash::SaplingSpendingKey::random().default_address();
+        libzcash::SaplingNote note(addr, 1 * COIN);
+        libzcash::SaplingNotePlaintext pt(note, memo);
+        auto res = pt.encrypt(addr.pk_d);
+        assert(res);
+        output.cmu = *note.cmu();
+        output.ephemeralKey = res->second.get_epk();
+        output.encCiphertext = res->first;
+    }
+    return vOutputs;
+}
+
+static std::vector<libzcash::SaplingIncomingViewingKey> CreateIvks(size_t nKeys)
+{
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    for (size_t i = 0; i < nKeys; i++) {
+        vIvks.emplace_back(libzcash::SaplingSpendingKey::random().full_viewing_key().in_viewing_key());
+    }
+    return vIvks;
+}
+
+static void SaplingTrialDecrypt(benchmark::State& state, size_t nKeys, int nThreads)
+{
+    const std::vector<OutputDescription>& vOutputs = CreateOutputs(NUM_OUTPUTS);
+    const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks = CreateIvks(nKeys);
+    std::vector<const OutputDescription*> vOutputPtrs;
+    for (const OutputDescription& output : vOutputs) vOutputPtrs.emplace_back(&output);
+
+    SetSaplingTrialDecryptThreads(nThreads);
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread(&ThreadSaplingTrialDecrypt);
+    }
+    while (state.KeepRunning()) {
+        const auto& vResults = TrialDecryptSaplingOutputs(vOutputPtrs, vIvks);
+        assert(vResults.size() == NUM_OUTPUTS);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+    SetSaplingTrialDecryptThreads(0);
+}
+
+static void SaplingTrialDecrypt_1Key(benchmark::State& state) { SaplingTrialDecrypt(state, 1, GetNumCores()); }
+static void SaplingTrialDecrypt_10Keys(benchmark::State& state) { SaplingTrialDecrypt(state, 10, GetNumCores()); }
+static void SaplingTrialDecrypt_100Keys(benchmark::State& state) { SaplingTrialDecrypt(state, 100, GetNumCores()); }
+static void SaplingTrialDecrypt_100Keys_SingleThread(benchmark::State& state) { SaplingTrialDecrypt(state, 100, 1); }
+
+BENCHMARK(SaplingTrialDecrypt_1Key);
+BENCHMARK(SaplingTrialDecrypt_10Keys);
+BENCHMARK(SaplingTrialDecrypt_100Keys);
+BENCHMARK(SaplingTrialDecrypt_100Keys_SingleThread);
@@ -0,0 +1,60 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "kernel.h"
+#include "random.h"
+#include "util/memory.h"
+#include "util/system.h"
+
+#include <boost/thread/thread.hpp>
+
+// Stake inputs searched in each iteration (a large staking wallet).
+// Throughput in kernels/sec is NUM_STAKE_INPUTS / (time per iteration).
+static const size_t NUM_STAKE_INPUTS = 20000;
+// Tiny target: no kernel is found, every input is checked
+static const unsigned int KERNEL_BITS = 0x03000001;
+
+static void StakeKernelSearch(benchmark::State& state, int nThreads)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CBlockIndex indexFrom;
+    indexFrom.nHeight = 1;
+    indexFrom.nTime = 1600000000;
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 1000;
+    indexPrev.nTime = 1600100000;
+    indexPrev.SetStakeModifier(GetRandHash());
+
+    CStakeKernelSearch search(&indexPrev, KERNEL_BITS, GetRandHash());
+    for (size_t i = 0; i < NUM_STAKE_INPUTS; i++) {
+        search.AddStakeInput(MakeUnique<CPivStake>(CTxOut(100 * COIN, CScript()),
+                                                   COutPoint(GetRandHash(), i % 4),
+                                                   &indexFrom));
+    }
+
+    SetStakeKernelSearchThreads(nThreads);
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread(&ThreadStakeKernelSearch);
+    }
+    int nTimeTx = indexPrev.nTime;
+    while (state.KeepRunning()) {
+        nTimeTx += 15;
+        int nFound = search.FindKernel(nTimeTx);
+        assert(nFound < 0);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+    SetStakeKernelSearchThreads(0);
+}
+
+static void StakeKernelSearch_SingleThread(benchmark::State& state) { StakeKernelSearch(state, 1); }
+static void StakeKernelSearch_MultiThread(benchmark::State& state) { StakeKernelSearch(state, GetNumCores()); }
+
+BENCHMARK(StakeKernelSearch_SingleThread);
+BENCHMARK(StakeKernelSearch_MultiThread);
@@ -0,0 +1,210 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "logging.h"
+#include "util/memory.h"
+#include "util/system.h"
+
+// A batch is handed to the workers once it holds this many blocks, or this many bytes
+static const size_t IMPORT_BATCH_MAX_BLOCKS = 128;
+static const size_t IMPORT_BATCH_MAX_SIZE = 4 * 1000 * 1000;
+
+CBlockFileImporter::CBlockFileImporter(FILE* fileIn, const FlatFilePos* dbp, int nWorkers) :
+        nMaxBatches(2 * std::max(nWorkers, 1) + 2),
+        blkdat(MakeUnique<CBufferedFile>(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION)),
+        nFile(dbp ? dbp->nFile : -1)
+{
+    threadReader = std::thread(&CBlockFileImporter::ThreadRead, this);
+    for (int i = 0; i < std::max(nWorkers, 1); i++) {
+        vWorkerThreads.emplace_back(&CBlockFileImporter::ThreadDeserialize, this);
+    }
+}
+
+CBlockFileImporter::~CBlockFileImporter()
+{
+    {
+        LOCK(cs);
+        fInterrupt = true;
+    }
+    condReader.notify_all();
+    condWorker.notify_all();
+    if (threadReader.joinable()) threadReader.join();
+    for (std::thread& t : vWorkerThreads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+bool CBlockFileImporter::ReadBatch(Batch& batch, uint64_t& nRewind, bool& fEof)
+{
+    size_t nBatchSize = 0;
+    while (batch.vRaw.size() < IMPORT_BATCH_MAX_BLOCKS && nBatchSize < IMPORT_BATCH_MAX_SIZE) {
+        // rewind before checking for the end of file: a record truncated by the end
+        // of the file may still hide complete blocks
+        blkdat->SetPos(nRewind);
+        if (blkdat->eof()) break;
+        nRewind++;          // start one byte further next time, in case of failure
+        blkdat->SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat->FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat->GetPos() + 1;
+            *blkdat >> buf;
+            if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            *blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            fEof = true;
+            break;
+        }
+        try {
+            // read the raw block, deserialized by the workers
+            uint64_t nBlockPos = blkdat->GetPos();
+            blkdat->SetLimit(nBlockPos + nSize);
+            batch.vRaw.emplace_back(SER_DISK, CLIENT_VERSION);
+            batch.vRaw.back().resize(nSize);
+            blkdat->read(batch.vRaw.back().data(), nSize);
+            batch.vPos.emplace_back((unsigned int)nBlockPos);
+            nRewind = blkdat->GetPos();
+            nBatchSize += nSize;
+        } catch (const std::exception& e) {
+            if (batch.vRaw.size() > batch.vPos.size()) batch.vRaw.pop_back();
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    if (blkdat->eof()) fEof = true;
+    return !batch.vRaw.empty();
+}
+
+void CBlockFileImporter::ThreadRead()
+{
+    util::ThreadRename("pivx-loadblkrd");
+    uint64_t nRewind = blkdat->GetPos();
+    bool fEof = false;
+    while (true) {
+        {
+            WAIT_LOCK(cs, lock);
+            if (fEof && !fReaderDone) {
+                fReaderDone = true;
+                condConsumer.notify_all();
+            }
+            // at the end of the file, wait for a rescan (or the end of the import)
+            condReader.wait(lock, [this, &fEof]{ return fInterrupt || fRescan || (!fEof && queueBatches.size() < nMaxBatches); });
+            if (fInterrupt) break;
+            if (fRescan) {
+                LogPrintf("%s : Scanning again from position %d\n", __func__, nRescanPos);
+                fRescan = false;
+                fReaderDone = false;
+                nRewind = nRescanPos;
+                fEof = !blkdat->Seek(nRewind);
+            }
+        }
+        if (fEof) continue;
+        auto batch = std::make_shared<Batch>();
+        if (!ReadBatch(*batch, nRewind, fEof)) continue;
+        {
+            LOCK(cs);
+            // read before a rescan request: dropped, the reader goes back first
+            if (fRescan) continue;
+            queueBatches.emplace_back(batch);
+            queuePending.emplace_back(batch);
+        }
+        condWorker.notify_one();
+    }
+}
+
+void CBlockFileImporter::DeserializeBatch(Batch& batch, int nFile)
+{
+    std::vector<CBlockHeader> vHeaders;
+    batch.vBlocks.reserve(batch.vRaw.size());
+    for (size_t i = 0; i < batch.vRaw.size(); i++) {
+        try {
+            CImportedBlock imported;
+            imported.pos = FlatFilePos(nFile, batch.vPos[i]);
+            imported.nSize = batch.vRaw[i].size();
+            auto block = std::make_shared<CBlock>();
+            batch.vRaw[i] >> *block;
+            vHeaders.emplace_back(block->GetBlockHeader());
+            imported.block = std::move(block);
+            batch.vBlocks.emplace_back(std::move(imported));
+        } catch (const std::exception& e) {
+            // the rest of the file is scanned again from the byte after the magic of the record
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            batch.fFailed = true;
+            batch.nRescanPos = batch.vPos[i] - MESSAGE_START_SIZE - sizeof(uint32_t) + 1;
+            break;
+        }
+    }
+    batch.vRaw.clear();
+    // Hash the headers together (multi-lane quark hashing for the legacy ones)
+    const std::vector<uint256>& vHashes = GetBlockHeadersHashes(vHeaders);
+    for (size_t i = 0; i < batch.vBlocks.size(); i++) {
+        batch.vBlocks[i].hash = vHashes[i];
+    }
+}
+
+void CBlockFileImporter::ThreadDeserialize()
+{
+    util::ThreadRename("pivx-loadblkdes");
+    while (true) {
+        std::shared_ptr<Batch> batch;
+        {
+            WAIT_LOCK(cs, lock);
+            condWorker.wait(lock, [this]{ return fInterrupt || !queuePending.empty(); });
+            if (fInterrupt) return;
+            batch = queuePending.front();
+            queuePending.pop_front();
+        }
+        DeserializeBatch(*batch, nFile);
+        {
+            LOCK(cs);
+            batch->fProcessed = true;
+        }
+        condConsumer.notify_one();
+    }
+}
+
+bool CBlockFileImporter::Next(CImportedBlock& blockOut)
+{
+    bool fFound = false;
+    bool fPopped = false;
+    {
+        WAIT_LOCK(cs, lock);
+        while (!fFound) {
+            condConsumer.wait(lock, [this]{ return (!queueBatches.empty() && queueBatches.front()->fProcessed) ||
+                                                   (queueBatches.empty() && fReaderDone && !fRescan); });
+            if (queueBatches.empty()) break;
+            Batch& batch = *queueBatches.front();
+            if (nNextBlock < batch.vBlocks.size()) {
+                blockOut = std::move(batch.vBlocks[nNextBlock++]);
+                fFound = true;
+            } else if (batch.fFailed) {
+                // drop what was read after the failed record, and scan again from it
+                fRescan = true;
+                nRescanPos = batch.nRescanPos;
+                queueBatches.clear();
+                queuePending.clear();
+                nNextBlock = 0;
+                fPopped = true;
+            } else {
+                // front batch fully consumed, let the reader go on
+                queueBatches.pop_front();
+                nNextBlock = 0;
+                fPopped = true;
+            }
+        }
+    }
+    if (fPopped) condReader.notify_one();
+    return fFound;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_BLOCKIMPORT_H
+#define PIVX_BLOCKIMPORT_H
+
+#include "flatfile.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/** Maximum number of threads deserializing and hashing the blocks of an imported file */
+static const int MAX_BLOCK_IMPORT_THREADS = 4;
+/** Maximum size of the out of order blocks kept in memory during an import (the others are read back from disk) */
+static const size_t MAX_IMPORT_UNKNOWN_PARENT_SIZE = 128 * 1000 * 1000;
+
+/** A block read from an external or blk file, deserialized and hashed ahead of its validation */
+struct CImportedBlock
+{
+    std::shared_ptr<const CBlock> block;
+    uint256 hash;
+    // Position of the block in the file (nFile is null when not importing a blk file)
+    FlatFilePos pos;
+    unsigned int nSize{0};
+};
+
+/**
+ * Staged import of a block file (-reindex, -loadblock and bootstrap.dat).
+ * A reader thread scans the file for the network magic and reads the raw
+ * blocks in batches, a pool of workers deserializes them (computing the
+ * transactions hashes) and hashes the block headers, and the single caller
+ * of Next() gets them back in file order, ready to be connected.
+ * The number of batches in flight is bounded, so the reader never gets too
+ * far ahead of the validation.
+ * A record that fails to deserialize may hide the blocks written over it (e.g.
+ * after a crash): when the caller reaches it, the batches read after it are
+ * dropped and the reader scans the file again from the byte after its magic.
+ */
+class CBlockFileImporter
+{
+private:
+    struct Batch
+    {
+        std::vector<CDataStream> vRaw;
+        std::vector<unsigned int> vPos;
+        std::vector<CImportedBlock> vBlocks;
+        bool fProcessed{false};
+        // Set if a record failed to deserialize (vBlocks stops before it), with the position to scan again from
+        bool fFailed{false};
+        uint64_t nRescanPos{0};
+    };
+
+    // Protects all the members below
+    Mutex cs;
+    std::condition_variable condReader;
+    std::condition_variable condWorker;
+    std::condition_variable condConsumer;
+
+    // All the batches read, in file order (front is the one being consumed)
+    std::deque<std::shared_ptr<Batch>> queueBatches;
+    // Batches waiting to be deserialized by the workers
+    std::deque<std::shared_ptr<Batch>> queuePending;
+    // Next block of the front batch to return
+    size_t nNextBlock{0};
+    size_t nMaxBatches;
+    bool fReaderDone{false};
+    bool fInterrupt{false};
+    // Set by the consumer when the reader must scan again from nRescanPos
+    bool fRescan{false};
+    uint64_t nRescanPos{0};
+
+    std::unique_ptr<CBufferedFile> blkdat;
+    int nFile;
+    std::thread threadReader;
+    std::vector<std::thread> vWorkerThreads;
+
+    void ThreadRead();
+    void ThreadDeserialize();
+    bool ReadBatch(Batch& batch, uint64_t& nRewind, bool& fEof);
+    static void DeserializeBatch(Batch& batch, int nFile);
+
+public:
+    /** Takes over fileIn, closed when the importer is destroyed. dbp is the position of the file (if it is a blk file) */
+    CBlockFileImporter(FILE* fileIn, const FlatFilePos* dbp, int nWorkers);
+    ~CBlockFileImporter();
+
+    /** Waits for the next block of the file. Returns false when there are no more blocks. */
+    bool Next(CImportedBlock& blockOut);
+};
+
+#endif // PIVX_BLOCKIMPORT_H
@@ -0,0 +1,143 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+
+#include "fs.h"
+#include "validation.h"
+
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#endif
+
+#ifdef WIN32
+
+struct CMappedBlockFiles::MappedFile {};
+
+std::shared_ptr<const CMappedBlockFiles::MappedFile> CMappedBlockFiles::GetFile(const FlatFilePos& pos, size_t nMinSize)
+{
+    return nullptr;
+}
+
+bool CMappedBlockFiles::Read(const FlatFilePos& pos, size_t nSize, unsigned char* pOut)
+{
+    // No mappings, read through a FILE*
+    FILE* file = OpenBlockFile(pos, true);
+    if (!file)
+        return false;
+    const bool fRet = fread(pOut, 1, nSize, file) == nSize;
+    fclose(file);
+    return fRet;
+}
+
+#else
+
+struct CMappedBlockFiles::MappedFile
+{
+    const unsigned char* data{nullptr};
+    size_t size{0};
+
+    ~MappedFile()
+    {
+        if (data) munmap((void*)data, size);
+    }
+};
+
+std::shared_ptr<const CMappedBlockFiles::MappedFile> CMappedBlockFiles::GetFile(const FlatFilePos& pos, size_t nMinSize)
+{
+    LOCK(cs);
+    auto it = mapFiles.find(pos.nFile);
+    if (it != mapFiles.end() && it->second->size >= nMinSize) {
+        listLru.remove(pos.nFile);
+        listLru.push_front(pos.nFile);
+        return it->second;
+    }
+
+    // Map the whole file (again, if it has grown since the last mapping)
+    FILE* file = fsbridge::fopen(GetBlockPosFilename(FlatFilePos(pos.nFile, 0)), "rb");
+    if (!file)
+        return nullptr;
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || st.st_size <= 0 || (size_t)st.st_size < nMinSize) {
+        fclose(file);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    fclose(file);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    auto mapped = std::make_shared<MappedFile>();
+    mapped->data = (const unsigned char*)data;
+    mapped->size = st.st_size;
+    if (it != mapFiles.end()) {
+        // The old mapping is released when its last reader is done with it
+        it->second = mapped;
+        listLru.remove(pos.nFile);
+    } else {
+        mapFiles.emplace(pos.nFile, mapped);
+    }
+    listLru.push_front(pos.nFile);
+    while (listLru.size() > nMaxFiles) {
+        mapFiles.erase(listLru.back());
+        listLru.pop_back();
+    }
+    return mapped;
+}
+
+bool CMappedBlockFiles::Read(const FlatFilePos& pos, size_t nSize, unsigned char* pOut)
+{
+    const auto& file = GetFile(pos, (size_t)pos.nPos + nSize);
+    if (!file)
+        return false;
+    memcpy(pOut, file->data + pos.nPos, nSize);
+    return true;
+}
+
+#endif // WIN32
+
+void CMappedBlockFiles::Clear()
+{
+    LOCK(cs);
+    mapFiles.clear();
+    listLru.clear();
+}
+
+CRawBlockCache::RawBlockRef CRawBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return nullptr;
+    listLru.splice(listLru.begin(), listLru, it->second);
+    return it->second->second;
+}
+
+void CRawBlockCache::Put(const uint256& hash, const RawBlockRef& block)
+{
+    if (!block || block->size() > nMaxSize)
+        return;
+    LOCK(cs);
+    if (mapBlocks.count(hash))
+        return;
+    listLru.emplace_front(hash, block);
+    mapBlocks.emplace(hash, listLru.begin());
+    nSize += block->size();
+    while (nSize > nMaxSize) {
+        nSize -= listLru.back().second->size();
+        mapBlocks.erase(listLru.back().first);
+        listLru.pop_back();
+    }
+}
+
+void CRawBlockCache::Clear()
+{
+    LOCK(cs);
+    listLru.clear();
+    mapBlocks.clear();
+    nSize = 0;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_BLOCKSTORE_H
+#define PIVX_BLOCKSTORE_H
+
+#include "flatfile.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/** Maximum number of block files mapped in memory at the same time */
+static const size_t MAX_MAPPED_BLOCK_FILES = 64;
+/** Maximum size of the raw blocks kept in memory after being served (in bytes) */
+static const size_t DEFAULT_RAW_BLOCK_CACHE_SIZE = 32 * 1024 * 1024;
+
+/**
+ * Read-only access to the block files through memory mappings.
+ * Used to get the serialized bytes of the stored blocks without going
+ * through a FILE* (open, seek and buffered read for every block).
+ * The least recently used mappings are released when there are more than
+ * nMaxFiles, and a file is mapped again when it has grown past the
+ * mapped size (the last block file is still being appended).
+ * On Windows the bytes are read with a plain FILE*.
+ */
+class CMappedBlockFiles
+{
+private:
+    struct MappedFile;
+
+    Mutex cs;
+    size_t nMaxFiles;
+    // File number -> mapping, and the files in most recently used order
+    std::map<int, std::shared_ptr<const MappedFile>> mapFiles;
+    std::list<int> listLru;
+
+    std::shared_ptr<const MappedFile> GetFile(const FlatFilePos& pos, size_t nMinSize);
+
+public:
+    explicit CMappedBlockFiles(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Copy nSize bytes of the block file pos.nFile, at offset pos.nPos, into pOut */
+    bool Read(const FlatFilePos& pos, size_t nSize, unsigned char* pOut);
+
+    /** Release all the mappings */
+    void Clear();
+};
+
+/**
+ * LRU of the serialized blocks recently served (to peers, RPC and REST),
+ * bounded by the total size of the blocks.
+ */
+class CRawBlockCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char>> RawBlockRef;
+
+private:
+    struct CacheHasher {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+    typedef std::list<std::pair<uint256, RawBlockRef>> LruList;
+
+    Mutex cs;
+    size_t nMaxSize;
+    size_t nSize{0};
+    LruList listLru;
+    std::unordered_map<uint256, LruList::iterator, CacheHasher> mapBlocks;
+
+public:
+    explicit CRawBlockCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    /** Return the cached block (nullptr if not cached), moving it to the front */
+    RawBlockRef Get(const uint256& hash);
+    void Put(const uint256& hash, const RawBlockRef& block);
+    void Clear();
+};
+
+#endif // PIVX_BLOCKSTORE_H
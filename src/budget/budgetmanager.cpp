@@ -5,14 +5,18 @@
 
 #include "budget/budgetmanager.h"
 
+#include "budget/budgetvotecheck.h"
 #include "consensus/validation.h"
 #include "evo/deterministicmns.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "net_processing.h"
 #include "netmessagemaker.h"
+#include "util/threadnames.h"
 #include "validation.h"   // GetTransaction, cs_main
 
+#include <boost/thread/thread.hpp>
+
 
 CBudgetManager g_budgetman;
 
@@ -973,6 +977,26 @@ int CBudgetManager::ProcessProposal(CBudgetProposal& proposal)
     return 0;
 }
 
+bool CBudgetManager::GetVoteSigner(const CTxIn& voteVin, const CDeterministicMNList& mnList, bool fOperatorKey, CBudgetVoteSigner& signerRet) const
+{
+    signerRet = CBudgetVoteSigner();
+    auto dmn = mnList.GetMNByCollateral(voteVin.prevout);
+    if (dmn) {
+        signerRet.dmn = dmn;
+        signerRet.keyID = fOperatorKey ? dmn->pdmnState->keyIDOperator : dmn->pdmnState->keyIDVoting;
+        return true;
+    }
+
+    // -- Legacy System (!TODO: remove after enforcement) --
+    CMasternode* pmn = mnodeman.Find(voteVin.prevout);
+    if (!pmn) {
+        return false;
+    }
+    signerRet.fLegacy = true;
+    signerRet.keyID = pmn->pubKeyMasternode.GetID();
+    return true;
+}
+
 bool CBudgetManager::ProcessProposalVote(CBudgetVote& vote, CNode* pfrom, CValidationState& state)
 {
     const uint256& voteID = vote.GetHash();
@@ -982,16 +1006,25 @@ bool CBudgetManager::ProcessProposalVote(CBudgetVote& vote, CNode* pfrom, CValid
         return false;
     }
 
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    CBudgetVoteSigner signer;
+    const bool fSigValid = GetVoteSigner(vote.GetVin(), mnList, false, signer) &&
+                           vote.CheckSignature(signer.keyID);
+    return ProcessProposalVoteChecked(vote, mnList, signer, fSigValid, pfrom, state);
+}
+
+bool CBudgetManager::ProcessProposalVoteChecked(CBudgetVote& vote, const CDeterministicMNList& mnList, const CBudgetVoteSigner& signer, bool fSigValid, CNode* pfrom, CValidationState& state)
+{
+    const uint256& voteID = vote.GetHash();
     const CTxIn& voteVin = vote.GetVin();
 
     // See if this vote was signed with a deterministic masternode
     std::string err;
-    auto mnList = deterministicMNManager->GetListAtChainTip();
-    auto dmn = mnList.GetMNByCollateral(voteVin.prevout);
+    const auto& dmn = signer.dmn;
     if (dmn) {
         const std::string& mn_protx_id = dmn->proTxHash.ToString();
 
-        if (!vote.CheckSignature(dmn->pdmnState->keyIDVoting)) {
+        if (!fSigValid) {
             err = strprintf("invalid mvote sig from dmn: %s", mn_protx_id);
             return state.DoS(100, false, REJECT_INVALID, "bad-mvote-sig", false, err);
         }
@@ -1016,8 +1049,7 @@ bool CBudgetManager::ProcessProposalVote(CBudgetVote& vote, CNode* pfrom, CValid
 
     // -- Legacy System (!TODO: remove after enforcement) --
 
-    CMasternode* pmn = mnodeman.Find(voteVin.prevout);
-    if (!pmn) {
+    if (!signer.fLegacy) {
         err = strprintf("unknown masternode - vin: %s", voteVin.prevout.ToString());
         mnodeman.AskForMN(pfrom, voteVin);
         return state.DoS(0, false, REJECT_INVALID, "bad-mvote", false, err);
@@ -1025,7 +1057,7 @@ bool CBudgetManager::ProcessProposalVote(CBudgetVote& vote, CNode* pfrom, CValid
 
     AddSeenProposalVote(vote);
 
-    if (!vote.CheckSignature(pmn->pubKeyMasternode.GetID())) {
+    if (!fSigValid) {
         if (masternodeSync.IsSynced()) {
             err = strprintf("signature from masternode %s invalid", voteVin.prevout.ToString());
             return state.DoS(20, false, REJECT_INVALID, "bad-fbvote", false, err);
@@ -1035,7 +1067,9 @@ bool CBudgetManager::ProcessProposalVote(CBudgetVote& vote, CNode* pfrom, CValid
         return false;
     }
 
-    if (!pmn->IsEnabled()) {
+    // the masternode could have been removed since the signature check
+    CMasternode* pmn = mnodeman.Find(voteVin.prevout);
+    if (!pmn || !pmn->IsEnabled()) {
         return state.DoS(0, false, REJECT_INVALID, "bad-mvote", false, "masternode not valid");
     }
     if (!UpdateProposal(vote, pfrom, err)) {
@@ -1078,16 +1112,25 @@ bool CBudgetManager::ProcessFinalizedBudgetVote(CFinalizedBudgetVote& vote, CNod
         return false;
     }
 
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    CBudgetVoteSigner signer;
+    const bool fSigValid = GetVoteSigner(vote.GetVin(), mnList, true, signer) &&
+                           vote.CheckSignature(signer.keyID);
+    return ProcessFinalizedBudgetVoteChecked(vote, mnList, signer, fSigValid, pfrom, state);
+}
+
+bool CBudgetManager::ProcessFinalizedBudgetVoteChecked(CFinalizedBudgetVote& vote, const CDeterministicMNList& mnList, const CBudgetVoteSigner& signer, bool fSigValid, CNode* pfrom, CValidationState& state)
+{
+    const uint256& voteID = vote.GetHash();
     const CTxIn& voteVin = vote.GetVin();
 
     // See if this vote was signed with a deterministic masternode
     std::string err;
-    auto mnList = deterministicMNManager->GetListAtChainTip();
-    auto dmn = mnList.GetMNByCollateral(voteVin.prevout);
+    const auto& dmn = signer.dmn;
     if (dmn) {
         const std::string& mn_protx_id = dmn->proTxHash.ToString();
 
-        if (!vote.CheckSignature(dmn->pdmnState->keyIDOperator)) {
+        if (!fSigValid) {
             err = strprintf("invalid fbvote sig from dmn: %s", mn_protx_id);
             return state.DoS(100, false, REJECT_INVALID, "bad-fbvote-sig", false, err);
         }
@@ -1110,8 +1153,7 @@ bool CBudgetManager::ProcessFinalizedBudgetVote(CFinalizedBudgetVote& vote, CNod
     }
 
     // -- Legacy System (!TODO: remove after enforcement) --
-    CMasternode* pmn = mnodeman.Find(voteVin.prevout);
-    if (!pmn) {
+    if (!signer.fLegacy) {
         err = strprintf("unknown masternode - vin: %s", voteVin.prevout.ToString());
         mnodeman.AskForMN(pfrom, voteVin);
         return state.DoS(0, false, REJECT_INVALID, "bad-fbvote", false, err);
@@ -1119,7 +1161,7 @@ bool CBudgetManager::ProcessFinalizedBudgetVote(CFinalizedBudgetVote& vote, CNod
 
     AddSeenFinalizedBudgetVote(vote);
 
-    if (!vote.CheckSignature(pmn->pubKeyMasternode.GetID())) {
+    if (!fSigValid) {
         if (masternodeSync.IsSynced()) {
             err = strprintf("signature from masternode %s invalid", voteVin.prevout.ToString());
             return state.DoS(20, false, REJECT_INVALID, "bad-fbvote", false, err);
@@ -1129,7 +1171,9 @@ bool CBudgetManager::ProcessFinalizedBudgetVote(CFinalizedBudgetVote& vote, CNod
         return false;
     }
 
-    if (!pmn->IsEnabled()) {
+    // the masternode could have been removed since the signature check
+    CMasternode* pmn = mnodeman.Find(voteVin.prevout);
+    if (!pmn || !pmn->IsEnabled()) {
         return state.DoS(0, false, REJECT_INVALID, "bad-fbvote", false, "masternode not valid");
     }
     if (!UpdateFinalizedBudget(vote, pfrom, err)) {
@@ -1143,6 +1187,143 @@ bool CBudgetManager::ProcessFinalizedBudgetVote(CFinalizedBudgetVote& vote, CNod
     return true;
 }
 
+// Ban score of a vote rejected by ProcessProposalVote/ProcessFinalizedBudgetVote
+static int GetVoteBanScore(const CValidationState& state)
+{
+    int nDos = 0;
+    if (state.IsInvalid(nDos) && nDos > 0) {
+        LogPrint(BCLog::NET, "%s: %s\n", __func__, FormatStateMessage(state));
+        return nDos;
+    }
+    return 0;
+}
+
+template <typename VoteType>
+bool CBudgetManager::QueueVote(std::deque<CPendingBudgetVote<VoteType>>& vPending, const VoteType& vote, NodeId nodeId)
+{
+    boost::unique_lock<boost::mutex> lock(cs_pendingvotes);
+    const uint256& voteID = vote.GetHash();
+    if (setPendingVotes.count(voteID)) {
+        // already received from another peer
+        masternodeSync.AddedBudgetItem(voteID);
+        return true;
+    }
+    if (setPendingVotes.size() >= MAX_PENDING_BUDGET_VOTES) {
+        return false;
+    }
+    setPendingVotes.emplace(voteID);
+    vPending.emplace_back(vote, nodeId);
+    condPendingVotes.notify_one();
+    return true;
+}
+
+size_t CBudgetManager::GetPendingVotesCount()
+{
+    boost::unique_lock<boost::mutex> lock(cs_pendingvotes);
+    return setPendingVotes.size();
+}
+
+bool CBudgetManager::WaitForPendingVotes(int64_t nMillis)
+{
+    boost::unique_lock<boost::mutex> lock(cs_pendingvotes);
+    if (setPendingVotes.empty()) {
+        condPendingVotes.wait_for(lock, boost::chrono::milliseconds(nMillis));
+    }
+    return !setPendingVotes.empty();
+}
+
+// Reference to the node with the given id (to be released by the caller), or nullptr if disconnected
+static CNode* GetNodeRef(NodeId nodeId)
+{
+    CNode* pnode = nullptr;
+    g_connman->ForNode(nodeId, [&pnode](CNode* p) {
+        p->AddRef();
+        pnode = p;
+        return true;
+    });
+    return pnode;
+}
+
+// Resolve the signers of a batch of votes and queue their signature checks
+template <typename VoteType>
+static void AddVoteChecks(const CBudgetManager& budgetman, std::vector<CPendingBudgetVote<VoteType>>& vVotes,
+                          const CDeterministicMNList& mnList, bool fOperatorKey, std::vector<CSignedMessageCheck>& vChecks)
+{
+    for (CPendingBudgetVote<VoteType>& pending : vVotes) {
+        if (budgetman.GetVoteSigner(pending.vote.GetVin(), mnList, fOperatorKey, pending.signer)) {
+            vChecks.emplace_back(&pending.vote, pending.signer.keyID, &pending.fSigValid);
+        }
+    }
+}
+
+size_t CBudgetManager::ProcessPendingVotes()
+{
+    std::vector<CPendingBudgetVote<CBudgetVote>> vProposalVotes;
+    std::vector<CPendingBudgetVote<CFinalizedBudgetVote>> vFinalizedVotes;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_pendingvotes);
+        while (!vPendingProposalVotes.empty() && vProposalVotes.size() < MAX_BUDGET_VOTES_BATCH) {
+            vProposalVotes.emplace_back(std::move(vPendingProposalVotes.front()));
+            vPendingProposalVotes.pop_front();
+            setPendingVotes.erase(vProposalVotes.back().vote.GetHash());
+        }
+        while (!vPendingFinalizedVotes.empty() && vProposalVotes.size() + vFinalizedVotes.size() < MAX_BUDGET_VOTES_BATCH) {
+            vFinalizedVotes.emplace_back(std::move(vPendingFinalizedVotes.front()));
+            vPendingFinalizedVotes.pop_front();
+            setPendingVotes.erase(vFinalizedVotes.back().vote.GetHash());
+        }
+    }
+    if (vProposalVotes.empty() && vFinalizedVotes.empty()) {
+        return 0;
+    }
+
+    // Verify all the signatures of the batch, against a single snapshot of the masternode list
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    std::vector<CSignedMessageCheck> vChecks;
+    vChecks.reserve(vProposalVotes.size() + vFinalizedVotes.size());
+    AddVoteChecks(*this, vProposalVotes, mnList, false, vChecks);
+    AddVoteChecks(*this, vFinalizedVotes, mnList, true, vChecks);
+    RunSignedMessageChecks(vChecks);
+
+    // Then apply the votes, in the order they were received
+    std::map<NodeId, int> mapBanScores;
+    for (auto& pending : vProposalVotes) {
+        if (HaveSeenProposalVote(pending.vote.GetHash())) {
+            masternodeSync.AddedBudgetItem(pending.vote.GetHash());
+            continue;
+        }
+        // the votes of disconnected peers are dropped
+        CNode* pnode = GetNodeRef(pending.nodeId);
+        if (!pnode) continue;
+        CValidationState state;
+        if (!ProcessProposalVoteChecked(pending.vote, mnList, pending.signer, pending.fSigValid, pnode, state)) {
+            mapBanScores[pending.nodeId] += GetVoteBanScore(state);
+        }
+        pnode->Release();
+    }
+    for (auto& pending : vFinalizedVotes) {
+        if (HaveSeenFinalizedBudgetVote(pending.vote.GetHash())) {
+            masternodeSync.AddedBudgetItem(pending.vote.GetHash());
+            continue;
+        }
+        CNode* pnode = GetNodeRef(pending.nodeId);
+        if (!pnode) continue;
+        CValidationState state;
+        if (!ProcessFinalizedBudgetVoteChecked(pending.vote, mnList, pending.signer, pending.fSigValid, pnode, state)) {
+            mapBanScores[pending.nodeId] += GetVoteBanScore(state);
+        }
+        pnode->Release();
+    }
+
+    for (const auto& it : mapBanScores) {
+        if (it.second > 0) {
+            LOCK(cs_main);
+            Misbehaving(it.first, it.second);
+        }
+    }
+    return vProposalVotes.size() + vFinalizedVotes.size();
+}
+
 void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     int banScore = ProcessMessageInner(pfrom, strCommand, vRecv);
@@ -1178,15 +1359,16 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         CBudgetVote vote;
         vRecv >> vote;
         vote.SetValid(true);
-        CValidationState state;
-        if (!ProcessProposalVote(vote, pfrom, state)) {
-            int nDos = 0;
-            if(state.IsInvalid(nDos) && nDos > 0) {
-                LogPrint(BCLog::NET, "%s: %s\n", __func__, FormatStateMessage(state));
-                return nDos;
-            }
+        if (HaveSeenProposalVote(vote.GetHash())) {
+            masternodeSync.AddedBudgetItem(vote.GetHash());
+            return 0;
         }
-        return 0;
+        // Verified later, in a batch, by ThreadBudgetVotes (unless too many votes are waiting)
+        if (fBatchVotes && QueueVote(vPendingProposalVotes, vote, pfrom->GetId())) {
+            return 0;
+        }
+        CValidationState state;
+        return ProcessProposalVote(vote, pfrom, state) ? 0 : GetVoteBanScore(state);
     }
 
     if (strCommand == NetMsgType::FINALBUDGET) {
@@ -1202,15 +1384,16 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         CFinalizedBudgetVote vote;
         vRecv >> vote;
         vote.SetValid(true);
-        CValidationState state;
-        if (!ProcessFinalizedBudgetVote(vote, pfrom, state)) {
-            int nDos = 0;
-            if(state.IsInvalid(nDos) && nDos > 0) {
-                LogPrint(BCLog::NET, "%s: %s\n", __func__, FormatStateMessage(state));
-                return nDos;
-            }
+        if (HaveSeenFinalizedBudgetVote(vote.GetHash())) {
+            masternodeSync.AddedBudgetItem(vote.GetHash());
+            return 0;
         }
-        return 0;
+        // Verified later, in a batch, by ThreadBudgetVotes (unless too many votes are waiting)
+        if (fBatchVotes && QueueVote(vPendingFinalizedVotes, vote, pfrom->GetId())) {
+            return 0;
+        }
+        CValidationState state;
+        return ProcessFinalizedBudgetVote(vote, pfrom, state) ? 0 : GetVoteBanScore(state);
     }
 
     // nothing was done
@@ -1379,7 +1562,9 @@ bool CheckCollateral(const uint256& nTxCollateralHash, const uint256& nExpectedH
     CTransactionRef txCollateral;
     uint256 nBlockHash;
     if (!GetTransaction(nTxCollateralHash, txCollateral, nBlockHash, true)) {
-        strError = strprintf("Can't find collateral tx %s", nTxCollateralHash.ToString());
+        // the tx index could still be building: the proposal is requested again at the next sync
+        strError = strprintf("Can't find collateral tx %s%s", nTxCollateralHash.ToString(),
+                IsTxIndexSyncing() ? " (transaction index syncing)" : "");
         return false;
     }
 
@@ -1452,3 +1637,24 @@ bool CheckCollateral(const uint256& nTxCollateralHash, const uint256& nExpectedH
 
     return CheckCollateralConfs(nTxCollateralHash, nCurrentHeight, nProposalHeight, strError);
 }
+
+void ThreadBudgetVotes()
+{
+    if (fLiteMode) return; //disable all Masternode related functionality
+
+    util::ThreadRename("pivx-mnvotes");
+    LogPrintf("Budget votes thread started\n");
+
+    g_budgetman.SetBatchVotes(true);
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+            if (g_budgetman.WaitForPendingVotes(500)) {
+                g_budgetman.ProcessPendingVotes();
+            }
+        }
+    } catch (boost::thread_interrupted&) {
+        // nothing, thread interrupted.
+    }
+    g_budgetman.SetBatchVotes(false);
+}
@@ -9,7 +9,43 @@
 #include "budget/budgetproposal.h"
 #include "budget/finalizedbudget.h"
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+
+class CDeterministicMN;
+class CDeterministicMNList;
 class CValidationState;
+typedef std::shared_ptr<const CDeterministicMN> CDeterministicMNCPtr;
+
+//! Maximum number of received votes verified together
+static const unsigned int MAX_BUDGET_VOTES_BATCH = 1024;
+//! Maximum number of received votes waiting for verification (beyond that they are processed on arrival)
+static const unsigned int MAX_PENDING_BUDGET_VOTES = 100000;
+
+/** The masternode signing a budget vote: a deterministic masternode (dmn) or a legacy one (fLegacy) */
+struct CBudgetVoteSigner
+{
+    CDeterministicMNCPtr dmn;
+    bool fLegacy{false};
+    CKeyID keyID;
+
+    bool IsNull() const { return !dmn && !fLegacy; }
+};
+
+/** A vote received from a peer, waiting to be verified with the rest of its batch */
+template <typename VoteType>
+struct CPendingBudgetVote
+{
+    VoteType vote;
+    NodeId nodeId;
+    // filled by the batch verification
+    CBudgetVoteSigner signer;
+    bool fSigValid{false};
+
+    CPendingBudgetVote(const VoteType& _vote, NodeId _nodeId) : vote(_vote), nodeId(_nodeId) {}
+};
 
 //
 // Budget Manager : Contains all proposals for the budget
@@ -37,6 +73,22 @@ protected:
     // Memory Only. Updated in NewBlock (blocks arrive in order)
     std::atomic<int> nBestHeight;
 
+    // Memory Only. Votes received from the network, verified in batches by ThreadBudgetVotes
+    std::deque<CPendingBudgetVote<CBudgetVote>> vPendingProposalVotes;              // guarded by cs_pendingvotes
+    std::deque<CPendingBudgetVote<CFinalizedBudgetVote>> vPendingFinalizedVotes;    // guarded by cs_pendingvotes
+    std::set<uint256> setPendingVotes;                                              // guarded by cs_pendingvotes
+    boost::mutex cs_pendingvotes;
+    boost::condition_variable condPendingVotes;
+    // Set while ThreadBudgetVotes is running (votes are processed on arrival otherwise)
+    std::atomic<bool> fBatchVotes{false};
+
+    // Process a vote whose signature has already been checked (fSigValid) against the signer found in mnList or mnodeman
+    bool ProcessProposalVoteChecked(CBudgetVote& vote, const CDeterministicMNList& mnList, const CBudgetVoteSigner& signer, bool fSigValid, CNode* pfrom, CValidationState& state);
+    bool ProcessFinalizedBudgetVoteChecked(CFinalizedBudgetVote& vote, const CDeterministicMNList& mnList, const CBudgetVoteSigner& signer, bool fSigValid, CNode* pfrom, CValidationState& state);
+    // Queue a vote received from a peer for batch verification. Returns false if too many votes are waiting.
+    template <typename VoteType>
+    bool QueueVote(std::deque<CPendingBudgetVote<VoteType>>& vPending, const VoteType& vote, NodeId nodeId);
+
     // Returns a const pointer to the budget with highest vote count
     const CFinalizedBudget* GetBudgetWithHighestVoteCount(int chainHeight) const;
     int GetHighestVoteCount(int chainHeight) const;
@@ -104,6 +156,16 @@ public:
     bool ProcessProposalVote(CBudgetVote& proposal, CNode* pfrom, CValidationState& state);
     bool ProcessFinalizedBudgetVote(CFinalizedBudgetVote& vote, CNode* pfrom, CValidationState& state);
 
+    // Find the masternode with the given collateral, and the key id signing its votes
+    bool GetVoteSigner(const CTxIn& voteVin, const CDeterministicMNList& mnList, bool fOperatorKey, CBudgetVoteSigner& signerRet) const;
+    // Verify the signatures of a batch of queued votes in parallel, then apply them in arrival order.
+    // Returns the number of votes processed.
+    size_t ProcessPendingVotes();
+    // Wait (at most nMillis) for votes to be queued. Returns true if there are pending votes.
+    bool WaitForPendingVotes(int64_t nMillis);
+    size_t GetPendingVotesCount();
+    void SetBatchVotes(bool fEnable) { fBatchVotes = fEnable; }
+
     // functions returning a pointer in the map. Need cs_proposals/cs_budgets locked from the caller
     CBudgetProposal* FindProposal(const uint256& nHash);
     CFinalizedBudget* FindFinalizedBudget(const uint256& nHash);
@@ -189,4 +251,7 @@ public:
 
 extern CBudgetManager g_budgetman;
 
+/** Verify and apply the votes received from the network, in batches (started by the node when not in lite mode) */
+void ThreadBudgetVotes();
+
 #endif // BUDGET_MANAGER_H
@@ -0,0 +1,56 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "budget/budgetvotecheck.h"
+
+#include "checkqueue.h"
+#include "sync.h"
+#include "util/threadnames.h"
+
+#include <atomic>
+
+static CCheckQueue<CSignedMessageCheck> budgetVoteCheckQueue(16);
+// Only one master at a time can use the queue
+static Mutex cs_budgetVoteCheckMaster;
+static std::atomic<int> nBudgetVoteCheckThreads{0};
+
+bool CSignedMessageCheck::operator()()
+{
+    *pfValid = msg->CheckSignature(keyID);
+    return true;
+}
+
+void CSignedMessageCheck::swap(CSignedMessageCheck& check)
+{
+    std::swap(msg, check.msg);
+    std::swap(keyID, check.keyID);
+    std::swap(pfValid, check.pfValid);
+}
+
+void SetBudgetVoteCheckThreads(int nThreads)
+{
+    nBudgetVoteCheckThreads = nThreads;
+}
+
+void ThreadBudgetVoteCheck()
+{
+    util::ThreadRename("pivx-mnvotechk");
+    budgetVoteCheckQueue.Thread();
+}
+
+void RunSignedMessageChecks(std::vector<CSignedMessageCheck>& vChecks)
+{
+    if (nBudgetVoteCheckThreads <= 1 || vChecks.size() < 2) {
+        // Not worth spreading the work, verify in this thread
+        for (CSignedMessageCheck& check : vChecks) {
+            check();
+        }
+        return;
+    }
+
+    LOCK(cs_budgetVoteCheckMaster);
+    CCheckQueueControl<CSignedMessageCheck> control(&budgetVoteCheckQueue);
+    control.Add(vChecks);
+    control.Wait();
+}
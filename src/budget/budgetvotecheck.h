@@ -0,0 +1,47 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_BUDGET_BUDGETVOTECHECK_H
+#define PIVX_BUDGET_BUDGETVOTECHECK_H
+
+#include "messagesigner.h"
+
+#include <vector>
+
+/**
+ * Signature verification of a tier-two signed message (budget vote, finalized
+ * budget vote), with the key id of the signer resolved beforehand.
+ * The result is stored in *pfValid.
+ * Suitable to be used with CCheckQueue (always returns true).
+ */
+class CSignedMessageCheck
+{
+private:
+    const CSignedMessage* msg{nullptr};
+    CKeyID keyID;
+    bool* pfValid{nullptr};
+
+public:
+    CSignedMessageCheck() {}
+    CSignedMessageCheck(const CSignedMessage* _msg, const CKeyID& _keyID, bool* _pfValid) :
+        msg(_msg), keyID(_keyID), pfValid(_pfValid) {}
+
+    bool operator()();
+    void swap(CSignedMessageCheck& check);
+};
+
+/**
+ * Run the given signature checks, spread across the vote verification
+ * worker threads (when started). The calling thread joins them until all
+ * the checks are done.
+ */
+void RunSignedMessageChecks(std::vector<CSignedMessageCheck>& vChecks);
+
+/** Set the number of threads (including the caller) used by RunSignedMessageChecks */
+void SetBudgetVoteCheckThreads(int nThreads);
+
+/** Run a vote verification worker (started by the node when not in lite mode) */
+void ThreadBudgetVoteCheck();
+
+#endif // PIVX_BUDGET_BUDGETVOTECHECK_H
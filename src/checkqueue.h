@@ -6,12 +6,19 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 
 template <typename T>
+class CCheckQueue;
+
+template <typename T, typename Q = CCheckQueue<T>>
 class CCheckQueueControl;
 
 /**
@@ -166,19 +173,256 @@ public:
     }
 };
 
+/** Statistics of a verification run of a CWorkStealingCheckQueue (checks added before a Wait) */
+struct CCheckQueueStats
+{
+    //! Number of checks verified.
+    uint64_t nChecks{0};
+    //! Time from the first check added to the end of the Wait, in microseconds.
+    int64_t nWallTime{0};
+    //! Time spent running checks, summed over all the threads, in microseconds.
+    int64_t nBusyTime{0};
+    //! Number of threads (including the master) that could run the checks.
+    int nThreads{0};
+    //! Number of batches stolen from the deque of another thread.
+    uint64_t nSteals{0};
+
+    //! Fraction of the available thread time spent running checks.
+    double GetUtilization() const
+    {
+        return (nWallTime > 0 && nThreads > 0) ? (double)nBusyTime / ((double)nWallTime * nThreads) : 0;
+    }
+};
+
 /**
- * RAII-style controller object for a CCheckQueue that guarantees the passed
- * queue is finished before continuing.
- */
+ * Work-stealing variant of CCheckQueue, with the same interface.
+  * Every thread owns a deque of verifications. The master spreads the
+  * batches it adds over the deques, each thread takes work from the back
+  * of its own deque and, when that is empty, steals from the front of
+  * the others. The shared mutex is only used to sleep and wake up the
+  * threads, so they don't contend on it while there is work to do.
+  * Only one master at a time is supported (see CCheckQueueControl).
+  */
 template <typename T>
+class CWorkStealingCheckQueue
+{
+private:
+    struct WorkerDeque
+    {
+        boost::mutex mutex;
+        std::deque<T> deque;
+    };
+
+    //! The deques of the threads (the first one is the master's).
+    std::vector<std::unique_ptr<WorkerDeque>> vDeques;
+
+    //! Mutex used to sleep/wake up the threads, protects the stats of the current run
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+
+    //! Number of verifications added and not yet taken by any thread.
+    std::atomic<int> nPending{0};
+
+    //! Number of verifications that haven't completed yet.
+    std::atomic<int> nTodo{0};
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk{true};
+
+    //! The number of worker threads (excluding the master).
+    std::atomic<int> nWorkers{0};
+
+    //! The maximum number of elements to be processed in one batch
+    const unsigned int nBatchSize;
+
+    //! The deque that gets the next chunk of checks added (only used by the master)
+    unsigned int nNextDeque{0};
+
+    //! Stats of the current run
+    std::atomic<int64_t> nBusyTime{0};
+    std::atomic<uint64_t> nSteals{0};
+    uint64_t nRunChecks{0};
+    bool fRunStarted{false};
+    std::chrono::steady_clock::time_point runStart;
+    CCheckQueueStats lastStats;
+
+    unsigned int GetActiveDeques() const
+    {
+        return std::min((unsigned int)nWorkers, (unsigned int)vDeques.size() - 1) + 1;
+    }
+
+    /** Take a batch: from the back of our own deque, or stolen from the front of another one. */
+    bool Fetch(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        const unsigned int nDeques = vDeques.size();
+        for (unsigned int i = 0; i < nDeques; i++) {
+            const bool fSteal = (i != 0);
+            WorkerDeque& wd = *vDeques[(nOwn + i) % nDeques];
+            boost::unique_lock<boost::mutex> lock(wd.mutex);
+            if (wd.deque.empty())
+                continue;
+            // Take half of the deque at most, so that the rest can still be stolen
+            unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)wd.deque.size() / 2));
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                if (fSteal) {
+                    vChecks[j].swap(wd.deque.front());
+                    wd.deque.pop_front();
+                } else {
+                    vChecks[j].swap(wd.deque.back());
+                    wd.deque.pop_back();
+                }
+            }
+            nPending -= nNow;
+            if (fSteal)
+                nSteals++;
+            return true;
+        }
+        return false;
+    }
+
+    /** Internal function that does bulk of the verification work. */
+    void Loop(unsigned int nOwn, bool fMaster)
+    {
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (Fetch(nOwn, vChecks)) {
+                const auto start = std::chrono::steady_clock::now();
+                // Check whether we need to do work at all
+                bool fOk = fAllOk;
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                nBusyTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+                const int nDone = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nDone) == nDone && !fMaster) {
+                    // We processed the last element; inform the master he can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Nothing left to take (only the master adds): wait for the batches being run by the workers
+                if (nPending > 0)
+                    continue;
+                while (nTodo > 0)
+                    condMaster.wait(lock);
+                return;
+            }
+            while (nPending == 0)
+                condWorker.wait(lock); // wait
+        }
+    }
+
+public:
+    //! Create a new check queue, for up to nMaxThreadsIn threads (including the master)
+    CWorkStealingCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxThreadsIn) : nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i < std::max(2U, nMaxThreadsIn); i++) {
+            vDeques.emplace_back(new WorkerDeque());
+        }
+    }
+
+    //! Worker thread
+    void Thread()
+    {
+        // More threads than deques share them
+        const unsigned int nOwn = 1 + (nWorkers++ % (vDeques.size() - 1));
+        Loop(nOwn, false);
+    }
+
+    //! Wait until execution finishes, and return whether all evaluations where successful.
+    bool Wait()
+    {
+        Loop(0, true);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        lastStats = CCheckQueueStats();
+        lastStats.nChecks = nRunChecks;
+        if (fRunStarted)
+            lastStats.nWallTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - runStart).count();
+        lastStats.nBusyTime = nBusyTime;
+        lastStats.nThreads = GetActiveDeques();
+        lastStats.nSteals = nSteals;
+        // reset the status for new work later
+        nRunChecks = 0;
+        fRunStarted = false;
+        nBusyTime = 0;
+        nSteals = 0;
+        bool fRet = fAllOk;
+        fAllOk = true;
+        return fRet;
+    }
+
+    //! Add a batch of checks to the queue
+    void Add(std::vector<T>& vChecks)
+    {
+        if (vChecks.empty())
+            return;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (!fRunStarted) {
+                fRunStarted = true;
+                runStart = std::chrono::steady_clock::now();
+            }
+            nRunChecks += vChecks.size();
+            nTodo += vChecks.size();
+            nPending += vChecks.size();
+        }
+        // Spread the checks over the deques of the threads, in chunks
+        const unsigned int nDeques = GetActiveDeques();
+        const size_t nChunk = std::max((size_t)1, std::min((size_t)nBatchSize, vChecks.size() / nDeques));
+        size_t i = 0;
+        while (i < vChecks.size()) {
+            WorkerDeque& wd = *vDeques[nNextDeque++ % nDeques];
+            boost::unique_lock<boost::mutex> lock(wd.mutex);
+            for (size_t j = 0; j < nChunk && i < vChecks.size(); j++, i++) {
+                wd.deque.emplace_back();
+                wd.deque.back().swap(vChecks[i]);
+            }
+        }
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else
+            condWorker.notify_all();
+    }
+
+    bool IsIdle()
+    {
+        return (nTodo == 0 && nPending == 0 && fAllOk == true);
+    }
+
+    //! Stats of the last completed run
+    CCheckQueueStats GetLastStats()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return lastStats;
+    }
+};
+
+/**
+ * RAII-style controller object for a CCheckQueue (or CWorkStealingCheckQueue)
+ * that guarantees the passed queue is finished before continuing.
+ */
+template <typename T, typename Q>
 class CCheckQueueControl
 {
 private:
-    CCheckQueue<T>* pqueue;
+    Q* pqueue;
     bool fDone;
 
 public:
-    CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
+    CCheckQueueControl(Q* pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
@@ -13,14 +13,18 @@
 class CBlockIndex;
 class CChainParams;
 class CCoinsViewCache;
+class CPublicCoinSpendCheck;
+class CSaplingProofCheck;
 class CValidationState;
 
 /** Transaction validation functions */
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fColdStakingActive);
-/** Context-dependent validity checks */
-bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD);
+/** Context-dependent validity checks (Sapling proofs, and zc public spends proofs, deferred to pvSaplingChecks/pvZerocoinChecks, if not nullptr) */
+bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD,
+                                std::vector<CSaplingProofCheck>* pvSaplingChecks = nullptr,
+                                std::vector<CPublicCoinSpendCheck>* pvZerocoinChecks = nullptr);
 
 /**
  * Count ECDSA signature operations the old-fashioned (pre-0.6) way
@@ -6,9 +6,14 @@
 
 #include "chainparams.h"
 #include "consensus/consensus.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "guiinterface.h"        // for ui_interface
 #include "invalid.h"
+#include "random.h"
 #include "script/interpreter.h"
+#include "script/sigcache.h"
 #include "spork.h"               // for sporkManager
 #include "txdb.h"
 #include "upgrades.h"            // for IsActivationHeight
@@ -16,8 +21,72 @@
 #include "../validation.h"
 #include "zpiv/zpivmodule.h"
 
+#include <boost/thread/shared_mutex.hpp>
 
-static bool CheckZerocoinSpend(const CTransactionRef _tx, CValidationState& state)
+namespace {
+/**
+ * Verified public spends cache, to avoid verifying the spend proofs twice
+ * (once when accepted into the memory pool, and again when the block is connected).
+ * Entries are erased when hit by a block verification.
+ */
+class CPublicSpendCache
+{
+private:
+    //! Entries are SHA256(nonce || txid || input index), a txid commits to the spend proof and to the spent mint
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_spendcache;
+
+public:
+    CPublicSpendCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        // A proof is a few KB: there are never many public spends in flight
+        setValid.setup_bytes(1 << 20);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& txid, unsigned int nIn)
+    {
+        unsigned char buf[4];
+        WriteLE32(buf, nIn);
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Write(buf, 4).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+        setValid.insert(entry);
+    }
+};
+
+static CPublicSpendCache publicSpendCache;
+}
+
+bool CPublicCoinSpendCheck::operator()()
+{
+    const CTransaction& tx = *ptx;
+    uint256 entry;
+    publicSpendCache.ComputeEntry(entry, tx.GetHash(), nIn);
+    if (publicSpendCache.Get(entry, !fStore))
+        return true;
+    PublicCoinSpend ret(Params().GetConsensus().Zerocoin_Params(false));
+    if (!ZPIVModule::validateInput(tx.vin[nIn], prevOut, tx, ret))
+        return false;
+    if (fStore)
+        publicSpendCache.Set(entry);
+    return true;
+}
+
+
+static bool CheckZerocoinSpend(const CTransactionRef _tx, CValidationState& state, bool isMined,
+                               std::vector<CPublicCoinSpendCheck>* pvChecks)
 {
     const CTransaction& tx = *_tx;
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
@@ -43,17 +112,29 @@ static bool CheckZerocoinSpend(const CTransactionRef _tx, CValidationState& stat
     const Consensus::Params& consensus = Params().GetConsensus();
     std::set<CBigNum> serials;
     CAmount nTotalRedeemed = 0;
-    for (const CTxIn& txin : tx.vin) {
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CTxIn& txin = tx.vin[i];
 
         //only check txin that is a zcspend
         bool isPublicSpend = txin.IsZerocoinPublicSpend();
         if (!txin.IsZerocoinSpend() && !isPublicSpend)
             continue;
 
+        // Spend of a connected block: all the checks below already passed
+        CZerocoinSpendRecord record;
+        if (ReadZerocoinSpendRecord(COutPoint(tx.GetHash(), i), record)) {
+            if (serials.count(record.bnSerial))
+                return state.DoS(100, error("%s: Zerocoinspend serial is used twice in the same tx", __func__));
+            serials.insert(record.bnSerial);
+            nTotalRedeemed += libzerocoin::ZerocoinDenominationToAmount(record.GetDenomination());
+            fValidated = true;
+            continue;
+        }
+
         libzerocoin::CoinSpend newSpend;
         CTxOut prevOut;
         if (isPublicSpend) {
-            if(!GetOutput(txin.prevout.hash, txin.prevout.n, state, prevOut)){
+            if(!ZPIVModule::GetSpentMintOutput(txin.prevout, state, prevOut)){
                 return state.DoS(100, error("%s: public zerocoin spend prev output not found, prevTx %s, index %d", __func__, txin.prevout.hash.GetHex(), txin.prevout.n));
             }
             libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
@@ -62,9 +143,13 @@ static bool CheckZerocoinSpend(const CTransactionRef _tx, CValidationState& stat
                 return state.DoS(100, error("%s: public zerocoin spend parse failed", __func__));
             }
             newSpend = publicSpend;
+            if (isMined) record = CZerocoinSpendRecord(publicSpend, publicSpend.getCoinVersion());
         } else {
             newSpend = TxInToZerocoinSpend(txin);
+            if (isMined) record = CZerocoinSpendRecord(newSpend);
         }
+        // Keep the parsed spend for the block connection
+        if (isMined) CacheZerocoinSpendRecord(COutPoint(tx.GetHash(), i), record);
 
         //check that the denomination is valid
         if (newSpend.getDenomination() == libzerocoin::ZQ_ERROR)
@@ -79,10 +164,13 @@ static bool CheckZerocoinSpend(const CTransactionRef _tx, CValidationState& stat
             return state.DoS(100, error("%s: Zerocoinspend does not use the same txout that was used in the SoK", __func__));
 
         if (isPublicSpend) {
-            libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-            PublicCoinSpend ret(params);
-            if (!ZPIVModule::validateInput(txin, prevOut, tx, ret)){
-                return state.DoS(100, error("%s: public zerocoin spend did not verify", __func__));
+            CPublicCoinSpendCheck check(tx, i, prevOut, !isMined);
+            if (pvChecks) {
+                pvChecks->emplace_back();
+                check.swap(pvChecks->back());
+            } else if (!check()) {
+                return state.DoS(100, error("%s: public zerocoin spend did not verify", __func__),
+                                 REJECT_INVALID, "bad-txns-invalid-zpiv");
             }
         }
 
@@ -135,7 +223,8 @@ bool CheckPublicCoinSpendVersion(int version) {
     return version == CurrentPublicCoinSpendVersion();
 }
 
-bool ContextualCheckZerocoinTx(const CTransactionRef& tx, CValidationState& state, const Consensus::Params& consensus, int nHeight)
+bool ContextualCheckZerocoinTx(const CTransactionRef& tx, CValidationState& state, const Consensus::Params& consensus, int nHeight,
+                               bool isMined, std::vector<CPublicCoinSpendCheck>* pvChecks)
 {
     // zerocoin enforced via block time. First block with a zc mint is 863735
     const bool fZerocoinEnforced = (nHeight >= consensus.ZC_HeightStart);
@@ -180,7 +269,7 @@ bool ContextualCheckZerocoinTx(const CTransactionRef& tx, CValidationState& stat
     }
 
     if (hasPrivateSpendInputs || hasPublicSpendInputs) {
-        if (!CheckZerocoinSpend(tx, state))
+        if (!CheckZerocoinSpend(tx, state, isMined, pvChecks))
             return false;   // failure reason logged in validation state
     }
 
@@ -196,52 +285,59 @@ bool ContextualCheckZerocoinTx(const CTransactionRef& tx, CValidationState& stat
 
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend* spend, int nHeight)
 {
-    if(!ContextualCheckZerocoinSpendNoSerialCheck(tx, spend, nHeight)){
+    return ContextualCheckZerocoinSpend(tx, CZerocoinSpendRecord(*spend), nHeight);
+}
+
+bool ContextualCheckZerocoinSpend(const CTransaction& tx, const CZerocoinSpendRecord& record, int nHeight)
+{
+    if(!ContextualCheckZerocoinSpendNoSerialCheck(tx, record, nHeight)){
         return false;
     }
 
     //Reject serial's that are already in the blockchain
     int nHeightTx = 0;
-    if (IsSerialInBlockchain(spend->getCoinSerialNumber(), nHeightTx))
+    if (IsSerialInBlockchain(record.bnSerial, nHeightTx))
         return error("%s : zPIV spend with serial %s is already in block %d\n", __func__,
-                     spend->getCoinSerialNumber().GetHex(), nHeightTx);
+                     record.bnSerial.GetHex(), nHeightTx);
 
     return true;
 }
 
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend* spend, int nHeight)
+{
+    return ContextualCheckZerocoinSpendNoSerialCheck(tx, CZerocoinSpendRecord(*spend), nHeight);
+}
+
+bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const CZerocoinSpendRecord& record, int nHeight)
 {
     const Consensus::Params& consensus = Params().GetConsensus();
     //Check to see if the zPIV is properly signed
     if (consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_ZC_V2)) {
-        try {
-            if (!spend->HasValidSignature())
-                return error("%s: V2 zPIV spend does not have a valid signature\n", __func__);
-        } catch (const libzerocoin::InvalidSerialException& e) {
+        if (record.nSignature == CZerocoinSpendRecord::SIG_INVALID_SERIAL) {
             // Check if we are in the range of the attack
             if(!isBlockBetweenFakeSerialAttackRange(nHeight))
                 return error("%s: Invalid serial detected, txid %s, in block %d\n", __func__, tx.GetHash().GetHex(), nHeight);
             else
                 LogPrintf("%s: Invalid serial detected within range in block %d\n", __func__, nHeight);
+        } else if (record.nSignature != CZerocoinSpendRecord::SIG_VALID) {
+            return error("%s: V2 zPIV spend does not have a valid signature\n", __func__);
         }
 
         libzerocoin::SpendType expectedType = libzerocoin::SpendType::SPEND;
         if (tx.IsCoinStake())
             expectedType = libzerocoin::SpendType::STAKE;
-        if (spend->getSpendType() != expectedType) {
+        if (record.nSpendType != expectedType) {
             return error("%s: trying to spend zPIV without the correct spend type. txid=%s\n", __func__,
                          tx.GetHash().GetHex());
         }
     }
 
-    bool fUseV1Params = spend->getCoinVersion() < libzerocoin::PUBKEY_VERSION;
-
     //Reject serial's that are not in the acceptable value range
-    if (!spend->HasValidSerial(consensus.Zerocoin_Params(fUseV1Params)))  {
+    if (!record.fValidSerial)  {
         // Up until this block our chain was not checking serials correctly..
         if (!isBlockBetweenFakeSerialAttackRange(nHeight))
             return error("%s : zPIV spend with serial %s from tx %s is not in valid range\n", __func__,
-                     spend->getCoinSerialNumber().GetHex(), tx.GetHash().GetHex());
+                     record.bnSerial.GetHex(), tx.GetHash().GetHex());
         else
             LogPrintf("%s:: HasValidSerial :: Invalid serial detected within range in block %d\n", __func__, nHeight);
     }
@@ -254,7 +350,8 @@ Optional<CoinSpendValues> ParseAndValidateZerocoinSpend(const Consensus::Params&
                                                         const CTransaction& tx, int chainHeight,
                                                         CValidationState& state)
 {
-    for (const CTxIn& txIn : tx.vin) {
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CTxIn& txIn = tx.vin[i];
         bool isPublicSpend = txIn.IsZerocoinPublicSpend();
         bool isPrivZerocoinSpend = txIn.IsZerocoinSpend();
         if (!isPrivZerocoinSpend && !isPublicSpend)
@@ -265,31 +362,20 @@ Optional<CoinSpendValues> ParseAndValidateZerocoinSpend(const Consensus::Params&
             return nullopt;
         }
 
-        if (isPublicSpend) {
-            libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-            PublicCoinSpend publicSpend(params);
-            if (!ZPIVModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend) ||
-                !CheckPublicCoinSpendVersion(publicSpend.getCoinVersion())){
-                return nullopt;
-            }
-            //queue for db write after the 'justcheck' section has concluded
-            if (!ContextualCheckZerocoinSpend(tx, &publicSpend, chainHeight)) {
-                state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__,
-                                     tx.GetHash().GetHex()), REJECT_INVALID);
-                return nullopt;
-            }
-            // return value
-            return Optional<CoinSpendValues>(CoinSpendValues(publicSpend.getCoinSerialNumber(), publicSpend.getDenomination() * COIN));
-        } else {
-            libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-            //queue for db write after the 'justcheck' section has concluded
-            if (!ContextualCheckZerocoinSpend(tx, &spend, chainHeight)) {
-                state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__,
-                                     tx.GetHash().GetHex()), REJECT_INVALID);
-                return nullopt;
-            }
-            return Optional<CoinSpendValues>(CoinSpendValues(spend.getCoinSerialNumber(), spend.getDenomination() * COIN));
+        // Parsed spend (stored, if the block was already connected once)
+        CZerocoinSpendRecord record;
+        if (!GetZerocoinSpendRecord(tx, i, record, state) ||
+            (isPublicSpend && !CheckPublicCoinSpendVersion(record.nPublicSpendVersion))) {
+            return nullopt;
+        }
+        //queue for db write after the 'justcheck' section has concluded
+        if (!ContextualCheckZerocoinSpend(tx, record, chainHeight)) {
+            state.DoS(100, error("%s: failed to add block %s with invalid %s", __func__,
+                                 tx.GetHash().GetHex(), isPublicSpend ? "public zc spend" : "zerocoinspend"), REJECT_INVALID);
+            return nullopt;
         }
+        // return value
+        return Optional<CoinSpendValues>(CoinSpendValues(record.bnSerial, record.GetDenomination() * COIN));
     }
     return nullopt;
 }
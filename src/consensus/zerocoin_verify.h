@@ -9,15 +9,50 @@
 #include "script/interpreter.h"
 #include "zpivchain.h"
 
+/**
+ * Verification of the proof of a zerocoin public spend input (the GMP-heavy
+ * part of the spend checks), deferred so that the spends of a block can be
+ * verified by the parallel check queue.
+ * Verified spends are remembered (when fStore is set, i.e. for mempool txs),
+ * to skip the proof verification when the tx is connected.
+ */
+class CPublicCoinSpendCheck
+{
+private:
+    const CTransaction* ptx{nullptr};
+    unsigned int nIn{0};
+    CTxOut prevOut;
+    bool fStore{false};
+
+public:
+    CPublicCoinSpendCheck() {}
+    CPublicCoinSpendCheck(const CTransaction& tx, unsigned int nInIn, const CTxOut& prevOutIn, bool fStoreIn) :
+        ptx(&tx), nIn(nInIn), prevOut(prevOutIn), fStore(fStoreIn) {}
+
+    bool operator()();
+
+    void swap(CPublicCoinSpendCheck& check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(nIn, check.nIn);
+        std::swap(prevOut, check.prevOut);
+        std::swap(fStore, check.fStore);
+    }
+};
+
 // Fake Serial attack Range
 bool isBlockBetweenFakeSerialAttackRange(int nHeight);
 // Public coin spend
 bool CheckPublicCoinSpendEnforced(int blockHeight, bool isPublicSpend);
 int CurrentPublicCoinSpendVersion();
 bool CheckPublicCoinSpendVersion(int version);
-bool ContextualCheckZerocoinTx(const CTransactionRef& tx, CValidationState& state, const Consensus::Params& consensus, int nHeight);
+// Note: if pvChecks is not nullptr, the public spends proofs verification is deferred (appended to pvChecks).
+bool ContextualCheckZerocoinTx(const CTransactionRef& tx, CValidationState& state, const Consensus::Params& consensus, int nHeight,
+                               bool isMined, std::vector<CPublicCoinSpendCheck>* pvChecks = nullptr);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend* spend, int nHeight);
+bool ContextualCheckZerocoinSpend(const CTransaction& tx, const CZerocoinSpendRecord& record, int nHeight);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend* spend, int nHeight);
+bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const CZerocoinSpendRecord& record, int nHeight);
 
 struct CoinSpendValues {
 public:
@@ -0,0 +1,226 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <assert.h>
+#include <limits>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = Num3072::double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMBS = Num3072::LIMBS;
+/** 2^3072 - 1103717, the largest 3072-bit safe prime number, is used as the modulus. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** The exponent of the inverse (modulus - 2) is 3051 one bits followed by these 21 bits */
+constexpr int INVERSE_ONES = 3051;
+constexpr int INVERSE_TAIL_BITS = 21;
+constexpr uint32_t INVERSE_TAIL = (1 << INVERSE_TAIL_BITS) - (MAX_PRIME_DIFF + 2);
+
+/** in_out = in_out^(2^sq) * mul */
+inline void square_n_mul(Num3072& in_out, const int sq, const Num3072& mul)
+{
+    for (int j = 0; j < sq; ++j) in_out.Square();
+    in_out.Multiply(mul);
+}
+
+/** Adds a * MAX_PRIME_DIFF to the limbs, returning the carry out of the top limb */
+inline limb_t add_mul_diff(limb_t* limbs, limb_t a)
+{
+    double_limb_t t = (double_limb_t)a * MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && t; ++i) {
+        t += limbs[i];
+        limbs[i] = (limb_t)t;
+        t >>= LIMB_SIZE;
+    }
+    return (limb_t)t;
+}
+
+} // namespace
+
+/** Indicates whether d is larger than the modulus. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != std::numeric_limits<limb_t>::max()) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus is adding MAX_PRIME_DIFF modulo 2^3072
+    add_mul_diff(limbs, 1);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat's little theorem: a^-1 = a^(modulus - 2). The run of ones of
+    // the exponent is computed with repunits, p[i] = a^(2^(2^i)-1)
+    // (see "Fast Point Decompression for Standard Elliptic Curves",
+    // Brumley, Järvinen, 2008), then the last bits one by one.
+    Num3072 p[12];
+    p[0] = *this;
+    for (int i = 0; i < 11; ++i) {
+        p[i + 1] = p[i];
+        for (int j = 0; j < (1 << i); ++j) p[i + 1].Square();
+        p[i + 1].Multiply(p[i]);
+    }
+
+    // 3051 = 2048 + 512 + 256 + 128 + 64 + 32 + 8 + 2 + 1
+    Num3072 out = p[11];
+    int ones = 1 << 11;
+    for (int i = 10; i >= 0; --i) {
+        if ((INVERSE_ONES >> i) & 1) {
+            square_n_mul(out, 1 << i, p[i]);
+            ones += 1 << i;
+        }
+    }
+    assert(ones == INVERSE_ONES);
+
+    for (int i = INVERSE_TAIL_BITS - 1; i >= 0; --i) {
+        out.Square();
+        if ((INVERSE_TAIL >> i) & 1) out.Multiply(*this);
+    }
+    return out;
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product, in 2 * LIMBS limbs
+    limb_t prod[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            carry += (double_limb_t)limbs[i] * a.limbs[j] + prod[i + j];
+            prod[i + j] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+        prod[i + LIMBS] = (limb_t)carry;
+    }
+
+    // Reduce the high half, as 2^3072 = MAX_PRIME_DIFF (mod modulus)
+    double_limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += (double_limb_t)prod[i + LIMBS] * MAX_PRIME_DIFF + prod[i];
+        limbs[i] = (limb_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+    // The carry is at most MAX_PRIME_DIFF: one more reduction can only
+    // overflow into a small number, which the last one can't.
+    limb_t top = add_mul_diff(limbs, (limb_t)carry);
+    if (top) add_mul_diff(limbs, top);
+
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::Square()
+{
+    Multiply(*this);
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) limbs[i] = 0;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    if (IsOverflow()) FullReduce();
+
+    Num3072 inv;
+    if (a.IsOverflow()) {
+        Num3072 b = a;
+        b.FullReduce();
+        inv = b.GetInverse();
+    } else {
+        inv = a.GetInverse();
+    }
+
+    Multiply(inv);
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            limbs[i] = ReadLE32(data + 4 * i);
+        } else {
+            limbs[i] = ReadLE64(data + 8 * i);
+        }
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            WriteLE32(out + i * 4, limbs[i]);
+        } else {
+            WriteLE64(out + i * 8, limbs[i]);
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(Span<const unsigned char> in)
+{
+    unsigned char hashed_in[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(in.data(), in.size()).Finalize(hashed_in);
+    unsigned char tmp[Num3072::BYTE_SIZE];
+    ChaCha20(hashed_in, sizeof(hashed_in)).Keystream(tmp, Num3072::BYTE_SIZE);
+    return Num3072(tmp);
+}
+
+MuHash3072::MuHash3072(Span<const unsigned char> in) noexcept
+{
+    m_numerator = ToNum3072(in);
+}
+
+void MuHash3072::Finalize(uint256& out) noexcept
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne(); // Needed to keep the MuHash object valid
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul) noexcept
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div) noexcept
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(Span<const unsigned char> in) noexcept
+{
+    m_numerator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(Span<const unsigned char> in) noexcept
+{
+    m_denominator.Multiply(ToNum3072(in));
+    return *this;
+}
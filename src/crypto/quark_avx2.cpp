@@ -0,0 +1,269 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way (one message per 64-bit lane of a ymm register) implementations of the
+// Quark primitives that are plain 64-bit add/rotate/xor: blake512, keccak512 and
+// skein512. They produce the same output as the sph ones in this directory.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace quark_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Xor(Xor(Xor(x, y), Xor(z, w)), v); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+__m256i inline Rotl(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+__m256i inline Rotr(__m256i x, int n) { return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n)); }
+
+__m256i inline Read4LE(const unsigned char* const* in, int offset)
+{
+    return _mm256_set_epi64x(ReadLE64(in[3] + offset), ReadLE64(in[2] + offset), ReadLE64(in[1] + offset), ReadLE64(in[0] + offset));
+}
+
+__m256i inline Read4BE(const unsigned char* const* in, int offset)
+{
+    return _mm256_set_epi64x(ReadBE64(in[3] + offset), ReadBE64(in[2] + offset), ReadBE64(in[1] + offset), ReadBE64(in[0] + offset));
+}
+
+void inline Write4LE(unsigned char* const* out, int offset, __m256i v)
+{
+    alignas(32) uint64_t tmp[4];
+    _mm256_store_si256((__m256i*)tmp, v);
+    WriteLE64(out[0] + offset, tmp[0]);
+    WriteLE64(out[1] + offset, tmp[1]);
+    WriteLE64(out[2] + offset, tmp[2]);
+    WriteLE64(out[3] + offset, tmp[3]);
+}
+
+void inline Write4BE(unsigned char* const* out, int offset, __m256i v)
+{
+    alignas(32) uint64_t tmp[4];
+    _mm256_store_si256((__m256i*)tmp, v);
+    WriteBE64(out[0] + offset, tmp[0]);
+    WriteBE64(out[1] + offset, tmp[1]);
+    WriteBE64(out[2] + offset, tmp[2]);
+    WriteBE64(out[3] + offset, tmp[3]);
+}
+
+/* BLAKE-512 (16 rounds, as the final round version implemented by sph_blake512) */
+
+const uint64_t BLAKE512_IV[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL};
+
+const uint64_t BLAKE512_C[16] = {
+    0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL,
+    0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL, 0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL,
+    0x9216D5D98979FB1BULL, 0xD1310BA698DFB5ACULL, 0x2FFD72DBD01ADFB7ULL, 0xB8E1AFED6A267E96ULL,
+    0xBA7C9045F12C7F99ULL, 0x24A19947B3916CF7ULL, 0x0801F2E2858EFC16ULL, 0x636920D871574E69ULL};
+
+const uint8_t BLAKE_SIGMA[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}};
+
+void inline BlakeG(const __m256i* m, const uint8_t* s, int i, __m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    const int x = s[2 * i], y = s[2 * i + 1];
+    a = Add(Add(a, b), Xor(m[x], K(BLAKE512_C[y])));
+    d = Rotr(Xor(d, a), 32);
+    c = Add(c, d);
+    b = Rotr(Xor(b, c), 25);
+    a = Add(Add(a, b), Xor(m[y], K(BLAKE512_C[x])));
+    d = Rotr(Xor(d, a), 16);
+    c = Add(c, d);
+    b = Rotr(Xor(b, c), 11);
+}
+
+/* Keccak-512 (the original padding, as sph_keccak512) */
+
+const uint64_t KECCAK_RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL};
+
+void KeccakF(__m256i* s)
+{
+    __m256i c[5], d[5], b[25];
+    for (int r = 0; r < 24; r++) {
+        // Theta
+        for (int x = 0; x < 5; x++) c[x] = Xor(s[x], s[x + 5], s[x + 10], s[x + 15], s[x + 20]);
+        for (int x = 0; x < 5; x++) d[x] = Xor(c[(x + 4) % 5], Rotl(c[(x + 1) % 5], 1));
+        // Rho and pi: b[y, 2x + 3y] = rot(s[x, y] ^ d[x])
+        b[0] = Xor(s[0], d[0]);
+        b[10] = Rotl(Xor(s[1], d[1]), 1);
+        b[20] = Rotl(Xor(s[2], d[2]), 62);
+        b[5] = Rotl(Xor(s[3], d[3]), 28);
+        b[15] = Rotl(Xor(s[4], d[4]), 27);
+        b[16] = Rotl(Xor(s[5], d[0]), 36);
+        b[1] = Rotl(Xor(s[6], d[1]), 44);
+        b[11] = Rotl(Xor(s[7], d[2]), 6);
+        b[21] = Rotl(Xor(s[8], d[3]), 55);
+        b[6] = Rotl(Xor(s[9], d[4]), 20);
+        b[7] = Rotl(Xor(s[10], d[0]), 3);
+        b[17] = Rotl(Xor(s[11], d[1]), 10);
+        b[2] = Rotl(Xor(s[12], d[2]), 43);
+        b[12] = Rotl(Xor(s[13], d[3]), 25);
+        b[22] = Rotl(Xor(s[14], d[4]), 39);
+        b[23] = Rotl(Xor(s[15], d[0]), 41);
+        b[8] = Rotl(Xor(s[16], d[1]), 45);
+        b[18] = Rotl(Xor(s[17], d[2]), 15);
+        b[3] = Rotl(Xor(s[18], d[3]), 21);
+        b[13] = Rotl(Xor(s[19], d[4]), 8);
+        b[14] = Rotl(Xor(s[20], d[0]), 18);
+        b[24] = Rotl(Xor(s[21], d[1]), 2);
+        b[9] = Rotl(Xor(s[22], d[2]), 61);
+        b[19] = Rotl(Xor(s[23], d[3]), 56);
+        b[4] = Rotl(Xor(s[24], d[4]), 14);
+        // Chi
+        for (int y = 0; y < 25; y += 5) {
+            for (int x = 0; x < 5; x++) s[y + x] = Xor(b[y + x], AndNot(b[y + (x + 1) % 5], b[y + (x + 2) % 5]));
+        }
+        // Iota
+        s[0] = Xor(s[0], K(KECCAK_RC[r]));
+    }
+}
+
+/* Skein-512-512 (Skein 1.3 Threefish constants, as sph_skein512) */
+
+const uint64_t SKEIN512_IV[8] = {
+    0x4903ADFF749C51CEULL, 0x0D95DE399746DF03ULL, 0x8FD1934127C79BCEULL, 0x9A255629FF352CB1ULL,
+    0x5DB62599DF6CA7B0ULL, 0xEABE394CA9D5C3F4ULL, 0x991112C71A75B523ULL, 0xAE18A40B660FCC33ULL};
+
+void inline SkeinMix(__m256i& x0, __m256i& x1, int rc)
+{
+    x0 = Add(x0, x1);
+    x1 = Xor(Rotl(x1, rc), x0);
+}
+
+void inline SkeinMix8(__m256i& w0, __m256i& w1, __m256i& w2, __m256i& w3, __m256i& w4, __m256i& w5, __m256i& w6, __m256i& w7, int rc0, int rc1, int rc2, int rc3)
+{
+    SkeinMix(w0, w1, rc0);
+    SkeinMix(w2, w3, rc1);
+    SkeinMix(w4, w5, rc2);
+    SkeinMix(w6, w7, rc3);
+}
+
+void inline SkeinAddKey(__m256i* p, const __m256i* k, const uint64_t* t, int s)
+{
+    for (int i = 0; i < 8; i++) p[i] = Add(p[i], k[(s + i) % 9]);
+    p[5] = Add(p[5], K(t[s % 3]));
+    p[6] = Add(p[6], K(t[(s + 1) % 3]));
+    p[7] = Add(p[7], K(s));
+}
+
+/** Threefish-512 encryption of p, keyed by h and the tweak (t0, t1) */
+void Threefish(__m256i* p, const __m256i* h, uint64_t t0, uint64_t t1)
+{
+    __m256i k[9];
+    k[8] = K(0x1BD11BDAA9FC1A22ULL);
+    for (int i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+    }
+    const uint64_t t[3] = {t0, t1, t0 ^ t1};
+    for (int s = 0; s < 18; s += 2) {
+        SkeinAddKey(p, k, t, s);
+        SkeinMix8(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], 46, 36, 19, 37);
+        SkeinMix8(p[2], p[1], p[4], p[7], p[6], p[5], p[0], p[3], 33, 27, 14, 42);
+        SkeinMix8(p[4], p[1], p[6], p[3], p[0], p[5], p[2], p[7], 17, 49, 36, 39);
+        SkeinMix8(p[6], p[1], p[0], p[7], p[2], p[5], p[4], p[3], 44, 9, 54, 56);
+        SkeinAddKey(p, k, t, s + 1);
+        SkeinMix8(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], 39, 30, 34, 24);
+        SkeinMix8(p[2], p[1], p[4], p[7], p[6], p[5], p[0], p[3], 13, 50, 10, 17);
+        SkeinMix8(p[4], p[1], p[6], p[3], p[0], p[5], p[2], p[7], 25, 29, 39, 43);
+        SkeinMix8(p[6], p[1], p[0], p[7], p[2], p[5], p[4], p[3], 8, 35, 56, 22);
+    }
+    SkeinAddKey(p, k, t, 18);
+}
+
+} // namespace
+
+void Blake512(const unsigned char* const* in, size_t len, unsigned char* const* out)
+{
+    // Single padded block: message, 0x80, zeros, 0x01, 128-bit length
+    unsigned char buf[4][128];
+    const unsigned char* pbuf[4];
+    for (int l = 0; l < 4; l++) {
+        memcpy(buf[l], in[l], len);
+        memset(buf[l] + len, 0, 128 - len);
+        buf[l][len] = 0x80;
+        buf[l][111] |= 0x01;
+        WriteBE64(buf[l] + 120, (uint64_t)len << 3);
+        pbuf[l] = buf[l];
+    }
+    __m256i m[16], v[16];
+    for (int i = 0; i < 16; i++) m[i] = Read4BE(pbuf, 8 * i);
+    for (int i = 0; i < 8; i++) v[i] = K(BLAKE512_IV[i]);
+    for (int i = 0; i < 4; i++) v[i + 8] = K(BLAKE512_C[i]);
+    v[12] = K(((uint64_t)len << 3) ^ BLAKE512_C[4]);
+    v[13] = K(((uint64_t)len << 3) ^ BLAKE512_C[5]);
+    v[14] = K(BLAKE512_C[6]);
+    v[15] = K(BLAKE512_C[7]);
+    for (int r = 0; r < 16; r++) {
+        const uint8_t* s = BLAKE_SIGMA[r % 10];
+        BlakeG(m, s, 0, v[0], v[4], v[8], v[12]);
+        BlakeG(m, s, 1, v[1], v[5], v[9], v[13]);
+        BlakeG(m, s, 2, v[2], v[6], v[10], v[14]);
+        BlakeG(m, s, 3, v[3], v[7], v[11], v[15]);
+        BlakeG(m, s, 4, v[0], v[5], v[10], v[15]);
+        BlakeG(m, s, 5, v[1], v[6], v[11], v[12]);
+        BlakeG(m, s, 6, v[2], v[7], v[8], v[13]);
+        BlakeG(m, s, 7, v[3], v[4], v[9], v[14]);
+    }
+    for (int i = 0; i < 8; i++) Write4BE(out, 8 * i, Xor(K(BLAKE512_IV[i]), Xor(v[i], v[i + 8])));
+}
+
+void Keccak512_64(const unsigned char* const* in, unsigned char* const* out)
+{
+    // Single padded block: the message fills 64 bytes of the 72 bytes rate
+    __m256i s[25];
+    for (int i = 0; i < 8; i++) s[i] = Read4LE(in, 8 * i);
+    s[8] = K(0x8000000000000001ULL);
+    for (int i = 9; i < 25; i++) s[i] = _mm256_setzero_si256();
+    KeccakF(s);
+    for (int i = 0; i < 8; i++) Write4LE(out, 8 * i, s[i]);
+}
+
+void Skein512_64(const unsigned char* const* in, unsigned char* const* out)
+{
+    __m256i h[8], m[8], p[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = K(SKEIN512_IV[i]);
+        m[i] = p[i] = Read4LE(in, 8 * i);
+    }
+    // Message block: first and final, type 48, 64 bytes
+    Threefish(p, h, 64, 0xF000000000000000ULL);
+    for (int i = 0; i < 8; i++) {
+        h[i] = Xor(m[i], p[i]);
+        p[i] = _mm256_setzero_si256();
+    }
+    // Output block: first and final, type 63, counter 0 over 8 bytes
+    Threefish(p, h, 8, 0xFF00000000000000ULL);
+    for (int i = 0; i < 8; i++) Write4LE(out, 8 * i, p[i]);
+}
+
+} // namespace quark_avx2
+
+#endif
@@ -85,6 +85,13 @@ public:
         ssValue << value;
         leveldb::Slice slValue(ssValue.data(), ssValue.size());
 
+        WriteSerialized(slKey, slValue);
+        ssValue.clear();
+    }
+
+    //! Write a key and a value already serialized (e.g. by other threads)
+    void WriteSerialized(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+    {
         batch.Put(slKey, slValue);
 
         // LevelDB serializes writes as:
@@ -95,7 +102,6 @@ public:
         // - byte[]: value
         // The formula below assumes the key and value are both less than 16k.
         size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
-        ssValue.clear();
     }
 
     template <typename K>
@@ -109,8 +115,12 @@ public:
 
     void Erase(const CDataStream& _ssKey)
     {
-        leveldb::Slice slKey(_ssKey.data(), _ssKey.size());
+        EraseSerialized(leveldb::Slice(_ssKey.data(), _ssKey.size()));
+    }
 
+    //! Erase a key already serialized
+    void EraseSerialized(const leveldb::Slice& slKey)
+    {
         batch.Delete(slKey);
 
         // LevelDB serializes erases as:
@@ -539,13 +539,14 @@ bool CDeterministicMNManager::ProcessBlock(const CBlock& block, const CBlockInde
         evoDb.Write(std::make_pair(DB_LIST_DIFF, newList.GetBlockHash()), diff);
         if ((nHeight % DISK_SNAPSHOT_PERIOD) == 0 || oldList.GetHeight() == -1) {
             evoDb.Write(std::make_pair(DB_LIST_SNAPSHOT, newList.GetBlockHash()), newList);
-            mnListsCache.emplace(newList.GetBlockHash(), newList);
             LogPrintf("CDeterministicMNManager::%s -- Wrote snapshot. nHeight=%d, mapCurMNs.allMNsCount=%d\n",
                 __func__, nHeight, newList.GetAllMNsCount());
         }
 
         diff.nHeight = pindex->nHeight;
-        mnListDiffsCache.emplace(pindex->GetBlockHash(), diff);
+        LOCK(cs_cache);
+        mnListsCache.insert(newList.GetBlockHash(), newList);
+        mnListDiffsCache.emplace(pindex->GetBlockHash(), std::make_shared<const CDeterministicMNListDiff>(diff));
     } catch (const std::exception& e) {
         LogPrintf("CDeterministicMNManager::%s -- internal error: %s\n", __func__, e.what());
         return _state.DoS(100, false, REJECT_INVALID, "failed-dmn-block");
@@ -557,7 +558,6 @@ bool CDeterministicMNManager::ProcessBlock(const CBlock& block, const CBlockInde
         uiInterface.NotifyMasternodeListChanged(newList);
     }
 
-    LOCK(cs);
     CleanupCache(nHeight);
 
     return true;
@@ -585,6 +585,7 @@ bool CDeterministicMNManager::UndoBlock(const CBlock& block, const CBlockIndex*
             prevList = GetListForBlock(pindex->pprev);
         }
 
+        LOCK(cs_cache);
         mnListsCache.erase(blockHash);
         mnListDiffsCache.erase(blockHash);
     }
@@ -600,8 +601,13 @@ bool CDeterministicMNManager::UndoBlock(const CBlock& block, const CBlockIndex*
 
 void CDeterministicMNManager::UpdatedBlockTip(const CBlockIndex* pindex)
 {
-    LOCK(cs);
     tipIndex = pindex;
+    // keep the list of the new tip (already built when the block was connected)
+    LOCK(cs_cache);
+    CDeterministicMNList mnList;
+    if (pindex && mnListsCache.get(pindex->GetBlockHash(), mnList)) {
+        mnListTip = mnList;
+    }
 }
 
 bool CDeterministicMNManager::BuildNewListFromBlock(const CBlock& block, const CBlockIndex* pindexPrev, CValidationState& _state, CDeterministicMNList& mnListRet, bool debugLogs)
@@ -852,35 +858,64 @@ void CDeterministicMNManager::DecreasePoSePenalties(CDeterministicMNList& mnList
     }
 }
 
-CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex* pindex)
+bool CDeterministicMNManager::GetCachedList(const uint256& blockHash, CDeterministicMNList& mnListRet)
 {
-    LOCK(cs);
+    LOCK(cs_cache);
+    if (mnListTip.GetBlockHash() == blockHash && !blockHash.IsNull()) {
+        mnListRet = mnListTip;
+        return true;
+    }
+    return mnListsCache.get(blockHash, mnListRet);
+}
 
+void CDeterministicMNManager::CacheList(const CDeterministicMNList& mnList)
+{
+    LOCK(cs_cache);
+    mnListsCache.insert(mnList.GetBlockHash(), mnList);
+    // always keep the list of the tip
+    const CBlockIndex* pindexTip = tipIndex;
+    if (pindexTip && mnList.GetBlockHash() == pindexTip->GetBlockHash()) {
+        mnListTip = mnList;
+    }
+}
+
+CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex* pindex)
+{
     // Return early before enforcement
     if (!IsDIP3Enforced(pindex->nHeight)) {
         return {};
     }
+    nLookups++;
 
+    // The lookups don't hold cs: the cache is only locked while accessed,
+    // and the diffs are read from disk and replayed without holding any lock.
     CDeterministicMNList snapshot;
-    std::list<const CBlockIndex*> listDiffIndexes;
+    std::vector<std::pair<const CBlockIndex*, std::shared_ptr<const CDeterministicMNListDiff>>> vDiffs;
 
     while (true) {
         // try using cache before reading from disk
-        auto itLists = mnListsCache.find(pindex->GetBlockHash());
-        if (itLists != mnListsCache.end()) {
-            snapshot = itLists->second;
+        if (GetCachedList(pindex->GetBlockHash(), snapshot)) {
+            if (vDiffs.empty()) nCacheHits++;
             break;
         }
 
         if (evoDb.Read(std::make_pair(DB_LIST_SNAPSHOT, pindex->GetBlockHash()), snapshot)) {
-            mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
+            nSnapshotReads++;
+            CacheList(snapshot);
             break;
         }
 
         // no snapshot found yet, check diffs
-        auto itDiffs = mnListDiffsCache.find(pindex->GetBlockHash());
-        if (itDiffs != mnListDiffsCache.end()) {
-            listDiffIndexes.emplace_front(pindex);
+        std::shared_ptr<const CDeterministicMNListDiff> pdiff;
+        {
+            LOCK(cs_cache);
+            auto itDiffs = mnListDiffsCache.find(pindex->GetBlockHash());
+            if (itDiffs != mnListDiffsCache.end()) {
+                pdiff = itDiffs->second;
+            }
+        }
+        if (pdiff) {
+            vDiffs.emplace_back(pindex, pdiff);
             pindex = pindex->pprev;
             continue;
         }
@@ -895,32 +930,45 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
                 throw std::runtime_error(err);
             }
             snapshot = CDeterministicMNList(pindex->GetBlockHash(), -1, 0);
-            mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
+            CacheList(snapshot);
             break;
         }
 
         diff.nHeight = pindex->nHeight;
-        mnListDiffsCache.emplace(pindex->GetBlockHash(), std::move(diff));
-        listDiffIndexes.emplace_front(pindex);
+        pdiff = std::make_shared<const CDeterministicMNListDiff>(std::move(diff));
+        {
+            LOCK(cs_cache);
+            mnListDiffsCache.emplace(pindex->GetBlockHash(), pdiff);
+        }
+        vDiffs.emplace_back(pindex, pdiff);
         pindex = pindex->pprev;
     }
 
-    for (const auto& diffIndex : listDiffIndexes) {
-        const auto& diff = mnListDiffsCache.at(diffIndex->GetBlockHash());
+    // Replay the diffs (oldest first)
+    for (auto it = vDiffs.rbegin(); it != vDiffs.rend(); ++it) {
+        const CBlockIndex* diffIndex = it->first;
+        const CDeterministicMNListDiff& diff = *it->second;
         if (diff.HasChanges()) {
             snapshot = snapshot.ApplyDiff(diffIndex, diff);
         } else {
             snapshot.SetBlockHash(diffIndex->GetBlockHash());
             snapshot.SetHeight(diffIndex->nHeight);
         }
+        // keep intermediate lists, so the next lookups in this range replay less diffs
+        if (diffIndex->nHeight % MEMORY_SNAPSHOT_PERIOD == 0 && it + 1 != vDiffs.rend()) {
+            CacheList(snapshot);
+        }
     }
 
-    if (tipIndex) {
-        // always keep a snapshot for the tip
-        if (snapshot.GetBlockHash() == tipIndex->GetBlockHash()) {
-            mnListsCache.emplace(snapshot.GetBlockHash(), snapshot);
-        } else {
-            // !TODO: keep snapshots for yet alive quorums
+    if (!vDiffs.empty()) {
+        CacheList(snapshot);
+        const uint64_t nReplayed = vDiffs.size();
+        nDiffsReplayed += nReplayed;
+        uint64_t nMax = nMaxDiffsReplayed;
+        while (nReplayed > nMax && !nMaxDiffsReplayed.compare_exchange_weak(nMax, nReplayed)) {}
+        if (nReplayed > (uint64_t)MEMORY_SNAPSHOT_PERIOD) {
+            LogPrint(BCLog::MASTERNODE, "CDeterministicMNManager::%s -- replayed %d diffs for block %s at height %d\n",
+                     __func__, nReplayed, snapshot.GetBlockHash().ToString(), snapshot.GetHeight());
         }
     }
 
@@ -929,11 +977,11 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
 
 CDeterministicMNList CDeterministicMNManager::GetListAtChainTip()
 {
-    LOCK(cs);
-    if (!tipIndex) {
+    const CBlockIndex* pindexTip = tipIndex;
+    if (!pindexTip) {
         return {};
     }
-    return GetListForBlock(tipIndex);
+    return GetListForBlock(pindexTip);
 }
 
 bool CDeterministicMNManager::IsDIP3Enforced(int nHeight) const
@@ -943,7 +991,8 @@ bool CDeterministicMNManager::IsDIP3Enforced(int nHeight) const
 
 bool CDeterministicMNManager::IsDIP3Enforced() const
 {
-    int tipHeight = WITH_LOCK(cs, return tipIndex ? tipIndex->nHeight : -1;);
+    const CBlockIndex* pindexTip = tipIndex;
+    int tipHeight = pindexTip ? pindexTip->nHeight : -1;
     return IsDIP3Enforced(tipHeight);
 }
 
@@ -954,28 +1003,19 @@ bool CDeterministicMNManager::LegacyMNObsolete(int nHeight) const
 
 bool CDeterministicMNManager::LegacyMNObsolete() const
 {
-    int tipHeight = WITH_LOCK(cs, return tipIndex ? tipIndex->nHeight : -1;);
+    const CBlockIndex* pindexTip = tipIndex;
+    int tipHeight = pindexTip ? pindexTip->nHeight : -1;
     return LegacyMNObsolete(tipHeight);
 }
 
 void CDeterministicMNManager::CleanupCache(int nHeight)
 {
-    AssertLockHeld(cs);
+    LOCK(cs_cache);
 
-    std::vector<uint256> toDeleteLists;
+    // The lists cache is bounded by itself (least recently used lists are dropped)
     std::vector<uint256> toDeleteDiffs;
-    for (const auto& p : mnListsCache) {
-        if (p.second.GetHeight() + LIST_DIFFS_CACHE_SIZE < nHeight) {
-            toDeleteLists.emplace_back(p.first);
-            continue;
-        }
-        // !TODO: llmq cache cleanup
-    }
-    for (const auto& h : toDeleteLists) {
-        mnListsCache.erase(h);
-    }
     for (const auto& p : mnListDiffsCache) {
-        if (p.second.nHeight + LIST_DIFFS_CACHE_SIZE < nHeight) {
+        if (p.second->nHeight + LIST_DIFFS_CACHE_SIZE < nHeight) {
             toDeleteDiffs.emplace_back(p.first);
         }
     }
@@ -983,3 +1023,19 @@ void CDeterministicMNManager::CleanupCache(int nHeight)
         mnListDiffsCache.erase(h);
     }
 }
+
+CDeterministicMNListCacheStats CDeterministicMNManager::GetCacheStats() const
+{
+    CDeterministicMNListCacheStats stats;
+    stats.nLookups = nLookups;
+    stats.nCacheHits = nCacheHits;
+    stats.nSnapshotReads = nSnapshotReads;
+    stats.nDiffsReplayed = nDiffsReplayed;
+    stats.nMaxDiffsReplayed = nMaxDiffsReplayed;
+    {
+        LOCK(cs_cache);
+        stats.nCachedLists = mnListsCache.size();
+        stats.nCachedDiffs = mnListDiffsCache.size();
+    }
+    return stats;
+}
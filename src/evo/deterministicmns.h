@@ -12,10 +12,13 @@
 #include "evo/providertx.h"
 #include "saltedhasher.h"
 #include "sync.h"
+#include "unordered_lru_cache.h"
 
 #include <immer/map.hpp>
 #include <immer/map_transient.hpp>
 
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 
 class CBlock;
@@ -550,21 +553,51 @@ public:
     }
 };
 
+/** Metrics of the masternode lists lookups (see CDeterministicMNManager::GetListForBlock) */
+struct CDeterministicMNListCacheStats
+{
+    uint64_t nLookups{0};
+    // lookups answered by the lists cache without replaying any diff
+    uint64_t nCacheHits{0};
+    // snapshots read from disk
+    uint64_t nSnapshotReads{0};
+    // diffs applied, in total and by the longest replay
+    uint64_t nDiffsReplayed{0};
+    uint64_t nMaxDiffsReplayed{0};
+    size_t nCachedLists{0};
+    size_t nCachedDiffs{0};
+};
+
 class CDeterministicMNManager
 {
-    static const int DISK_SNAPSHOT_PERIOD = 1440; // once per day
-    static const int DISK_SNAPSHOTS = 3; // keep cache for 3 disk snapshots to have 2 full days covered
+    static const int DISK_SNAPSHOT_PERIOD = 576; // every 9.6 hours
+    static const int DISK_SNAPSHOTS = 5; // keep cache for 5 disk snapshots to have 2 full days covered
     static const int LIST_DIFFS_CACHE_SIZE = DISK_SNAPSHOT_PERIOD * DISK_SNAPSHOTS;
+    // When replaying diffs, the lists at multiples of this height are cached too,
+    // so that the next lookups in the same range replay less than this many diffs
+    static const int MEMORY_SNAPSHOT_PERIOD = 32;
+    static const size_t LISTS_CACHE_SIZE = 256;
 
 public:
+    // Held while building, connecting and disconnecting the lists (not needed for the lookups)
     mutable RecursiveMutex cs;
 
 private:
     CEvoDB& evoDb;
 
-    std::unordered_map<uint256, CDeterministicMNList, StaticSaltedHasher> mnListsCache;
-    std::unordered_map<uint256, CDeterministicMNListDiff, StaticSaltedHasher> mnListDiffsCache;
-    const CBlockIndex* tipIndex{nullptr};
+    // Protects the caches. Held only while accessing them, never while reading from disk
+    mutable Mutex cs_cache;
+    unordered_lru_cache<uint256, CDeterministicMNList, StaticSaltedHasher> mnListsCache GUARDED_BY(cs_cache){LISTS_CACHE_SIZE};
+    std::unordered_map<uint256, std::shared_ptr<const CDeterministicMNListDiff>, StaticSaltedHasher> mnListDiffsCache GUARDED_BY(cs_cache);
+    // the list of the chain tip is always kept
+    CDeterministicMNList mnListTip GUARDED_BY(cs_cache);
+    std::atomic<const CBlockIndex*> tipIndex{nullptr};
+
+    std::atomic<uint64_t> nLookups{0};
+    std::atomic<uint64_t> nCacheHits{0};
+    std::atomic<uint64_t> nSnapshotReads{0};
+    std::atomic<uint64_t> nDiffsReplayed{0};
+    std::atomic<uint64_t> nMaxDiffsReplayed{0};
 
 public:
     explicit CDeterministicMNManager(CEvoDB& _evoDb);
@@ -590,8 +623,12 @@ public:
     bool LegacyMNObsolete(int nHeight) const;
     bool LegacyMNObsolete() const;
 
+    CDeterministicMNListCacheStats GetCacheStats() const;
+
 private:
     void CleanupCache(int nHeight);
+    bool GetCachedList(const uint256& blockHash, CDeterministicMNList& mnListRet);
+    void CacheList(const CDeterministicMNList& mnList);
 };
 
 extern std::unique_ptr<CDeterministicMNManager> deterministicMNManager;
@@ -5,6 +5,7 @@
 #include "evo/evonotificationinterface.h"
 
 #include "evo/deterministicmns.h"
+#include "masternodeman.h"
 #include "validation.h"
 
 void EvoNotificationInterface::InitializeCurrentBlockTip()
@@ -16,6 +17,8 @@ void EvoNotificationInterface::InitializeCurrentBlockTip()
 void EvoNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
 {
     deterministicMNManager->UpdatedBlockTip(pindexNew);
+    // masternode scores depend on the list at the chain tip
+    mnodeman.ClearRankCache();
 }
 
 void EvoNotificationInterface::NotifyMasternodeListChanged(bool undo, const CDeterministicMNList& oldMNList, const CDeterministicMNListDiff& diff)
@@ -3,7 +3,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/pivx-config.h"
+#endif
+
 #include "hash.h"
+#include "compat/cpuid.h"
 #include "crypto/common.h"
 #include "crypto/hmac_sha512.h"
 #include "crypto/scrypt.h"
@@ -79,6 +84,183 @@ void BIP32Hash(const ChainCode chainCode, unsigned int nChild, unsigned char hea
     CHMAC_SHA512(chainCode.begin(), chainCode.size()).Write(&header, 1).Write(data, 32).Write(num, 4).Finalize(output);
 }
 
+#ifndef BUILD_BITCOIN_INTERNAL
+
+#if defined(ENABLE_AVX2)
+namespace quark_avx2
+{
+void Blake512(const unsigned char* const* in, size_t len, unsigned char* const* out);
+void Keccak512_64(const unsigned char* const* in, unsigned char* const* out);
+void Skein512_64(const unsigned char* const* in, unsigned char* const* out);
+}
+#endif
+
+static void QuarkBlake(const void* data, size_t len, void* out)
+{
+    sph_blake512_context ctx;
+    sph_blake512_init(&ctx);
+    sph_blake512(&ctx, data, len);
+    sph_blake512_close(&ctx, out);
+}
+
+static void QuarkBmw(const void* data, size_t len, void* out)
+{
+    sph_bmw512_context ctx;
+    sph_bmw512_init(&ctx);
+    sph_bmw512(&ctx, data, len);
+    sph_bmw512_close(&ctx, out);
+}
+
+static void QuarkGroestl(const void* data, size_t len, void* out)
+{
+    sph_groestl512_context ctx;
+    sph_groestl512_init(&ctx);
+    sph_groestl512(&ctx, data, len);
+    sph_groestl512_close(&ctx, out);
+}
+
+static void QuarkJh(const void* data, size_t len, void* out)
+{
+    sph_jh512_context ctx;
+    sph_jh512_init(&ctx);
+    sph_jh512(&ctx, data, len);
+    sph_jh512_close(&ctx, out);
+}
+
+static void QuarkKeccak(const void* data, size_t len, void* out)
+{
+    sph_keccak512_context ctx;
+    sph_keccak512_init(&ctx);
+    sph_keccak512(&ctx, data, len);
+    sph_keccak512_close(&ctx, out);
+}
+
+static void QuarkSkein(const void* data, size_t len, void* out)
+{
+    sph_skein512_context ctx;
+    sph_skein512_init(&ctx);
+    sph_skein512(&ctx, data, len);
+    sph_skein512_close(&ctx, out);
+}
+
+namespace
+{
+typedef void (*QuarkFunc)(const void* data, size_t len, void* out);
+typedef void (*QuarkFunc4)(const unsigned char* const* in, size_t len, unsigned char* const* out);
+
+/** A primitive of the Quark chain, with its 4-way implementation if the CPU has one */
+struct QuarkPrimitive {
+    QuarkFunc func;
+    QuarkFunc4 func4;
+
+    /** Hash the n messages in[i] to out[i] */
+    void Run(const unsigned char* const* in, size_t len, unsigned char* const* out, size_t n) const
+    {
+        size_t i = 0;
+        if (func4) {
+            for (; i + 4 <= n; i += 4) func4(in + i, len, out + i);
+        }
+        for (; i < n; i++) func(in[i], len, out[i]);
+    }
+};
+
+#if defined(ENABLE_AVX2) && defined(HAVE_GETCPUID)
+void QuarkBlake4(const unsigned char* const* in, size_t len, unsigned char* const* out) { quark_avx2::Blake512(in, len, out); }
+void QuarkKeccak4(const unsigned char* const* in, size_t len, unsigned char* const* out) { quark_avx2::Keccak512_64(in, out); }
+void QuarkSkein4(const unsigned char* const* in, size_t len, unsigned char* const* out) { quark_avx2::Skein512_64(in, out); }
+
+/** Whether the CPU supports AVX2, and the OS saves the ymm registers */
+bool AVX2Enabled()
+{
+    uint32_t a, b, c, d;
+    GetCPUID(0, 0, a, b, c, d);
+    if (a < 7) return false;
+    GetCPUID(1, 0, a, b, c, d);
+    if (!((c >> 27) & 1) || !((c >> 28) & 1)) return false; // OSXSAVE and AVX
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) return false; // XMM and YMM state
+    GetCPUID(7, 0, a, b, c, d);
+    return (b >> 5) & 1;
+}
+#endif
+
+/**
+ * The primitives used by HashQuarkN. Blake, keccak and skein get a 4-way AVX2
+ * implementation when available (bmw, groestl and jh stay scalar).
+ */
+struct QuarkPrimitives {
+    QuarkPrimitive blake{QuarkBlake, nullptr};
+    QuarkPrimitive bmw{QuarkBmw, nullptr};
+    QuarkPrimitive groestl{QuarkGroestl, nullptr};
+    QuarkPrimitive jh{QuarkJh, nullptr};
+    QuarkPrimitive keccak{QuarkKeccak, nullptr};
+    QuarkPrimitive skein{QuarkSkein, nullptr};
+
+    QuarkPrimitives()
+    {
+#if defined(ENABLE_AVX2) && defined(HAVE_GETCPUID)
+        if (AVX2Enabled()) {
+            blake.func4 = QuarkBlake4;
+            keccak.func4 = QuarkKeccak4;
+            skein.func4 = QuarkSkein4;
+        }
+#endif
+    }
+};
+
+/**
+ * Step k of the chain, hash[l][k - 1] -> hash[l][k], for the first nLanes lanes.
+ * If pAlt is set, the lanes whose input has bit 3 unset go through it instead.
+ */
+void QuarkStep(arith_uint512 (*hash)[9], size_t nLanes, int k, const QuarkPrimitive& prim, const QuarkPrimitive* pAlt = nullptr)
+{
+    const arith_uint512 mask(8);
+    const arith_uint512 zero(0);
+    const unsigned char* in[2][QUARK_LANES];
+    unsigned char* out[2][QUARK_LANES];
+    size_t n[2] = {0, 0};
+    for (size_t l = 0; l < nLanes; l++) {
+        const int i = (pAlt && (hash[l][k - 1] & mask) == zero) ? 1 : 0;
+        in[i][n[i]] = reinterpret_cast<const unsigned char*>(&hash[l][k - 1]);
+        out[i][n[i]++] = reinterpret_cast<unsigned char*>(&hash[l][k]);
+    }
+    prim.Run(in[0], 64, out[0], n[0]);
+    if (pAlt) pAlt->Run(in[1], 64, out[1], n[1]);
+}
+} // namespace
+
+void HashQuarkN(const unsigned char* const* ppdata, size_t nLen, size_t nCount, uint256* pOut)
+{
+    static const QuarkPrimitives q;
+    static unsigned char pblank[1];
+    // The 4-way blake only hashes single block messages
+    const QuarkPrimitive blakeFirst{QuarkBlake, nLen < 112 ? q.blake.func4 : nullptr};
+    arith_uint512 hash[QUARK_LANES][9];
+    const unsigned char* in[QUARK_LANES];
+    unsigned char* out[QUARK_LANES];
+
+    for (size_t nFirst = 0; nFirst < nCount; nFirst += QUARK_LANES) {
+        const size_t nLanes = std::min(QUARK_LANES, nCount - nFirst);
+        for (size_t l = 0; l < nLanes; l++) {
+            in[l] = (nLen == 0 ? pblank : ppdata[nFirst + l]);
+            out[l] = reinterpret_cast<unsigned char*>(&hash[l][0]);
+        }
+        blakeFirst.Run(in, nLen, out, nLanes);
+        QuarkStep(hash, nLanes, 1, q.bmw);
+        QuarkStep(hash, nLanes, 2, q.groestl, &q.skein);
+        QuarkStep(hash, nLanes, 3, q.groestl);
+        QuarkStep(hash, nLanes, 4, q.jh);
+        QuarkStep(hash, nLanes, 5, q.blake, &q.bmw);
+        QuarkStep(hash, nLanes, 6, q.keccak);
+        QuarkStep(hash, nLanes, 7, q.skein);
+        QuarkStep(hash, nLanes, 8, q.keccak, &q.jh);
+        for (size_t l = 0; l < nLanes; l++) pOut[nFirst + l] = hash[l][8].trim256();
+    }
+}
+
+#endif // BUILD_BITCOIN_INTERNAL
+
 void scrypt_hash(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char* output, unsigned int N, unsigned int r, unsigned int p, unsigned int dkLen)
 {
     scrypt(pass, pLen, salt, sLen, output, N, r, p, dkLen);
@@ -466,6 +466,18 @@ inline uint256 HashQuark(const T1 pbegin, const T1 pend)
     return hash[8].trim256();
 }
 
+/** Number of messages hashed together by HashQuarkN */
+static const size_t QUARK_LANES = 8;
+
+/**
+ * Quark hash of nCount messages of nLen bytes each (same result as HashQuark on each one).
+ * The messages are hashed in lanes of QUARK_LANES: each step of the Quark chain is run
+ * on all the lanes before moving to the next one, keeping the code and tables of each
+ * primitive hot in cache (headers batches, reindex). On CPUs with AVX2, the lanes of
+ * the blake, keccak and skein steps are hashed 4 at a time (see crypto/quark_avx2.cpp).
+ */
+void HashQuarkN(const unsigned char* const* ppdata, size_t nLen, size_t nCount, uint256* pOut);
+
 void scrypt_hash(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char* output, unsigned int N, unsigned int r, unsigned int p, unsigned int dkLen);
 
 
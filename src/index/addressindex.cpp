@@ -0,0 +1,267 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindex.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "hash.h"
+#include "script/standard.h"
+#include "undo.h"
+#include "util/memory.h"
+#include "util/system.h"
+#include "validation.h"
+
+#include <map>
+
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENT = 'u';
+static const char DB_ADDRESSBALANCE = 'd';
+static const char DB_SPENTINDEX = 'p';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+uint160 GetAddressIndexScriptHash(const CScript& script)
+{
+    txnouttype type;
+    std::vector<std::vector<unsigned char>> vSolutions;
+    if (Solver(script, type, vSolutions) && type == TX_PUBKEY) {
+        const CScript scriptKeyHash = GetScriptForDestination(CPubKey(vSolutions[0]).GetID());
+        return Hash160(scriptKeyHash);
+    }
+    return Hash160(script);
+}
+
+static bool IsIndexedOutput(const CTxOut& out)
+{
+    // Skip the empty first output of the coinstakes, the data outputs, and the zerocoin
+    // mints (not in the UTXO set: their zc spends are skipped too)
+    return !out.IsEmpty() && !out.scriptPubKey.IsUnspendable() && !out.IsZerocoinMint();
+}
+
+namespace {
+
+/** Balance delta of a script in the block at nHeight */
+struct CAddressBalanceKey
+{
+    uint160 hashScript;
+    uint32_t nHeight{0};
+
+    CAddressBalanceKey() {}
+    CAddressBalanceKey(const uint160& hashScriptIn, uint32_t nHeightIn) : hashScript(hashScriptIn), nHeight(nHeightIn) {}
+
+    SERIALIZE_METHODS(CAddressBalanceKey, obj) { READWRITE(obj.hashScript, Using<BigEndianFormatter<4>>(obj.nHeight)); }
+};
+
+} // anon namespace
+
+/** Access to the address index database (indexes/addressindex/) */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadAddressDeltas(const uint160& hashScript, int nStart, int nEnd, std::vector<std::pair<CAddressIndexKey, CAmount>>& vDeltas);
+    bool ReadAddressUnspent(const uint160& hashScript, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& vUnspent);
+    bool ReadAddressBalance(const uint160& hashScript, CAmount& nBalance, CAmount& nReceived);
+    bool ReadSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value) const;
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool AddressIndex::DB::ReadAddressDeltas(const uint160& hashScript, int nStart, int nEnd, std::vector<std::pair<CAddressIndexKey, CAmount>>& vDeltas)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(hashScript, std::max(nStart, 0), 0, UINT256_ZERO, 0, false)));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.hashScript != hashScript) break;
+        if (nEnd >= 0 && key.second.nHeight > (uint32_t)nEnd) break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue)) {
+            return error("%s: failed to read address index entry", __func__);
+        }
+        vDeltas.emplace_back(key.second, nValue);
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadAddressUnspent(const uint160& hashScript, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& vUnspent)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(hashScript, UINT256_ZERO, 0)));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENT || key.second.hashScript != hashScript) break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address unspent entry", __func__);
+        }
+        vUnspent.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadAddressBalance(const uint160& hashScript, CAmount& nBalance, CAmount& nReceived)
+{
+    nBalance = nReceived = 0;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSBALANCE, CAddressBalanceKey(hashScript, 0)));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressBalanceKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCE || key.second.hashScript != hashScript) break;
+        CAddressBalanceDelta delta;
+        if (!pcursor->GetValue(delta)) {
+            return error("%s: failed to read address balance entry", __func__);
+        }
+        nBalance += delta.nBalance;
+        nReceived += delta.nReceived;
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value) const
+{
+    return Read(std::make_pair(DB_SPENTINDEX, outpoint), value);
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::WriteBlockEntries(const CBlock& block, const CBlockIndex* pindex, bool fErase)
+{
+    CBlockUndo blockundo;
+    if (!UndoReadFromDisk(blockundo, pindex)) {
+        return false;
+    }
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    const uint32_t nHeight = pindex->nHeight;
+    std::map<uint160, CAddressBalanceDelta> mapDeltas;
+    CDBBatch batch;
+
+    // The transactions are processed in block order when connecting, and in reverse
+    // order (outputs first) when disconnecting, so that the outputs created and
+    // spent in the same block are not left in the unspent entries.
+    const size_t nTxes = block.vtx.size();
+    for (size_t k = 0; k < nTxes; k++) {
+        const size_t i = fErase ? nTxes - 1 - k : k;
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (!IsIndexedOutput(out)) continue;
+            const uint160 hashScript = GetAddressIndexScriptHash(out.scriptPubKey);
+            const auto key = std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(hashScript, nHeight, i, txid, j, false));
+            const auto keyUnspent = std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(hashScript, txid, j));
+            if (fErase) {
+                batch.Erase(key);
+                batch.Erase(keyUnspent);
+            } else {
+                batch.Write(key, out.nValue);
+                batch.Write(keyUnspent, CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight));
+            }
+            CAddressBalanceDelta& delta = mapDeltas[hashScript];
+            delta.nBalance += out.nValue;
+            delta.nReceived += out.nValue;
+        }
+
+        // Coinbases and zerocoin spends don't spend outputs
+        if (tx.IsCoinBase() || tx.HasZerocoinSpendInputs()) continue;
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction %s and undo data inconsistent", __func__, txid.ToString());
+        }
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            const COutPoint& prevout = tx.vin[j].prevout;
+            if (!IsIndexedOutput(coin.out)) continue;
+            const uint160 hashScript = GetAddressIndexScriptHash(coin.out.scriptPubKey);
+            const auto key = std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(hashScript, nHeight, i, txid, j, true));
+            const auto keyUnspent = std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(hashScript, prevout.hash, prevout.n));
+            const auto keySpent = std::make_pair(DB_SPENTINDEX, prevout);
+            if (fErase) {
+                batch.Erase(key);
+                batch.Write(keyUnspent, CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+                batch.Erase(keySpent);
+            } else {
+                batch.Write(key, -coin.out.nValue);
+                batch.Erase(keyUnspent);
+                batch.Write(keySpent, CSpentIndexValue(txid, j, nHeight, coin.out.nValue, hashScript));
+            }
+            mapDeltas[hashScript].nBalance -= coin.out.nValue;
+        }
+    }
+
+    for (const auto& it : mapDeltas) {
+        const auto key = std::make_pair(DB_ADDRESSBALANCE, CAddressBalanceKey(it.first, nHeight));
+        if (fErase) {
+            batch.Erase(key);
+        } else {
+            batch.Write(key, it.second);
+        }
+    }
+
+    // The best block is committed with the entries: after a crash the
+    // index never has entries of blocks past its locator, that it would
+    // not remove in case of reorg.
+    WriteBestBlock(batch, fErase ? pindex->pprev : pindex);
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The outputs of the genesis block are not spendable
+    if (pindex->nHeight == 0) return true;
+    return WriteBlockEntries(block, pindex, false);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Remove the entries of the blocks, from the tip down, reading them
+    // (and their undo data) from disk
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!WriteBlockEntries(block, pindex, true)) {
+            return error("%s: Failed to remove block %s from the index", __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::GetAddressDeltas(const uint160& hashScript, int nStart, int nEnd, std::vector<std::pair<CAddressIndexKey, CAmount>>& vDeltas) const
+{
+    return m_db->ReadAddressDeltas(hashScript, nStart, nEnd, vDeltas);
+}
+
+bool AddressIndex::GetAddressUnspent(const uint160& hashScript, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& vUnspent) const
+{
+    return m_db->ReadAddressUnspent(hashScript, vUnspent);
+}
+
+bool AddressIndex::GetAddressBalance(const uint160& hashScript, CAmount& nBalance, CAmount& nReceived) const
+{
+    return m_db->ReadAddressBalance(hashScript, nBalance, nReceived);
+}
+
+bool AddressIndex::GetSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value) const
+{
+    return m_db->ReadSpentInfo(outpoint, value);
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_ADDRESSINDEX_H
+#define PIVX_INDEX_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "index/base.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <memory>
+#include <vector>
+
+/** Key of the index: the hash of the output script (P2PK outputs are indexed as the P2PKH of the key) */
+uint160 GetAddressIndexScriptHash(const CScript& script);
+
+/**
+ * A funding output (fSpending = false) or a spending input of a transaction.
+ * The heights and positions are serialized big endian, so that the entries
+ * of a script are iterated in chain order.
+ */
+struct CAddressIndexKey
+{
+    uint160 hashScript;
+    uint32_t nHeight{0};
+    uint32_t nTxIndex{0};   // position of the transaction in the block
+    uint256 txid;
+    uint32_t nIndex{0};     // output index, or input index when spending
+    bool fSpending{false};
+
+    CAddressIndexKey() {}
+    CAddressIndexKey(const uint160& hashScriptIn, uint32_t nHeightIn, uint32_t nTxIndexIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn) :
+        hashScript(hashScriptIn), nHeight(nHeightIn), nTxIndex(nTxIndexIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    SERIALIZE_METHODS(CAddressIndexKey, obj)
+    {
+        READWRITE(obj.hashScript, Using<BigEndianFormatter<4>>(obj.nHeight), Using<BigEndianFormatter<4>>(obj.nTxIndex),
+                  obj.txid, Using<BigEndianFormatter<4>>(obj.nIndex), obj.fSpending);
+    }
+};
+
+/** An unspent output of a script */
+struct CAddressUnspentKey
+{
+    uint160 hashScript;
+    uint256 txid;
+    uint32_t nIndex{0};
+
+    CAddressUnspentKey() {}
+    CAddressUnspentKey(const uint160& hashScriptIn, const uint256& txidIn, uint32_t nIndexIn) :
+        hashScript(hashScriptIn), txid(txidIn), nIndex(nIndexIn) {}
+
+    SERIALIZE_METHODS(CAddressUnspentKey, obj) { READWRITE(obj.hashScript, obj.txid, obj.nIndex); }
+};
+
+struct CAddressUnspentValue
+{
+    CAmount nValue{0};
+    CScript script;
+    int nHeight{0};
+
+    CAddressUnspentValue() {}
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptIn, int nHeightIn) :
+        nValue(nValueIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    SERIALIZE_METHODS(CAddressUnspentValue, obj) { READWRITE(obj.nValue, obj.script, obj.nHeight); }
+};
+
+/** The change of the balance of a script in a block */
+struct CAddressBalanceDelta
+{
+    CAmount nBalance{0};
+    CAmount nReceived{0};
+
+    SERIALIZE_METHODS(CAddressBalanceDelta, obj) { READWRITE(obj.nBalance, obj.nReceived); }
+};
+
+/** The input spending an output */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    uint32_t nInput{0};
+    int nHeight{0};
+    CAmount nValue{0};
+    uint160 hashScript;
+
+    CSpentIndexValue() {}
+    CSpentIndexValue(const uint256& txidIn, uint32_t nInputIn, int nHeightIn, CAmount nValueIn, const uint160& hashScriptIn) :
+        txid(txidIn), nInput(nInputIn), nHeight(nHeightIn), nValue(nValueIn), hashScript(hashScriptIn) {}
+
+    SERIALIZE_METHODS(CSpentIndexValue, obj) { READWRITE(obj.txid, obj.nInput, obj.nHeight, obj.nValue, obj.hashScript); }
+};
+
+/**
+ * AddressIndex records, for each output script, the outputs funding it, the
+ * inputs spending them, the unspent outputs and the balance deltas of each
+ * block, and for each spent output the input spending it (indexes/addressindex/).
+ * The entries of a block are built from the block and its undo data, and
+ * removed (from the same data) when the block is disconnected.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    bool WriteBlockEntries(const CBlock& block, const CBlockIndex* pindex, bool fErase);
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Funding outputs and spending inputs of the script, in chain order, between
+    /// the heights nStart and nEnd (included, nEnd = -1 for no upper bound).
+    bool GetAddressDeltas(const uint160& hashScript, int nStart, int nEnd, std::vector<std::pair<CAddressIndexKey, CAmount>>& vDeltas) const;
+
+    /// Unspent outputs of the script
+    bool GetAddressUnspent(const uint160& hashScript, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& vUnspent) const;
+
+    /// Balance and total amount received by the script
+    bool GetAddressBalance(const uint160& hashScript, CAmount& nBalance, CAmount& nReceived) const;
+
+    /// Input spending the output (false if the output is unspent or unknown)
+    bool GetSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value) const;
+};
+
+/// The global address index. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // PIVX_INDEX_ADDRESSINDEX_H
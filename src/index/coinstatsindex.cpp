@@ -0,0 +1,417 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/coinstatsindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "invalid.h"
+#include "moneysupply.h"
+#include "undo.h"
+#include "util/memory.h"
+#include "util/system.h"
+#include "validation.h"
+
+/* The index database stores three items:
+ *
+ * - Statistics of the UTXO set after each block of the active chain, keyed
+ *   by height ('t' + uint32 BE height -> block hash, CCoinsStatsEntry).
+ * - Statistics of the blocks disconnected from the active chain, keyed by
+ *   block hash ('s' + hash -> CCoinsStatsEntry), copied from the height keys
+ *   when the index is rewound.
+ * - The MuHash3072 state of the UTXO set at the best block of the index ('M'),
+ *   committed with the best block locator.
+ */
+static const char DB_BLOCK_HASH = 's';
+static const char DB_BLOCK_HEIGHT = 't';
+static const char DB_MUHASH = 'M';
+
+namespace {
+
+struct DBHeightKey {
+    uint32_t height{0};
+
+    DBHeightKey() {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        s << Using<BigEndianFormatter<4>>(height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coinstats index DB height key");
+        }
+        s >> Using<BigEndianFormatter<4>>(height);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    SERIALIZE_METHODS(DBHashKey, obj) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for coinstats index DB hash key");
+        }
+
+        READWRITE(obj.hash);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+static void SerializeCoin(CDataStream& ss, const COutPoint& outpoint, const Coin& coin)
+{
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
+    ss << coin.out;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeCoin(ss, outpoint, coin);
+    muhash.Insert(MakeUCharSpan(ss));
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeCoin(ss, outpoint, coin);
+    muhash.Remove(MakeUCharSpan(ss));
+}
+
+uint64_t GetBogoSize(const CScript& script_pub_key)
+{
+    return 32 /* txid */ +
+           4 /* vout index */ +
+           4 /* height + coinbase/coinstake */ +
+           8 /* amount */ +
+           2 /* scriptPubKey len */ +
+           script_pub_key.size() /* scriptPubKey */;
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+
+    if (Params().NetworkIDString() == CBaseChainParams::MAIN) {
+        invalid_out::LoadOutpoints(m_invalid_outpoints);
+    }
+}
+
+bool CoinStatsIndex::IsIndexedCoin(const COutPoint& outpoint, const Coin& coin) const
+{
+    if (coin.out.scriptPubKey.IsUnspendable() || coin.out.IsZerocoinMint()) return false;
+    return m_invalid_outpoints.empty() ||
+           (int)coin.nHeight > Params().GetConsensus().height_last_invalid_UTXO ||
+           !m_invalid_outpoints.count(outpoint);
+}
+
+static bool LookupOne(const CDBWrapper& db, const CBlockIndex* block_index, CCoinsStatsEntry& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, CCoinsStatsEntry> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != (uint32_t)height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, CCoinsStatsEntry> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!m_db->Read(DB_MUHASH, m_muhash)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+
+    // The committed MuHash state is the one of the best block of the locator. If that block
+    // was disconnected while the index was not running, step the state back to the fork
+    // point with the active chain, which BaseIndex::Init starts the index from.
+    CBlockLocator locator;
+    if (m_db->ReadBestBlock(locator) && !locator.IsNull()) {
+        const CBlockIndex* pindex_committed;
+        const CBlockIndex* pindex_fork;
+        {
+            LOCK(cs_main);
+            auto it = mapBlockIndex.find(locator.vHave.front());
+            if (it == mapBlockIndex.end()) {
+                return error("%s: best block of %s not found", __func__, GetName());
+            }
+            pindex_committed = it->second;
+            pindex_fork = FindForkInGlobalIndex(chainActive, locator);
+        }
+        if (pindex_committed != pindex_fork) {
+            if (!pindex_fork || pindex_committed->GetAncestor(pindex_fork->nHeight) != pindex_fork) {
+                return error("%s: best block of %s not connected to the active chain", __func__, GetName());
+            }
+            CDBBatch batch;
+            std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+            if (!CopyHeightIndexToHashIndex(*db_it, batch, GetName(), pindex_fork->nHeight, pindex_committed->nHeight) ||
+                !m_db->WriteBatch(batch)) {
+                return false;
+            }
+            for (const CBlockIndex* pindex = pindex_committed; pindex != pindex_fork; pindex = pindex->pprev) {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, pindex)) {
+                    return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+                }
+                if (!ReverseBlock(block, pindex)) return false;
+            }
+        }
+    }
+
+    if (!BaseIndex::Init()) return false;
+
+    const int best_height = GetBestHeight();
+    if (best_height >= 0) {
+        std::pair<uint256, CCoinsStatsEntry> read_out;
+        if (!m_db->Read(DBHeightKey(best_height), read_out)) {
+            return error("%s: Cannot read the entry at height %d of %s", __func__, best_height, GetName());
+        }
+        uint256 out;
+        m_muhash.Finalize(out);
+        if (read_out.second.muhash != out) {
+            return error("%s: %s MuHash state inconsistent with the best block entry; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    // The MuHash state is written atomically with the best block locator
+    batch.Write(DB_MUHASH, m_muhash);
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CCoinsStatsEntry entry;
+
+    if (pindex->nHeight > 0) {
+        std::pair<uint256, CCoinsStatsEntry> read_out;
+        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+            return false;
+        }
+
+        uint256 expected_block_hash = pindex->pprev->GetBlockHash();
+        if (read_out.first != expected_block_hash) {
+            return error("%s: previous block entry belongs to unexpected block %s; expected %s",
+                         __func__, read_out.first.ToString(), expected_block_hash.ToString());
+        }
+
+        // Carry over the totals of the UTXO set
+        entry.nTransactionOutputs = read_out.second.nTransactionOutputs;
+        entry.nBogoSize = read_out.second.nBogoSize;
+        entry.nTotalAmount = read_out.second.nTotalAmount;
+        entry.nTotalUnspendable = read_out.second.nTotalUnspendable;
+
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+        if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            const uint256& txid = tx.GetHash();
+            const bool fCoinBase = tx.IsCoinBase();
+            const bool fCoinStake = tx.IsCoinStake();
+
+            for (size_t j = 0; j < tx.vout.size(); j++) {
+                const COutPoint outpoint(txid, j);
+                const Coin coin(tx.vout[j], pindex->nHeight, fCoinBase, fCoinStake);
+                if (!IsIndexedCoin(outpoint, coin)) {
+                    entry.nBlockUnspendable += coin.out.nValue;
+                    continue;
+                }
+                ApplyCoinHash(m_muhash, outpoint, coin);
+                entry.nTransactionOutputs++;
+                entry.nBogoSize += GetBogoSize(coin.out.scriptPubKey);
+                entry.nTotalAmount += coin.out.nValue;
+                entry.nBlockNewOutputs += coin.out.nValue;
+            }
+
+            if (tx.IsShieldedTx()) {
+                entry.nBlockShielded -= tx.sapData->valueBalance;
+            }
+
+            // Coinbases and zerocoin spends don't spend outputs
+            if (fCoinBase || tx.HasZerocoinSpendInputs()) continue;
+            const CTxUndo& txundo = block_undo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("%s: transaction %s and undo data inconsistent", __func__, txid.ToString());
+            }
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const Coin& coin = txundo.vprevout[j];
+                const COutPoint& prevout = tx.vin[j].prevout;
+                if (!IsIndexedCoin(prevout, coin)) continue;
+                RemoveCoinHash(m_muhash, prevout, coin);
+                entry.nTransactionOutputs--;
+                entry.nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+                entry.nTotalAmount -= coin.out.nValue;
+                entry.nBlockPrevoutSpent += coin.out.nValue;
+            }
+        }
+    } else {
+        // The outputs of the genesis block are not added to the UTXO set
+        for (const auto& tx : block.vtx) {
+            entry.nBlockUnspendable += tx->GetValueOut();
+        }
+    }
+    entry.nTotalUnspendable += entry.nBlockUnspendable;
+    m_muhash.Finalize(entry.muhash);
+
+    std::pair<uint256, CCoinsStatsEntry> value(pindex->GetBlockHash(), entry);
+    if (!m_db->Write(DBHeightKey(pindex->nHeight), value)) {
+        return false;
+    }
+
+    // Once in sync, the index keeps the cached money supply up to date
+    // (see FlushStateToDisk)
+    if (IsSynced()) MoneySupply.Update(entry.nTotalAmount, pindex->nHeight);
+    return true;
+}
+
+bool CoinStatsIndex::ReverseBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            const COutPoint outpoint(txid, j);
+            const Coin coin(tx.vout[j], pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake());
+            if (IsIndexedCoin(outpoint, coin)) RemoveCoinHash(m_muhash, outpoint, coin);
+        }
+
+        if (tx.IsCoinBase() || tx.HasZerocoinSpendInputs()) continue;
+        const CTxUndo& txundo = block_undo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction %s and undo data inconsistent", __func__, txid.ToString());
+        }
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            if (IsIndexedCoin(tx.vin[j].prevout, coin)) ApplyCoinHash(m_muhash, tx.vin[j].prevout, coin);
+        }
+    }
+
+    // Check that the state matches the one of the previous block
+    CCoinsStatsEntry prev_entry;
+    if (!LookupOne(*m_db, pindex->pprev, prev_entry)) {
+        return error("%s: Cannot read the entry of block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+    uint256 out;
+    m_muhash.Finalize(out);
+    if (prev_entry.muhash != out) {
+        return error("%s: MuHash of block %s inconsistent after disconnecting block %s",
+                     __func__, pindex->pprev->GetBlockHash().ToString(), pindex->GetBlockHash().ToString());
+    }
+
+    if (IsSynced()) MoneySupply.Update(prev_entry.nTotalAmount, pindex->pprev->nHeight);
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch;
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // During a reorg, we need to copy all the entries of the blocks that are getting disconnected
+    // from the height index to the hash index so we can still find them when the height index
+    // entries are overwritten.
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, GetName(), new_tip->nHeight, current_tip->nHeight)) {
+        return false;
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    // Remove the coins of the blocks from the MuHash state (committed with the
+    // new best block by BaseIndex::Rewind), from the tip down
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ReverseBlock(block, pindex)) {
+            return error("%s: Failed to remove block %s from the index", __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* pindex, CCoinsStatsEntry& entry) const
+{
+    return LookupOne(*m_db, pindex, entry);
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_COINSTATSINDEX_H
+#define PIVX_INDEX_COINSTATSINDEX_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "index/base.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <memory>
+#include <set>
+
+class Coin;
+class CScript;
+
+/** Adds the coin to (or removes it from) the MuHash of the UTXO set */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/** Rough size of a coin in the UTXO set (the bogosize statistic) */
+uint64_t GetBogoSize(const CScript& script_pub_key);
+
+/**
+ * Statistics about the UTXO set after a block, and about the transparent
+ * amounts moved by the block.
+ */
+struct CCoinsStatsEntry
+{
+    uint256 muhash;
+    uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
+    CAmount nTotalAmount{0};
+    // Amount never added to the UTXO set, up to the block (included)
+    CAmount nTotalUnspendable{0};
+
+    // Value of the coins spent by the block
+    CAmount nBlockPrevoutSpent{0};
+    // Value of the coins created by the block
+    CAmount nBlockNewOutputs{0};
+    // Value of the outputs of the block not added to the UTXO set
+    // (data outputs, zerocoin mints, invalid outputs, genesis block)
+    CAmount nBlockUnspendable{0};
+    // Net value moved into the shielded pool by the block
+    CAmount nBlockShielded{0};
+
+    /** Amount issued by the block: the transparent outputs created (spendable or not) plus the
+     *  value moved into the shielded pool, minus the coins spent. */
+    CAmount GetBlockIssued() const { return nBlockNewOutputs + nBlockUnspendable + nBlockShielded - nBlockPrevoutSpent; }
+
+    SERIALIZE_METHODS(CCoinsStatsEntry, obj)
+    {
+        READWRITE(obj.muhash, obj.nTransactionOutputs, obj.nBogoSize, obj.nTotalAmount, obj.nTotalUnspendable,
+                  obj.nBlockPrevoutSpent, obj.nBlockNewOutputs, obj.nBlockUnspendable, obj.nBlockShielded);
+    }
+};
+
+/**
+ * CoinStatsIndex maintains the statistics of the UTXO set (a rolling MuHash3072 of the coins,
+ * their number, bogosize and total amount) at every block, built from the blocks and their
+ * undo data (indexes/coinstats/), so that they are available without walking the chainstate.
+ * The entries of the active chain are indexed by height, those of blocks reorganized out of
+ * it by block hash. The MuHash state at the best block is committed with the best block.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+    MuHash3072 m_muhash;
+    // Outputs of the first blocks of mainnet removed from the UTXO set (see invalid.h).
+    // The index keeps its own copy, as validation frees invalid_out::setInvalidOutPoints.
+    std::set<COutPoint> m_invalid_outpoints;
+
+    /// Whether the coin is part of the UTXO set (CCoinsViewCache::AddCoin and AddCoins filters)
+    bool IsIndexedCoin(const COutPoint& outpoint, const Coin& coin) const;
+
+    bool ReverseBlock(const CBlock& block, const CBlockIndex* pindex);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Statistics of the UTXO set after the block (false if the block is not indexed)
+    bool LookUpStats(const CBlockIndex* pindex, CCoinsStatsEntry& entry) const;
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // PIVX_INDEX_COINSTATSINDEX_H
@@ -0,0 +1,167 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txindex.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "guiinterface.h"
+#include "init.h"
+#include "txdb.h"
+#include "util/memory.h"
+#include "util/system.h"
+#include "validation.h"
+
+static const char DB_TXINDEX = 't';
+
+//! Size of the batches erasing the legacy index entries
+static const size_t LEGACY_TXINDEX_ERASE_BATCH_SIZE = 1 << 24;
+
+std::unique_ptr<TxIndex> g_txindex;
+
+/** Access to the txindex database (indexes/txindex/) */
+class TxIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Read the disk location of the transaction data with the given hash. Returns false if the
+    /// transaction hash is not indexed.
+    bool ReadTxPos(const uint256& txid, CDiskTxPos& pos) const;
+
+    /// Write a batch of transaction positions to the DB.
+    bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos);
+};
+
+TxIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool TxIndex::DB::ReadTxPos(const uint256& txid, CDiskTxPos& pos) const
+{
+    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool TxIndex::DB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos)
+{
+    CDBBatch batch;
+    for (const auto& tuple : v_pos) {
+        batch.Write(std::make_pair(DB_TXINDEX, tuple.first), tuple.second);
+    }
+    return WriteBatch(batch);
+}
+
+TxIndex::TxIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<TxIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+TxIndex::~TxIndex() {}
+
+bool EraseLegacyTxIndex(CBlockTreeDB& block_tree_db)
+{
+    // Set by previous versions (the index was in the block tree db), cleared once the entries are erased.
+    // An interrupted erase resumes at the next start.
+    bool fLegacyIndex = false;
+    if (!block_tree_db.ReadFlag("txindex", fLegacyIndex) || !fLegacyIndex) {
+        return true;
+    }
+
+    // Same key format as the new index
+    LogPrintf("Erasing the legacy transaction index from the block tree database...\n");
+    uiInterface.ShowProgress(_("Erasing the legacy transaction index..."), 0);
+
+    const std::pair<char, uint256> begin_key(DB_TXINDEX, UINT256_ZERO);
+    std::pair<char, uint256> prev_key = begin_key;
+    std::pair<char, uint256> key;
+    CDBBatch batch;
+    size_t nBatch = 0, nErased = 0;
+    bool fInterrupted = false;
+
+    std::unique_ptr<CDBIterator> cursor(block_tree_db.NewIterator());
+    for (cursor->Seek(begin_key); cursor->Valid(); cursor->Next()) {
+        if (!cursor->GetKey(key) || key.first != DB_TXINDEX) {
+            break;
+        }
+        batch.Erase(key);
+        nBatch++;
+
+        if (batch.SizeEstimate() > LEGACY_TXINDEX_ERASE_BATCH_SIZE) {
+            block_tree_db.WriteBatch(batch);
+            block_tree_db.CompactRange(prev_key, key);
+            batch.Clear();
+            prev_key = key;
+            nErased += nBatch;
+            nBatch = 0;
+
+            // txids are uniformly distributed and visited in order: the first bytes give the progress
+            const int nProgress = ((key.second.begin()[0] << 8) + key.second.begin()[1]) * 100 / 65536;
+            uiInterface.ShowProgress(_("Erasing the legacy transaction index..."), std::max(1, std::min(99, nProgress)));
+            if (ShutdownRequested()) {
+                fInterrupted = true;
+                break;
+            }
+        }
+    }
+    if (!fInterrupted) {
+        block_tree_db.WriteBatch(batch);
+        block_tree_db.CompactRange(prev_key, key);
+        nErased += nBatch;
+    }
+
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("%s %u legacy transaction index entries\n", fInterrupted ? "Interrupted after erasing" : "Erased", nErased);
+    if (fInterrupted) {
+        return false;
+    }
+    if (!block_tree_db.WriteFlag("txindex", false)) {
+        return error("%s: failed to clear the legacy txindex flag", __func__);
+    }
+    return true;
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return true;
+
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    vPos.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        vPos.emplace_back(tx->GetHash(), pos);
+        pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
+    }
+    return m_db->WriteTxs(vPos);
+}
+
+BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
+
+bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const
+{
+    CDiskTxPos postx;
+    if (!m_db->ReadTxPos(tx_hash, postx)) {
+        return false;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: OpenBlockFile failed", __func__);
+    }
+    CBlockHeader header;
+    try {
+        file >> header;
+        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
+            return error("%s: fseek(...) failed", __func__);
+        }
+        file >> tx;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (tx->GetHash() != tx_hash) {
+        return error("%s: txid mismatch", __func__);
+    }
+    block_hash = header.GetHash();
+    return true;
+}
@@ -25,6 +25,11 @@ namespace invalid_out
     }
 
     bool LoadOutpoints()
+    {
+        return LoadOutpoints(setInvalidOutPoints);
+    }
+
+    bool LoadOutpoints(std::set<COutPoint>& setOutPoints)
     {
         UniValue v = read_json(LoadInvalidOutPoints());
 
@@ -49,7 +54,7 @@ namespace invalid_out
 
             auto n = static_cast<uint32_t>(vN.get_int());
             COutPoint out(txid, n);
-            setInvalidOutPoints.insert(out);
+            setOutPoints.insert(out);
         }
         return true;
     }
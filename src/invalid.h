@@ -19,6 +19,8 @@ namespace invalid_out
 
     bool ContainsOutPoint(const COutPoint& out);
     bool LoadOutpoints();
+    // Loads the invalid outpoints in a set other than setInvalidOutPoints
+    bool LoadOutpoints(std::set<COutPoint>& setOutPoints);
 }
 
 #endif //PIVX_INVALID_H
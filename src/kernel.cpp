@@ -7,6 +7,8 @@
 
 #include "kernel.h"
 
+#include "checkqueue.h"
+#include "crypto/common.h"
 #include "db.h"
 #include "legacy/stakemodifier.h"
 #include "policy/policy.h"
@@ -17,6 +19,15 @@
 #include "validation.h"
 #include "zpivchain.h"
 #include "zpiv/zpos.h"
+#include "util/threadnames.h"
+
+/** Minimum number of stake inputs checked by a single kernel search job */
+static const size_t KERNEL_SEARCH_MIN_INPUTS_PER_JOB = 256;
+
+static CCheckQueue<CKernelSearchCheck> kernelSearchQueue(1);
+// Only one master at a time can use the queue (e.g. stake minter and generate RPC)
+static Mutex cs_kernelSearchMaster;
+static std::atomic<int> nKernelSearchThreads{0};
 
 /**
  * CStakeKernel Constructor
@@ -49,19 +60,41 @@ CStakeKernel::CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* sta
 
 // Return stake kernel hash
 uint256 CStakeKernel::GetHash() const
+{
+    return GetHash(GetPrefixHasher(), nTime);
+}
+
+CHash256 CStakeKernel::GetPrefixHasher() const
 {
     CDataStream ss(stakeModifier);
-    ss << nTimeBlockFrom << stakeUniqueness << nTime;
-    return Hash(ss.begin(), ss.end());
+    ss << nTimeBlockFrom << stakeUniqueness;
+    CHash256 hasher;
+    hasher.Write((const unsigned char*)ss.data(), ss.size());
+    return hasher;
 }
 
-// Check that the kernel hash meets the target required
-bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
+uint256 CStakeKernel::GetHash(CHash256 prefixHasher, int nTimeTx)
+{
+    unsigned char time[4];
+    WriteLE32(time, (uint32_t) nTimeTx);
+    uint256 hash;
+    prefixHasher.Write(time, sizeof(time)).Finalize(hash.begin());
+    return hash;
+}
+
+arith_uint256 CStakeKernel::GetWeightedTarget() const
 {
-    // Get weighted target
     arith_uint256 bnTarget;
     bnTarget.SetCompact(nBits);
     bnTarget *= (arith_uint256(stakeValue) / 100);
+    return bnTarget;
+}
+
+// Check that the kernel hash meets the target required
+bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
+{
+    // Get weighted target
+    const arith_uint256& bnTarget = GetWeightedTarget();
 
     // Check PoS kernel hash
     const arith_uint256& hashProofOfStake = UintToArith256(GetHash());
@@ -84,6 +117,93 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
 }
 
 
+/*
+ * Kernel search
+ */
+
+CStakeKernelSearch::CStakeKernelSearch(const CBlockIndex* _pindexPrev, unsigned int _nBits, const uint256& _hashCoins) :
+    pindexPrev(_pindexPrev),
+    nBits(_nBits),
+    hashCoins(_hashCoins)
+{}
+
+void CStakeKernelSearch::AddStakeInput(std::unique_ptr<CStakeInput> stakeInput)
+{
+    CStakeKernel stakeKernel(pindexPrev, stakeInput.get(), nBits, 0);
+    vCandidates.push_back({std::move(stakeInput), stakeKernel.GetPrefixHasher(), stakeKernel.GetWeightedTarget()});
+}
+
+bool CStakeKernelSearch::CheckKernel(size_t nIndex, int nTimeTx) const
+{
+    const Candidate& candidate = vCandidates[nIndex];
+    return UintToArith256(CStakeKernel::GetHash(candidate.prefixHasher, nTimeTx)) < candidate.bnTarget;
+}
+
+int CStakeKernelSearch::FindKernel(int nTimeTx, size_t nStart) const
+{
+    const size_t nSize = vCandidates.size();
+    if (nStart >= nSize) return -1;
+
+    const int nThreads = nKernelSearchThreads;
+    if (nThreads <= 1 || nSize - nStart < 2 * KERNEL_SEARCH_MIN_INPUTS_PER_JOB) {
+        for (size_t i = nStart; i < nSize; i++) {
+            if (CheckKernel(i, nTimeTx)) return (int) i;
+        }
+        return -1;
+    }
+
+    // A few jobs per thread, so that the search stops early when a kernel is found
+    const size_t nJobSize = std::max(KERNEL_SEARCH_MIN_INPUTS_PER_JOB, (nSize - nStart) / (nThreads * 4));
+    std::atomic<int> nFound{-1};
+    std::vector<CKernelSearchCheck> vChecks;
+    for (size_t i = nStart; i < nSize; i += nJobSize) {
+        vChecks.emplace_back(this, i, std::min(nSize, i + nJobSize), nTimeTx, &nFound);
+    }
+    {
+        LOCK(cs_kernelSearchMaster);
+        CCheckQueueControl<CKernelSearchCheck> control(&kernelSearchQueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+    return nFound;
+}
+
+bool CKernelSearchCheck::operator()()
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        // Stop if a kernel has already been found in a previous input
+        const int nFound = *pnFound;
+        if (nFound >= 0 && (size_t) nFound < i) break;
+        if (search->CheckKernel(i, nTimeTx)) {
+            // Keep the first kernel, in inputs order
+            int nExpected = *pnFound;
+            while ((nExpected < 0 || (size_t) nExpected > i) && !pnFound->compare_exchange_weak(nExpected, (int) i)) {}
+            break;
+        }
+    }
+    return true;
+}
+
+void CKernelSearchCheck::swap(CKernelSearchCheck& check)
+{
+    std::swap(search, check.search);
+    std::swap(nBegin, check.nBegin);
+    std::swap(nEnd, check.nEnd);
+    std::swap(nTimeTx, check.nTimeTx);
+    std::swap(pnFound, check.pnFound);
+}
+
+void SetStakeKernelSearchThreads(int nThreads)
+{
+    nKernelSearchThreads = nThreads;
+}
+
+void ThreadStakeKernelSearch()
+{
+    util::ThreadRename("pivx-kernelsrch");
+    kernelSearchQueue.Thread();
+}
+
 /*
  * PoS Validation
  */
@@ -8,8 +8,14 @@
 #ifndef PIVX_KERNEL_H
 #define PIVX_KERNEL_H
 
+#include "arith_uint256.h"
+#include "hash.h"
 #include "stakeinput.h"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 class CStakeKernel {
 public:
     /**
@@ -28,6 +34,15 @@ public:
     // Check that the kernel hash meets the target required
     bool CheckKernelHash(bool fSkipLog = false) const;
 
+    // Return the hash target, weighted by the stake value
+    arith_uint256 GetWeightedTarget() const;
+
+    // Return the kernel message hasher, fed with everything but the kernel time
+    CHash256 GetPrefixHasher() const;
+
+    // Return stake kernel hash, finalizing the prefix hasher with the given kernel time
+    static uint256 GetHash(CHash256 prefixHasher, int nTimeTx);
+
 private:
     // kernel message hashed
     CDataStream stakeModifier{CDataStream(SER_GETHASH, 0)};
@@ -39,6 +54,73 @@ private:
     CAmount stakeValue{0};     // target multiplier
 };
 
+/*
+ * Kernel search over a snapshot of stake inputs, for kernel blocks on top of a given tip.
+ * The kernel message prefix (stake modifier, time of the block from, stake uniqueness) and
+ * the weighted target of each input are computed once, so that trying a new time slot only
+ * costs the hashing of the kernel time.
+ * The inputs are checked in parallel by the kernel search threads (when started).
+ * hashCoins identifies the set of inputs of the snapshot (e.g. a hash of their outpoints),
+ * so that the caller can tell when it must be rebuilt.
+ */
+class CStakeKernelSearch
+{
+public:
+    CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int nBits, const uint256& hashCoins);
+
+    // Add a stake input (checked in insertion order)
+    void AddStakeInput(std::unique_ptr<CStakeInput> stakeInput);
+
+    // Return the index of the first input, starting at nStart, whose kernel at nTimeTx meets the target (or -1)
+    int FindKernel(int nTimeTx, size_t nStart = 0) const;
+
+    // Check the kernel of a single input
+    bool CheckKernel(size_t nIndex, int nTimeTx) const;
+
+    CStakeInput* GetStakeInput(size_t nIndex) const { return vCandidates[nIndex].stakeInput.get(); }
+    size_t Size() const { return vCandidates.size(); }
+    const CBlockIndex* GetTip() const { return pindexPrev; }
+    unsigned int GetBits() const { return nBits; }
+    const uint256& GetCoinsHash() const { return hashCoins; }
+
+private:
+    struct Candidate {
+        std::unique_ptr<CStakeInput> stakeInput;
+        CHash256 prefixHasher;
+        arith_uint256 bnTarget;
+    };
+
+    const CBlockIndex* pindexPrev;
+    unsigned int nBits;
+    uint256 hashCoins;
+    std::vector<Candidate> vCandidates;
+};
+
+/** Check a range of kernel search candidates. Suitable to be used with CCheckQueue (always returns true) */
+class CKernelSearchCheck
+{
+private:
+    const CStakeKernelSearch* search{nullptr};
+    size_t nBegin{0};
+    size_t nEnd{0};
+    int nTimeTx{0};
+    std::atomic<int>* pnFound{nullptr};
+
+public:
+    CKernelSearchCheck() {}
+    CKernelSearchCheck(const CStakeKernelSearch* _search, size_t _nBegin, size_t _nEnd, int _nTimeTx, std::atomic<int>* _pnFound) :
+        search(_search), nBegin(_nBegin), nEnd(_nEnd), nTimeTx(_nTimeTx), pnFound(_pnFound) {}
+
+    bool operator()();
+    void swap(CKernelSearchCheck& check);
+};
+
+/** Set the number of threads (including the caller) used by the kernel search */
+void SetStakeKernelSearchThreads(int nThreads);
+
+/** Run a kernel search worker (started with the stake minter) */
+void ThreadStakeKernelSearch();
+
 /* PoS Validation */
 
 /*
@@ -15,30 +15,32 @@ bool DisconnectZerocoinTx(const CTransaction& tx, CZerocoinDB* zerocoinDB)
          * addresses should still be handled by the typical bitcoin based undo code
          * */
     if (tx.ContainsZerocoins()) {
-        libzerocoin::ZerocoinParams *params = Params().GetConsensus().Zerocoin_Params(false);
         if (tx.HasZerocoinSpendInputs()) {
             //erase all zerocoinspends in this transaction
-            for (const CTxIn &txin : tx.vin) {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                const CTxIn& txin = tx.vin[i];
                 bool isPublicSpend = txin.IsZerocoinPublicSpend();
                 if (txin.scriptSig.IsZerocoinSpend() || isPublicSpend) {
-                    CBigNum serial;
-                    if (isPublicSpend) {
-                        PublicCoinSpend publicSpend(params);
-                        CValidationState state;
-                        if (!ZPIVModule::ParseZerocoinPublicSpend(txin, tx, state, publicSpend)) {
-                            return error("Failed to parse public spend");
-                        }
-                        serial = publicSpend.getCoinSerialNumber();
-                    } else {
-                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
-                        serial = spend.getCoinSerialNumber();
+                    // the spend was recorded when the block was connected
+                    CZerocoinSpendRecord record;
+                    CValidationState state;
+                    if (!GetZerocoinSpendRecord(tx, i, record, state)) {
+                        return error("Failed to parse %s", isPublicSpend ? "public spend" : "zerocoin spend");
                     }
 
-                    if (!zerocoinDB->EraseCoinSpend(serial))
+                    if (!zerocoinDB->EraseCoinSpend(record.bnSerial))
                         return error("failed to erase spent zerocoin in block");
                 }
 
             }
+            if (!zerocoinDB->EraseSpendTxBlock(tx.GetHash()))
+                return error("failed to erase zerocoin spend tx in block");
+        }
+        if (tx.HasZerocoinMintOutputs()) {
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                if (tx.vout[i].IsZerocoinMint() && !zerocoinDB->EraseMintOutput(COutPoint(tx.GetHash(), i)))
+                    return error("failed to erase zerocoin mint in block");
+            }
         }
     }
     return true;
@@ -135,6 +135,7 @@ CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments&
 
         // de-serialize data into CMasternodePayments object
         ssObj >> objToLoad;
+        objToLoad.RebuildPayeeIndex();
     } catch (const std::exception& e) {
         objToLoad.Clear();
         error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -553,16 +554,62 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
-    }
 
-    CTxDestination addr;
-    ExtractDestination(winnerIn.payee, addr);
-    LogPrint(BCLog::MASTERNODE, "mnw - Adding winner %s for block %d\n", EncodeDestination(addr), winnerIn.nBlockHeight);
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        CTxDestination addr;
+        ExtractDestination(winnerIn.payee, addr);
+        LogPrint(BCLog::MASTERNODE, "mnw - Adding winner %s for block %d\n", EncodeDestination(addr), winnerIn.nBlockHeight);
+        if (mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1) == MNPAYMENTS_LASTPAID_VOTES) {
+            AddPayeeVotedHeight(winnerIn.payee, winnerIn.nBlockHeight);
+        }
+    }
 
     return true;
 }
 
+void CMasternodePayments::AddPayeeVotedHeight(const CScript& payee, int nBlockHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    mapPayeeVotedHeights[payee].insert(nBlockHeight);
+}
+
+void CMasternodePayments::RemoveBlockFromPayeeIndex(const CMasternodeBlockPayees& blockPayees)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    LOCK(cs_vecPayments);
+    for (const CMasternodePayee& p : blockPayees.vecPayments) {
+        if (p.nVotes < MNPAYMENTS_LASTPAID_VOTES) continue;
+        auto it = mapPayeeVotedHeights.find(p.scriptPubKey);
+        if (it == mapPayeeVotedHeights.end()) continue;
+        it->second.erase(blockPayees.nBlockHeight);
+        if (it->second.empty()) mapPayeeVotedHeights.erase(it);
+    }
+}
+
+void CMasternodePayments::RebuildPayeeIndex()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_vecPayments);
+    mapPayeeVotedHeights.clear();
+    for (const auto& it : mapMasternodeBlocks) {
+        for (const CMasternodePayee& p : it.second.vecPayments) {
+            if (p.nVotes >= MNPAYMENTS_LASTPAID_VOTES) {
+                AddPayeeVotedHeight(p.scriptPubKey, it.first);
+            }
+        }
+    }
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+    const auto it = mapPayeeVotedHeights.find(payee);
+    if (it == mapPayeeVotedHeights.end()) return -1;
+    // first height greater than nMaxHeight, then step back
+    auto itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin()) return -1;
+    --itHeight;
+    return *itHeight >= nMinHeight ? *itHeight : -1;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -686,7 +733,11 @@ void CMasternodePayments::CleanPaymentList(int mnCount, int nHeight)
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            const auto itBlock = mapMasternodeBlocks.find(winner.nBlockHeight);
+            if (itBlock != mapMasternodeBlocks.end()) {
+                RemoveBlockFromPayeeIndex(itBlock->second);
+                mapMasternodeBlocks.erase(itBlock);
+            }
         } else {
             ++it;
         }
@@ -23,6 +23,8 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// Minimum number of votes for a payee to be considered paid in a block (used for the payment queue)
+#define MNPAYMENTS_LASTPAID_VOTES 2
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, const CBlockIndex* pindexPrev);
@@ -101,19 +103,21 @@ public:
         vecPayments.clear();
     }
 
-    void AddPayee(const CScript& payeeIn, int nIncrement)
+    // Return the updated number of votes for payeeIn
+    int AddPayee(const CScript& payeeIn, int nIncrement)
     {
         LOCK(cs_vecPayments);
 
         for (CMasternodePayee& payee : vecPayments) {
             if (payee.scriptPubKey == payeeIn) {
                 payee.nVotes += nIncrement;
-                return;
+                return payee.nVotes;
             }
         }
 
         CMasternodePayee c(payeeIn, nIncrement);
         vecPayments.push_back(c);
+        return nIncrement;
     }
 
     bool GetPayee(CScript& payee) const
@@ -208,6 +212,13 @@ class CMasternodePayments
 private:
     int nLastBlockHeight;
 
+    // Memory only. Index of the heights (in mapMasternodeBlocks) where each payee script
+    // has at least MNPAYMENTS_LASTPAID_VOTES votes. Protected by cs_mapMasternodeBlocks.
+    std::map<CScript, std::set<int>> mapPayeeVotedHeights;
+
+    void AddPayeeVotedHeight(const CScript& payee, int nBlockHeight);
+    void RemoveBlockFromPayeeIndex(const CMasternodeBlockPayees& blockPayees);
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -223,8 +234,16 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeVotedHeights.clear();
     }
 
+    // Rebuild the payee index from mapMasternodeBlocks (after loading mnpayments.dat)
+    void RebuildPayeeIndex();
+
+    // Return the highest height in [nMinHeight, nMaxHeight] where payee has been voted
+    // with at least MNPAYMENTS_LASTPAID_VOTES votes, or -1 if there is none.
+    int GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight) const;
+
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     void ProcessBlock(int nBlockHeight);
 
@@ -93,7 +93,7 @@ void CMasternodeSync::Reset()
     lastBudgetItem = 0;
     mapSeenSyncMNB.clear();
     mapSeenSyncMNW.clear();
-    mapSeenSyncBudget.clear();
+    WITH_LOCK(cs_seenSyncBudget, mapSeenSyncBudget.clear(); );
     lastFailure = 0;
     nCountFailures = 0;
     sumMasternodeList = 0;
@@ -137,10 +137,12 @@ void CMasternodeSync::AddedMasternodeWinner(const uint256& hash)
 
 void CMasternodeSync::AddedBudgetItem(const uint256& hash)
 {
-    if (g_budgetman.HaveProposal(hash) ||
-            g_budgetman.HaveSeenProposalVote(hash) ||
-            g_budgetman.HaveFinalizedBudget(hash) ||
-            g_budgetman.HaveSeenFinalizedBudgetVote(hash)) {
+    const bool fHaveItem = g_budgetman.HaveProposal(hash) ||
+                           g_budgetman.HaveSeenProposalVote(hash) ||
+                           g_budgetman.HaveFinalizedBudget(hash) ||
+                           g_budgetman.HaveSeenFinalizedBudgetVote(hash);
+    LOCK(cs_seenSyncBudget);
+    if (fHaveItem) {
         if (mapSeenSyncBudget[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastBudgetItem = GetTime();
             mapSeenSyncBudget[hash]++;
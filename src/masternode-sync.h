@@ -43,11 +43,13 @@ class CMasternodeSync
 public:
     std::map<uint256, int> mapSeenSyncMNB;
     std::map<uint256, int> mapSeenSyncMNW;
-    std::map<uint256, int> mapSeenSyncBudget;
+    // budget items are also counted by the budget votes thread
+    Mutex cs_seenSyncBudget;
+    std::map<uint256, int> mapSeenSyncBudget;   // guarded by cs_seenSyncBudget
 
     int64_t lastMasternodeList;
     int64_t lastMasternodeWinner;
-    int64_t lastBudgetItem;
+    std::atomic<int64_t> lastBudgetItem;
     int64_t lastFailure;
     int nCountFailures;
 
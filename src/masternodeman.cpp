@@ -197,6 +197,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
         LogPrint(BCLog::MASTERNODE, "Adding new Masternode %s\n", mn.vin.prevout.ToString());
         mapMasternodes.emplace(mn.vin.prevout, std::make_shared<CMasternode>(mn));
         LogPrint(BCLog::MASTERNODE, "Masternode added. New total count: %d\n", mapMasternodes.size());
+        ClearRankCache();
         return true;
     }
 
@@ -270,6 +271,7 @@ int CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 
             it = mapMasternodes.erase(it);
             LogPrint(BCLog::MASTERNODE, "Masternode removed.\n");
+            ClearRankCache();
         } else {
             ++it;
         }
@@ -340,6 +342,7 @@ void CMasternodeMan::Clear()
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nDsqCount = 0;
+    ClearRankCache();
 }
 
 int CMasternodeMan::stable_size() const
@@ -525,21 +528,24 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     int nMnCount = mnList.GetValidMNsCount();
     {
         LOCK(cs);
-        nMnCount += CountEnabled();
+        const int nEnabled = CountEnabled();
+        // blocks to look back when searching for the last payment (same as GetLastPaid)
+        const int nMaxDepth = nEnabled * 1.25;
+        nMnCount += nEnabled;
         for (const auto& it : mapMasternodes) {
             if (!it.second->IsEnabled()) continue;
             if (canScheduleMN(fFilterSigTime, it.second, minProtocol, nMnCount, nBlockHeight)) {
-                vecMasternodeLastPaid.emplace_back(SecondsSincePayment(it.second, BlockReading), it.second);
+                vecMasternodeLastPaid.emplace_back(SecondsSincePayment(it.second, BlockReading, nMaxDepth), it.second);
             }
         }
+        // Add deterministic masternodes to the vector
+        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
+            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
+            if (canScheduleMN(fFilterSigTime, mn, minProtocol, nMnCount, nBlockHeight)) {
+                vecMasternodeLastPaid.emplace_back(SecondsSincePayment(mn, BlockReading, nMaxDepth), mn);
+            }
+        });
     }
-    // Add deterministic masternodes to the vector
-    mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-        const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-        if (canScheduleMN(fFilterSigTime, mn, minProtocol, nMnCount, nBlockHeight)) {
-            vecMasternodeLastPaid.emplace_back(SecondsSincePayment(mn, BlockReading), mn);
-        }
-    });
 
     nCount = (int)vecMasternodeLastPaid.size();
 
@@ -572,41 +578,136 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     return pBestMasternode;
 }
 
-MasternodeRef CMasternodeMan::GetCurrentMasterNode(const uint256& hash) const
+enum RankFlags : uint8_t {
+    RANK_ENABLED = 1,   // enabled masternode
+    RANK_ELIGIBLE = 2,  // can be the winner
+    RANK_RANKABLE = 4,  // can vote for payments
+};
+
+static uint8_t GetRankFlags(const CMasternode& mn, int minProtocol, bool fCheckAge, int64_t nNow)
 {
-    int minProtocol = ActiveProtocol();
-    int64_t score = 0;
-    MasternodeRef winner = nullptr;
+    const bool fEnabled = mn.IsEnabled();
+    // Skip obsolete versions
+    const bool fEligible = fEnabled && mn.protocolVersion >= minProtocol;
+    // Skip masternodes younger than (default) 1 hour when ranking
+    const bool fOldEnough = !fCheckAge || nNow - mn.sigTime >= MN_WINNER_MINIMUM_AGE;
+    return (fEnabled ? RANK_ENABLED : 0) | (fEligible ? RANK_ELIGIBLE : 0) | (fEligible && fOldEnough ? RANK_RANKABLE : 0);
+}
 
-    // scan for winner
+std::vector<std::pair<COutPoint, uint8_t>> CMasternodeMan::GetLegacyRankState(int minProtocol) const
+{
+    const bool fCheckAge = sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    const int64_t nNow = GetAdjustedTime();
+    std::vector<std::pair<COutPoint, uint8_t>> vState;
+    LOCK(cs);
+    vState.reserve(mapMasternodes.size());
     for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
-        if (mn->protocolVersion < minProtocol || !mn->IsEnabled()) continue;
-        // calculate the score of the masternode
-        const int64_t n = mn->CalculateScore(hash).GetCompact(false);
+        vState.emplace_back(it.first, GetRankFlags(*it.second, minProtocol, fCheckAge, nNow));
+    }
+    return vState;
+}
+
+MasternodeRankTableRef CMasternodeMan::BuildRankTable(const uint256& hash, int minProtocol, const CDeterministicMNList& mnList) const
+{
+    auto table = std::make_shared<CMasternodeRankTable>();
+    const bool fCheckAge = sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    const int64_t nNow = GetAdjustedTime();
+    int64_t nHighScore = 0;
+
+    // fValid: enabled/valid masternode. fEligible: can be the winner. fRankable: can vote for payments.
+    auto addMN = [&](const MasternodeRef& mn, bool fValid, bool fEligible, bool fRankable) {
+        // calculate the score of the masternode (only once per block hash)
+        const int64_t score = mn->CalculateScore(hash).GetCompact(false);
+        table->vecAll.emplace_back(fValid ? score : 9999, mn);
+        if (!fEligible) return;
         // determine the winner
-        if (n > score) {
-            score = n;
-            winner = mn;
+        if (score > nHighScore) {
+            nHighScore = score;
+            table->winner = mn;
+        }
+        if (fRankable) table->vecRanked.emplace_back(score, mn);
+    };
+
+    {
+        LOCK(cs);
+        table->vLegacyState.reserve(mapMasternodes.size());
+        for (const auto& it : mapMasternodes) {
+            const MasternodeRef& mn = it.second;
+            const uint8_t flags = GetRankFlags(*mn, minProtocol, fCheckAge, nNow);
+            table->vLegacyState.emplace_back(it.first, flags);
+            addMN(mn, flags & RANK_ENABLED, flags & RANK_ELIGIBLE, flags & RANK_RANKABLE);
         }
     }
 
     // scan also dmns
+    mnList.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) {
+        const bool fValid = mnList.IsMNValid(dmn);
+        addMN(MakeMasternodeRefForDMN(dmn), fValid, fValid, fValid);
+    });
+
+    // Sort them high to low
+    std::stable_sort(table->vecAll.rbegin(), table->vecAll.rend(), CompareScoreMN());
+    std::stable_sort(table->vecRanked.rbegin(), table->vecRanked.rend(), CompareScoreMN());
+
+    int rank = 0;
+    for (const auto& s : table->vecRanked) {
+        table->mapRanks.emplace(s.second->vin.prevout, ++rank);
+    }
+    return table;
+}
+
+MasternodeRankTableRef CMasternodeMan::GetRankTable(const uint256& hash) const
+{
+    const int minProtocol = ActiveProtocol();
+    CDeterministicMNList mnList;
     if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            // calculate the score of the masternode
-            const int64_t n = mn->CalculateScore(hash).GetCompact(false);
-            // determine the winner
-            if (n > score) {
-                score = n;
-                winner = mn;
+        mnList = deterministicMNManager->GetListAtChainTip();
+    }
+    const auto key = std::make_pair(hash, minProtocol);
+    const auto& vLegacyState = GetLegacyRankState(minProtocol);
+
+    {
+        LOCK(cs_rank_cache);
+        // the tables of a different dmn list are stale (the validation interface might not have notified us yet)
+        if (rankCacheTip != mnList.GetBlockHash()) {
+            mapRankTables.clear();
+            listRankTablesOrder.clear();
+            rankCacheTip = mnList.GetBlockHash();
+        }
+        const auto it = mapRankTables.find(key);
+        if (it != mapRankTables.end() && it->second->vLegacyState == vLegacyState) return it->second;
+    }
+
+    // compute it without holding cs_rank_cache (BuildRankTable locks cs)
+    MasternodeRankTableRef table = BuildRankTable(hash, minProtocol, mnList);
+
+    LOCK(cs_rank_cache);
+    if (rankCacheTip == mnList.GetBlockHash()) {
+        const auto ret = mapRankTables.emplace(key, table);
+        if (!ret.second) {
+            // replace the stale table
+            ret.first->second = table;
+        } else {
+            listRankTablesOrder.emplace_back(key);
+            if (listRankTablesOrder.size() > CACHED_RANK_TABLES) {
+                mapRankTables.erase(listRankTablesOrder.front());
+                listRankTablesOrder.pop_front();
             }
-        });
+        }
     }
+    return table;
+}
 
-    return winner;
+void CMasternodeMan::ClearRankCache()
+{
+    LOCK(cs_rank_cache);
+    mapRankTables.clear();
+    listRankTablesOrder.clear();
+}
+
+MasternodeRef CMasternodeMan::GetCurrentMasterNode(const uint256& hash) const
+{
+    return GetRankTable(hash)->winner;
 }
 
 std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast) const
@@ -615,9 +716,15 @@ std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast
     int nChainHeight = GetBestHeight();
     if (nChainHeight < 0) return ret;
 
+    // One table per height, each used once: build them without going through the cache
+    const int minProtocol = ActiveProtocol();
+    CDeterministicMNList mnList;
+    if (deterministicMNManager->IsDIP3Enforced()) {
+        mnList = deterministicMNManager->GetListAtChainTip();
+    }
     for (int nHeight = nChainHeight - nLast; nHeight < nChainHeight + 20; nHeight++) {
         const uint256& hash = GetHashAtHeight(nHeight - 101);
-        MasternodeRef winner = GetCurrentMasterNode(hash);
+        MasternodeRef winner = BuildRankTable(hash, minProtocol, mnList)->winner;
         if (winner) {
             ret.emplace_back(winner, nHeight);
         }
@@ -631,78 +738,17 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) co
     // height outside range
     if (hash == UINT256_ZERO) return -1;
 
-    // scan for winner
-    int minProtocol = ActiveProtocol();
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-    {
-        LOCK(cs);
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef& mn = it.second;
-            if (!mn->IsEnabled()) {
-                continue; // Skip not enabled
-            }
-            if (mn->protocolVersion < minProtocol) {
-                LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn->protocolVersion);
-                continue; // Skip obsolete versions
-            }
-            if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) &&
-                    GetAdjustedTime() - mn->sigTime < MN_WINNER_MINIMUM_AGE) {
-                continue; // Skip masternodes younger than (default) 1 hour
-            }
-            vecMasternodeScores.emplace_back(mn->CalculateScore(hash).GetCompact(false), mn->vin);
-        }
-    }
-
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            vecMasternodeScores.emplace_back(mn->CalculateScore(hash).GetCompact(false), mn->vin);
-        });
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s : vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
-        }
-    }
-
-    return -1;
+    const MasternodeRankTableRef& table = GetRankTable(hash);
+    const auto it = table->mapRanks.find(vin.prevout);
+    return it != table->mapRanks.end() ? it->second : -1;
 }
 
 std::vector<std::pair<int64_t, MasternodeRef>> CMasternodeMan::GetMasternodeRanks(int nBlockHeight) const
 {
-    std::vector<std::pair<int64_t, MasternodeRef>> vecMasternodeScores;
     const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
     // height outside range
-    if (hash == UINT256_ZERO) return vecMasternodeScores;
-    {
-        LOCK(cs);
-        // scan for winner
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef mn = it.second;
-            const uint32_t score = mn->IsEnabled() ? mn->CalculateScore(hash).GetCompact(false) : 9999;
-
-            vecMasternodeScores.emplace_back(score, mn);
-        }
-    }
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            const uint32_t score = mnList.IsMNValid(dmn) ? mn->CalculateScore(hash).GetCompact(false) : 9999;
-
-            vecMasternodeScores.emplace_back(score, mn);
-        });
-    }
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-    return vecMasternodeScores;
+    if (hash == UINT256_ZERO) return std::vector<std::pair<int64_t, MasternodeRef>>();
+    return GetRankTable(hash)->vecAll;
 }
 
 int CMasternodeMan::ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
@@ -721,6 +767,12 @@ int CMasternodeMan::ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
     // make sure the vout that was signed is related to the transaction that spawned the Masternode
     //  - this is expensive, so it's only done once per Masternode
     if (!mnb.IsInputAssociatedWithPubkey()) {
+        // the collateral tx can't be checked yet while the tx index is building: ignore the
+        // broadcast (not seen yet), without punishing the peer
+        if (IsTxIndexSyncing()) {
+            LogPrint(BCLog::MASTERNODE, "CMasternodeMan::ProcessMessage() : mnb - Can't check the vin while the tx index is syncing\n");
+            return 0;
+        }
         LogPrintf("CMasternodeMan::ProcessMessage() : mnb - Got mismatched pubkey and vin\n");
         return 33;
     }
@@ -873,6 +925,7 @@ void CMasternodeMan::Remove(const COutPoint& collateralOut)
     const auto it = mapMasternodes.find(collateralOut);
     if (it != mapMasternodes.end()) {
         mapMasternodes.erase(it);
+        ClearRankCache();
     }
 }
 
@@ -899,16 +952,27 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast& mnb)
     }
 }
 
-int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
+// Deterministic per-masternode hash, used to break ties between masternodes paid in the same block
+// and to order the ones that were never paid.
+static arith_uint256 GetPaymentTieBreakHash(const MasternodeRef& mn)
 {
-    int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, BlockReading));
-    int64_t month = 60 * 60 * 24 * 30;
-    if (sec < month) return sec; //if it's less than 30 days, give seconds
-
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     ss << mn->vin;
     ss << mn->sigTime;
-    const arith_uint256& hash = UintToArith256(ss.GetHash());
+    return UintToArith256(ss.GetHash());
+}
+
+int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
+{
+    return SecondsSincePayment(mn, BlockReading, CountEnabled() * 1.25);
+}
+
+int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading, int nMaxDepth) const
+{
+    const arith_uint256& hash = GetPaymentTieBreakHash(mn);
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, BlockReading, nMaxDepth, hash));
+    int64_t month = 60 * 60 * 24 * 30;
+    if (sec < month) return sec; //if it's less than 30 days, give seconds
 
     // return some deterministic value for unknown/unpaid but force it to be more than 30 days old
     return month + hash.GetCompact(false);
@@ -916,35 +980,27 @@ int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBloc
 
 int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
 {
-    if (BlockReading == nullptr) return false;
-
-    const CScript& mnpayee = mn->GetPayeeScript();
+    return GetLastPaid(mn, BlockReading, CountEnabled() * 1.25, GetPaymentTieBreakHash(mn));
+}
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    ss << mn->vin;
-    ss << mn->sigTime;
-    uint256 hash = ss.GetHash();
+int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading, int nMaxDepth, const arith_uint256& tieBreakHash) const
+{
+    if (BlockReading == nullptr || nMaxDepth <= 0) return false;
 
-    // use a deterministic offset to break a tie -- 2.5 minutes
-    int64_t nOffset = UintToArith256(hash).GetCompact(false) % 150;
-
-    int nMnCount = CountEnabled() * 1.25;
-    for (int n = 0; n < nMnCount; n++) {
-        const auto& it = masternodePayments.mapMasternodeBlocks.find(BlockReading->nHeight);
-        if (it != masternodePayments.mapMasternodeBlocks.end()) {
-            // Search for this payee, with at least 2 votes. This will aid in consensus
-            // allowing the network to converge on the same payees quickly, then keep the same schedule.
-            if (it->second.HasPayeeWithVotes(mnpayee, 2))
-                return BlockReading->nTime + nOffset;
-        }
-        BlockReading = BlockReading->pprev;
+    // Search for the last block (up to nMaxDepth blocks back) where this payee had at least
+    // MNPAYMENTS_LASTPAID_VOTES votes. This will aid in consensus allowing the network
+    // to converge on the same payees quickly, then keep the same schedule.
+    // Votes are indexed by height, so the result is resolved against the chain of BlockReading.
+    const int nMinHeight = std::max(1, BlockReading->nHeight - nMaxDepth + 1);
+    const int nPaidHeight = masternodePayments.GetLastPaidHeight(mn->GetPayeeScript(), nMinHeight, BlockReading->nHeight);
+    if (nPaidHeight < 0) return 0;
 
-        if (BlockReading == nullptr || BlockReading->nHeight <= 0) {
-            break;
-        }
-    }
+    const CBlockIndex* pindexPaid = BlockReading->GetAncestor(nPaidHeight);
+    if (pindexPaid == nullptr) return 0;
 
-    return 0;
+    // use a deterministic offset to break a tie -- 2.5 minutes
+    int64_t nOffset = tieBreakHash.GetCompact(false) % 150;
+    return pindexPaid->nTime + nOffset;
 }
 
 std::string CMasternodeMan::ToString() const
@@ -15,12 +15,20 @@
 #include "sync.h"
 #include "util/system.h"
 
+#include <list>
+#include <memory>
+
+class CDeterministicMNList;
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
 /** Maximum number of block hashes to cache */
 static const unsigned int CACHED_BLOCK_HASHES = 200;
 
+/** Maximum number of masternode rank tables to cache (per chain tip) */
+static const unsigned int CACHED_RANK_TABLES = 64;
+
 class CMasternodeMan;
 class CActiveMasternode;
 
@@ -54,6 +62,26 @@ public:
 };
 
 
+/** Masternode scores for a given block hash.
+ * Computed once per chain tip, and shared by all the winner/rank lookups.
+ */
+class CMasternodeRankTable
+{
+public:
+    // Highest score among the enabled (legacy) and valid (deterministic) masternodes
+    MasternodeRef winner{nullptr};
+    // Masternodes eligible for payment votes, ordered by score (high to low)
+    std::vector<std::pair<int64_t, MasternodeRef>> vecRanked;
+    // Rank (1-based position in vecRanked) indexed by collateral outpoint
+    std::map<COutPoint, int> mapRanks;
+    // All the known masternodes ordered by score (not enabled/valid ones have score 9999)
+    std::vector<std::pair<int64_t, MasternodeRef>> vecAll;
+    // Eligibility flags of the legacy masternodes the table was built with (see GetLegacyRankState)
+    std::vector<std::pair<COutPoint, uint8_t>> vLegacyState;
+};
+
+typedef std::shared_ptr<const CMasternodeRankTable> MasternodeRankTableRef;
+
 class CMasternodeMan
 {
 private:
@@ -78,11 +106,31 @@ private:
     // Memory Only. Cache last block hashes. Used to verify mn pings and winners.
     CyclingVector<uint256> cvLastBlockHashes;
 
+    // Memory Only. Rank tables indexed by (block hash, min protocol), for the current chain tip.
+    // Cleared when the tip, or the masternode list, changes. Rebuilt when the legacy masternodes state changes.
+    mutable Mutex cs_rank_cache;
+    mutable std::map<std::pair<uint256, int>, MasternodeRankTableRef> mapRankTables;
+    mutable std::list<std::pair<uint256, int>> listRankTablesOrder;
+    mutable uint256 rankCacheTip;
+
+    // Eligibility flags (enabled, protocol, age) of the legacy masternodes. Their state changes
+    // with pings, spent collaterals, ... and with time: a cached table is only valid for the same state.
+    std::vector<std::pair<COutPoint, uint8_t>> GetLegacyRankState(int minProtocol) const;
+    // Compute the rank table for the given hash (without caching it)
+    MasternodeRankTableRef BuildRankTable(const uint256& hash, int minProtocol, const CDeterministicMNList& mnList) const;
+    // Return the (cached) rank table for the given hash
+    MasternodeRankTableRef GetRankTable(const uint256& hash) const;
+
     // Return the banning score (0 if no ban score increase is needed).
     int ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb);
     int ProcessMNPing(CNode* pfrom, CMasternodePing& mnp);
     int ProcessMessageInner(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
+    // Last paid time / seconds since payment, looking back at most nMaxDepth blocks from BlockReading.
+    // tieBreakHash is the deterministic hash of the masternode (see GetPaymentTieBreakHash).
+    int64_t GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading, int nMaxDepth, const arith_uint256& tieBreakHash) const;
+    int64_t SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading, int nMaxDepth) const;
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -151,6 +199,9 @@ public:
     std::vector<std::pair<int64_t, MasternodeRef>> GetMasternodeRanks(int nBlockHeight) const;
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) const;
 
+    /// Invalidate the cached rank tables (called when the chain tip, or the masternode list, changes)
+    void ClearRankCache();
+
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     // Process GETMNLIST message, returning the banning score (if 0, no ban score increase is needed)
@@ -3,15 +3,105 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "messagesigner.h"
+
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "hash.h"
 #include "key_io.h"
-#include "messagesigner.h"
+#include "random.h"
+#include "script/sigcache.h"
 #include "tinyformat.h"
 #include "util/system.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
+#include <boost/thread/shared_mutex.hpp>
+
 const std::string strMessageMagic = "DarkNet Signed Message:\n";
 
+namespace {
+/**
+ * Valid message signature cache. Masternode broadcasts, pings, payment votes,
+ * budget votes and sporks are received many times (from every peer, and again
+ * during each sync), and each verification recovers the public key from the
+ * compact signature. Only successful verifications are stored, and entries
+ * are not erased when hit, as the same message keeps being relayed.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || message hash || key id || signature):
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_msgsigcache;
+    size_t nMaxElements{0};
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+
+public:
+    CMessageSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        // not sized yet (binaries that never call InitMessageSignatureCache)
+        if (nMaxElements == 0) return false;
+        const bool found = setValid.contains(entry, false);
+        (found ? nHits : nMisses)++;
+        return found;
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        if (nMaxElements == 0) return;
+        setValid.insert(entry);
+    }
+
+    size_t setup_bytes(size_t n)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        nMaxElements = setValid.setup_bytes(n);
+        return nMaxElements;
+    }
+
+    MessageSigCacheStats GetStats() const
+    {
+        MessageSigCacheStats stats;
+        stats.nMaxElements = nMaxElements;
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        return stats;
+    }
+};
+
+static CMessageSignatureCache messageSignatureCache;
+}
+
+void InitMessageSignatureCache()
+{
+    // If -maxmsgsigcachesize is set to zero, setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxmsgsigcachesize", DEFAULT_MAX_MSG_SIG_CACHE_SIZE)), MAX_MAX_MSG_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = messageSignatureCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for message signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+MessageSigCacheStats GetMessageSignatureCacheStats()
+{
+    return messageSignatureCache.GetStats();
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string& strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     keyRet = KeyIO::DecodeSecret(strSecret);
@@ -67,6 +157,12 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey& pubkey, const s
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, keyID, vchSig);
+    if (messageSignatureCache.Get(entry)) {
+        return true;
+    }
+
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
@@ -80,6 +176,7 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std
         return false;
     }
 
+    messageSignatureCache.Set(entry);
     return true;
 }
 
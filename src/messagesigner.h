@@ -11,6 +11,21 @@
 
 extern const std::string strMessageMagic;
 
+//! Default and maximum size (in MiB) of the cache of verified message signatures
+static const unsigned int DEFAULT_MAX_MSG_SIG_CACHE_SIZE = 4;
+static const int64_t MAX_MAX_MSG_SIG_CACHE_SIZE = 1024;
+
+/** Counters of the cache of verified message signatures */
+struct MessageSigCacheStats {
+    size_t nMaxElements{0};
+    uint64_t nHits{0};
+    uint64_t nMisses{0};
+};
+
+/** To be called once in AppInitMain/BasicTestingSetup to size the cache of verified message signatures */
+void InitMessageSignatureCache();
+MessageSigCacheStats GetMessageSignatureCacheStats();
+
 enum MessageVersion {
         MESS_VER_STRMESS    = 0, // old format
         MESS_VER_HASH       = 1,
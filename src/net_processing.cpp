@@ -6,9 +6,11 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
 #include "budget/budgetmanager.h"
 #include "chain.h"
 #include "evo/deterministicmns.h"
+#include "index/blockfilterindex.h"
 #include "masternodeman.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
@@ -46,6 +48,25 @@ std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_c
 
 void EraseOrphansFor(NodeId peer);
 
+/**
+ * Blocks downloaded ahead of their parent (parallel download of the window),
+ * with the peer they came from, waiting to be processed in chain order.
+ * Bounded by MAX_UNCONNECTED_BLOCKS_SIZE, expired after UNCONNECTED_BLOCK_EXPIRE_TIME.
+ */
+struct CUnconnectedBlock {
+    // When modifying, adapt the copy of this definition in tests/DoS_tests.
+    std::shared_ptr<const CBlock> block;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nSize;
+};
+std::map<uint256, CUnconnectedBlock> mapUnconnectedBlocks GUARDED_BY(cs_main);
+std::multimap<uint256, uint256> mapUnconnectedBlocksByPrev GUARDED_BY(cs_main);
+size_t nUnconnectedBlocksSize GUARDED_BY(cs_main) = 0;
+int64_t nNextUnconnectedBlockExpire GUARDED_BY(cs_main) = std::numeric_limits<int64_t>::max();
+
+unsigned int EraseUnconnectedBlocksFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 // Internal stuff
 namespace {
 
@@ -88,6 +109,7 @@ struct QueuedBlock {
     int64_t nTime;              //! Time of "getdata" request in microseconds.
     int nValidatedQueuedBefore; //! Number of blocks queued with validated headers (globally) at the time this one is requested.
     bool fValidatedHeaders;     //! Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock; //! Optional, the compact block waiting for its missing transactions.
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -97,6 +119,19 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/** Outbound peers asked to announce the new blocks with a cmpctblock message (high bandwidth mode). Protected by cs_main. */
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+/**
+ * The most recent block connected, and its compact version, used to announce
+ * it to the peers and to answer their cmpctblock and getblocktxn requests
+ * without reading it back from disk.
+ */
+Mutex cs_most_recent_block;
+std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+
 } // anon namespace
 
 namespace
@@ -217,6 +252,23 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants the new blocks announced with a cmpctblock message.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer can give us compact blocks (it sent a sendcmpct with a version we support).
+    bool fProvidesHeaderAndIDs;
+    //! The best header we have sent this peer.
+    const CBlockIndex* pindexBestHeaderSent;
+    //! Whether this peer wants the new blocks announced with a headers message.
+    bool fPreferHeaders;
+    //! Length of the current streak of unconnecting headers announcements.
+    int nUnconnectingHeaders;
+    //! When the headers sync started with this peer must be done (in microseconds).
+    int64_t nHeadersSyncTimeout;
+    //! Last header accepted from this peer, when its headers got too far ahead of the active chain
+    //! (the headers sync resumes from it once the blocks are connected).
+    const CBlockIndex* pindexHeadersAhead;
+    //! Number of headers received from this peer, since the last ones extending our best header chain.
+    int nForkHeaders;
 
     CNodeBlocks nodeBlocks;
 
@@ -231,6 +283,14 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
+        pindexBestHeaderSent = nullptr;
+        fPreferHeaders = false;
+        nUnconnectingHeaders = 0;
+        nHeadersSyncTimeout = 0;
+        pindexHeadersAhead = nullptr;
+        nForkHeaders = 0;
     }
 };
 
@@ -290,8 +350,8 @@ void MarkBlockAsReceived(const uint256& hash)
     }
 }
 
-// Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
+// Requires cs_main. Returns the entry of the block in the peer's queue.
+std::list<QueuedBlock>::iterator MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
 {
     CNodeState* state = State(nodeid);
     assert(state != NULL);
@@ -299,11 +359,12 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL};
+    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL, nullptr};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), std::move(newentry));
     state->nBlocksInFlight++;
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    return it;
 }
 
 /** Check whether the last unknown block a peer advertised is not yet known. */
@@ -341,6 +402,22 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256& hash)
     }
 }
 
+/** Whether the peer is known to have the header of the block (it announced it, or we sent it) */
+bool PeerHasHeader(const CNodeState* state, const CBlockIndex* pindex)
+{
+    if (state->pindexBestKnownBlock && pindex == state->pindexBestKnownBlock->GetAncestor(pindex->nHeight))
+        return true;
+    if (state->pindexBestHeaderSent && pindex == state->pindexBestHeaderSent->GetAncestor(pindex->nHeight))
+        return true;
+    return false;
+}
+
+/** Whether we are close enough to the tip of the network to download the announced blocks directly */
+bool CanDirectFetch()
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().GetConsensus().nTargetSpacing * 20;
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller)
@@ -403,8 +480,16 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (mapUnconnectedBlocks.count(pindex->GetBlockHash())) {
+                // Already downloaded, waiting for its parent.
+                continue;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
+                if (nUnconnectedBlocksSize + MAX_BLOCK_SIZE_CURRENT > MAX_UNCONNECTED_BLOCKS_SIZE &&
+                        !(pindex->pprev->nStatus & BLOCK_HAVE_DATA)) {
+                    // No room to keep it until its parent is stored: fetch it later.
+                    continue;
+                }
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
@@ -452,10 +537,14 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         fUpdateConnectionTime = true;
     }
 
-    for (const QueuedBlock& entry : state->vBlocksInFlight)
+    for (const QueuedBlock& entry : state->vBlocksInFlight) {
+        nQueuedValidatedHeaders -= entry.fValidatedHeaders;
         mapBlocksInFlight.erase(entry.hash);
+    }
     EraseOrphansFor(nodeid);
+    EraseUnconnectedBlocksFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -591,6 +680,96 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
     return nEvicted;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// mapUnconnectedBlocks
+//
+
+static void EraseUnconnectedBlock(std::map<uint256, CUnconnectedBlock>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto range = mapUnconnectedBlocksByPrev.equal_range(it->second.block->hashPrevBlock);
+    for (auto itPrev = range.first; itPrev != range.second; ++itPrev) {
+        if (itPrev->second == it->first) {
+            mapUnconnectedBlocksByPrev.erase(itPrev);
+            break;
+        }
+    }
+    nUnconnectedBlocksSize -= it->second.nSize;
+    mapUnconnectedBlocks.erase(it);
+}
+
+unsigned int ExpireUnconnectedBlocks(int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (nNow < nNextUnconnectedBlockExpire) return 0;
+    unsigned int nErased = 0;
+    nNextUnconnectedBlockExpire = std::numeric_limits<int64_t>::max();
+    auto iter = mapUnconnectedBlocks.begin();
+    while (iter != mapUnconnectedBlocks.end()) {
+        auto maybeErase = iter++;
+        if (maybeErase->second.nTimeExpire <= nNow) {
+            EraseUnconnectedBlock(maybeErase);
+            nErased++;
+        } else {
+            nNextUnconnectedBlockExpire = std::min(maybeErase->second.nTimeExpire, nNextUnconnectedBlockExpire);
+        }
+    }
+    if (nErased > 0) LogPrint(BCLog::NET, "Erased %d blocks downloaded ahead of their parent due to expiration\n", nErased);
+    return nErased;
+}
+
+bool AddUnconnectedBlock(const std::shared_ptr<const CBlock>& pblock, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const uint256& hash = pblock->GetHash();
+    if (mapUnconnectedBlocks.count(hash))
+        return false;
+
+    const int64_t nNow = GetTime();
+    ExpireUnconnectedBlocks(nNow);
+    const size_t nSize = ::GetSerializeSize(*pblock, PROTOCOL_VERSION);
+    if (nUnconnectedBlocksSize + nSize > MAX_UNCONNECTED_BLOCKS_SIZE) {
+        LogPrint(BCLog::NET, "not keeping block %s ahead of its parent (size %u, buffered %u), peer=%d\n", hash.ToString(), nSize, nUnconnectedBlocksSize, peer);
+        return false;
+    }
+
+    const int64_t nTimeExpire = nNow + UNCONNECTED_BLOCK_EXPIRE_TIME;
+    mapUnconnectedBlocks.emplace(hash, CUnconnectedBlock{pblock, peer, nTimeExpire, nSize});
+    mapUnconnectedBlocksByPrev.emplace(pblock->hashPrevBlock, hash);
+    nUnconnectedBlocksSize += nSize;
+    nNextUnconnectedBlockExpire = std::min(nTimeExpire, nNextUnconnectedBlockExpire);
+    return true;
+}
+
+unsigned int EraseUnconnectedBlocksFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    unsigned int nErased = 0;
+    auto iter = mapUnconnectedBlocks.begin();
+    while (iter != mapUnconnectedBlocks.end()) {
+        auto maybeErase = iter++;
+        if (maybeErase->second.fromPeer == peer) {
+            EraseUnconnectedBlock(maybeErase);
+            nErased++;
+        }
+    }
+    if (nErased > 0) LogPrint(BCLog::NET, "Erased %d blocks downloaded ahead of their parent from peer=%d\n", nErased, peer);
+    return nErased;
+}
+
+/** Erase the blocks waiting for hashParent, and the ones waiting for them, recursively */
+unsigned int EraseUnconnectedDescendants(const uint256& hashParent) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    unsigned int nErased = 0;
+    auto range = mapUnconnectedBlocksByPrev.equal_range(hashParent);
+    std::vector<uint256> vChildren;
+    for (auto it = range.first; it != range.second; ++it) {
+        vChildren.emplace_back(it->second);
+    }
+    for (const uint256& hashChild : vChildren) {
+        EraseUnconnectedBlock(mapUnconnectedBlocks.find(hashChild));
+        nErased += 1 + EraseUnconnectedDescendants(hashChild);
+    }
+    return nErased;
+}
+
 // Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
@@ -628,6 +807,15 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) :
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
+    // Keep the compact version of the new block at hand, to announce it (no need during IBD)
+    if (!IsInitialBlockDownload()) {
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
+        LOCK(cs_most_recent_block);
+        most_recent_block_hash = pindex->GetBlockHash();
+        most_recent_block = pblock;
+        most_recent_compact_block = pcmpctblock;
+    }
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -664,9 +852,52 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CB
 
     if (!fInitialDownload) {
         const uint256& hashNewTip = pindexNew->GetBlockHash();
+        // When the new tip extends the previous one, the peers in high bandwidth
+        // mode get its cmpctblock directly, instead of an inv.
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+        if (pindexNew->pprev == pindexFork) {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == hashNewTip)
+                pcmpctblock = most_recent_compact_block;
+        }
         // Relay inventory, but don't relay old inventory during initial block download.
-        connman->ForEachNode([nNewHeight, hashNewTip](CNode* pnode) {
-            if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
+        LOCK(cs_main);
+        // The new blocks, announced with their headers to the peers that prefer so
+        // (only an inv of the tip after a long reorg)
+        std::vector<CBlock> vHeaders;
+        for (const CBlockIndex* pindex = pindexNew; pindex != pindexFork && pindex; pindex = pindex->pprev) {
+            if (vHeaders.size() == MAX_BLOCKS_TO_ANNOUNCE) {
+                vHeaders.clear();
+                break;
+            }
+            vHeaders.emplace_back(pindex->GetBlockHeader());
+        }
+        std::reverse(vHeaders.begin(), vHeaders.end());
+        connman->ForEachNode([this, nNewHeight, pindexNew, &hashNewTip, &pcmpctblock, &vHeaders](CNode* pnode) {
+            if (nNewHeight <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
+                return;
+            }
+            CNodeState* state = State(pnode->GetId());
+            if (pcmpctblock && state && state->fPreferHeaderAndIDs) {
+                if (WITH_LOCK(pnode->cs_inventory, return pnode->filterInventoryKnown.contains(hashNewTip))) {
+                    // We got it from this peer
+                    return;
+                }
+                LogPrint(BCLog::NET, "sending cmpctblock %s to peer=%d\n", hashNewTip.ToString(), pnode->GetId());
+                pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+                connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            } else if (!vHeaders.empty() && state && state->fPreferHeaders &&
+                       mapBlockIndex.count(vHeaders.front().hashPrevBlock) &&
+                       PeerHasHeader(state, mapBlockIndex[vHeaders.front().hashPrevBlock])) {
+                if (PeerHasHeader(state, pindexNew)) {
+                    // It announced the tip to us
+                    return;
+                }
+                LogPrint(BCLog::NET, "sending %u headers (up to %s) to peer=%d\n", vHeaders.size(), hashNewTip.ToString(), pnode->GetId());
+                state->pindexBestHeaderSent = pindexNew;
+                pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+                connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::HEADERS, vHeaders));
+            } else {
                 pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
             }
         });
@@ -897,6 +1128,17 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
     return false;
 }
 
+// To prevent fingerprinting attacks, only send blocks outside of the active
+// chain if they are valid, and no more than a max reorg depth than the best header
+// chain we know about.
+static bool BlockRequestAllowed(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Contains(pindex)) return true;
+    return pindex->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != nullptr) &&
+           (chainActive.Height() - pindex->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LOCK(cs_main);
@@ -905,29 +1147,49 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
     bool send = false;
     BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
     if (mi != mapBlockIndex.end()) {
-        if (chainActive.Contains(mi->second)) {
-            send = true;
-        } else {
-            // To prevent fingerprinting attacks, only send blocks outside of the active
-            // chain if they are valid, and no more than a max reorg depth than the best header
-            // chain we know about.
-            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                   (chainActive.Height() - mi->second->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
-            if (!send) {
-                LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
-            }
+        send = BlockRequestAllowed(mi->second);
+        if (!send) {
+            LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
         }
     }
     // Don't send not-validated blocks
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+        // Blocks deep in the chain are sent in full, even when requested as compact blocks:
+        // the peer would have to request most of their transactions anyway.
+        const bool fSendCmpct = inv.type == MSG_CMPCT_BLOCK && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
         // Send block from disk
-        CBlock block;
-        if (!ReadBlockFromDisk(block, (*mi).second))
-            assert(!"cannot load block from disk");
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-        else // MSG_FILTERED_BLOCK)
+        if (inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fSendCmpct)) {
+            // Serve the stored bytes directly
+            const auto& rawBlock = GetRawBlock((*mi).second);
+            if (rawBlock) {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(*rawBlock)));
+            } else {
+                // Not stored as expected (e.g. no size prefix): read and serialize the block
+                LogPrint(BCLog::NET, "%s: cannot read the raw block %s, deserializing it\n", __func__, inv.hash.ToString());
+                CBlock block;
+                if (!ReadBlockFromDisk(block, (*mi).second))
+                    assert(!"cannot load block from disk");
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+            }
+        } else if (fSendCmpct) {
+            std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+            {
+                LOCK(cs_most_recent_block);
+                if (most_recent_block_hash == inv.hash)
+                    pcmpctblock = most_recent_compact_block;
+            }
+            if (!pcmpctblock) {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, (*mi).second))
+                    assert(!"cannot load block from disk");
+                pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs>(block);
+            }
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+        } else // MSG_FILTERED_BLOCK)
         {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, (*mi).second))
+                assert(!"cannot load block from disk");
             bool send_ = false;
             CMerkleBlock merkleBlock;
             {
@@ -1027,7 +1289,7 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
     if (it != pfrom->vRecvGetData.end()) {
         const CInv &inv = *it;
         it++;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
     }
@@ -1080,6 +1342,316 @@ static void CheckBlockSpam(CValidationState& state, CNode* pfrom, const uint256&
     }
 }
 
+/**
+ * Process the blocks downloaded ahead of hashParent, now that it is stored, and their descendants.
+ * If hashParent is invalid (fParentInvalid, or marked as failed), its descendants are dropped.
+ */
+void ProcessUnconnectedBlocks(const uint256& hashParent, bool fParentInvalid)
+{
+    std::deque<std::pair<uint256, bool>> queue{{hashParent, fParentInvalid}};
+    while (!queue.empty()) {
+        const uint256 hash = queue.front().first;
+        const bool fInvalid = queue.front().second;
+        queue.pop_front();
+        std::vector<CUnconnectedBlock> vChildren;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_FAILED_MASK) ||
+                    (fInvalid && !(mi->second->nStatus & BLOCK_HAVE_DATA))) {
+                // Invalid: its descendants can't be connected
+                unsigned int nErased = EraseUnconnectedDescendants(hash);
+                if (nErased > 0) LogPrint(BCLog::NET, "Erased %d blocks downloaded ahead of invalid block %s\n", nErased, hash.ToString());
+                continue;
+            }
+            if (!(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                // Not stored (failed to be written): its children keep waiting
+                continue;
+            }
+            auto range = mapUnconnectedBlocksByPrev.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                auto itBlock = mapUnconnectedBlocks.find(it->second);
+                nUnconnectedBlocksSize -= itBlock->second.nSize;
+                vChildren.emplace_back(std::move(itBlock->second));
+                mapUnconnectedBlocks.erase(itBlock);
+            }
+            mapUnconnectedBlocksByPrev.erase(range.first, range.second);
+        }
+
+        for (const CUnconnectedBlock& child : vChildren) {
+            const uint256& hashBlock = child.block->GetHash();
+            WITH_LOCK(cs_main, mapBlockSource.emplace(hashBlock, child.fromPeer); );
+            CValidationState state;
+            ProcessNewBlock(state, child.block, nullptr);
+
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                // The peer may be gone: reject and punish it asynchronously, if not
+                LOCK(cs_main);
+                CNodeState* nodestate = State(child.fromPeer);
+                if (nodestate) {
+                    assert(state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+                    nodestate->rejects.push_back({(unsigned char)state.GetRejectCode(), state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hashBlock});
+                    if (nDoS > 0)
+                        Misbehaving(child.fromPeer, nDoS);
+                }
+            }
+            queue.emplace_back(hashBlock, state.IsInvalid());
+        }
+    }
+}
+
+/** Process a block received from a peer (in full, or rebuilt from a cmpctblock), whose parent header we have */
+static void ProcessReceivedBlock(CNode* pfrom, const std::shared_ptr<const CBlock>& pblock, CConnman* connman)
+{
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const uint256& hashBlock = pblock->GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+    pfrom->AddInventoryKnown(inv);
+    CValidationState state;
+    bool fHaveBlock;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        fHaveBlock = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+        BlockMap::iterator miPrev = mapBlockIndex.find(pblock->hashPrevBlock);
+        if (!fHaveBlock && miPrev != mapBlockIndex.end() && !(miPrev->second->nStatus & BLOCK_HAVE_DATA)) {
+            // Downloaded ahead of its parent: keep it (if we asked this peer for it) until the parent is stored
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId()) {
+                MarkBlockAsReceived(hashBlock);
+                if (AddUnconnectedBlock(pblock, pfrom->GetId())) {
+                    LogPrint(BCLog::NET, "%s : block %s received ahead of its parent, peer=%d\n", __func__, hashBlock.GetHex(), pfrom->GetId());
+                }
+            } else {
+                LogPrint(BCLog::NET, "%s : unrequested block %s ahead of its parent, peer=%d\n", __func__, hashBlock.GetHex(), pfrom->GetId());
+            }
+            return;
+        }
+    }
+    if (!fHaveBlock) {
+        {
+            LOCK(cs_main);
+            MarkBlockAsReceived(hashBlock);
+            mapBlockSource.emplace(hashBlock, pfrom->GetId());
+        }
+        bool fAccepted = true;
+        ProcessNewBlock(state, pblock, nullptr, &fAccepted);
+        if (!fAccepted) {
+            CheckBlockSpam(state, pfrom, hashBlock);
+        }
+        int nDoS;
+        if(state.IsInvalid(nDoS)) {
+            assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, std::string(NetMsgType::BLOCK), state.GetRejectCode(),
+                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+            if(nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+        //disconnect this node if its old protocol version
+        pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), NetMsgType::BLOCK);
+        ProcessUnconnectedBlocks(hashBlock, state.IsInvalid());
+    } else {
+        LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, hashBlock.GetHex());
+    }
+}
+
+/** Answer a getblocktxn message with the requested transactions of the block */
+static void SendBlockTransactions(const CBlock& block, const BlockTransactionsRequest& req, CNode* pfrom, CConnman* connman)
+{
+    BlockTransactions resp(req);
+    for (size_t i = 0; i < req.indexes.size(); i++) {
+        if (req.indexes[i] >= block.vtx.size()) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->GetId());
+            return;
+        }
+        resp.txn[i] = block.vtx[req.indexes[i]];
+    }
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::BLOCKTXN, resp));
+}
+
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index, BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(stop_hash);
+        stop_index = mi != mapBlockIndex.end() ? mi->second : nullptr;
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with "
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/** Answer a getcfilters request with a cfilter message for each block of the range */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/** Answer a getcfheaders request with the filter header of the block before the range and the filter hashes of the range */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFHEADERS,
+                         filter_type_ser,
+                         stop_index->GetBlockHash(),
+                         prev_header,
+                         filter_hashes));
+}
+
+/** Answer a getcfcheckpt request with the filter headers of every CFCHECKPT_INTERVAL-th block up to the stop block */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFCHECKPT,
+                         filter_type_ser,
+                         stop_index->GetBlockHash(),
+                         headers));
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, std::atomic<bool>& interruptMsgProc)
 {
@@ -1276,6 +1848,25 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
                   (fLogIPs ? strprintf(", peeraddr=%s", pfrom->addr.ToString()) : ""));
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to receive compact blocks, and ask the first
+            // outbound peers to announce the new blocks with them (high bandwidth mode).
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            if (!pfrom->fInbound) {
+                LOCK(cs_main);
+                if (lNodesAnnouncingHeaderAndIDs.size() < MAX_CMPCTBLOCK_HB_PEERS) {
+                    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+                    fAnnounceUsingCMPCTBLOCK = true;
+                }
+            }
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, CMPCTBLOCKS_VERSION));
+        }
+
+        if (pfrom->nVersion >= SENDHEADERS_VERSION) {
+            // Tell our peer we prefer to receive the new blocks announced with their headers
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
+        }
     }
 
 
@@ -1360,14 +1951,31 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    if (pfrom->nVersion >= SENDHEADERS_VERSION) {
+                        // First request the headers preceding the announced block (none, in the normal
+                        // case of a block extending our tip), so that when the block arrives the header
+                        // chain leading to it is already validated. Then, only when we are close to be
+                        // synced, request the block itself directly (the download window gets it otherwise).
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
+                        if (CanDirectFetch() && State(pfrom->GetId())->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                            vToFetch.push_back(inv);
+                            MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        }
+                        LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(inv);
+                        LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
                 }
             }
 
         }
 
+        // A new block announcement from a peer that provides compact blocks: ask for the cmpctblock
+        if (vToFetch.size() == 1 && State(pfrom->GetId())->fProvidesHeaderAndIDs && !IsInitialBlockDownload())
+            vToFetch[0].type = MSG_CMPCT_BLOCK;
+
         if (!vToFetch.empty())
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
     }
@@ -1393,7 +2001,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::GETBLOCKS || strCommand == NetMsgType::GETHEADERS) {
+    else if (strCommand == NetMsgType::GETBLOCKS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -1431,22 +2039,21 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         if (locator.vHave.size() > MAX_LOCATOR_SZ) {
-            LogPrint(BCLog::NET, "getblocks locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
+            LogPrint(BCLog::NET, "getheaders locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
             pfrom->fDisconnect = true;
             return true;
         }
 
         LOCK(cs_main);
 
-        if (IsInitialBlockDownload())
-            return true;
-
+        // Served during initial block download too (like getblocks): the peer syncs
+        // the headers from several peers, and downloads the blocks from all of them.
         CBlockIndex* pindex = NULL;
         if (locator.IsNull()) {
             // If locator is null, return the hashStop block
@@ -1464,16 +2071,27 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
+        // pindex can be nullptr either if we sent chainActive.Tip() OR
+        // if our peer has chainActive.Tip() (and thus we are sending an empty
+        // headers message). In both cases it's safe to update
+        // pindexBestHeaderSent to be our tip.
+        State(pfrom->GetId())->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
     }
 
 
+    else if (strCommand == NetMsgType::SENDHEADERS) {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferHeaders = true;
+    }
+
+
     else if (strCommand == NetMsgType::TX) {
         std::deque<COutPoint> vWorkQueue;
         std::vector<uint256> vEraseQueue;
@@ -1627,7 +2245,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
     }
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -1644,44 +2262,122 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = NULL;
-        for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
-                Misbehaving(pfrom->GetId(), 20);
-                return error("non-continuous headers sequence");
+
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!mapBlockIndex.count(headers[0].hashPrevBlock) && nCount < MAX_BLOCKS_TO_ANNOUNCE) {
+                // An announcement that doesn't connect (the peer is ahead of us, or it reorganized):
+                // ask for the headers leading to it.
+                nodestate->nUnconnectingHeaders++;
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+                LogPrint(BCLog::NET, "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
+                        headers[0].GetHash().ToString(), headers[0].hashPrevBlock.ToString(), pindexBestHeader->nHeight, pfrom->GetId(), nodestate->nUnconnectingHeaders);
+                // Set hashLastUnknownBlock for this peer, so that if we eventually get the headers
+                // (even from a different peer) we can use this peer to download.
+                UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+                if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0)
+                    Misbehaving(pfrom->GetId(), 20);
+                return true;
             }
+        }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0)
-                        Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
-                    return error(strError.c_str());
+        CValidationState state;
+        CBlockIndex* pindexLast = nullptr;
+        if (!ProcessNewBlockHeaders(headers, state, &pindexLast)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                LOCK(cs_main);
+                if (nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS);
+                } else if (state.GetRejectReason() == "too-little-chainwork") {
+                    // Not worth storing (we can't check their proof-of-stake yet): tolerated as the unconnecting ones
+                    CNodeState* nodestate = State(pfrom->GetId());
+                    if (++nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0)
+                        Misbehaving(pfrom->GetId(), 20);
                 }
+                return error("invalid header received from peer=%d: %s", pfrom->GetId(), FormatStateMessage(state));
             }
         }
 
-        if (pindexLast)
-            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
+        nodestate->nUnconnectingHeaders = 0;
+        const bool fHeadersAhead = !pindexLast || pindexLast->GetBlockHash() != headers.back().GetHash();
+        if (fHeadersAhead) {
+            // The rest of the headers is too far ahead of the active chain: resume when its blocks are connected
+            nodestate->pindexHeadersAhead = pindexLast ? pindexLast : mapBlockIndex.at(headers[0].hashPrevBlock);
+            LogPrint(BCLog::NET, "headers from peer=%d too far ahead of the active chain (%d), waiting for the blocks\n",
+                     pfrom->GetId(), chainActive.Height());
+        }
+        if (!pindexLast)
+            return true;
+        UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        // Limit the headers leading to chains that aren't our best one (we can't check their proof-of-stake
+        // until we download the blocks), so that a peer can't fill the block index with many forks.
+        if (pindexBestHeader->GetAncestor(pindexLast->nHeight) != pindexLast) {
+            nodestate->nForkHeaders += nCount;
+            if (nodestate->nForkHeaders > MAX_POS_HEADERS_AHEAD) {
+                Misbehaving(pfrom->GetId(), 20);
+                nodestate->nForkHeaders = 0;
+            }
+        } else {
+            nodestate->nForkHeaders = 0;
+        }
+
+        if (nCount == MAX_HEADERS_RESULTS && !fHeadersAhead) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), UINT256_ZERO));
         }
+
+        // A new block announced with its header (or a few): if we are close to the tip, download it now,
+        // from this peer, instead of waiting for the download window.
+        if (pindexLast->IsValid(BLOCK_VALID_TREE) && chainActive.Tip()->nChainWork <= pindexLast->nChainWork &&
+                (CanDirectFetch() || pindexLast->nHeight - chainActive.Height() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER)) {
+            std::vector<const CBlockIndex*> vToFetch;
+            const CBlockIndex* pindexWalk = pindexLast;
+            // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) && !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
+                        !mapUnconnectedBlocks.count(pindexWalk->GetBlockHash())) {
+                    // We don't have this block, and it's not yet in flight.
+                    vToFetch.push_back(pindexWalk);
+                }
+                pindexWalk = pindexWalk->pprev;
+            }
+            // If pindexWalk still isn't on our main chain, we're looking at a
+            // very large reorg at a time we think we're close to caught up to
+            // the main chain -- this shouldn't really happen. Bail out on the
+            // direct fetch and rely on parallel download instead.
+            if (!chainActive.Contains(pindexWalk)) {
+                LogPrint(BCLog::NET, "Large reorg, won't direct fetch to %s (%d)\n", pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
+            } else {
+                std::vector<CInv> vGetData;
+                // Download as much as possible, from earliest to latest.
+                for (auto it = vToFetch.rbegin(); it != vToFetch.rend(); ++it) {
+                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                        // Can't download any more from this peer
+                        break;
+                    }
+                    vGetData.emplace_back(MSG_BLOCK, (*it)->GetBlockHash());
+                    MarkBlockAsInFlight(pfrom->GetId(), (*it)->GetBlockHash(), *it);
+                    LogPrint(BCLog::NET, "Requesting block %s from peer=%d\n", (*it)->GetBlockHash().ToString(), pfrom->id);
+                }
+                // Just the new tip: ask for its cmpctblock
+                if (vGetData.size() == 1 && nodestate->fProvidesHeaderAndIDs && pindexLast->pprev == chainActive.Tip())
+                    vGetData[0].type = MSG_CMPCT_BLOCK;
+                if (!vGetData.empty())
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+            }
+        }
     }
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
@@ -1692,8 +2388,17 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         CInv inv(MSG_BLOCK, hashBlock);
         LogPrint(BCLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
-        // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
+        const bool fHavePrevHeader = WITH_LOCK(cs_main, return mapBlockIndex.count(pblock->hashPrevBlock) > 0;);
+        if (!fHavePrevHeader && pfrom->nVersion >= SENDHEADERS_VERSION) {
+            // A block that doesn't connect to our headers: get the headers leading to it first
+            // (the download window requests it again then)
+            LOCK(cs_main);
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId())
+                MarkBlockAsReceived(hashBlock);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hashBlock));
+        } else if (!fHavePrevHeader) {
+            // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
             CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 // we already asked for this block, so lets work backwards and ask for the previous block
@@ -1705,35 +2410,207 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 pfrom->vBlockRequested.emplace_back(hashBlock);
             }
         } else {
-            pfrom->AddInventoryKnown(inv);
-            CValidationState state;
-            if (!mapBlockIndex.count(hashBlock)) {
-                {
-                    LOCK(cs_main);
-                    MarkBlockAsReceived(hashBlock);
-                    mapBlockSource.emplace(hashBlock, pfrom->GetId());
-                }
-                bool fAccepted = true;
-                ProcessNewBlock(state, pblock, nullptr, &fAccepted);
-                if (!fAccepted) {
-                    CheckBlockSpam(state, pfrom, hashBlock);
-                }
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
-            } else {
-                LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, pblock->GetHash().GetHex());
+            ProcessReceivedBlock(pfrom, pblock, connman);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState* state = State(pfrom->GetId());
+            state->fProvidesHeaderAndIDs = true;
+            state->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256& hashBlock = cmpctblock.header.GetHash();
+        LogPrint(BCLog::NET, "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->GetId());
+
+        const std::vector<CInv> vGetBlock{CInv(MSG_BLOCK, hashBlock)};
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                // Already have it
+                return true;
+            }
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && (itInFlight->second.first != pfrom->GetId() || itInFlight->second.second->partialBlock)) {
+                // Being downloaded from another peer, or being rebuilt already
+                return true;
+            }
+            BlockMap::iterator miPrev = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+            if (miPrev == mapBlockIndex.end() || !(miPrev->second->nStatus & BLOCK_HAVE_DATA) || IsInitialBlockDownload()) {
+                // We can't connect it now: go through the full block path (which syncs us to it)
+                if (itInFlight == mapBlocksInFlight.end() && miPrev != mapBlockIndex.end())
+                    MarkBlockAsInFlight(pfrom->GetId(), hashBlock, mi != mapBlockIndex.end() ? mi->second : nullptr);
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetBlock));
+                return true;
+            }
+        }
+        pfrom->AddInventoryKnown(vGetBlock[0]);
+
+        // Accept the header first (a cmpctblock pushed to us in high bandwidth mode is its announcement)
+        CValidationState state;
+        CBlockIndex* pindex = nullptr;
+        if (!ProcessNewBlockHeaders({cmpctblock.header}, state, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                LOCK(cs_main);
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->GetId());
+            }
+            return true;
+        }
+        WITH_LOCK(cs_main, UpdateBlockAvailability(pfrom->GetId(), hashBlock); );
+
+        // Look for the transactions in the mempool, and in the orphan pool
+        std::vector<std::pair<uint256, CTransactionRef>> vExtraTxn;
+        {
+            LOCK(g_cs_orphans);
+            vExtraTxn.reserve(mapOrphanTransactions.size());
+            for (const auto& it : mapOrphanTransactions) {
+                vExtraTxn.emplace_back(it.first, it.second.tx);
+            }
+        }
+        std::unique_ptr<PartiallyDownloadedBlock> partialBlock = MakeUnique<PartiallyDownloadedBlock>(&mempool);
+        ReadStatus status = partialBlock->InitData(cmpctblock, vExtraTxn);
+        if (status == READ_STATUS_INVALID) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            LogPrintf("Peer %d sent us invalid compact block\n", pfrom->GetId());
+            return true;
+        } else if (status == READ_STATUS_FAILED) {
+            // Short ID collision, just get the full block
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetBlock));
+            return true;
+        }
+
+        BlockTransactionsRequest req;
+        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+            if (!partialBlock->IsTxAvailable(i))
+                req.indexes.push_back(i);
+        }
+        if (!req.indexes.empty()) {
+            // Wait for the missing transactions (the block is in flight from this peer until then)
+            req.blockhash = hashBlock;
+            {
+                LOCK(cs_main);
+                MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex)->partialBlock = std::move(partialBlock);
+            }
+            LogPrint(BCLog::NET, "requesting %u missing transactions of cmpctblock %s peer=%d\n", req.indexes.size(), hashBlock.ToString(), pfrom->GetId());
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+            return true;
+        }
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        status = partialBlock->FillBlock(*pblock, {});
+        if (status == READ_STATUS_INVALID) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            LogPrintf("Peer %d sent us invalid compact block\n", pfrom->GetId());
+        } else if (status == READ_STATUS_FAILED) {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetBlock));
+        } else {
+            ProcessReceivedBlock(pfrom, pblock, connman);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> recent_block;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == req.blockhash)
+                recent_block = most_recent_block;
+        }
+        if (recent_block) {
+            SendBlockTransactions(*recent_block, req, pfrom, connman);
+            return true;
+        }
+
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->GetId());
+            return true;
+        }
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // If an older block is requested (should never happen in practice,
+            // but can happen in tests) send a block response instead of a
+            // blocktxn response. Sending a full block response instead of a
+            // small blocktxn response is preferable in the case where a peer
+            // might maliciously send lots of getblocktxn requests to trigger
+            // expensive disk reads, because it will require the peer to
+            // actually receive all the data read from disk over the network.
+            LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->GetId(), MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.emplace_back(MSG_BLOCK, req.blockhash);
+            // The message processing loop will go around again (without pausing) and we'll respond then (without cs_main)
+            return true;
+        }
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second))
+            assert(!"cannot load block from disk");
+        SendBlockTransactions(block, req, pfrom, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+            auto it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock || it->second.first != pfrom->GetId()) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            ReadStatus status = it->second.second->partialBlock->FillBlock(*pblock, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->GetId());
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                // The block stays in flight from this peer.
+                it->second.second->partialBlock.reset();
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_BLOCK, resp.blockhash)}));
+                return true;
             }
         }
+        ProcessReceivedBlock(pfrom, pblock, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
     }
 
     // This asymmetric behavior for inbound and outbound connections was introduced
@@ -2171,10 +3048,18 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (pto->nVersion >= SENDHEADERS_VERSION) {
+                    // Headers-first: the blocks are then downloaded in parallel from all the peers
+                    // that have them (FindNextBlocksToDownload)
+                    state.nHeadersSyncTimeout = GetTimeMicros() + HEADERS_DOWNLOAD_TIMEOUT_BASE + HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER *
+                            (GetAdjustedTime() - pindexBestHeader->GetBlockTime()) / Params().GetConsensus().nTargetSpacing;
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    // Older peers: inv-based sync
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
             }
         }
 
@@ -2324,10 +3209,56 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             return true;
         }
 
+        // Resume the headers sync stopped ahead of the active chain, once its blocks are connected
+        if (state.pindexHeadersAhead && state.pindexHeadersAhead->nHeight - chainActive.Height() <= (int) BLOCK_DOWNLOAD_WINDOW) {
+            LogPrint(BCLog::NET, "resume getheaders (%d) to peer=%d\n", state.pindexHeadersAhead->nHeight, pto->id);
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(state.pindexHeadersAhead), UINT256_ZERO));
+            state.pindexHeadersAhead = nullptr;
+            if (state.nHeadersSyncTimeout > 0 && state.nHeadersSyncTimeout < std::numeric_limits<int64_t>::max()) {
+                // The headers sync waited for the blocks
+                state.nHeadersSyncTimeout = GetTimeMicros() + HEADERS_DOWNLOAD_TIMEOUT_BASE;
+            }
+        }
+
+        // Check for headers sync timeouts
+        if (state.fSyncStarted && !state.pindexHeadersAhead &&
+                state.nHeadersSyncTimeout > 0 && state.nHeadersSyncTimeout < std::numeric_limits<int64_t>::max()) {
+            // Detect whether this is a stalling initial-headers-sync peer
+            if (pindexBestHeader->GetBlockTime() <= GetAdjustedTime() - 24 * 60 * 60) {
+                if (nNow > state.nHeadersSyncTimeout && nSyncStarted == 1 && (nPreferredDownload - state.fPreferredDownload >= 1)) {
+                    // Disconnect a (non-whitelisted) peer if it is our only sync peer,
+                    // and we have others we could be using instead.
+                    // Note: If all our peers are inbound, then we won't
+                    // disconnect our sync peer for stalling; we have bigger
+                    // problems if we can't get any outbound peers.
+                    if (!pto->fWhitelisted) {
+                        LogPrintf("Timeout downloading headers from peer=%d, disconnecting\n", pto->GetId());
+                        pto->fDisconnect = true;
+                        return true;
+                    } else {
+                        LogPrintf("Timeout downloading headers from whitelisted peer=%d, not disconnecting\n", pto->GetId());
+                        // Reset the headers sync state so that we have a
+                        // chance to try downloading from a different peer.
+                        // Note: this will also result in at least one more
+                        // getheaders message to be sent to
+                        // this peer (eventually).
+                        state.fSyncStarted = false;
+                        nSyncStarted--;
+                        state.nHeadersSyncTimeout = 0;
+                    }
+                }
+            } else {
+                // After we've caught up once, reset the timeout so we can't trigger
+                // disconnect later.
+                state.nHeadersSyncTimeout = std::numeric_limits<int64_t>::max();
+            }
+        }
+
         //
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
+        ExpireUnconnectedBlocks(GetTime());
         if (!pto->fClient && fFetch && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
@@ -18,6 +18,10 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 25;
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Maximum total serialized size of the blocks downloaded ahead of their parent kept in memory */
+static const size_t MAX_UNCONNECTED_BLOCKS_SIZE = 64 * 1000 * 1000;
+/** Expiration time for the blocks downloaded ahead of their parent in seconds */
+static const int64_t UNCONNECTED_BLOCK_EXPIRE_TIME = 10 * 60;
 /** Default for -blockspamfilter, use header spam filter */
 static const bool DEFAULT_BLOCK_SPAM_FILTER = true;
 /** Default for -blockspamfiltermaxsize, maximum size of the list of indexes in the block spam filter */
@@ -32,6 +36,25 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
 
+/** Version of the compact blocks (sendcmpct message) supported */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+/** Maximum number of outbound peers asked to announce the new blocks with a cmpctblock */
+static const unsigned int MAX_CMPCTBLOCK_HB_PEERS = 3;
+/** Maximum depth of the blocks sent as compact blocks when requested (deeper ones are sent in full) */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of the blocks whose transactions are sent in a blocktxn message (deeper ones are sent in full) */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum number of blocks announced with a headers message (more are announced with an inv of the tip) */
+static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
+/** Maximum number of unconnecting headers announcements before the peer is punished */
+static const int MAX_UNCONNECTING_HEADERS = 10;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static const uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static const uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** Interval between compact filter checkpoints. See BIP 157. */
+static const int CFCHECKPT_INTERVAL = 1000;
+
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
     CConnman* connman;
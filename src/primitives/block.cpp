@@ -33,6 +33,41 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+std::vector<uint256> GetBlockHeadersHashes(const std::vector<CBlockHeader>& vHeaders)
+{
+    std::vector<uint256> vHashes(vHeaders.size());
+    std::vector<size_t> vQuarkPos;
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        if (vHeaders[i].nVersion < 4) {
+            vQuarkPos.emplace_back(i);
+        } else {
+            vHashes[i] = vHeaders[i].GetHash();
+        }
+    }
+    if (vQuarkPos.empty()) return vHashes;
+
+    // Serialize the 80 bytes of the Quark headers
+    std::vector<uint8_t> vData(vQuarkPos.size() * 80);
+    std::vector<const unsigned char*> vDataPtrs(vQuarkPos.size());
+    std::vector<uint256> vQuarkHashes(vQuarkPos.size());
+    for (size_t i = 0; i < vQuarkPos.size(); i++) {
+        const CBlockHeader& header = vHeaders[vQuarkPos[i]];
+        uint8_t* data = &vData[i * 80];
+        WriteLE32(&data[0], header.nVersion);
+        memcpy(&data[4], header.hashPrevBlock.begin(), header.hashPrevBlock.size());
+        memcpy(&data[36], header.hashMerkleRoot.begin(), header.hashMerkleRoot.size());
+        WriteLE32(&data[68], header.nTime);
+        WriteLE32(&data[72], header.nBits);
+        WriteLE32(&data[76], header.nNonce);
+        vDataPtrs[i] = data;
+    }
+    HashQuarkN(vDataPtrs.data(), 80, vQuarkPos.size(), vQuarkHashes.data());
+    for (size_t i = 0; i < vQuarkPos.size(); i++) {
+        vHashes[vQuarkPos[i]] = vQuarkHashes[i];
+    }
+    return vHashes;
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
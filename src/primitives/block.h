@@ -75,6 +75,9 @@ public:
     }
 };
 
+/** Compute the hashes of a batch of headers (the Quark ones hashed together, see HashQuarkN) */
+std::vector<uint256> GetBlockHeadersHashes(const std::vector<CBlockHeader>& vHeaders);
+
 
 class CBlock : public CBlockHeader
 {
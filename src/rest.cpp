@@ -9,6 +9,7 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "httpserver.h"
+#include "index/txindex.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -193,7 +194,6 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -203,30 +203,34 @@ static bool rest_block(HTTPRequest* req,
         pblockindex = mapBlockIndex[hash];
         if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
+        // Reply with the stored bytes directly
+        const auto& rawBlock = GetRawBlock(pblockindex);
+        if (!rawBlock)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        std::string binaryBlock(rawBlock->begin(), rawBlock->end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        const auto& rawBlock = GetRawBlock(pblockindex);
+        if (!rawBlock)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        std::string strHex = HexStr(rawBlock->begin(), rawBlock->end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pblockindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
         UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
         std::string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
@@ -344,6 +348,10 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    if (g_txindex) {
+        g_txindex->BlockUntilSyncedToCurrentChain();
+    }
+
     CTransactionRef tx;
     uint256 hashBlock = uint256();
     if (!GetTransaction(hash, tx, hashBlock, true))
@@ -572,6 +580,86 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+// Address index queries, answered by the rpc calls defined in rpc/misc.cpp
+UniValue getaddressutxos(const JSONRPCRequest& request);
+UniValue getaddresstxids(const JSONRPCRequest& request);
+UniValue getaddressbalance(const JSONRPCRequest& request);
+
+/**
+ * /rest/<method>/<address>[,<address>...][/<start>/<end>].json
+ * The comma-separated addresses are the first parameter of the rpc call, the
+ * optional numeric components (the height range of getaddresstxids) the next ones.
+ */
+static bool rest_address(HTTPRequest* req, const std::string& strURIPart, UniValue (*method)(const JSONRPCRequest&), size_t nMaxParams)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    std::vector<std::string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    if (path.empty() || path[0].empty() || path.size() > nMaxParams) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/<method>/<address>[,<address>...]" +
+                       std::string(nMaxParams > 1 ? "[/<start>/<end>]" : "") + ".json");
+    }
+
+    switch (rf) {
+    case RF_JSON: {
+        JSONRPCRequest jsonRequest;
+        jsonRequest.params = UniValue(UniValue::VARR);
+        std::vector<std::string> vAddresses;
+        boost::split(vAddresses, path[0], boost::is_any_of(","));
+        UniValue addresses(UniValue::VARR);
+        for (const std::string& address : vAddresses) {
+            addresses.push_back(address);
+        }
+        jsonRequest.params.push_back(addresses);
+        for (size_t i = 1; i < path.size(); i++) {
+            int32_t n;
+            if (!ParseInt32(path[i], &n)) {
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[i]);
+            }
+            jsonRequest.params.push_back(n);
+        }
+
+        UniValue result;
+        try {
+            result = method(jsonRequest);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+        } catch (const std::exception& e) {
+            return RESTERR(req, HTTP_BAD_REQUEST, e.what());
+        }
+        std::string strJSON = result.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_addressutxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address(req, strURIPart, getaddressutxos, 1);
+}
+
+static bool rest_addresstxids(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address(req, strURIPart, getaddresstxids, 3);
+}
+
+static bool rest_addressbalance(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address(req, strURIPart, getaddressbalance, 1);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -584,6 +672,9 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/addressutxos/", rest_addressutxos},
+      {"/rest/addresstxids/", rest_addresstxids},
+      {"/rest/addressbalance/", rest_addressbalance},
 };
 
 bool StartREST()
@@ -5,6 +5,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilter.h"
 #include "budget/budgetmanager.h"
 #include "checkpoints.h"
 #include "clientversion.h"
@@ -22,6 +23,8 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "hash.h"
+#include "index/blockfilterindex.h"
+#include "index/coinstatsindex.h"
 #include "validationinterface.h"
 #include "wallet/wallet.h"
 #include "warnings.h"
@@ -578,16 +581,17 @@ UniValue getblock(const JSONRPCRequest& request)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (!fVerbose) {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        // No need to deserialize the block
+        const auto& rawBlock = GetRawBlock(pblockindex);
+        if (!rawBlock)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        return HexStr(rawBlock->begin(), rawBlock->end());
     }
 
+    if (!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -649,6 +653,84 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block (requires -blockfilterindex).\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",    (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"     (string) the hex-encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\""));
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(block_hash);
+        if (mi == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = mi->second;
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 UniValue getsupplyinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -695,40 +777,57 @@ UniValue getsupplyinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
+
+static CoinStatsHashType ParseHashType(const std::string& hash_type_input)
+{
+    if (hash_type_input == "hash_serialized_2") {
+        return CoinStatsHashType::HASH_SERIALIZED;
+    } else if (hash_type_input == "muhash") {
+        return CoinStatsHashType::MUHASH;
+    } else if (hash_type_input == "none") {
+        return CoinStatsHashType::NONE;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+}
+
 struct CCoinsStats
 {
     int nHeight{0};
     uint256 hashBlock{UINT256_ZERO};
     uint64_t nTransactions{0};
     uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
     uint256 hashSerialized{UINT256_ZERO};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+static void ApplyStats(CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
     ss << hash;
     const Coin& coin = outputs.begin()->second;
     ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
-    stats.nTransactions++;
     for (const auto& output : outputs) {
         ss << VARINT(output.first + 1);
         ss << output.second.out.scriptPubKey;
         ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
     }
     ss << VARINT(0u);
 }
 
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats, CoinStatsHashType hash_type)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
@@ -742,57 +841,167 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         COutPoint key;
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
+            // The coins of a transaction are contiguous in the cursor
+            if (stats.nTransactionOutputs == 0 || key.hash != prevkey) stats.nTransactions++;
+            stats.nTransactionOutputs++;
+            stats.nBogoSize += GetBogoSize(coin.out.scriptPubKey);
+            stats.nTotalAmount += coin.out.nValue;
+            if (hash_type == CoinStatsHashType::MUHASH) {
+                ApplyCoinHash(muhash, key, coin);
+            } else if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+                if (!outputs.empty() && key.hash != prevkey) {
+                    ApplyStats(ss, prevkey, outputs);
+                    outputs.clear();
+                }
+                outputs[key.n] = std::move(coin);
             }
             prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(ss, prevkey, outputs);
+    }
+    if (hash_type == CoinStatsHashType::MUHASH) {
+        muhash.Finalize(stats.hashSerialized);
+    } else if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+        stats.hashSerialized = ss.GetHash();
     }
-    stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
 
+//! Block index of the block hash, or of the block of the active chain at the height
+static const CBlockIndex* ParseHashOrHeight(const UniValue& param)
+{
+    LOCK(cs_main);
+    if (param.isNum()) {
+        const int height = param.get_int();
+        if (height < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+        }
+        const int current_tip = chainActive.Height();
+        if (height > current_tip) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+        }
+        return chainActive[height];
+    }
+    const uint256 hash = ParseHashV(param, "hash_or_height");
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+    return mi->second;
+}
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 3)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height use_index )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time without the coinstats index (-coinstatsindex).\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"       (string, optional, default=hash_serialized_2) Which UTXO set hash should be calculated.\n"
+            "                     Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'.\n"
+            "                     'hash_serialized_2' always walks the UTXO set.\n"
+            "2. hash_or_height    (string or numeric, optional) The block hash or height of the target height (requires -coinstatsindex).\n"
+            "3. use_index         (boolean, optional, default=true) Use the coinstats index when available.\n"
 
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
-            "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"height\":n,     (numeric) The block height (index) of the returned statistics\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the block at which these statistics are calculated\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (not available when using the coinstats index)\n"
+            "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
+            "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
+            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)\n"
+            "  \"muhash\": \"hash\",     (string) The serialized hash (only present if 'muhash' hash_type is chosen)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not available when using the coinstats index)\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount of coins in the UTXO set\n"
+            "  \"total_unspendable_amount\": x.xxx,  (numeric) The total amount of coins permanently excluded from the UTXO set (only available if coinstats index is used)\n"
+            "  \"block_info\": {         (json object) Info on amounts in the block at this block height (only available if coinstats index is used)\n"
+            "    \"prevout_spent\": x.xxx,  (numeric) Total amount of the coins spent by the block\n"
+            "    \"new_outputs\": x.xxx,    (numeric) Total amount of the new outputs added to the UTXO set\n"
+            "    \"unspendable\": x.xxx,    (numeric) Total amount of the outputs not added to the UTXO set (data outputs, zerocoin mints, invalid outputs)\n"
+            "    \"shielded\": x.xxx,       (numeric) Net amount moved into the shielded pool (negative when moved out of it)\n"
+            "    \"minted\": x.xxx          (numeric) Amount issued by the block (new_outputs + unspendable + shielded - prevout_spent)\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") +
+            HelpExampleCli("gettxoutsetinfo", "\"none\"") +
+            HelpExampleCli("gettxoutsetinfo", "\"none\" 1000") +
+            HelpExampleCli("gettxoutsetinfo", "\"none\" '\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"'") +
+            HelpExampleRpc("gettxoutsetinfo", "") +
+            HelpExampleRpc("gettxoutsetinfo", "\"muhash\", 1000"));
 
     UniValue ret(UniValue::VOBJ);
 
+    const CoinStatsHashType hash_type = request.params[0].isNull() ? CoinStatsHashType::HASH_SERIALIZED : ParseHashType(request.params[0].get_str());
+    const bool index_requested = request.params[2].isNull() || request.params[2].get_bool();
+    CoinStatsIndex* index = index_requested ? g_coin_stats_index.get() : nullptr;
+
+    const CBlockIndex* pindex = nullptr;
+    if (!request.params[1].isNull()) {
+        if (!index) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires coinstatsindex");
+        }
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 hash type cannot be queried for a specific block");
+        }
+        pindex = ParseHashOrHeight(request.params[1]);
+    }
+
+    // The index answers without walking the UTXO set, for any block it has
+    // processed. The tip is served by the index only once it has caught up.
+    const bool index_ready = index && index->BlockUntilSyncedToCurrentChain();
+    if (index && hash_type != CoinStatsHashType::HASH_SERIALIZED && (pindex || index_ready)) {
+        if (!pindex) {
+            pindex = WITH_LOCK(cs_main, return chainActive.Tip(); );
+        }
+        CCoinsStatsEntry entry;
+        if (!index->LookUpStats(pindex, entry)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, index_ready ?
+                    "Unable to read the UTXO set statistics of the block" :
+                    "UTXO set statistics of the block not found. The coinstats index is still syncing.");
+        }
+        ret.pushKV("height", (int64_t)pindex->nHeight);
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", (int64_t)entry.nTransactionOutputs);
+        ret.pushKV("bogosize", (int64_t)entry.nBogoSize);
+        if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", entry.muhash.GetHex());
+        }
+        ret.pushKV("total_amount", ValueFromAmount(entry.nTotalAmount));
+        ret.pushKV("total_unspendable_amount", ValueFromAmount(entry.nTotalUnspendable));
+        UniValue block_info(UniValue::VOBJ);
+        block_info.pushKV("prevout_spent", ValueFromAmount(entry.nBlockPrevoutSpent));
+        block_info.pushKV("new_outputs", ValueFromAmount(entry.nBlockNewOutputs));
+        block_info.pushKV("unspendable", ValueFromAmount(entry.nBlockUnspendable));
+        block_info.pushKV("shielded", ValueFromAmount(entry.nBlockShielded));
+        block_info.pushKV("minted", ValueFromAmount(entry.GetBlockIssued()));
+        ret.pushKV("block_info", block_info);
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
+    if (GetUTXOStats(pcoinsTip, stats, hash_type)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.hashSerialized.GetHex());
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
         ret.pushKV("disk_size", stats.nDiskSize);
     }
@@ -1061,6 +1270,114 @@ struct CompareBlocksByHeight {
     }
 };
 
+UniValue getchainstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "getchainstats ( blocks flushes )\n"
+            "\nReturns the verification metrics of the last connected blocks (script checks and Sapling proofs),\n"
+            "and the metrics of the last flushes of the coins cache to the chainstate database.\n"
+
+            "\nArguments:\n"
+            "1. blocks     (int, optional, default=10) the number of blocks (up to " + std::to_string(MAX_BLOCK_CHECK_STATS) + ")\n"
+            "2. flushes    (int, optional, default=10) the number of chainstate flushes (up to " + std::to_string(MAX_COINS_FLUSH_STATS) + ")\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,                 (numeric) The number of verification threads (including the connecting one)\n"
+            "  \"checks\": n,                  (numeric) Total checks verified in the returned blocks\n"
+            "  \"utilization\": x.xxx,         (numeric) Average fraction of the verification threads time spent running checks\n"
+            "  \"blocks\": [                   (array) The blocks, latest first\n"
+            "    {\n"
+            "      \"height\": n,              (numeric) The block height\n"
+            "      \"hash\": \"hash\",           (string) The block hash\n"
+            "      \"inputs\": n,              (numeric) The number of transaction inputs\n"
+            "      \"checks\": n,              (numeric) The number of checks run by the verification threads\n"
+            "      \"connect_time_ms\": x.xx,  (numeric) Time spent connecting the transactions\n"
+            "      \"verify_time_ms\": x.xx,   (numeric) Time from the first check queued to the last one verified\n"
+            "      \"busy_time_ms\": x.xx,     (numeric) Time spent running checks, summed over the threads\n"
+            "      \"threads\": n,             (numeric) The number of threads that verified the block\n"
+            "      \"utilization\": x.xxx,     (numeric) Fraction of the threads time spent running checks\n"
+            "      \"steals\": n               (numeric) The number of batches of checks stolen by idle threads\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"flushes\": [                  (array) The chainstate flushes, latest first\n"
+            "    {\n"
+            "      \"time\": n,                (numeric) The start time of the flush in seconds since epoch (Jan 1 1970 GMT)\n"
+            "      \"bestblock\": \"hash\",      (string) The block the chainstate was flushed at\n"
+            "      \"coins\": n,               (numeric) The number of coins in the cache\n"
+            "      \"written\": n,             (numeric) The number of changed coins written (including the erased ones)\n"
+            "      \"erased\": n,              (numeric) The number of spent coins erased\n"
+            "      \"bytes\": n,               (numeric) The estimated size of the batches written\n"
+            "      \"batches\": n,             (numeric) The number of batches written\n"
+            "      \"threads\": n,             (numeric) The number of threads that serialized the coins\n"
+            "      \"serialize_time_ms\": x.xx, (numeric) Time spent serializing and sorting the coins\n"
+            "      \"write_time_ms\": x.xx,   (numeric) Time spent writing the batches\n"
+            "      \"total_time_ms\": x.xx    (numeric) Total time of the flush\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getchainstats", "") + HelpExampleCli("getchainstats", "100") + HelpExampleCli("getchainstats", "0 5") + HelpExampleRpc("getchainstats", "100"));
+
+    int nBlocks = request.params.size() > 0 ? request.params[0].get_int() : 10;
+    if (nBlocks < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of blocks");
+    int nFlushes = request.params.size() > 1 ? request.params[1].get_int() : 10;
+    if (nFlushes < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of flushes");
+
+    uint64_t nTotalChecks = 0;
+    double dTotalAvailableTime = 0;
+    int64_t nTotalBusyTime = 0;
+    UniValue blocks(UniValue::VARR);
+    for (const BlockCheckStats& stats : GetBlockCheckStats((size_t)nBlocks)) {
+        const double dUtilization = (stats.nVerifyWallTime > 0 && stats.nThreads > 0) ?
+                (double)stats.nVerifyBusyTime / ((double)stats.nVerifyWallTime * stats.nThreads) : 0;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("height", stats.nHeight);
+        obj.pushKV("hash", stats.hash.GetHex());
+        obj.pushKV("inputs", (int64_t)stats.nInputs);
+        obj.pushKV("checks", (int64_t)stats.nChecks);
+        obj.pushKV("connect_time_ms", 0.001 * stats.nConnectTime);
+        obj.pushKV("verify_time_ms", 0.001 * stats.nVerifyWallTime);
+        obj.pushKV("busy_time_ms", 0.001 * stats.nVerifyBusyTime);
+        obj.pushKV("threads", stats.nThreads);
+        obj.pushKV("utilization", dUtilization);
+        obj.pushKV("steals", (int64_t)stats.nSteals);
+        blocks.push_back(obj);
+        nTotalChecks += stats.nChecks;
+        nTotalBusyTime += stats.nVerifyBusyTime;
+        dTotalAvailableTime += (double)stats.nVerifyWallTime * stats.nThreads;
+    }
+
+    UniValue flushes(UniValue::VARR);
+    for (const CoinsFlushStats& stats : GetCoinsFlushStats((size_t)nFlushes)) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("time", stats.nTime);
+        obj.pushKV("bestblock", stats.hashBlock.GetHex());
+        obj.pushKV("coins", (int64_t)stats.nCoins);
+        obj.pushKV("written", (int64_t)stats.nWritten);
+        obj.pushKV("erased", (int64_t)stats.nErased);
+        obj.pushKV("bytes", (int64_t)stats.nBytes);
+        obj.pushKV("batches", (int)stats.nBatches);
+        obj.pushKV("threads", stats.nThreads);
+        obj.pushKV("serialize_time_ms", 0.001 * stats.nSerializeTime);
+        obj.pushKV("write_time_ms", 0.001 * stats.nWriteTime);
+        obj.pushKV("total_time_ms", 0.001 * stats.nTotalTime);
+        flushes.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("threads", std::max(nScriptCheckThreads, 1));
+    ret.pushKV("checks", (int64_t)nTotalChecks);
+    ret.pushKV("utilization", dTotalAvailableTime > 0 ? (double)nTotalBusyTime / dTotalAvailableTime : 0);
+    ret.pushKV("blocks", blocks);
+    ret.pushKV("flushes", flushes);
+    return ret;
+}
+
 UniValue getchaintips(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -1453,8 +1770,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getblockheader",         &getblockheader,         false, {"blockhash","verbose"} },
     { "blockchain",         "getblockindexstats",     &getblockindexstats,     true,  {"height","range"} },
+    { "blockchain",         "getchainstats",          &getchainstats,          true,  {"blocks", "flushes"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getfeeinfo",             &getfeeinfo,             true,  {"blocks"} },
@@ -1462,7 +1781,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "getsupplyinfo",          &getsupplyinfo,          true,  {"force_update"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type","hash_or_height","use_index"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"nblocks"} },
 
     /* Not shown in help */
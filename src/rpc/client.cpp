@@ -47,6 +47,11 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "generate", 0, "nblocks" },
     { "generatetoaddress", 0, "nblocks" },
     { "getaddednodeinfo", 0, "dummy" },
+    { "getaddressbalance", 0, "addresses" },
+    { "getaddresstxids", 0, "addresses" },
+    { "getaddresstxids", 1, "start" },
+    { "getaddresstxids", 2, "end" },
+    { "getaddressutxos", 0, "addresses" },
     { "getbalance", 0, "minconf" },
     { "getbalance", 1, "include_watchonly" },
     { "getbalance", 2, "include_delegated" },
@@ -57,6 +62,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "getblockindexstats", 0, "height" },
     { "getblockindexstats", 1, "range" },
     { "getblocktemplate", 0, "template_request" },
+    { "getchainstats", 0, "blocks" },
+    { "getchainstats", 1, "flushes" },
     { "getfeeinfo", 0, "blocks" },
     { "getshieldbalance", 1, "minconf" },
     { "getshieldbalance", 2, "include_watchonly" },
@@ -67,10 +74,13 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "getreceivedbyaddress", 1, "minconf" },
     { "getreceivedbylabel", 1, "minconf" },
     { "getsaplingnotescount", 0, "minconf" },
+    { "getspentinfo", 1, "index" },
     { "getsupplyinfo", 0, "force_update" },
     { "gettransaction", 1, "include_watchonly" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
+    { "gettxoutsetinfo", 2, "use_index" },
     { "importaddress", 2, "rescan" },
     { "importaddress", 3, "p2sh" },
     { "importmulti", 0, "requests" },
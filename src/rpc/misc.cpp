@@ -7,10 +7,12 @@
 
 #include "clientversion.h"
 #include "httpserver.h"
+#include "index/addressindex.h"
 #include "init.h"
 #include "key_io.h"
 #include "sapling/key_io_sapling.h"
 #include "masternode-sync.h"
+#include "messagesigner.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
@@ -600,6 +602,236 @@ UniValue verifymessage(const JSONRPCRequest& request)
     return (pubkey.GetID() == *keyID);
 }
 
+static void EnsureAddressIndexReady()
+{
+    if (!g_addressindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled (start the node with -addressindex)");
+    }
+    // The index is updated in the background: wait for it to catch up with the chain
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Blockchain transactions are still in the process of being indexed");
+    }
+}
+
+/** Decode an address, or an array of addresses, to the script hashes of the index */
+static std::vector<std::pair<uint160, std::string>> ParseIndexAddresses(const UniValue& params)
+{
+    std::vector<std::string> vAddresses;
+    if (params.isStr()) {
+        vAddresses.emplace_back(params.get_str());
+    } else {
+        const UniValue& addresses = params.isObject() ? find_value(params.get_obj(), "addresses") : params;
+        if (!addresses.isArray()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        }
+        for (unsigned int i = 0; i < addresses.size(); i++) {
+            vAddresses.emplace_back(addresses[i].get_str());
+        }
+    }
+
+    std::vector<std::pair<uint160, std::string>> ret;
+    std::set<uint160> setHashes;
+    for (const std::string& strAddress : vAddresses) {
+        CTxDestination dest = DecodeDestination(strAddress);
+        if (!IsValidDestination(dest)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        }
+        const uint160 hashScript = GetAddressIndexScriptHash(GetScriptForDestination(dest));
+        if (setHashes.insert(hashScript).second) {
+            ret.emplace_back(hashScript, strAddress);
+        }
+    }
+    return ret;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos [\"address\",...]\n"
+            "\nReturns the unspent outputs of the addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. [\"address\",...]    (array, required) The pivx addresses\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"addr\",    (string) The address\n"
+            "    \"txid\": \"hash\",       (string) The transaction id\n"
+            "    \"outputIndex\": n,     (numeric) The output index\n"
+            "    \"script\": \"hex\",      (string) The output script, hex-encoded\n"
+            "    \"satoshis\": n,        (numeric) The value of the output, in satoshis\n"
+            "    \"height\": n           (numeric) The height of the block of the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'[\"DAD3Y6ivr8nPQLT1NEPX84DxGCw9jz9Jvg\"]'") +
+            HelpExampleRpc("getaddressutxos", "[\"DAD3Y6ivr8nPQLT1NEPX84DxGCw9jz9Jvg\"]"));
+
+    const auto vAddresses = ParseIndexAddresses(request.params[0]);
+    EnsureAddressIndexReady();
+
+    std::vector<std::pair<std::pair<CAddressUnspentKey, CAddressUnspentValue>, std::string>> vUnspent;
+    for (const auto& address : vAddresses) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> vAddrUnspent;
+        if (!g_addressindex->GetAddressUnspent(address.first, vAddrUnspent)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        }
+        for (auto& it : vAddrUnspent) {
+            vUnspent.emplace_back(std::move(it), address.second);
+        }
+    }
+    std::sort(vUnspent.begin(), vUnspent.end(), [](const auto& a, const auto& b) {
+        return a.first.second.nHeight < b.first.second.nHeight;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (const auto& it : vUnspent) {
+        UniValue output(UniValue::VOBJ);
+        output.pushKV("address", it.second);
+        output.pushKV("txid", it.first.first.txid.GetHex());
+        output.pushKV("outputIndex", (int64_t)it.first.first.nIndex);
+        output.pushKV("script", HexStr(it.first.second.script));
+        output.pushKV("satoshis", it.first.second.nValue);
+        output.pushKV("height", it.first.second.nHeight);
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddresstxids [\"address\",...] ( start end )\n"
+            "\nReturns the ids of the transactions funding or spending from the addresses, in chain order (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. [\"address\",...]    (array, required) The pivx addresses\n"
+            "2. start              (numeric, optional, default=0) The first block height\n"
+            "3. end                (numeric, optional, default=tip) The last block height\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"txid\"                (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'[\"DAD3Y6ivr8nPQLT1NEPX84DxGCw9jz9Jvg\"]' 1000 2000") +
+            HelpExampleRpc("getaddresstxids", "[\"DAD3Y6ivr8nPQLT1NEPX84DxGCw9jz9Jvg\"], 1000, 2000"));
+
+    const auto vAddresses = ParseIndexAddresses(request.params[0]);
+    const int nStart = request.params.size() > 1 ? request.params[1].get_int() : 0;
+    const int nEnd = request.params.size() > 2 ? request.params[2].get_int() : -1;
+    if (nStart < 0 || (nEnd >= 0 && nEnd < nStart)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+    EnsureAddressIndexReady();
+
+    // (height, position in the block) -> txid, to return the transactions once and in chain order
+    std::map<std::pair<uint32_t, uint32_t>, uint256> mapTxids;
+    for (const auto& address : vAddresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> vDeltas;
+        if (!g_addressindex->GetAddressDeltas(address.first, nStart, nEnd, vDeltas)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        }
+        for (const auto& it : vDeltas) {
+            mapTxids.emplace(std::make_pair(it.first.nHeight, it.first.nTxIndex), it.first.txid);
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const auto& it : mapTxids) {
+        result.push_back(it.second.GetHex());
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance [\"address\",...]\n"
+            "\nReturns the balance of the addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. [\"address\",...]    (array, required) The pivx addresses\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,     (numeric) The current balance, in satoshis\n"
+            "  \"received\": n     (numeric) The total amount received (including change), in satoshis\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'[\"DAD3Y6ivr8nPQLT1NEPX84DxGCw9jz9Jvg\"]'") +
+            HelpExampleRpc("getaddressbalance", "[\"DAD3Y6ivr8nPQLT1NEPX84DxGCw9jz9Jvg\"]"));
+
+    const auto vAddresses = ParseIndexAddresses(request.params[0]);
+    EnsureAddressIndexReady();
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const auto& address : vAddresses) {
+        CAmount nAddrBalance, nAddrReceived;
+        if (!g_addressindex->GetAddressBalance(address.first, nAddrBalance, nAddrReceived)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        }
+        nBalance += nAddrBalance;
+        nReceived += nAddrReceived;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("balance", nBalance);
+    result.pushKV("received", nReceived);
+    return result;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw std::runtime_error(
+            "getspentinfo \"txid\" index\n"
+            "\nReturns the input spending an output (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"txid\"     (string, required) The id of the transaction of the output\n"
+            "2. index      (numeric, required) The output index\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",   (string) The id of the spending transaction\n"
+            "  \"index\": n,       (numeric) The index of the spending input\n"
+            "  \"height\": n       (numeric) The height of the block of the spending transaction\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\" 0") +
+            HelpExampleRpc("getspentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", 0"));
+
+    const uint256 txid = ParseHashV(request.params[0], "txid");
+    const int nIndex = request.params[1].get_int();
+    if (nIndex < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output index");
+    }
+    EnsureAddressIndexReady();
+
+    CSpentIndexValue value;
+    if (!g_addressindex->GetSpentInfo(COutPoint(txid, nIndex), value)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("txid", value.txid.GetHex());
+    result.pushKV("index", (int64_t)value.nInput);
+    result.pushKV("height", value.nHeight);
+    return result;
+}
+
 UniValue setmocktime(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -718,6 +950,16 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCMessageSigCacheInfo()
+{
+    MessageSigCacheStats stats = GetMessageSignatureCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("max_elements", uint64_t(stats.nMaxElements));
+    obj.pushKV("hits", stats.nHits);
+    obj.pushKV("misses", stats.nMisses);
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -736,6 +978,11 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"msgsigcache\": {          (json object) Information about the cache of verified tier-two message signatures\n"
+            "    \"max_elements\": xxxxx,  (numeric) Number of signatures the cache can hold\n"
+            "    \"hits\": xxxxx,          (numeric) Number of verifications answered by the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of verifications not found in the cache\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -744,6 +991,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("locked", RPCLockedMemoryInfo());
+    obj.pushKV("msgsigcache", RPCMessageSigCacheInfo());
     return obj;
 }
 
@@ -763,6 +1011,11 @@ UniValue echo(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ --------
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true,  {"addresses"} },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        true,  {"addresses","start","end"} },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true,  {"addresses"} },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           true,  {"txid","index"} },
+
     { "control",            "getinfo",                &getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {} },
     { "control",            "mnsync",                 &mnsync,                 true,  {"mode"} },
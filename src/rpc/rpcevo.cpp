@@ -757,6 +757,40 @@ UniValue protx_list(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue protx_listcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+                "protx_listcacheinfo\n"
+                "\nReturns the metrics of the deterministic masternode lists lookups (since the node started).\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"lookups\": n,              (numeric) Number of lists requested\n"
+                "  \"cache_hits\": n,           (numeric) Lists found in memory, with no diff to apply\n"
+                "  \"snapshot_reads\": n,       (numeric) Snapshots read from disk\n"
+                "  \"diffs_replayed\": n,       (numeric) Total diffs applied to build the lists\n"
+                "  \"max_diffs_replayed\": n,   (numeric) Diffs applied by the longest lookup\n"
+                "  \"cached_lists\": n,         (numeric) Lists currently in memory\n"
+                "  \"cached_diffs\": n          (numeric) Diffs currently in memory\n"
+                "}\n"
+                "\nExamples:\n"
+                + HelpExampleCli("protx_listcacheinfo", "")
+                + HelpExampleRpc("protx_listcacheinfo", "")
+        );
+    }
+
+    const CDeterministicMNListCacheStats stats = deterministicMNManager->GetCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("lookups", (uint64_t)stats.nLookups);
+    ret.pushKV("cache_hits", (uint64_t)stats.nCacheHits);
+    ret.pushKV("snapshot_reads", (uint64_t)stats.nSnapshotReads);
+    ret.pushKV("diffs_replayed", (uint64_t)stats.nDiffsReplayed);
+    ret.pushKV("max_diffs_replayed", (uint64_t)stats.nMaxDiffsReplayed);
+    ret.pushKV("cached_lists", (uint64_t)stats.nCachedLists);
+    ret.pushKV("cached_diffs", (uint64_t)stats.nCachedDiffs);
+    return ret;
+}
+
 #ifdef ENABLE_WALLET
 UniValue protx_update_service(const JSONRPCRequest& request)
 {
@@ -980,6 +1014,7 @@ static const CRPCCommand commands[] =
 { //  category       name                              actor (function)         okSafe argNames
   //  -------------- --------------------------------- ------------------------ ------ --------
     { "evo",         "protx_list",                     &protx_list,             true,  {"detailed","wallet_only","valid_only","height"}  },
+    { "evo",         "protx_listcacheinfo",            &protx_listcacheinfo,    true,  {}  },
 #ifdef ENABLE_WALLET
     { "evo",         "protx_register",                 &protx_register,         true,  {"collateralHash","collateralIndex","ipAndPort","ownerAddress","operatorAddress","votingAddress","payoutAddress","operatorReward","operatorPayoutAddress"} },
     { "evo",         "protx_register_fund",            &protx_register_fund,    true,  {"collateralAddress","ipAndPort","ownerAddress","operatorAddress","votingAddress","payoutAddress","operatorReward","operatorPayoutAddress"} },
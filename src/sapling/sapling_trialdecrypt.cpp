@@ -0,0 +1,108 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "sapling/sapling_trialdecrypt.h"
+
+#include "checkqueue.h"
+#include "sapling/sapling_transaction.h"
+#include "sync.h"
+#include "util/threadnames.h"
+
+#include <atomic>
+
+static CCheckQueue<CSaplingTrialDecryptCheck> saplingDecryptQueue(4);
+// Only one master at a time can use the queue (e.g. validation thread and a rescan)
+static Mutex cs_saplingDecryptMaster;
+static std::atomic<int> nSaplingDecryptThreads{0};
+
+bool CSaplingTrialDecryptCheck::operator()()
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        auto note = libzcash::SaplingNotePlaintext::decrypt(output->encCiphertext, (*vIvks)[i],
+                                                           output->ephemeralKey, output->cmu);
+        if (note) {
+            result->nIvkIndex = (int) i;
+            result->notePlaintext = note;
+            break;
+        }
+    }
+    return true;
+}
+
+void CSaplingTrialDecryptCheck::swap(CSaplingTrialDecryptCheck& check)
+{
+    std::swap(output, check.output);
+    std::swap(vIvks, check.vIvks);
+    std::swap(nBegin, check.nBegin);
+    std::swap(nEnd, check.nEnd);
+    std::swap(result, check.result);
+}
+
+void SetSaplingTrialDecryptThreads(int nThreads)
+{
+    nSaplingDecryptThreads = nThreads;
+}
+
+void ThreadSaplingTrialDecrypt()
+{
+    util::ThreadRename("pivx-saplingdec");
+    saplingDecryptQueue.Thread();
+}
+
+std::vector<SaplingTrialDecryptResult> TrialDecryptSaplingOutputs(const std::vector<const OutputDescription*>& vOutputs,
+                                                                  const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks)
+{
+    const size_t nOutputs = vOutputs.size();
+    const size_t nIvks = vIvks.size();
+    std::vector<SaplingTrialDecryptResult> vResults(nOutputs);
+    if (nOutputs == 0 || nIvks == 0) return vResults;
+
+    const int nThreads = nSaplingDecryptThreads;
+    if (nThreads <= 1 || nOutputs * nIvks < 2 * SAPLING_TRIALDECRYPT_MIN_IVKS_PER_JOB) {
+        // Not worth spreading the work, decrypt in this thread
+        for (size_t i = 0; i < nOutputs; i++) {
+            CSaplingTrialDecryptCheck(vOutputs[i], &vIvks, 0, nIvks, &vResults[i])();
+        }
+        return vResults;
+    }
+
+    // Split the keys of each output in chunks, aiming at a few jobs per thread,
+    // so that small blocks with many viewing keys are spread as well.
+    const size_t nTargetJobs = (size_t) nThreads * 4;
+    const size_t nMaxChunks = std::max<size_t>(1, nIvks / SAPLING_TRIALDECRYPT_MIN_IVKS_PER_JOB);
+    const size_t nChunks = std::min(nMaxChunks, std::max<size_t>(1, (nTargetJobs + nOutputs - 1) / nOutputs));
+    const size_t nChunkSize = (nIvks + nChunks - 1) / nChunks;
+
+    // One result slot per (output, chunk)
+    std::vector<SaplingTrialDecryptResult> vChunkResults(nOutputs * nChunks);
+    std::vector<CSaplingTrialDecryptCheck> vChecks;
+    vChecks.reserve(nOutputs * nChunks);
+    for (size_t i = 0; i < nOutputs; i++) {
+        for (size_t c = 0; c < nChunks; c++) {
+            const size_t nBegin = c * nChunkSize;
+            if (nBegin >= nIvks) break;
+            vChecks.emplace_back(vOutputs[i], &vIvks, nBegin, std::min(nIvks, nBegin + nChunkSize),
+                                 &vChunkResults[i * nChunks + c]);
+        }
+    }
+
+    {
+        LOCK(cs_saplingDecryptMaster);
+        CCheckQueueControl<CSaplingTrialDecryptCheck> control(&saplingDecryptQueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    // Merge: the first chunk (lowest key index) decrypting the output wins
+    for (size_t i = 0; i < nOutputs; i++) {
+        for (size_t c = 0; c < nChunks; c++) {
+            SaplingTrialDecryptResult& res = vChunkResults[i * nChunks + c];
+            if (res.IsMine()) {
+                vResults[i] = std::move(res);
+                break;
+            }
+        }
+    }
+    return vResults;
+}
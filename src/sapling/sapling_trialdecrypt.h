@@ -0,0 +1,70 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_SAPLING_TRIALDECRYPT_H
+#define PIVX_SAPLING_TRIALDECRYPT_H
+
+#include "optional.h"
+#include "sapling/address.h"
+#include "sapling/note.h"
+
+#include <vector>
+
+class OutputDescription;
+
+/** Minimum number of viewing keys tried by a single trial-decryption job */
+static const size_t SAPLING_TRIALDECRYPT_MIN_IVKS_PER_JOB = 8;
+
+/** Result of the trial-decryption of a shielded output */
+struct SaplingTrialDecryptResult
+{
+    // Index (in the viewing keys vector) of the first key decrypting the output, or -1
+    int nIvkIndex{-1};
+    Optional<libzcash::SaplingNotePlaintext> notePlaintext{nullopt};
+
+    bool IsMine() const { return nIvkIndex >= 0; }
+};
+
+/**
+ * Trial-decryption job: try the keys [nBegin, nEnd) of vIvks on a single output,
+ * stopping at the first one decrypting it.
+ * Suitable to be used with CCheckQueue (always returns true).
+ */
+class CSaplingTrialDecryptCheck
+{
+private:
+    const OutputDescription* output{nullptr};
+    const std::vector<libzcash::SaplingIncomingViewingKey>* vIvks{nullptr};
+    size_t nBegin{0};
+    size_t nEnd{0};
+    SaplingTrialDecryptResult* result{nullptr};
+
+public:
+    CSaplingTrialDecryptCheck() {}
+    CSaplingTrialDecryptCheck(const OutputDescription* _output,
+                              const std::vector<libzcash::SaplingIncomingViewingKey>* _vIvks,
+                              size_t _nBegin, size_t _nEnd,
+                              SaplingTrialDecryptResult* _result) :
+        output(_output), vIvks(_vIvks), nBegin(_nBegin), nEnd(_nEnd), result(_result) {}
+
+    bool operator()();
+    void swap(CSaplingTrialDecryptCheck& check);
+};
+
+/**
+ * Trial-decrypt every output against the given incoming viewing keys.
+ * The (output x ivk) work is split in jobs and spread across the trial-decryption
+ * worker threads (when started), the calling thread joins them until all the work is done.
+ * Returns one result per output (with the first ivk, in vIvks order, decrypting it).
+ */
+std::vector<SaplingTrialDecryptResult> TrialDecryptSaplingOutputs(const std::vector<const OutputDescription*>& vOutputs,
+                                                                  const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks);
+
+/** Set the number of threads (including the caller) used by TrialDecryptSaplingOutputs */
+void SetSaplingTrialDecryptThreads(int nThreads);
+
+/** Run a trial-decryption worker (started by the node when the wallet is enabled) */
+void ThreadSaplingTrialDecrypt();
+
+#endif // PIVX_SAPLING_TRIALDECRYPT_H
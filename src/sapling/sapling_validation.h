@@ -8,9 +8,29 @@
 
 #include "chainparams.h"
 
+#include <vector>
+
 class CTransaction;
 class CValidationState;
 
+/**
+ * Closure representing the verification of the Sapling proofs, spend-auth
+ * and binding signatures of a single transaction.
+ * Used to verify the shielded txs of a block in parallel (see CCheckQueue).
+ */
+class CSaplingProofCheck
+{
+private:
+    const CTransaction* ptx{nullptr};
+
+public:
+    CSaplingProofCheck() {}
+    explicit CSaplingProofCheck(const CTransaction& tx) : ptx(&tx) {}
+
+    bool operator()();
+    void swap(CSaplingProofCheck& check) { std::swap(ptx, check.ptx); }
+};
+
 namespace SaplingValidation {
 
 /** Context-independent validity checks */
@@ -21,9 +41,14 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: if pvChecks is not nullptr, the proofs verification is deferred (appended to pvChecks).
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload,
+                                std::vector<CSaplingProofCheck>* pvChecks = nullptr);
+
+/** Verify the Sapling proofs, spend-auth and binding signatures of a shielded transaction */
+bool CheckSaplingProofs(const CTransaction& tx, CValidationState& state, int nDoS);
 
 }; // End SaplingValidation namespace
 
@@ -5,6 +5,7 @@
 
 #include "sapling/saplingscriptpubkeyman.h"
 #include "chain.h" // for CBlockIndex
+#include "sapling/sapling_trialdecrypt.h"
 #include "validation.h" // for ReadBlockFromDisk()
 
 void SaplingScriptPubKeyMan::AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid)
@@ -138,7 +139,7 @@ void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nW
 }
 
 template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+void AppendNoteCommitments(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const std::vector<uint256>& vCommitments)
 {
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
@@ -148,19 +149,21 @@ void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWi
             // Check the validity of the cache
             // See comment in CopyPreviousWitnesses about validity.
             assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
+            for (const uint256& note_commitment : vCommitments) {
+                nd->witnesses.front().append(note_commitment);
+            }
         }
     }
 }
 
 template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+NoteData* WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
 {
     auto ndIt = noteDataMap.find(key);
     if (ndIt != noteDataMap.end()) {
         auto* nd = &ndIt->second;
         // skip externally sent and already witnessed notes
-        if (!nd->IsMyNote() || nd->witnessHeight >= indexHeight) return;
+        if (!nd->IsMyNote() || nd->witnessHeight >= indexHeight) return nullptr;
         if (nd->witnesses.size() > 0) {
             // We think this can happen because we write out the
             // witness cache state after every block increment or
@@ -183,7 +186,9 @@ void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeigh
         nd->witnessHeight = indexHeight - 1;
         // Check the validity of the cache
         assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+        return nd;
     }
+    return nullptr;
 }
 
 template<typename NoteDataMap>
@@ -202,14 +207,45 @@ void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWi
     }
 }
 
+void SaplingScriptPubKeyMan::AddToSaplingNoteTxs(const CWalletTx& wtx)
+{
+    AssertLockHeld(wallet->cs_wallet);
+    for (const mapSaplingNoteData_t::value_type& item : wtx.mapSaplingNoteData) {
+        if (item.second.IsMyNote()) {
+            setSaplingNoteTxs.emplace(wtx.GetHash());
+            return;
+        }
+    }
+}
+
+std::vector<CWalletTx*> SaplingScriptPubKeyMan::GetSaplingNoteTxs()
+{
+    AssertLockHeld(wallet->cs_wallet);
+    std::vector<CWalletTx*> vNoteTxs;
+    vNoteTxs.reserve(setSaplingNoteTxs.size());
+    for (auto it = setSaplingNoteTxs.begin(); it != setSaplingNoteTxs.end();) {
+        auto wtxIt = wallet->mapWallet.find(*it);
+        if (wtxIt == wallet->mapWallet.end()) {
+            // erased from the wallet
+            it = setSaplingNoteTxs.erase(it);
+            continue;
+        }
+        vNoteTxs.emplace_back(&wtxIt->second);
+        it++;
+    }
+    return vNoteTxs;
+}
+
 void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                      const CBlock* pblock,
                                      SaplingMerkleTree& saplingTree)
 {
     LOCK(wallet->cs_wallet);
     int chainHeight = pindex->nHeight;
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+    // Only the txs owning notes have witnesses to update
+    const std::vector<CWalletTx*>& vNoteTxs = GetSaplingNoteTxs();
+    for (CWalletTx* pwtx : vNoteTxs) {
+        ::CopyPreviousWitnesses(pwtx->mapSaplingNoteData, chainHeight, nWitnessCacheSize);
     }
 
     if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
@@ -217,34 +253,54 @@ void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
         nWitnessCacheNeedsUpdate = true;
     }
 
+    // Note commitments of the block, in tree order
+    std::vector<uint256> vCommitments;
+    for (const auto& tx : pblock->vtx) {
+        if (!tx->IsShieldedTx()) continue;
+        for (const OutputDescription& output : tx->sapData->vShieldedOutput) {
+            vCommitments.emplace_back(output.cmu);
+        }
+    }
+
+    // Increment existing witnesses, all the block commitments at once
+    for (CWalletTx* pwtx : vNoteTxs) {
+        ::AppendNoteCommitments(pwtx->mapSaplingNoteData, chainHeight, nWitnessCacheSize, vCommitments);
+    }
+
+    std::vector<CWalletTx*> vWitnessedTxs;
+    size_t nPos = 0;
     for (const auto& tx : pblock->vtx) {
         if (!tx->IsShieldedTx()) continue;
 
         const uint256& hash = tx->GetHash();
-        bool txIsOurs = wallet->mapWallet.count(hash);
+        auto wtxIt = wallet->mapWallet.find(hash);
+        bool txIsOurs = wtxIt != wallet->mapWallet.end();
 
         // Sapling
-        for (uint32_t i = 0; i < tx->sapData->vShieldedOutput.size(); i++) {
-            const uint256& note_commitment = tx->sapData->vShieldedOutput[i].cmu;
-            saplingTree.append(note_commitment);
-
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize, note_commitment);
-            }
+        for (uint32_t i = 0; i < tx->sapData->vShieldedOutput.size(); i++, nPos++) {
+            saplingTree.append(vCommitments[nPos]);
 
-            // If this is our note, witness it
+            // If this is our note, witness it and append the rest of the block commitments
             if (txIsOurs) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(wallet->mapWallet.at(hash).mapSaplingNoteData, chainHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                auto* nd = ::WitnessNoteIfMine(wtxIt->second.mapSaplingNoteData, chainHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                if (nd) {
+                    for (size_t j = nPos + 1; j < vCommitments.size(); j++) {
+                        nd->witnesses.front().append(vCommitments[j]);
+                    }
+                    if (setSaplingNoteTxs.emplace(hash).second) vWitnessedTxs.emplace_back(&wtxIt->second);
+                }
             }
         }
 
     }
 
     // Update witness heights
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+    for (CWalletTx* pwtx : vNoteTxs) {
+        ::UpdateWitnessHeights(pwtx->mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+    }
+    for (CWalletTx* pwtx : vWitnessedTxs) {
+        ::UpdateWitnessHeights(pwtx->mapSaplingNoteData, chainHeight, nWitnessCacheSize);
     }
 
     // For performance reasons, we write out the witness cache in
@@ -297,8 +353,8 @@ void DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t n
 void SaplingScriptPubKeyMan::DecrementNoteWitnesses(int nChainHeight)
 {
     LOCK(wallet->cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, nChainHeight, nWitnessCacheSize);
+    for (CWalletTx* pwtx : GetSaplingNoteTxs()) {
+        ::DecrementNoteWitnesses(pwtx->mapSaplingNoteData, nChainHeight, nWitnessCacheSize);
     }
     nWitnessCacheSize -= 1;
     nWitnessCacheNeedsUpdate = true;
@@ -312,6 +368,17 @@ void SaplingScriptPubKeyMan::DecrementNoteWitnesses(int nChainHeight)
     // of the wallet.dat is maintained).
 }
 
+std::vector<libzcash::SaplingIncomingViewingKey> SaplingScriptPubKeyMan::GetSaplingIvks() const
+{
+    LOCK(wallet->cs_KeyStore);
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    vIvks.reserve(wallet->mapSaplingFullViewingKeys.size());
+    for (const auto& it : wallet->mapSaplingFullViewingKeys) {
+        vIvks.emplace_back(it.first);
+    }
+    return vIvks;
+}
+
 /**
  * Finds all output notes in the given transaction that have been sent to
  * SaplingPaymentAddresses in this wallet.
@@ -320,72 +387,104 @@ void SaplingScriptPubKeyMan::DecrementNoteWitnesses(int nChainHeight)
  * the result of FindMySaplingNotes (for the addresses available at the time) will
  * already have been cached in CWalletTx.mapSaplingNoteData.
  */
-std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingScriptPubKeyMan::FindMySaplingNotes(const CTransaction &tx) const
+SaplingNotesAndIVKs SaplingScriptPubKeyMan::FindMySaplingNotes(const CTransaction& tx) const
 {
     // First check that this tx is a Shielded tx.
     if (!tx.IsShieldedTx()) {
         return {};
     }
+    return FindMySaplingNotes(std::vector<const CTransaction*>{&tx})[0];
+}
 
-    LOCK(wallet->cs_KeyStore);
-    const uint256& hash = tx.GetHash();
+std::vector<SaplingNotesAndIVKs> SaplingScriptPubKeyMan::FindMySaplingNotes(const std::vector<CTransactionRef>& vtx) const
+{
+    std::vector<const CTransaction*> vtxPtrs;
+    vtxPtrs.reserve(vtx.size());
+    for (const auto& tx : vtx) {
+        vtxPtrs.emplace_back(tx.get());
+    }
+    return FindMySaplingNotes(vtxPtrs);
+}
 
-    mapSaplingNoteData_t noteData;
-    SaplingIncomingViewingKeyMap viewingKeysToAdd;
+std::vector<SaplingNotesAndIVKs> SaplingScriptPubKeyMan::FindMySaplingNotes(const std::vector<const CTransaction*>& vtx) const
+{
+    std::vector<SaplingNotesAndIVKs> ret(vtx.size());
+
+    // Collect the outputs of all the shielded txs
+    std::vector<const OutputDescription*> vOutputs;
+    std::vector<std::pair<size_t, uint32_t>> vOutputsPos; // (tx position, output index)
+    for (size_t t = 0; t < vtx.size(); t++) {
+        const CTransaction& tx = *vtx[t];
+        if (!tx.IsShieldedTx()) continue;
+        for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i) {
+            vOutputs.emplace_back(&tx.sapData->vShieldedOutput[i]);
+            vOutputsPos.emplace_back(t, i);
+        }
+    }
+    if (vOutputs.empty()) return ret;
 
     // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
-    for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.sapData->vShieldedOutput[i];
-        for (auto it = wallet->mapSaplingFullViewingKeys.begin(); it != wallet->mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
-            auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-            if (!result) {
-                continue;
-            }
+    // Trial-decrypt all the outputs against a snapshot of the viewing keys, without holding cs_KeyStore.
+    const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks = GetSaplingIvks();
+    const std::vector<SaplingTrialDecryptResult>& vResults = TrialDecryptSaplingOutputs(vOutputs, vIvks);
 
-            // Check if we already have it.
-            Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.get().d);
-            if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                viewingKeysToAdd[address.get()] = ivk;
-            }
-            // We don't cache the nullifier here as computing it requires knowledge of the note position
-            // in the commitment tree, which can only be determined when the transaction has been mined.
-            SaplingOutPoint op {hash, i};
-            SaplingNoteData nd;
-            nd.ivk = ivk;
-            nd.amount = result->value();
-            nd.address = address;
-            const auto& memo = result->memo();
-            // don't save empty memo (starting with 0xF6)
-            if (memo[0] < 0xF6) {
-                nd.memo = memo;
-            }
-            noteData.insert(std::make_pair(op, nd));
-            break;
+    LOCK(wallet->cs_KeyStore);
+    for (size_t k = 0; k < vResults.size(); k++) {
+        const SaplingTrialDecryptResult& result = vResults[k];
+        if (!result.IsMine()) {
+            continue;
+        }
+        const size_t t = vOutputsPos[k].first;
+        mapSaplingNoteData_t& noteData = ret[t].first;
+        SaplingIncomingViewingKeyMap& viewingKeysToAdd = ret[t].second;
+        const libzcash::SaplingIncomingViewingKey& ivk = vIvks[result.nIvkIndex];
+        const libzcash::SaplingNotePlaintext& notePlaintext = *result.notePlaintext;
+
+        // Check if we already have it.
+        Optional<libzcash::SaplingPaymentAddress> address = ivk.address(notePlaintext.d);
+        if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
+            viewingKeysToAdd[address.get()] = ivk;
         }
+        // We don't cache the nullifier here as computing it requires knowledge of the note position
+        // in the commitment tree, which can only be determined when the transaction has been mined.
+        SaplingOutPoint op {vtx[t]->GetHash(), vOutputsPos[k].second};
+        SaplingNoteData nd;
+        nd.ivk = ivk;
+        nd.amount = notePlaintext.value();
+        nd.address = address;
+        const auto& memo = notePlaintext.memo();
+        // don't save empty memo (starting with 0xF6)
+        if (memo[0] < 0xF6) {
+            nd.memo = memo;
+        }
+        noteData.insert(std::make_pair(op, nd));
     }
 
-    return std::make_pair(noteData, viewingKeysToAdd);
+    return ret;
 }
 
 std::vector<libzcash::SaplingPaymentAddress> SaplingScriptPubKeyMan::FindMySaplingAddresses(const CTransaction& tx) const
 {
-    LOCK(wallet->cs_KeyStore);
     std::vector<libzcash::SaplingPaymentAddress> ret;
     if (!tx.sapData) return ret;
 
-    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
+    std::vector<const OutputDescription*> vOutputs;
     for (const OutputDescription& output : tx.sapData->vShieldedOutput) {
-        for (auto it = wallet->mapSaplingFullViewingKeys.begin(); it != wallet->mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
-            auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-            if (!result) {
-                continue;
-            }
-            Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.get().d);
-            if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) != 0) {
-                ret.emplace_back(address.get());
-            }
+        vOutputs.emplace_back(&output);
+    }
+
+    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
+    const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks = GetSaplingIvks();
+    const std::vector<SaplingTrialDecryptResult>& vResults = TrialDecryptSaplingOutputs(vOutputs, vIvks);
+
+    LOCK(wallet->cs_KeyStore);
+    for (const SaplingTrialDecryptResult& result : vResults) {
+        if (!result.IsMine()) {
+            continue;
+        }
+        Optional<libzcash::SaplingPaymentAddress> address = vIvks[result.nIvkIndex].address(result.notePlaintext->d);
+        if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) != 0) {
+            ret.emplace_back(address.get());
         }
     }
     return ret;
@@ -130,6 +130,7 @@ enum KeyAddResult {
 };
 
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
+typedef std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesAndIVKs;
 
 /*
  * Sapling keys manager
@@ -164,6 +165,11 @@ public:
      */
     void DecrementNoteWitnesses(int nChainHeight);
 
+    /**
+     * Track the wallet tx if it owns Sapling notes (witnesses to be updated).
+     */
+    void AddToSaplingNoteTxs(const CWalletTx& wtx);
+
     /**
      * Update mapSaplingNullifiersToNotes
      * with the cached nullifiers in this tx.
@@ -268,7 +274,12 @@ public:
 
     //! Finds all output notes in the given tx that have been sent to a
     //! SaplingPaymentAddress in this wallet
-    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx) const;
+    SaplingNotesAndIVKs FindMySaplingNotes(const CTransaction& tx) const;
+
+    //! Finds all output notes in the given txs (e.g. the ones of a block) that have been sent to a
+    //! SaplingPaymentAddress in this wallet. Returns the result for each tx, in the same order.
+    //! The outputs of all the txs are trial-decrypted in a single parallel batch.
+    std::vector<SaplingNotesAndIVKs> FindMySaplingNotes(const std::vector<CTransactionRef>& vtx) const;
 
     //! Find all of the addresses in the given tx that have been sent to a SaplingPaymentAddress in this wallet.
     std::vector<libzcash::SaplingPaymentAddress> FindMySaplingAddresses(const CTransaction& tx) const;
@@ -413,6 +424,19 @@ private:
     Optional<uint256> commonOVK;
     uint256 getCommonOVKFromSeed() const;
 
+    /* Snapshot of the incoming viewing keys of the wallet (in mapSaplingFullViewingKeys order) */
+    std::vector<libzcash::SaplingIncomingViewingKey> GetSaplingIvks() const;
+    /* Trial-decrypt (in parallel) the shielded outputs of the given txs */
+    std::vector<SaplingNotesAndIVKs> FindMySaplingNotes(const std::vector<const CTransaction*>& vtx) const;
+    /* Resolve the wallet txs owning notes (dropping the ones erased from the wallet) */
+    std::vector<CWalletTx*> GetSaplingNoteTxs();
+
+    /**
+     * Hashes of the wallet txs owning at least one Sapling note. These are the
+     * only ones with witnesses to update, so the per-block witnesses update
+     * doesn't need to go through the whole mapWallet. Guarded by cs_wallet.
+     */
+    std::set<uint256> setSaplingNoteTxs;
 
     /**
      * Used to keep track of spent Notes, and
@@ -35,6 +35,18 @@ struct COrphanTx {
 };
 extern RecursiveMutex g_cs_orphans;
 extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+extern bool AddUnconnectedBlock(const std::shared_ptr<const CBlock>& pblock, NodeId peer);
+extern unsigned int ExpireUnconnectedBlocks(int64_t nNow);
+extern unsigned int EraseUnconnectedBlocksFor(NodeId peer);
+extern void ProcessUnconnectedBlocks(const uint256& hashParent, bool fParentInvalid);
+struct CUnconnectedBlock {
+    std::shared_ptr<const CBlock> block;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nSize;
+};
+extern std::map<uint256, CUnconnectedBlock> mapUnconnectedBlocks GUARDED_BY(cs_main);
+extern size_t nUnconnectedBlocksSize GUARDED_BY(cs_main);
 
 CService ip(uint32_t i)
 {
@@ -261,4 +273,134 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+// A block on top of hashPrev (only its header and its size matter)
+static std::shared_ptr<const CBlock> UnconnectedBlock(const uint256& hashPrev, const CTransactionRef& tx = MakeTransactionRef(CMutableTransaction()))
+{
+    static uint32_t nNonce = 0;
+    auto pblock = std::make_shared<CBlock>();
+    pblock->hashPrevBlock = hashPrev;
+    pblock->nNonce = nNonce++;
+    pblock->vtx.emplace_back(tx);
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_unconnected_blocks_invalid_parent)
+{
+    // Blocks waiting for a parent which is not known
+    const uint256 hashUnknown = InsecureRand256();
+    auto pblock1 = UnconnectedBlock(hashUnknown);
+    auto pblock2 = UnconnectedBlock(pblock1->GetHash());
+    auto pblock3 = UnconnectedBlock(pblock1->GetHash());
+    auto pblock4 = UnconnectedBlock(pblock2->GetHash());
+    // ... for the genesis block, marked as failed
+    const CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis(); );
+    auto pblock5 = UnconnectedBlock(pindexGenesis->GetBlockHash());
+    auto pblock6 = UnconnectedBlock(pblock5->GetHash());
+    // ... and for a parent still expected
+    const uint256 hashExpected = InsecureRand256();
+    auto pblock7 = UnconnectedBlock(hashExpected);
+    {
+        LOCK(cs_main);
+        for (const auto& pblock : {pblock1, pblock2, pblock3, pblock4, pblock5, pblock6, pblock7}) {
+            BOOST_CHECK(AddUnconnectedBlock(pblock, 0));
+        }
+        BOOST_CHECK(!AddUnconnectedBlock(pblock1, 0));
+        BOOST_CHECK_EQUAL(mapUnconnectedBlocks.size(), 7);
+    }
+
+    // The descendants of an unknown parent are dropped (also the ones waiting for a dropped block)
+    ProcessUnconnectedBlocks(hashUnknown, false);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(mapUnconnectedBlocks.size(), 3);
+        BOOST_CHECK(!mapUnconnectedBlocks.count(pblock4->GetHash()));
+    }
+
+    // The descendants of a failed parent are dropped, without being processed
+    {
+        LOCK(cs_main);
+        mapBlockIndex.at(pindexGenesis->GetBlockHash())->nStatus |= BLOCK_FAILED_VALID;
+    }
+    ProcessUnconnectedBlocks(pindexGenesis->GetBlockHash(), false);
+    {
+        LOCK(cs_main);
+        mapBlockIndex.at(pindexGenesis->GetBlockHash())->nStatus &= ~BLOCK_FAILED_VALID;
+        BOOST_CHECK_EQUAL(mapUnconnectedBlocks.size(), 1);
+        BOOST_CHECK(mapUnconnectedBlocks.count(pblock7->GetHash()));
+        BOOST_CHECK_EQUAL(nUnconnectedBlocksSize, ::GetSerializeSize(*pblock7, PROTOCOL_VERSION));
+
+        BOOST_CHECK_EQUAL(EraseUnconnectedBlocksFor(0), 1);
+        BOOST_CHECK(mapUnconnectedBlocks.empty());
+        BOOST_CHECK_EQUAL(nUnconnectedBlocksSize, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DoS_unconnected_blocks_peer_disconnect)
+{
+    CAddress addr(ip(0xa0b0c003), NODE_NONE);
+    CNode dummyNode(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr, 5, 5, "", true);
+    dummyNode.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode);
+    const NodeId otherId = id++;
+
+    auto pblock1 = UnconnectedBlock(InsecureRand256());
+    auto pblock2 = UnconnectedBlock(pblock1->GetHash());
+    auto pblock3 = UnconnectedBlock(pblock1->GetHash());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(AddUnconnectedBlock(pblock1, dummyNode.GetId()));
+        BOOST_CHECK(AddUnconnectedBlock(pblock2, dummyNode.GetId()));
+        BOOST_CHECK(AddUnconnectedBlock(pblock3, otherId));
+    }
+
+    // The blocks of the disconnected peer are dropped
+    bool fUpdateConnectionTime;
+    peerLogic->FinalizeNode(dummyNode.GetId(), fUpdateConnectionTime);
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(mapUnconnectedBlocks.size(), 1);
+    BOOST_CHECK(mapUnconnectedBlocks.count(pblock3->GetHash()));
+    BOOST_CHECK_EQUAL(nUnconnectedBlocksSize, ::GetSerializeSize(*pblock3, PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(EraseUnconnectedBlocksFor(otherId), 1);
+    BOOST_CHECK_EQUAL(nUnconnectedBlocksSize, 0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_unconnected_blocks_limits)
+{
+    const int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+
+    // A 1 MB transaction (shared by the blocks)
+    CMutableTransaction mtx;
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(1000000, 0);
+    const CTransactionRef tx = MakeTransactionRef(mtx);
+
+    // Kept up to the total size limit
+    LOCK(cs_main);
+    const uint256 hashPrev = InsecureRand256();
+    size_t nAdded = 0;
+    while (AddUnconnectedBlock(UnconnectedBlock(hashPrev, tx), 0)) {
+        nAdded++;
+    }
+    BOOST_CHECK_EQUAL(nAdded, MAX_UNCONNECTED_BLOCKS_SIZE / ::GetSerializeSize(*UnconnectedBlock(hashPrev, tx), PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(mapUnconnectedBlocks.size(), nAdded);
+    BOOST_CHECK(nUnconnectedBlocksSize <= MAX_UNCONNECTED_BLOCKS_SIZE);
+    // a small block still fits
+    BOOST_CHECK(AddUnconnectedBlock(UnconnectedBlock(hashPrev), 0));
+
+    // Expired after UNCONNECTED_BLOCK_EXPIRE_TIME
+    BOOST_CHECK_EQUAL(ExpireUnconnectedBlocks(nStartTime + UNCONNECTED_BLOCK_EXPIRE_TIME - 1), 0);
+    SetMockTime(nStartTime + 60);
+    auto pblockLater = UnconnectedBlock(hashPrev);
+    BOOST_CHECK(AddUnconnectedBlock(pblockLater, 0));
+    BOOST_CHECK_EQUAL(ExpireUnconnectedBlocks(nStartTime + UNCONNECTED_BLOCK_EXPIRE_TIME), nAdded + 1);
+    BOOST_CHECK_EQUAL(mapUnconnectedBlocks.size(), 1);
+    BOOST_CHECK(mapUnconnectedBlocks.count(pblockLater->GetHash()));
+    BOOST_CHECK_EQUAL(ExpireUnconnectedBlocks(nStartTime + 60 + UNCONNECTED_BLOCK_EXPIRE_TIME), 1);
+    BOOST_CHECK(mapUnconnectedBlocks.empty());
+    BOOST_CHECK_EQUAL(nUnconnectedBlocksSize, 0);
+
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
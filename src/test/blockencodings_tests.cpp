@@ -0,0 +1,160 @@
+// Copyright (c) 2016-2020 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockencodings.h"
+#include "consensus/merkle.h"
+#include "policy/feerate.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static CMutableTransaction BuildTx(const uint256& prevHash, int n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prevHash, n);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 1000 + n;
+    return tx;
+}
+
+// Coinbase (or empty PoS coinbase and coinstake) followed by nTxes transactions
+static CBlock BuildBlock(bool fProofOfStake, int nTxes)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    if (fProofOfStake) {
+        coinbase.vout[0].SetEmpty();
+    } else {
+        coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        coinbase.vout[0].nValue = 250;
+    }
+    block.vtx.emplace_back(MakeTransactionRef(coinbase));
+    if (fProofOfStake) {
+        CMutableTransaction coinstake = BuildTx(InsecureRand256(), 0);
+        coinstake.vout.insert(coinstake.vout.begin(), CTxOut(0, CScript()));
+        block.vtx.emplace_back(MakeTransactionRef(coinstake));
+        BOOST_CHECK(block.vtx[1]->IsCoinStake());
+        block.vchBlockSig = {0x30, 0x44, 0x02, 0x20};
+    }
+    const uint256 prevHash = InsecureRand256();
+    for (int i = 0; i < nTxes; i++) {
+        block.vtx.emplace_back(MakeTransactionRef(BuildTx(prevHash, i)));
+    }
+    block.nVersion = 10;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+    block.nTime = 1600000000;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs ret;
+    stream >> ret;
+    BOOST_CHECK(stream.empty());
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(cmpctblock_reconstruction)
+{
+    for (bool fProofOfStake : {false, true}) {
+        const CBlock block = BuildBlock(fProofOfStake, 4);
+        const size_t nPrefilled = fProofOfStake ? 2 : 1;
+        CTxMemPool pool(CFeeRate(0));
+        TestMemPoolEntryHelper entry;
+        // All the transactions in the mempool, but the last one
+        for (size_t i = nPrefilled; i < block.vtx.size() - 1; i++) {
+            pool.addUnchecked(block.vtx[i]->GetHash(), entry.FromTx(*block.vtx[i]));
+        }
+
+        const CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+        BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+        BOOST_CHECK(cmpctblock.vchBlockSig == block.vchBlockSig);
+        // The cmpctblock is much smaller than the block
+        BOOST_CHECK(GetSerializeSize(cmpctblock, PROTOCOL_VERSION) < GetSerializeSize(block, PROTOCOL_VERSION));
+
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(cmpctblock, {}) == READ_STATUS_OK);
+        for (size_t i = 0; i < block.vtx.size() - 1; i++) {
+            BOOST_CHECK(partialBlock.IsTxAvailable(i));
+        }
+        BOOST_CHECK(!partialBlock.IsTxAvailable(block.vtx.size() - 1));
+        BOOST_CHECK_EQUAL(partialBlock.GetMissingCount(), 1);
+
+        // Wrong number of missing transactions
+        {
+            PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+            CBlock block2;
+            BOOST_CHECK(partialBlockCopy.FillBlock(block2, {}) == READ_STATUS_INVALID);
+        }
+        // Wrong missing transaction: merkle root mismatch, the block must be downloaded in full
+        {
+            PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+            CBlock block2;
+            BOOST_CHECK(partialBlockCopy.FillBlock(block2, {block.vtx[nPrefilled]}) == READ_STATUS_FAILED);
+        }
+
+        CBlock block2;
+        BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx.back()}) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block2.GetHash(), block.GetHash());
+        BOOST_CHECK_EQUAL(block2.vtx.size(), block.vtx.size());
+        BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+        BOOST_CHECK_EQUAL(BlockMerkleRoot(block2), block.hashMerkleRoot);
+        BOOST_CHECK_EQUAL(block2.IsProofOfStake(), fProofOfStake);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cmpctblock_extra_txn)
+{
+    // Nothing in the mempool: the transactions are found in the extra (orphan) pool
+    const CBlock block = BuildBlock(false, 3);
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<std::pair<uint256, CTransactionRef>> vExtraTxn;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        vExtraTxn.emplace_back(block.vtx[i]->GetHash(), block.vtx[i]);
+    }
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(RoundTrip(CBlockHeaderAndShortTxIDs(block)), vExtraTxn) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.GetMissingCount(), 0);
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash(), block.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(blocktxn_request_roundtrip)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = InsecureRand256();
+    req1.indexes = {0, 1, 3, 4, std::numeric_limits<uint16_t>::max()};
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+    BlockTransactionsRequest req2;
+    stream >> req2;
+    BOOST_CHECK_EQUAL(req1.blockhash, req2.blockhash);
+    BOOST_CHECK(req1.indexes == req2.indexes);
+
+    // Indexes not in increasing order can't be encoded
+    req1.indexes = {3, 1};
+    CDataStream stream2(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_THROW(stream2 << req1, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
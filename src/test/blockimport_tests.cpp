@@ -0,0 +1,206 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockassembler.h"
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, RegTestingSetup)
+
+// A valid block on top of prev_hash
+static std::shared_ptr<const CBlock> ImportTestBlock(const uint256& prev_hash)
+{
+    static int i = 0;
+    static uint32_t nTime = Params().GenesisBlock().nTime;
+
+    CScript pubKey;
+    pubKey << i++ << OP_TRUE;
+
+    auto ptemplate = BlockAssembler(Params(), false).CreateNewBlock(pubKey);
+    auto pblock = std::make_shared<CBlock>(ptemplate->block);
+    pblock->hashPrevBlock = prev_hash;
+    pblock->nTime = ++nTime;
+
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
+    txCoinbase.vout.resize(1);
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+
+    return FinalizeBlock(pblock);
+}
+
+// Chain of nBlocks blocks on top of the genesis block
+static std::vector<std::shared_ptr<const CBlock>> ImportTestChain(size_t nBlocks)
+{
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    uint256 hashPrev = Params().GenesisBlock().GetHash();
+    for (size_t i = 0; i < nBlocks; i++) {
+        vBlocks.emplace_back(ImportTestBlock(hashPrev));
+        hashPrev = vBlocks.back()->GetHash();
+    }
+    return vBlocks;
+}
+
+// Append a block file record (network magic, size, block), return the position of the block
+static unsigned int WriteRecord(CDataStream& ss, const CBlock& block)
+{
+    ss.write((const char*)Params().MessageStart(), MESSAGE_START_SIZE);
+    ss << (uint32_t)::GetSerializeSize(block, CLIENT_VERSION);
+    const unsigned int nPos = ss.size();
+    ss << block;
+    return nPos;
+}
+
+// Append a record of nSize bytes which fails to deserialize, with the given bytes inside
+static void WriteCorruptRecord(CDataStream& ss, const CDataStream& inner, uint32_t nSize)
+{
+    ss.write((const char*)Params().MessageStart(), MESSAGE_START_SIZE);
+    ss << nSize;
+    // a null header, then a transactions count too large
+    std::vector<unsigned char> vBody(80, 0);
+    vBody.insert(vBody.end(), 9, 0xff);
+    ss.write((const char*)vBody.data(), vBody.size());
+    ss.write(inner.data(), inner.size());
+}
+
+static fs::path WriteImportFile(const CDataStream& ss)
+{
+    const fs::path path = GetDataDir() / "import.dat";
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(ss.data(), 1, ss.size(), file), ss.size());
+    fclose(file);
+    return path;
+}
+
+static std::vector<CImportedBlock> ImportAll(const fs::path& path, int nWorkers)
+{
+    std::vector<CImportedBlock> vImported;
+    CBlockFileImporter importer(fsbridge::fopen(path, "rb"), nullptr, nWorkers);
+    CImportedBlock imported;
+    while (importer.Next(imported)) {
+        vImported.emplace_back(imported);
+    }
+    return vImported;
+}
+
+static void CheckImported(const std::vector<CImportedBlock>& vImported,
+                          const std::vector<std::shared_ptr<const CBlock>>& vExpected,
+                          const std::vector<unsigned int>& vExpectedPos)
+{
+    BOOST_REQUIRE_EQUAL(vImported.size(), vExpected.size());
+    for (size_t i = 0; i < vImported.size(); i++) {
+        BOOST_CHECK_EQUAL(vImported[i].hash, vExpected[i]->GetHash());
+        BOOST_CHECK_EQUAL(vImported[i].block->GetHash(), vExpected[i]->GetHash());
+        BOOST_CHECK_EQUAL(vImported[i].pos.nPos, vExpectedPos[i]);
+        BOOST_CHECK_EQUAL(vImported[i].nSize, ::GetSerializeSize(*vExpected[i], CLIENT_VERSION));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(import_file_order)
+{
+    // Blocks are returned in file order (not chain order), over several batches
+    const auto& vChain = ImportTestChain(10);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<std::shared_ptr<const CBlock>> vExpected;
+    std::vector<unsigned int> vExpectedPos;
+    for (size_t i = 0; i < 300; i++) {
+        vExpected.emplace_back(vChain[(i * 7) % vChain.size()]);
+        vExpectedPos.emplace_back(WriteRecord(ss, *vExpected.back()));
+        // garbage between the records is skipped
+        if (i % 50 == 0) ss << std::string("garbage");
+    }
+    const fs::path& path = WriteImportFile(ss);
+    for (int nWorkers : {1, 4}) {
+        CheckImported(ImportAll(path, nWorkers), vExpected, vExpectedPos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(import_corrupt_record)
+{
+    // A record failing to deserialize, with a block written over it: the file is
+    // scanned again from the byte after its magic, and the batches read after it
+    // (in flight with the workers) are dropped and read again.
+    const auto& vChain = ImportTestChain(3);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<std::shared_ptr<const CBlock>> vExpected;
+    std::vector<unsigned int> vExpectedPos;
+    for (size_t i = 0; i < 200; i++) {
+        vExpected.emplace_back(vChain[0]);
+        vExpectedPos.emplace_back(WriteRecord(ss, *vChain[0]));
+    }
+    CDataStream inner(SER_DISK, CLIENT_VERSION);
+    const unsigned int nInnerPos = WriteRecord(inner, *vChain[1]);
+    const unsigned int nCorruptPos = ss.size();
+    WriteCorruptRecord(ss, inner, 80 + 9 + inner.size() + 100);
+    vExpected.emplace_back(vChain[1]);
+    vExpectedPos.emplace_back(nCorruptPos + 8 + 80 + 9 + nInnerPos);
+    // the rest of the claimed size of the corrupt record
+    ss << std::vector<unsigned char>(99, 0);
+    for (size_t i = 0; i < 200; i++) {
+        vExpected.emplace_back(vChain[2]);
+        vExpectedPos.emplace_back(WriteRecord(ss, *vChain[2]));
+    }
+    const fs::path& path = WriteImportFile(ss);
+    for (int nWorkers : {1, 4}) {
+        CheckImported(ImportAll(path, nWorkers), vExpected, vExpectedPos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(import_truncated_eof)
+{
+    const auto& vChain = ImportTestChain(3);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<std::shared_ptr<const CBlock>> vExpected;
+    std::vector<unsigned int> vExpectedPos;
+    for (size_t i = 0; i < 2; i++) {
+        vExpected.emplace_back(vChain[i]);
+        vExpectedPos.emplace_back(WriteRecord(ss, *vChain[i]));
+    }
+
+    // The last block is cut by the end of the file
+    CDataStream ssTruncated(ss);
+    CDataStream last(SER_DISK, CLIENT_VERSION);
+    WriteRecord(last, *vChain[2]);
+    ssTruncated.write(last.data(), last.size() / 2);
+    CheckImported(ImportAll(WriteImportFile(ssTruncated), 2), vExpected, vExpectedPos);
+
+    // A record whose size goes past the end of the file, with a complete block inside
+    ss.write((const char*)Params().MessageStart(), MESSAGE_START_SIZE);
+    ss << (uint32_t)(last.size() + 1000);
+    vExpected.emplace_back(vChain[2]);
+    vExpectedPos.emplace_back(WriteRecord(ss, *vChain[2]));
+    CheckImported(ImportAll(WriteImportFile(ss), 2), vExpected, vExpectedPos);
+}
+
+BOOST_AUTO_TEST_CASE(load_external_block_file)
+{
+    // Out of order blocks, a block hidden in a corrupt record and a block cut by
+    // the end of the file: the chain is connected up to the last complete block
+    const auto& vChain = ImportTestChain(6);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    WriteRecord(ss, *vChain[0]);
+    WriteRecord(ss, *vChain[2]);
+    CDataStream inner(SER_DISK, CLIENT_VERSION);
+    WriteRecord(inner, *vChain[1]);
+    WriteCorruptRecord(ss, inner, 80 + 9 + inner.size());
+    WriteRecord(ss, *vChain[4]);
+    WriteRecord(ss, *vChain[3]);
+    CDataStream last(SER_DISK, CLIENT_VERSION);
+    WriteRecord(last, *vChain[5]);
+    ss.write(last.data(), last.size() - 1);
+
+    BOOST_CHECK(LoadExternalBlockFile(fsbridge::fopen(WriteImportFile(ss), "rb")));
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 5);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), vChain[4]->GetHash());
+    BOOST_CHECK(mapBlockIndex.count(vChain[5]->GetHash()) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
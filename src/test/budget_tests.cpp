@@ -6,6 +6,8 @@
 
 #include "test/util/blocksutil.h"
 #include "budget/budgetmanager.h"
+#include "budget/budgetvotecheck.h"
+#include "evo/deterministicmns.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "spork.h"
@@ -290,4 +292,58 @@ BOOST_FIXTURE_TEST_CASE(IsCoinbaseValueValid_test, TestingSetup)
 
 }
 
+BOOST_FIXTURE_TEST_CASE(budget_votes_signature_checks, BasicTestingSetup)
+{
+    // Votes signed by the expected key (even) or by another one (odd)
+    const size_t nVotes = 200;
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    const CKeyID keyID = key.GetPubKey().GetID();
+    std::vector<CBudgetVote> vVotes;
+    std::vector<CFinalizedBudgetVote> vFinVotes;
+    for (size_t i = 0; i < nVotes; i++) {
+        const CTxIn vin(GetRandHash(), 0);
+        vVotes.emplace_back(vin, GetRandHash(), CBudgetVote::VOTE_YES);
+        vFinVotes.emplace_back(vin, GetRandHash());
+        const CKey& signer = (i % 2 == 0) ? key : otherKey;
+        BOOST_CHECK(vVotes.back().Sign(signer, signer.GetPubKey().GetID()));
+        BOOST_CHECK(vFinVotes.back().Sign(signer, signer.GetPubKey().GetID()));
+    }
+
+    // The signers of unknown masternodes are not found
+    CBudgetVoteSigner signer;
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    BOOST_CHECK(!g_budgetman.GetVoteSigner(vVotes[0].GetVin(), mnList, false, signer));
+    BOOST_CHECK(signer.IsNull());
+
+    auto runChecks = [&](int nThreads) {
+        SetBudgetVoteCheckThreads(nThreads);
+        std::unique_ptr<bool[]> results(new bool[2 * nVotes]());
+        std::vector<CSignedMessageCheck> vChecks;
+        for (size_t i = 0; i < nVotes; i++) {
+            vChecks.emplace_back(&vVotes[i], keyID, &results[i]);
+            vChecks.emplace_back(&vFinVotes[i], keyID, &results[nVotes + i]);
+        }
+        RunSignedMessageChecks(vChecks);
+        for (size_t i = 0; i < nVotes; i++) {
+            BOOST_CHECK_EQUAL(results[i], i % 2 == 0);
+            BOOST_CHECK_EQUAL(results[nVotes + i], i % 2 == 0);
+        }
+    };
+
+    // In the calling thread
+    runChecks(0);
+
+    // Spread over the worker threads
+    boost::thread_group tg;
+    for (int i = 0; i < 3; i++) {
+        tg.create_thread(&ThreadBudgetVoteCheck);
+    }
+    runChecks(4);
+    tg.interrupt_all();
+    tg.join_all();
+    SetBudgetVoteCheckThreads(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_pivx.h"
+
+#include <atomic>
+
+#include <boost/thread/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+static const unsigned int QUEUE_BATCH_SIZE = 128;
+static const int QUEUE_THREADS = 4;
+
+static std::atomic<uint64_t> nChecksRun{0};
+
+struct FakeCheck
+{
+    bool fOk{true};
+    FakeCheck() {}
+    explicit FakeCheck(bool fOkIn) : fOk(fOkIn) {}
+    bool operator()()
+    {
+        nChecksRun++;
+        return fOk;
+    }
+    void swap(FakeCheck& x) { std::swap(fOk, x.fOk); }
+};
+
+typedef CWorkStealingCheckQueue<FakeCheck> FakeCheckQueue;
+
+BOOST_AUTO_TEST_CASE(workstealing_queue_all_checks)
+{
+    FakeCheckQueue queue(QUEUE_BATCH_SIZE, QUEUE_THREADS);
+    boost::thread_group tg;
+    for (int i = 0; i < QUEUE_THREADS - 1; i++) {
+        tg.create_thread([&]{queue.Thread();});
+    }
+
+    // Different numbers of checks, added in batches of different sizes
+    for (size_t nBatches : {0, 1, 3, 50, 1000}) {
+        nChecksRun = 0;
+        size_t nTotal = 0;
+        {
+            CCheckQueueControl<FakeCheck, FakeCheckQueue> control(&queue);
+            for (size_t i = 0; i < nBatches; i++) {
+                std::vector<FakeCheck> vChecks(1 + (i % 7));
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecksRun, nTotal);
+        const CCheckQueueStats& stats = queue.GetLastStats();
+        BOOST_CHECK_EQUAL(stats.nChecks, nTotal);
+        BOOST_CHECK(stats.nThreads >= 1 && stats.nThreads <= QUEUE_THREADS);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(workstealing_queue_failure)
+{
+    FakeCheckQueue queue(QUEUE_BATCH_SIZE, QUEUE_THREADS);
+    boost::thread_group tg;
+    for (int i = 0; i < QUEUE_THREADS - 1; i++) {
+        tg.create_thread([&]{queue.Thread();});
+    }
+
+    for (size_t nFailPos : {0, 1, 500, 999}) {
+        CCheckQueueControl<FakeCheck, FakeCheckQueue> control(&queue);
+        for (size_t i = 0; i < 100; i++) {
+            std::vector<FakeCheck> vChecks;
+            for (size_t j = 0; j < 10; j++) {
+                vChecks.emplace_back(i * 10 + j != nFailPos);
+            }
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(!control.Wait());
+        // The failure is reset for the next run
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    // And a valid run after the failed ones
+    {
+        CCheckQueueControl<FakeCheck, FakeCheckQueue> control(&queue);
+        std::vector<FakeCheck> vChecks(100);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 
 #include "coins.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -1056,7 +1057,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinsMapEntry(map, value, flags);
     CAnchorsSaplingMap mapSaplingAnchors;
     CNullifiersMap mapSaplingNullifiers;
@@ -1320,4 +1322,91 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(coins_db_flush)
+{
+    // Flush a cache to the coin database in small batches, with the dirty coins
+    // serialized by several threads (run by this one, as no worker is started).
+    CCoinsViewDB db(1 << 23, true, true);
+    gArgs.ForceSetArg("-dbbatchsize", "16384");
+    SetCoinsFlushThreads(4);
+
+    std::map<COutPoint, Coin> expected;
+    const uint256 hashBlock1 = InsecureRand256();
+    {
+        CCoinsViewCache cache(&db);
+        const size_t nEmptyUsage = cache.DynamicMemoryUsage();
+        for (int i = 0; i < 10000; i++) {
+            COutPoint out(InsecureRand256(), InsecureRandBits(4));
+            Coin coin;
+            coin.out.nValue = InsecureRand32();
+            coin.out.scriptPubKey.assign(InsecureRand32() & 0x3F, 0);
+            coin.nHeight = 1 + InsecureRandBits(10);
+            expected[out] = coin;
+            cache.AddCoin(out, std::move(coin), false);
+        }
+        cache.SetBestBlock(hashBlock1);
+        BOOST_CHECK(cache.DynamicMemoryUsage() > nEmptyUsage);
+        BOOST_CHECK(cache.Flush());
+        // The flush releases the memory pool of the coins
+        BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nEmptyUsage);
+    }
+    std::vector<CoinsFlushStats> vStats = GetCoinsFlushStats(MAX_COINS_FLUSH_STATS);
+    BOOST_REQUIRE(!vStats.empty());
+    BOOST_CHECK(vStats[0].hashBlock == hashBlock1);
+    BOOST_CHECK_EQUAL(vStats[0].nCoins, expected.size());
+    BOOST_CHECK_EQUAL(vStats[0].nWritten, expected.size());
+    BOOST_CHECK_EQUAL(vStats[0].nErased, 0U);
+    BOOST_CHECK_EQUAL(vStats[0].nThreads, 4);
+    BOOST_CHECK(vStats[0].nBatches > 1);
+
+    // Spend a third of the coins, fetching another third
+    const uint256 hashBlock2 = InsecureRand256();
+    size_t nSpent = 0;
+    size_t nFetched = 0;
+    {
+        CCoinsViewCache cache(&db);
+        int i = 0;
+        for (auto it = expected.begin(); it != expected.end(); i++) {
+            if (i % 3 == 0) {
+                cache.SpendCoin(it->first);
+                it = expected.erase(it);
+                nSpent++;
+                continue;
+            }
+            if (i % 3 == 1) {
+                BOOST_CHECK(cache.HaveCoin(it->first));
+                nFetched++;
+            }
+            ++it;
+        }
+        cache.SetBestBlock(hashBlock2);
+        BOOST_CHECK(cache.Flush());
+    }
+    vStats = GetCoinsFlushStats(1);
+    BOOST_REQUIRE_EQUAL(vStats.size(), 1U);
+    BOOST_CHECK(vStats[0].hashBlock == hashBlock2);
+    BOOST_CHECK_EQUAL(vStats[0].nCoins, nSpent + nFetched);
+    BOOST_CHECK_EQUAL(vStats[0].nWritten, nSpent);
+    BOOST_CHECK_EQUAL(vStats[0].nErased, nSpent);
+
+    // The database holds exactly the unspent coins, and is consistent with the last block
+    BOOST_CHECK(db.GetBestBlock() == hashBlock2);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    size_t nFound = 0;
+    std::unique_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        auto it = expected.find(key);
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK(coin == it->second);
+        nFound++;
+    }
+    BOOST_CHECK_EQUAL(nFound, expected.size());
+
+    SetCoinsFlushThreads(0);
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
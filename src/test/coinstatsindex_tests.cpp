@@ -0,0 +1,138 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "index/coinstatsindex.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+// Compares the statistics of the index at the tip with a walk of the UTXO set
+static void CheckStatsMatchUTXOSet(const CoinStatsIndex& index)
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+    const CBlockIndex* tip = chainActive.Tip();
+
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs = 0;
+    CAmount nTotalAmount = 0;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsTip->Cursor());
+    BOOST_CHECK(pcursor->GetBestBlock() == tip->GetBlockHash());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        ApplyCoinHash(muhash, key, coin);
+        nTransactionOutputs++;
+        nTotalAmount += coin.out.nValue;
+    }
+    uint256 utxo_set_hash;
+    muhash.Finalize(utxo_set_hash);
+
+    CCoinsStatsEntry entry;
+    BOOST_REQUIRE(index.LookUpStats(tip, entry));
+    BOOST_CHECK(entry.muhash == utxo_set_hash);
+    BOOST_CHECK_EQUAL(entry.nTransactionOutputs, nTransactionOutputs);
+    BOOST_CHECK_EQUAL(entry.nTotalAmount, nTotalAmount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    CCoinsStatsEntry entry;
+
+    // The stats should not be found in the index before it is started.
+    BOOST_CHECK(!coin_stats_index.LookUpStats(tip, entry));
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+    BOOST_CHECK(coin_stats_index.IsSynced());
+    CheckStatsMatchUTXOSet(coin_stats_index);
+
+    // The outputs of the genesis block are not in the UTXO set
+    const CBlockIndex* genesis_block_index = WITH_LOCK(cs_main, return chainActive.Genesis(); );
+    BOOST_CHECK(coin_stats_index.LookUpStats(genesis_block_index, entry));
+    BOOST_CHECK_EQUAL(entry.nTransactionOutputs, 0U);
+    BOOST_CHECK(entry.nBlockUnspendable > 0);
+    BOOST_CHECK_EQUAL(entry.nTotalUnspendable, entry.nBlockUnspendable);
+
+    // Spend a mature coinbase output, with a data output (not added to the UTXO set)
+    const CScript coinbase_script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CAmount coinbase_value = coinbaseTxns[0].vout[0].nValue;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.emplace_back(COutPoint(coinbaseTxns[0].GetHash(), 0));
+    spend.vout.emplace_back(11 * CENT, coinbase_script_pub_key);
+    spend.vout.emplace_back(1 * CENT, CScript() << OP_RETURN);
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script_pub_key, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == block.GetHash());
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckStatsMatchUTXOSet(coin_stats_index);
+
+    const CBlockIndex* spend_block_index = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(spend_block_index, entry));
+    const CAmount fee = coinbase_value - 12 * CENT;
+    BOOST_CHECK_EQUAL(entry.nBlockPrevoutSpent, coinbase_value);
+    BOOST_CHECK_EQUAL(entry.nBlockNewOutputs, block.vtx[0]->GetValueOut() + 11 * CENT);
+    BOOST_CHECK_EQUAL(entry.nBlockUnspendable, 1 * CENT);
+    BOOST_CHECK_EQUAL(entry.nBlockShielded, 0);
+    BOOST_CHECK_EQUAL(entry.GetBlockIssued(), block.vtx[0]->GetValueOut() - fee);
+
+    // Disconnect the block: the index is rewound to the previous state, and
+    // the entry of the disconnected block is still found by its hash
+    {
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), WITH_LOCK(cs_main, return chainActive.Tip(); )));
+    }
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckStatsMatchUTXOSet(coin_stats_index);
+    CCoinsStatsEntry disconnected_entry;
+    BOOST_CHECK(coin_stats_index.LookUpStats(spend_block_index, disconnected_entry));
+    BOOST_CHECK(disconnected_entry.muhash == entry.muhash);
+
+    // Connect a different block at the same height
+    CKey key;
+    key.MakeNewKey(true);
+    CreateAndProcessBlock({}, GetScriptForDestination(key.GetPubKey().GetID()));
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckStatsMatchUTXOSet(coin_stats_index);
+
+    // shutdown sequence (c.f. PrepareShutdown in init.cpp)
+    coin_stats_index.Interrupt();
+    coin_stats_index.Stop();
+
+    // Let scheduler events finish running to avoid accessing memory that is going to be unloaded
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -93,7 +93,7 @@ static void SignTransaction(CMutableTransaction& tx, const CKey& coinbaseKey)
     for (size_t i = 0; i < tx.vin.size(); i++) {
         CTransactionRef txFrom;
         uint256 hashBlock;
-        BOOST_ASSERT(GetTransaction(tx.vin[i].prevout.hash, txFrom, hashBlock));
+        BOOST_ASSERT(GetTransaction(tx.vin[i].prevout.hash, txFrom, hashBlock, true));
         BOOST_ASSERT(SignSignature(tempKeystore, *txFrom, tx, i, SIGHASH_ALL));
     }
 }
@@ -250,7 +250,7 @@ static bool CheckTransactionSignature(const CMutableTransaction& tx)
         const auto& txin = tx.vin[i];
         CTransactionRef txFrom;
         uint256 hashBlock;
-        BOOST_ASSERT(GetTransaction(txin.prevout.hash, txFrom, hashBlock));
+        BOOST_ASSERT(GetTransaction(txin.prevout.hash, txFrom, hashBlock, true));
 
         CAmount amount = txFrom->vout[txin.prevout.n].nValue;
         if (!VerifyScript(txin.scriptSig, txFrom->vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(&tx, i, amount), tx.GetRequiredSigVersion())) {
@@ -788,4 +788,90 @@ BOOST_FIXTURE_TEST_CASE(dip3_protx, TestChain400Setup)
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V6_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
+static void CheckSameList(const CDeterministicMNList& a, const CDeterministicMNList& b)
+{
+    BOOST_CHECK(a.GetBlockHash() == b.GetBlockHash());
+    BOOST_CHECK_EQUAL(a.GetHeight(), b.GetHeight());
+    BOOST_CHECK_EQUAL(a.GetAllMNsCount(), b.GetAllMNsCount());
+    a.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) { BOOST_CHECK(b.HasMN(dmn->proTxHash)); });
+}
+
+// Lookups of the lists through the layers (lists cache, in-memory snapshots and diffs, disk), and their metrics
+BOOST_FIXTURE_TEST_CASE(dip3_list_cache, TestChain400Setup)
+{
+    auto utxos = BuildSimpleUtxoMap(coinbaseTxns);
+    const int nActivationHeight = chainActive.Height() + 2;
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V6_0, nActivationHeight);
+
+    // last block before enforcement, and first one (with the initial snapshot on disk)
+    CreateAndProcessBlock({}, coinbaseKey);
+    CreateAndProcessBlock({}, coinbaseKey);
+    // register a MN, then build a few memory snapshot periods on top
+    auto tx = CreateProRegTx(nullopt, utxos, 1, GenerateRandomAddress(), coinbaseKey, GetRandomKey(), GetRandomKey());
+    CreateAndProcessBlock({tx}, coinbaseKey);
+    for (int i = 0; i < 70; i++) {
+        CreateAndProcessBlock({}, coinbaseKey);
+    }
+    SyncWithValidationInterfaceQueue();
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const int nTipHeight = pindexTip->nHeight;
+
+    // A new manager, on the same db, starts with empty caches
+    CDeterministicMNManager mnManager(*evoDb);
+    CDeterministicMNListCacheStats stats = mnManager.GetCacheStats();
+    BOOST_CHECK_EQUAL(stats.nLookups, 0U);
+    BOOST_CHECK_EQUAL(stats.nCachedLists, 0U);
+    BOOST_CHECK_EQUAL(stats.nCachedDiffs, 0U);
+
+    // Not enforced yet: not counted
+    BOOST_CHECK_EQUAL(mnManager.GetListForBlock(chainActive[nActivationHeight - 1]).GetAllMNsCount(), 0U);
+    BOOST_CHECK_EQUAL(mnManager.GetCacheStats().nLookups, 0U);
+
+    // Tip: all the diffs since the initial snapshot are read from disk and replayed
+    CDeterministicMNList mnList = mnManager.GetListForBlock(pindexTip);
+    CheckSameList(mnList, deterministicMNManager->GetListForBlock(pindexTip));
+    BOOST_CHECK(mnList.HasMN(tx.GetHash()));
+    const uint64_t nReplayed = nTipHeight - nActivationHeight;
+    stats = mnManager.GetCacheStats();
+    BOOST_CHECK_EQUAL(stats.nLookups, 1U);
+    BOOST_CHECK_EQUAL(stats.nCacheHits, 0U);
+    BOOST_CHECK_EQUAL(stats.nSnapshotReads, 1U);
+    BOOST_CHECK_EQUAL(stats.nDiffsReplayed, nReplayed);
+    BOOST_CHECK_EQUAL(stats.nMaxDiffsReplayed, nReplayed);
+    BOOST_CHECK_EQUAL(stats.nCachedDiffs, (size_t) nReplayed);
+    // the tip, the initial snapshot and the lists at each memory snapshot period
+    const int nPeriod = 32;
+    const int nFirstPeriod = (nActivationHeight / nPeriod + 1) * nPeriod;
+    const int nLastPeriod = ((nTipHeight - 1) / nPeriod) * nPeriod;
+    BOOST_CHECK(nLastPeriod > nFirstPeriod);
+    BOOST_CHECK_EQUAL(stats.nCachedLists, (size_t) (2 + (nLastPeriod - nFirstPeriod) / nPeriod + 1));
+
+    // Tip again: lists cache hit
+    CheckSameList(mnManager.GetListForBlock(pindexTip), mnList);
+    stats = mnManager.GetCacheStats();
+    BOOST_CHECK_EQUAL(stats.nLookups, 2U);
+    BOOST_CHECK_EQUAL(stats.nCacheHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nDiffsReplayed, nReplayed);
+
+    // A block between two memory snapshots: only the cached diffs since the previous one are replayed
+    const CBlockIndex* pindex = chainActive[nLastPeriod - 5];
+    CheckSameList(mnManager.GetListForBlock(pindex), deterministicMNManager->GetListForBlock(pindex));
+    stats = mnManager.GetCacheStats();
+    BOOST_CHECK_EQUAL(stats.nLookups, 3U);
+    BOOST_CHECK_EQUAL(stats.nCacheHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nSnapshotReads, 1U);
+    BOOST_CHECK_EQUAL(stats.nDiffsReplayed, nReplayed + nPeriod - 5);
+    BOOST_CHECK_EQUAL(stats.nMaxDiffsReplayed, nReplayed);
+
+    // The memory snapshot itself, and the block just looked up: lists cache hits
+    mnManager.GetListForBlock(chainActive[nLastPeriod - nPeriod]);
+    mnManager.GetListForBlock(pindex);
+    stats = mnManager.GetCacheStats();
+    BOOST_CHECK_EQUAL(stats.nLookups, 5U);
+    BOOST_CHECK_EQUAL(stats.nCacheHits, 3U);
+    BOOST_CHECK_EQUAL(stats.nDiffsReplayed, nReplayed + nPeriod - 5);
+
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V6_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "primitives/block.h"
 #include "utilstrencodings.h"
 #include "test/test_pivx.h"
 
@@ -144,4 +145,38 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(quarkhash_batch)
+{
+    // HashQuarkN must match HashQuark, for partial lanes too, and for messages
+    // that don't fit in a single blake block (hashed without the 4-way blake)
+    FastRandomContext ctx;
+    for (size_t nLen : {0, 64, 80, 111, 112, 200}) {
+        for (size_t nCount : {0, 1, 4, 7, 8, 9, 33}) {
+            std::vector<std::vector<unsigned char>> vData;
+            std::vector<const unsigned char*> vPtrs;
+            for (size_t i = 0; i < nCount; i++) {
+                vData.emplace_back(ctx.randbytes(std::max(nLen, (size_t)1)));
+            }
+            for (const auto& data : vData) vPtrs.emplace_back(data.data());
+            std::vector<uint256> vHashes(nCount);
+            HashQuarkN(vPtrs.data(), nLen, nCount, vHashes.data());
+            for (size_t i = 0; i < nCount; i++) {
+                BOOST_CHECK_EQUAL(vHashes[i], HashQuark(vData[i].begin(), vData[i].begin() + nLen));
+            }
+        }
+    }
+
+    // Block headers batch
+    std::vector<CBlockHeader> vHeaders(10);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vHeaders[i].nVersion = (i % 2 == 0 ? 3 : CBlockHeader::CURRENT_VERSION);
+        vHeaders[i].hashPrevBlock = GetRandHash();
+        vHeaders[i].nNonce = ctx.rand32();
+    }
+    const std::vector<uint256>& vHeadersHashes = GetBlockHeadersHashes(vHeaders);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        BOOST_CHECK_EQUAL(vHeadersHashes[i], vHeaders[i].GetHash());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "kernel.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+// Stake input with a random uniqueness (outpoint of a PIV stake, or serial hash of a zPIV stake)
+class CTestStake : public CStakeInput
+{
+private:
+    CDataStream uniqueness{CDataStream(SER_GETHASH, 0)};
+    CAmount nValue;
+
+public:
+    CTestStake(const CBlockIndex* _pindexFrom) : CStakeInput(_pindexFrom), nValue(InsecureRandRange(1000000 * COIN))
+    {
+        if (InsecureRandBool()) {
+            uniqueness << COutPoint(InsecureRand256(), InsecureRand32());
+        } else {
+            uniqueness << InsecureRand256();
+        }
+    }
+
+    bool InitFromTxIn(const CTxIn& txin) override { return true; }
+    const CBlockIndex* GetIndexFrom() const override { return pindexFrom; }
+    bool GetTxOutFrom(CTxOut& out) const override { return false; }
+    CAmount GetValue() const override { return nValue; }
+    bool IsZPIV() const override { return false; }
+    CDataStream GetUniqueness() const override { return uniqueness; }
+    bool ContextCheck(int nHeight, uint32_t nTime) override { return true; }
+};
+
+// Kernel hash, as computed before the prefix hasher: serialization of the whole message
+static uint256 GetSerializedKernelHash(const CDataStream& stakeModifier, int nTimeBlockFrom, const CDataStream& stakeUniqueness, int nTimeTx)
+{
+    CDataStream ss(stakeModifier);
+    ss << nTimeBlockFrom << stakeUniqueness << nTimeTx;
+    return Hash(ss.begin(), ss.end());
+}
+
+static void CheckKernelHashes(const CBlockIndex* pindexPrev, CTestStake& stake, const CDataStream& stakeModifier)
+{
+    const int nTimeBlockFrom = stake.GetIndexFrom()->nTime;
+    const int nTimeTx = nTimeBlockFrom + (int) InsecureRandRange(24 * 60 * 60);
+    CStakeKernel kernel(pindexPrev, &stake, InsecureRand32(), nTimeTx);
+    BOOST_CHECK(kernel.GetHash() == GetSerializedKernelHash(stakeModifier, nTimeBlockFrom, stake.GetUniqueness(), nTimeTx));
+
+    // The prefix hasher is reused for the following time slots (as in the kernel search)
+    const CHash256 prefixHasher = kernel.GetPrefixHasher();
+    for (int i = 0; i < 16; i++) {
+        const int nTimeSlot = nTimeTx + i * 15;
+        BOOST_CHECK(CStakeKernel::GetHash(prefixHasher, nTimeSlot) == GetSerializedKernelHash(stakeModifier, nTimeBlockFrom, stake.GetUniqueness(), nTimeSlot));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_hash_prefix_hasher)
+{
+    SeedInsecureRand();
+    const int nV2Height = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_V3_4].nActivationHeight;
+    LOCK(cs_main);
+
+    for (int i = 0; i < 100; i++) {
+        // Modifier v1: taken from the block generating a modifier, a selection interval after the block from
+        CBlockIndex indexes[2];
+        indexes[0].nHeight = 0;
+        indexes[0].nTime = 1500000000 + InsecureRandRange(100000000);
+        indexes[1].nHeight = 1;
+        indexes[1].pprev = &indexes[0];
+        indexes[1].nTime = indexes[0].nTime + 2087;
+        const uint64_t nModifierV1 = InsecureRandBits(64);
+        indexes[1].SetStakeModifier(nModifierV1, true);
+        chainActive.SetTip(&indexes[1]);
+
+        CBlockIndex indexPrev;
+        indexPrev.nHeight = 1 + InsecureRandRange(nV2Height - 2);
+        CTestStake stakeV1(&indexes[0]);
+        CDataStream ssModifierV1(SER_GETHASH, 0);
+        ssModifierV1 << nModifierV1;
+        CheckKernelHashes(&indexPrev, stakeV1, ssModifierV1);
+        chainActive.SetTip(nullptr);
+
+        // Modifier v2: taken from the parent of the kernel block
+        indexPrev.nHeight = nV2Height + InsecureRandRange(1000000);
+        const uint256 nModifierV2 = InsecureRand256();
+        indexPrev.SetStakeModifier(nModifierV2);
+        CTestStake stakeV2(&indexes[0]);
+        CDataStream ssModifierV2(SER_GETHASH, 0);
+        ssModifierV2 << nModifierV2;
+        CheckKernelHashes(&indexPrev, stakeV2, ssModifierV2);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
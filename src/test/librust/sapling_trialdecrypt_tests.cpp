@@ -0,0 +1,115 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "sapling/address.h"
+#include "sapling/note.h"
+#include "sapling/noteencryption.h"
+#include "sapling/sapling_transaction.h"
+#include "sapling/sapling_trialdecrypt.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sapling_trialdecrypt_tests, BasicTestingSetup)
+
+static OutputDescription CreateOutput(const libzcash::SaplingPaymentAddress& addr, CAmount nValue)
+{
+    std::array<unsigned char, ZC_MEMO_SIZE> memo = {{(unsigned char) InsecureRandBits(8)}};
+    libzcash::SaplingNote note(addr, nValue);
+    libzcash::SaplingNotePlaintext pt(note, memo);
+    auto res = pt.encrypt(addr.pk_d);
+    BOOST_REQUIRE(res);
+    OutputDescription output;
+    output.cmu = *note.cmu();
+    output.ephemeralKey = res->second.get_epk();
+    output.encCiphertext = res->first;
+    return output;
+}
+
+static void CheckSameResults(const std::vector<SaplingTrialDecryptResult>& vSerial,
+                             const std::vector<SaplingTrialDecryptResult>& vParallel)
+{
+    BOOST_REQUIRE_EQUAL(vSerial.size(), vParallel.size());
+    for (size_t i = 0; i < vSerial.size(); i++) {
+        BOOST_CHECK_EQUAL(vSerial[i].nIvkIndex, vParallel[i].nIvkIndex);
+        BOOST_CHECK_EQUAL((bool) vSerial[i].notePlaintext, (bool) vParallel[i].notePlaintext);
+        if (vSerial[i].notePlaintext && vParallel[i].notePlaintext) {
+            const libzcash::SaplingNotePlaintext& a = *vSerial[i].notePlaintext;
+            const libzcash::SaplingNotePlaintext& b = *vParallel[i].notePlaintext;
+            BOOST_CHECK_EQUAL(a.value(), b.value());
+            BOOST_CHECK(a.memo() == b.memo());
+            BOOST_CHECK(a.d == b.d);
+            BOOST_CHECK(a.rcm == b.rcm);
+        }
+    }
+}
+
+/**
+ * The outputs of a block, trial-decrypted in parallel by the worker threads, give the same
+ * notes and ivks as the serial path, for owned and foreign outputs mixed together.
+ * The first ivk (in the keys order) decrypting an output wins, also when split in different jobs.
+ */
+BOOST_AUTO_TEST_CASE(parallel_same_as_serial)
+{
+    SeedInsecureRand();
+    const size_t nKeys = 25;
+    std::vector<libzcash::SaplingPaymentAddress> vAddrs;
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    for (size_t i = 0; i < nKeys; i++) {
+        const libzcash::SaplingSpendingKey& sk = libzcash::SaplingSpendingKey::random();
+        vAddrs.emplace_back(sk.default_address());
+        vIvks.emplace_back(sk.full_viewing_key().in_viewing_key());
+    }
+    // A key imported twice, only its first index is expected
+    vIvks.emplace_back(vIvks[3]);
+
+    std::vector<OutputDescription> vOutputs;
+    std::vector<int> vExpectedIndex;
+    std::vector<CAmount> vExpectedValue;
+    for (size_t i = 0; i < 40; i++) {
+        const CAmount nValue = 1 + InsecureRandRange(100 * COIN);
+        int nIndex = -1;
+        if (i == 0) {
+            nIndex = 3;
+        } else if (i == 1 || InsecureRandBool()) {
+            nIndex = (int) InsecureRandRange(nKeys);
+        }
+        const libzcash::SaplingPaymentAddress& addr = nIndex >= 0 ? vAddrs[nIndex] :
+                libzcash::SaplingSpendingKey::random().default_address();
+        vOutputs.emplace_back(CreateOutput(addr, nValue));
+        vExpectedIndex.emplace_back(nIndex);
+        vExpectedValue.emplace_back(nValue);
+    }
+    std::vector<const OutputDescription*> vOutputPtrs;
+    for (const OutputDescription& output : vOutputs) vOutputPtrs.emplace_back(&output);
+
+    // Serial path
+    SetSaplingTrialDecryptThreads(0);
+    const std::vector<SaplingTrialDecryptResult>& vSerial = TrialDecryptSaplingOutputs(vOutputPtrs, vIvks);
+    BOOST_REQUIRE_EQUAL(vSerial.size(), vOutputs.size());
+    for (size_t i = 0; i < vOutputs.size(); i++) {
+        BOOST_CHECK_EQUAL(vSerial[i].nIvkIndex, vExpectedIndex[i]);
+        BOOST_CHECK_EQUAL(vSerial[i].IsMine(), (bool) vSerial[i].notePlaintext);
+        if (vSerial[i].notePlaintext) BOOST_CHECK_EQUAL(vSerial[i].notePlaintext->value(), vExpectedValue[i]);
+    }
+
+    // Parallel path, with the keys split in a few jobs per output or not
+    const int nThreads = 4;
+    SetSaplingTrialDecryptThreads(nThreads);
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread(&ThreadSaplingTrialDecrypt);
+    }
+    CheckSameResults(vSerial, TrialDecryptSaplingOutputs(vOutputPtrs, vIvks));
+    std::vector<const OutputDescription*> vFewOutputs(vOutputPtrs.begin(), vOutputPtrs.begin() + 2);
+    CheckSameResults(std::vector<SaplingTrialDecryptResult>(vSerial.begin(), vSerial.begin() + 2),
+                     TrialDecryptSaplingOutputs(vFewOutputs, vIvks));
+    tg.interrupt_all();
+    tg.join_all();
+    SetSaplingTrialDecryptThreads(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
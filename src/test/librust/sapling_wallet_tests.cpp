@@ -860,6 +860,96 @@ BOOST_AUTO_TEST_CASE(CachedWitnessesCleanIndex)
     }
 }
 
+// Wallet receive with a note, loaded in the wallet (or not, for a foreign tx)
+static CTransactionRef AddSaplingReceive(CWallet& wallet, libzcash::SaplingExtendedSpendingKey& sk, bool fLoad,
+                                         std::vector<SaplingOutPoint>& saplingNotes)
+{
+    CWalletTx wtx = GetValidSaplingReceive(Params().GetConsensus(), wallet, sk, 10, true);
+    if (fLoad) {
+        auto notes = SetSaplingNoteData(wtx);
+        saplingNotes.insert(saplingNotes.end(), notes.begin(), notes.end());
+        wallet.LoadToWallet(wtx);
+    }
+    return wtx.tx;
+}
+
+static void CheckWitnessRoots(CWallet& wallet, const std::vector<SaplingOutPoint>& saplingNotes,
+                              size_t nWitnessed, const uint256& root)
+{
+    std::vector<Optional<SaplingWitness>> saplingWitnesses;
+    GetWitnessesAndAnchors(wallet, saplingNotes, saplingWitnesses);
+    BOOST_CHECK_EQUAL(saplingWitnesses.size(), saplingNotes.size());
+    for (size_t i = 0; i < saplingWitnesses.size(); i++) {
+        BOOST_CHECK_EQUAL((bool) saplingWitnesses[i], i < nWitnessed);
+        if (saplingWitnesses[i]) BOOST_CHECK(saplingWitnesses[i]->root() == root);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CachedWitnessesConnectDisconnect)
+{
+    // Only the wallet txs owning notes are updated: the witnesses of the notes
+    // of earlier blocks and the ones witnessed mid-block must all get the
+    // remaining commitments of the block (also of the foreign outputs).
+    libzcash::SaplingExtendedSpendingKey sk = GetTestMasterSaplingSpendingKey();
+    CWallet& wallet = m_wallet;
+    {
+        LOCK(wallet.cs_wallet);
+        setupWallet(wallet);
+        BOOST_CHECK(wallet.AddSaplingZKey(sk));
+    }
+
+    std::vector<SaplingOutPoint> saplingNotes;
+    SaplingMerkleTree saplingTree;
+
+    // First block: our note, a foreign output, our note, a foreign output
+    CBlock block1;
+    block1.vtx.emplace_back(AddSaplingReceive(wallet, sk, true, saplingNotes));
+    block1.vtx.emplace_back(AddSaplingReceive(wallet, sk, false, saplingNotes));
+    block1.vtx.emplace_back(AddSaplingReceive(wallet, sk, true, saplingNotes));
+    block1.vtx.emplace_back(AddSaplingReceive(wallet, sk, false, saplingNotes));
+    CBlockIndex index1(block1);
+    index1.nHeight = 1;
+    wallet.IncrementNoteWitnesses(&index1, &block1, saplingTree);
+    const uint256 root1 = saplingTree.root();
+    CheckWitnessRoots(wallet, saplingNotes, 2, root1);
+
+    // Second block: a foreign output, then our note
+    CBlock block2;
+    block2.hashPrevBlock = block1.GetHash();
+    block2.vtx.emplace_back(AddSaplingReceive(wallet, sk, false, saplingNotes));
+    block2.vtx.emplace_back(AddSaplingReceive(wallet, sk, true, saplingNotes));
+    CBlockIndex index2(block2);
+    index2.nHeight = 2;
+    SaplingMerkleTree saplingTree1 {saplingTree};
+    wallet.IncrementNoteWitnesses(&index2, &block2, saplingTree);
+    const uint256 root2 = saplingTree.root();
+    BOOST_CHECK(root1 != root2);
+    CheckWitnessRoots(wallet, saplingNotes, 3, root2);
+    {
+        LOCK(wallet.cs_wallet);
+        const SaplingOutPoint& op = saplingNotes[0];
+        const SaplingNoteData& nd = wallet.mapWallet.at(op.hash).mapSaplingNoteData.at(op);
+        BOOST_CHECK_EQUAL(nd.witnesses.size(), 2);
+        BOOST_CHECK_EQUAL(nd.witnessHeight, 2);
+    }
+
+    // Disconnect the second block: the witnesses roll back to the first one
+    wallet.DecrementNoteWitnesses(&index2);
+    CheckWitnessRoots(wallet, saplingNotes, 2, root1);
+    {
+        LOCK(wallet.cs_wallet);
+        const SaplingOutPoint& op = saplingNotes[0];
+        const SaplingNoteData& nd = wallet.mapWallet.at(op.hash).mapSaplingNoteData.at(op);
+        BOOST_CHECK_EQUAL(nd.witnesses.size(), 1);
+        BOOST_CHECK_EQUAL(nd.witnessHeight, 1);
+    }
+
+    // And connect it again
+    wallet.IncrementNoteWitnesses(&index2, &block2, saplingTree1);
+    BOOST_CHECK(saplingTree1.root() == root2);
+    CheckWitnessRoots(wallet, saplingNotes, 3, root2);
+}
+
 BOOST_AUTO_TEST_CASE(ClearNoteWitnessCache)
 {
     auto consensusParams = Params().GetConsensus();
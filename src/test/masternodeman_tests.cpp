@@ -0,0 +1,111 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "masternodeman.h"
+#include "timedata.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternodeman_tests, TestingSetup)
+
+static CMasternode MakeTestMasternode(int64_t nNow)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(GetRandHash(), 0);
+    mn.sigTime = nNow - 2 * 60 * 60;
+    mn.protocolVersion = PROTOCOL_VERSION;
+    mn.SetLastPing(CMasternodePing(mn.vin, UINT256_ZERO, nNow));
+    return mn;
+}
+
+// Check the (cached) winner and ranks against the ones computed from the current masternodes state
+static void CheckRanks(const CMasternodeMan& man, const std::vector<COutPoint>& vOutpoints, const uint256& hash)
+{
+    const int minProtocol = ActiveProtocol();
+    std::vector<std::pair<int64_t, COutPoint>> vScores;
+    for (const COutPoint& outpoint : vOutpoints) {
+        const CMasternode* pmn = man.Find(outpoint);
+        if (pmn && pmn->IsEnabled() && pmn->protocolVersion >= minProtocol) {
+            vScores.emplace_back(pmn->CalculateScore(hash).GetCompact(false), outpoint);
+        }
+    }
+
+    const MasternodeRef winner = man.GetCurrentMasterNode(hash);
+    BOOST_CHECK_EQUAL(winner == nullptr, vScores.empty());
+    int64_t nHighScore = 0;
+    for (const auto& s : vScores) nHighScore = std::max(nHighScore, s.first);
+    if (winner) BOOST_CHECK_EQUAL(winner->CalculateScore(hash).GetCompact(false), nHighScore);
+
+    for (const COutPoint& outpoint : vOutpoints) {
+        const int rank = man.GetMasternodeRank(CTxIn(outpoint), 1);
+        const auto it = std::find_if(vScores.begin(), vScores.end(), [&](const std::pair<int64_t, COutPoint>& s) { return s.second == outpoint; });
+        if (it == vScores.end()) {
+            BOOST_CHECK_EQUAL(rank, -1);
+            continue;
+        }
+        // between the count of higher scores and the count of higher or equal scores (ties)
+        int nHigher = 0, nHigherOrEqual = 0;
+        for (const auto& s : vScores) {
+            nHigher += s.first > it->first;
+            nHigherOrEqual += s.first >= it->first;
+        }
+        BOOST_CHECK(rank > nHigher && rank <= nHigherOrEqual);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rank_cache_state_changes)
+{
+    CMasternodeMan man;
+    uint256 hashBlock = GetRandHash();
+    CBlockIndex index;
+    index.nHeight = 0;
+    index.phashBlock = &hashBlock;
+    man.CacheBlockHash(&index);
+    man.SetBestHeight(0);
+
+    const int64_t nNow = GetAdjustedTime();
+    std::vector<COutPoint> vOutpoints;
+    for (int i = 0; i < 20; i++) {
+        CMasternode mn = MakeTestMasternode(nNow);
+        BOOST_CHECK(man.Add(mn));
+        vOutpoints.emplace_back(mn.vin.prevout);
+    }
+    CheckRanks(man, vOutpoints, hashBlock);
+    // same result from the cache
+    CheckRanks(man, vOutpoints, hashBlock);
+
+    // State changes within the same block, without adding or removing masternodes:
+    // the cached ranks must follow them.
+    // Collateral spent
+    man.Find(vOutpoints[0])->SetSpent();
+    CheckRanks(man, vOutpoints, hashBlock);
+    // Disabled (no ping)
+    man.Find(vOutpoints[1])->Disable();
+    man.Find(vOutpoints[2])->Disable();
+    CheckRanks(man, vOutpoints, hashBlock);
+    // Obsolete protocol
+    man.Find(vOutpoints[3])->protocolVersion = ActiveProtocol() - 1;
+    CheckRanks(man, vOutpoints, hashBlock);
+    // Expired ping, then pinged again
+    CMasternode* pmn = man.Find(vOutpoints[4]);
+    pmn->SetLastPing(CMasternodePing(pmn->vin, UINT256_ZERO, nNow - MasternodeExpirationSeconds() - 1));
+    BOOST_CHECK(!pmn->IsEnabled());
+    CheckRanks(man, vOutpoints, hashBlock);
+    pmn->SetLastPing(CMasternodePing(pmn->vin, UINT256_ZERO, nNow));
+    BOOST_CHECK(pmn->IsEnabled());
+    CheckRanks(man, vOutpoints, hashBlock);
+    // Protocol upgraded back
+    man.Find(vOutpoints[3])->protocolVersion = PROTOCOL_VERSION;
+    CheckRanks(man, vOutpoints, hashBlock);
+
+    // A new block hash
+    hashBlock = GetRandHash();
+    man.CacheBlockHash(&index);
+    CheckRanks(man, vOutpoints, hashBlock);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
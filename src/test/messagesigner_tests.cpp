@@ -0,0 +1,54 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "messagesigner.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(messagesigner_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(verify_hash_cache)
+{
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    const CKeyID keyID = key.GetPubKey().GetID();
+    const CKeyID otherKeyID = otherKey.GetPubKey().GetID();
+
+    const uint256 hash = InsecureRand256();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CHashSigner::SignHash(hash, key, vchSig));
+
+    std::string strError;
+    const MessageSigCacheStats start = GetMessageSignatureCacheStats();
+    BOOST_CHECK(start.nMaxElements > 0);
+
+    // First verification is a miss, then the signature is served from the cache
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, keyID, vchSig, strError));
+    MessageSigCacheStats stats = GetMessageSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.nMisses, start.nMisses + 1);
+    BOOST_CHECK_EQUAL(stats.nHits, start.nHits);
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(CHashSigner::VerifyHash(hash, keyID, vchSig, strError));
+    }
+    stats = GetMessageSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.nMisses, start.nMisses + 1);
+    BOOST_CHECK_EQUAL(stats.nHits, start.nHits + 3);
+
+    // A cached signature is still rejected for another key, hash or signature
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, otherKeyID, vchSig, strError));
+    BOOST_CHECK(!CHashSigner::VerifyHash(InsecureRand256(), keyID, vchSig, strError));
+    std::vector<unsigned char> vchBadSig(vchSig);
+    vchBadSig[10] ^= 1;
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyID, vchBadSig, strError));
+
+    // Failed verifications are not cached
+    stats = GetMessageSignatureCacheStats();
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, otherKeyID, vchSig, strError));
+    BOOST_CHECK_EQUAL(GetMessageSignatureCacheStats().nMisses, stats.nMisses + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "clientversion.h"
+#include "masternode-payments.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnpayments_tests, BasicTestingSetup)
+
+// The last paid height, searched by scanning the payment blocks back from nMaxHeight
+static int LinearLastPaidHeight(CMasternodePayments& payments, const CScript& payee, int nMinHeight, int nMaxHeight)
+{
+    for (int nHeight = nMaxHeight; nHeight >= nMinHeight; nHeight--) {
+        auto it = payments.mapMasternodeBlocks.find(nHeight);
+        if (it != payments.mapMasternodeBlocks.end() && it->second.HasPayeeWithVotes(payee, MNPAYMENTS_LASTPAID_VOTES)) {
+            return nHeight;
+        }
+    }
+    return -1;
+}
+
+static void CheckLastPaidHeights(CMasternodePayments& payments, const std::vector<CScript>& vPayees, int nMaxHeight)
+{
+    for (const CScript& payee : vPayees) {
+        // the whole range, and random windows (also empty and out of range ones)
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 0, nMaxHeight), LinearLastPaidHeight(payments, payee, 0, nMaxHeight));
+        for (int i = 0; i < 50; i++) {
+            const int nMin = InsecureRandRange(nMaxHeight + 10);
+            const int nMax = InsecureRandRange(nMaxHeight + 10);
+            BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, nMin, nMax), LinearLastPaidHeight(payments, payee, nMin, nMax));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(payee_voted_heights_index)
+{
+    const int nBlocks = 100;
+    std::vector<CScript> vPayees;
+    for (int i = 0; i < 20; i++) {
+        vPayees.emplace_back(CScript() << ToByteVector(GetRandHash()) << OP_CHECKSIG);
+    }
+    // never voted
+    const CScript otherPayee = CScript() << ToByteVector(GetRandHash()) << OP_CHECKSIG;
+
+    // Up to 6 winner votes per block, for a few payees: some get one vote, some reach the threshold
+    CMasternodePayments payments;
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        const int nVotes = InsecureRandRange(7);
+        for (int i = 0; i < nVotes; i++) {
+            CMasternodePaymentWinner winner(CTxIn(GetRandHash(), 0), nHeight);
+            winner.AddPayee(vPayees[InsecureRandRange(vPayees.size())]);
+            BOOST_CHECK(payments.AddWinningMasternode(winner));
+            // a vote is counted once
+            BOOST_CHECK(!payments.AddWinningMasternode(winner));
+        }
+    }
+    CheckLastPaidHeights(payments, vPayees, nBlocks);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(otherPayee, 0, nBlocks), -1);
+    int nPaid = 0;
+    for (const CScript& payee : vPayees) {
+        nPaid += payments.GetLastPaidHeight(payee, 50, nBlocks) >= 0;
+    }
+    BOOST_CHECK(nPaid > 0);
+
+    // Rebuilt when loaded from disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << payments;
+    CMasternodePayments loaded;
+    ss >> loaded;
+    loaded.RebuildPayeeIndex();
+    CheckLastPaidHeights(loaded, vPayees, nBlocks);
+
+    // Pruned with the old payment blocks (below height 50)
+    payments.CleanPaymentList(0, 1050);
+    BOOST_CHECK(payments.mapMasternodeBlocks.begin()->first >= 50);
+    for (const CScript& payee : vPayees) {
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 0, 49), -1);
+    }
+    CheckLastPaidHeights(payments, vPayees, nBlocks);
+
+    // All pruned
+    payments.CleanPaymentList(0, 2000);
+    BOOST_CHECK(payments.mapMasternodeBlocks.empty());
+    for (const CScript& payee : vPayees) {
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 0, nBlocks), -1);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "memusage.h"
+#include "support/allocators/pool.h"
+#include "test/test_pivx.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocating)
+{
+    PoolResource<8, 8> resource(16);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 16U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // first chunk is already allocated, two blocks of 8 bytes fit in it
+    void* block = resource.Allocate(8, 8);
+    void* block2 = resource.Allocate(8, 8);
+    BOOST_CHECK(block != block2);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // the chunk is exhausted, a new one is allocated
+    void* block3 = resource.Allocate(8, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    // a deallocated block is served again by the freelist, without a new chunk
+    resource.Deallocate(block2, 8, 8);
+    BOOST_CHECK(resource.Allocate(8, 8) == block2);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    // zero bytes still take one block
+    void* block4 = resource.Allocate(0, 1);
+    BOOST_CHECK(block4 != block3);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    // too large, or too strictly aligned, blocks are not taken from the chunks
+    void* big = resource.Allocate(16, 8);
+    void* aligned = resource.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    resource.Deallocate(big, 16, 8);
+    resource.Deallocate(aligned, 8, 16);
+
+    // the blocks left allocated are freed with the resource
+    resource.Deallocate(block, 8, 8);
+}
+
+BOOST_AUTO_TEST_CASE(random_allocations)
+{
+    // Blocks of different sizes, written to check they don't overlap
+    PoolResource<128, 8> resource(1024);
+    struct Block {
+        unsigned char* p;
+        size_t size;
+        unsigned char tag;
+    };
+    std::vector<Block> vBlocks;
+    for (int i = 0; i < 10000; i++) {
+        if (!vBlocks.empty() && InsecureRandBits(2) == 0) {
+            const size_t idx = InsecureRandRange(vBlocks.size());
+            const Block& b = vBlocks[idx];
+            for (size_t j = 0; j < b.size; j++) BOOST_REQUIRE_EQUAL(b.p[j], b.tag);
+            resource.Deallocate(b.p, b.size, 8);
+            vBlocks.erase(vBlocks.begin() + idx);
+            continue;
+        }
+        Block b;
+        b.size = InsecureRandRange(160);
+        b.tag = (unsigned char) i;
+        b.p = static_cast<unsigned char*>(resource.Allocate(b.size, 8));
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(b.p) % 8, 0U);
+        std::fill(b.p, b.p + b.size, b.tag);
+        vBlocks.push_back(b);
+    }
+    for (const Block& b : vBlocks) {
+        for (size_t j = 0; j < b.size; j++) BOOST_REQUIRE_EQUAL(b.p[j], b.tag);
+        resource.Deallocate(b.p, b.size, 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(memusage_test)
+{
+    auto std_map = std::unordered_map<int, int>{};
+
+    using Map = std::unordered_map<int,
+                                   int,
+                                   std::hash<int>,
+                                   std::equal_to<int>,
+                                   PoolAllocator<std::pair<const int, int>,
+                                                 sizeof(std::pair<const int, int>) + sizeof(void*) * 4,
+                                                 alignof(void*)>>;
+    Map::allocator_type::ResourceType resource(1024);
+    {
+        auto resource_map = Map{0, std::hash<int>{}, std::equal_to<int>{}, &resource};
+
+        // can't have the same resource usage
+        BOOST_CHECK(memusage::DynamicUsage(std_map) != memusage::DynamicUsage(resource_map));
+
+        for (size_t i = 0; i < 10000; ++i) {
+            std_map[i];
+            resource_map[i];
+        }
+
+        // Eventually the resource_map should have a much lower memory usage because it has less malloc overhead
+        BOOST_CHECK_LE(memusage::DynamicUsage(resource_map), memusage::DynamicUsage(std_map) * 90 / 100);
+
+        // The usage only grows when a chunk is allocated: erasing and inserting
+        // as many entries reuses the freed nodes.
+        const size_t nChunks = resource.NumAllocatedChunks();
+        const size_t nUsage = memusage::DynamicUsage(resource_map);
+        for (int i = 0; i < 5000; ++i) resource_map.erase(i);
+        for (int i = 10000; i < 15000; ++i) resource_map[i];
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(resource_map), nUsage);
+        BOOST_CHECK_EQUAL(resource_map.size(), 10000U);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "blockassembler.h"
 #include "consensus/merkle.h"
 #include "guiinterface.h"
+#include "messagesigner.h"
 #include "evo/deterministicmns.h"
 #include "evo/evodb.h"
 #include "evo/evonotificationinterface.h"
@@ -46,6 +47,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     ECC_Start();
     SetupEnvironment();
     InitSignatureCache();
+    InitMessageSignatureCache();
     fCheckBlockIndex = true;
     SelectParams(chainName);
     evoDb.reset(new CEvoDB(1 << 20, true, true));
@@ -92,6 +94,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         // instead of unit tests, but for now we need these here.
         RegisterAllCoreRPCCommands(tableRPC);
         zerocoinDB = new CZerocoinDB(0, true);
+        zerocoinSpendDB = new CZerocoinSpendDB(0, true);
         pSporkDB = new CSporkDB(0, true);
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
@@ -125,6 +128,7 @@ TestingSetup::~TestingSetup()
         delete pcoinsdbview;
         delete pblocktree;
         delete zerocoinDB;
+        delete zerocoinSpendDB;
         delete pSporkDB;
 }
 
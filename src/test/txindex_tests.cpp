@@ -0,0 +1,117 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "index/txindex.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txindex_tests)
+
+static void CheckTxesFound(const TxIndex& txindex, const std::vector<CTransaction>& txns)
+{
+    for (const auto& txn : txns) {
+        CTransactionRef tx_disk;
+        uint256 block_hash;
+        BOOST_CHECK(txindex.FindTx(txn.GetHash(), block_hash, tx_disk));
+        BOOST_CHECK_EQUAL(tx_disk->GetHash(), txn.GetHash());
+        BOOST_CHECK(!block_hash.IsNull());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
+{
+    TxIndex txindex(1 << 20, true);
+
+    CTransactionRef tx_disk;
+    uint256 block_hash;
+
+    // Transaction should not be found in the index before it is started.
+    for (const auto& txn : coinbaseTxns) {
+        BOOST_CHECK(!txindex.FindTx(txn.GetHash(), block_hash, tx_disk));
+    }
+
+    // BlockUntilSyncedToCurrentChain should return false before txindex is started.
+    BOOST_CHECK(!txindex.BlockUntilSyncedToCurrentChain());
+
+    txindex.Start();
+
+    // Allow tx index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+    BOOST_CHECK(txindex.IsSynced());
+    BOOST_CHECK_EQUAL(txindex.GetBestHeight(), WITH_LOCK(cs_main, return chainActive.Height(); ));
+
+    // Check that txindex has all txs that were in the chain before it started
+    // (but the genesis coinbase, which is not spendable).
+    CheckTxesFound(txindex, coinbaseTxns);
+
+    // Check that new transactions in new blocks make it into the index.
+    std::vector<CTransaction> newTxns;
+    CScript coinbase_script_pub_key = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    for (int i = 0; i < 10; i++) {
+        std::vector<CMutableTransaction> no_txns;
+        const CBlock& block = CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        newTxns.emplace_back(*block.vtx[0]);
+    }
+    BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+    CheckTxesFound(txindex, newTxns);
+
+    // The transactions are also found by GetTransaction through the global index
+    // (and without it, for the unspent outputs, through the coins database).
+    for (const auto& txn : newTxns) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        BOOST_CHECK(GetTransaction(txn.GetHash(), tx, hashBlock, true));
+        BOOST_CHECK_EQUAL(tx->GetHash(), txn.GetHash());
+    }
+
+    // shutdown sequence (c.f. PrepareShutdown in init.cpp)
+    txindex.Interrupt();
+    txindex.Stop();
+
+    // Let scheduler events finish running to avoid accessing memory that is going to be unloaded
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_FIXTURE_TEST_CASE(txindex_legacy_erase, TestingSetup)
+{
+    // Entries of the legacy index, in the block tree db, next to other records
+    const std::pair<char, uint256> other_key('u', GetRandHash());
+    BOOST_CHECK(pblocktree->Write(other_key, 1));
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 1000; i++) {
+        vTxids.emplace_back(GetRandHash());
+        BOOST_CHECK(pblocktree->Write(std::make_pair('t', vTxids.back()), CDiskTxPos(FlatFilePos(0, i), 0)));
+    }
+    BOOST_CHECK(pblocktree->WriteFlag("txindex", true));
+
+    // Erased at startup, with or without the new index
+    BOOST_CHECK(EraseLegacyTxIndex(*pblocktree));
+
+    bool fLegacyIndex = true;
+    BOOST_CHECK(pblocktree->ReadFlag("txindex", fLegacyIndex));
+    BOOST_CHECK(!fLegacyIndex);
+    for (const uint256& txid : vTxids) {
+        BOOST_CHECK(!pblocktree->Exists(std::make_pair('t', txid)));
+    }
+    BOOST_CHECK(pblocktree->Exists(other_key));
+
+    // Nothing to do once the flag is cleared
+    BOOST_CHECK(pblocktree->Write(std::make_pair('t', vTxids[0]), CDiskTxPos(FlatFilePos(0, 0), 0)));
+    BOOST_CHECK(EraseLegacyTxIndex(*pblocktree));
+    BOOST_CHECK(pblocktree->Exists(std::make_pair('t', vTxids[0])));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "unordered_lru_cache.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(unordered_lru_cache_tests, BasicTestingSetup)
+
+typedef unordered_lru_cache<int, int, std::hash<int>> TestCache;
+
+BOOST_AUTO_TEST_CASE(lru_eviction_order)
+{
+    // Truncated down to 4 entries when growing past 6
+    TestCache cache(4, 6);
+    BOOST_CHECK_EQUAL(cache.max_size(), 4U);
+    for (int i = 1; i <= 6; i++) {
+        cache.insert(i, i * 10);
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 6U);
+
+    // Refresh 1 (get), 2 (exists) and 3 (insert over), the least recently used are now 4, 5, 6
+    int v;
+    BOOST_CHECK(cache.get(1, v));
+    BOOST_CHECK_EQUAL(v, 10);
+    BOOST_CHECK(cache.exists(2));
+    cache.insert(3, 33);
+    BOOST_CHECK_EQUAL(cache.size(), 6U);
+
+    // Past the threshold: only the 4 most recently used are kept
+    cache.insert(7, 70);
+    BOOST_CHECK_EQUAL(cache.size(), 4U);
+    for (int i : {4, 5, 6}) {
+        BOOST_CHECK(!cache.exists(i));
+    }
+    BOOST_CHECK(cache.get(1, v) && v == 10);
+    BOOST_CHECK(cache.get(2, v) && v == 20);
+    BOOST_CHECK(cache.get(3, v) && v == 33);
+    BOOST_CHECK(cache.get(7, v) && v == 70);
+
+    // Erased entries are missed
+    cache.erase(7);
+    BOOST_CHECK(!cache.get(7, v));
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(lru_default_threshold)
+{
+    // Truncated when growing past twice the maximum size
+    TestCache cache(3);
+    for (int i = 0; i < 6; i++) {
+        cache.insert(i, i);
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 6U);
+    cache.insert(6, 6);
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+    for (int i = 0; i < 7; i++) {
+        BOOST_CHECK_EQUAL(cache.exists(i), i >= 4);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
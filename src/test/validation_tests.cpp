@@ -155,4 +155,29 @@ BOOST_FIXTURE_TEST_CASE(zerocoin_rejection_tests, WalletRegTestingSetup)
     CheckMempoolZcRejection(mtx);
 }
 
+BOOST_FIXTURE_TEST_CASE(read_raw_block_tests, TestingSetup)
+{
+    const CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis(); );
+    BOOST_REQUIRE(pindexGenesis);
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindexGenesis));
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    // The stored bytes are the serialized block
+    const auto& rawBlock = GetRawBlock(pindexGenesis);
+    BOOST_REQUIRE(rawBlock);
+    BOOST_CHECK(std::vector<unsigned char>(ssBlock.begin(), ssBlock.end()) == *rawBlock);
+    // served again from memory
+    BOOST_CHECK(GetRawBlock(pindexGenesis) == rawBlock);
+
+    // Not a block position
+    std::vector<unsigned char> vch;
+    FlatFilePos pos = WITH_LOCK(cs_main, return pindexGenesis->GetBlockPos(); );
+    BOOST_CHECK(!ReadRawBlockFromDisk(vch, FlatFilePos(pos.nFile, 0)));
+    BOOST_CHECK(!ReadRawBlockFromDisk(vch, FlatFilePos(pos.nFile, pos.nPos + 1)));
+    BOOST_CHECK(ReadRawBlockFromDisk(vch, pos));
+    BOOST_CHECK(vch == *rawBlock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,347 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockassembler.h"
+#include "chainparams.h"
+#include "consensus/zerocoin_verify.h"
+#include "key.h"
+#include "legacy/validation_zerocoin_legacy.h"
+#include "libzerocoin/Commitment.h"
+#include "txdb.h"
+#include "validation.h"
+#include "zpiv/zpivmodule.h"
+#include "zpivchain.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(zerocoin_spend_tests, RegTestingSetup)
+
+// A v1 coin and its mint output
+struct TestCoin
+{
+    CBigNum bnSerial;
+    CBigNum bnRandomness;
+    COutPoint outpoint;
+    CTxOut mint;
+};
+
+static TestCoin MintTestCoin(libzerocoin::CoinDenomination denom = libzerocoin::ZQ_ONE)
+{
+    const libzerocoin::ZerocoinParams* params = Params().GetConsensus().Zerocoin_Params(true);
+    TestCoin coin;
+    // v1 serial: below the group order, and without the v2 mark
+    coin.bnSerial = CBigNum(ArithToUint256(UintToArith256(GetRandHash()) >> 8));
+    CBigNum bnValue;
+    do {
+        coin.bnRandomness = CBigNum::randBignum(params->coinCommitmentGroup.groupOrder);
+        bnValue = libzerocoin::Commitment(&params->coinCommitmentGroup, coin.bnSerial, coin.bnRandomness).getCommitmentValue();
+        // the value is read at a fixed offset of the mint script
+    } while (bnValue.getvch().size() < 128);
+    const std::vector<unsigned char>& vch = bnValue.getvch();
+    coin.outpoint = COutPoint(GetRandHash(), 0);
+    coin.mint = CTxOut(libzerocoin::ZerocoinDenominationToAmount(denom), CScript() << OP_ZEROCOINMINT << vch.size() << vch);
+
+    libzerocoin::PublicCoin pubCoin(Params().GetConsensus().Zerocoin_Params(false));
+    CValidationState state;
+    BOOST_REQUIRE(TxOutToPublicCoin(coin.mint, pubCoin, state));
+    BOOST_REQUIRE(pubCoin.getValue() == bnValue);
+    return coin;
+}
+
+// v4 public spend
+class TestPublicCoinSpend : public PublicCoinSpend
+{
+public:
+    TestPublicCoinSpend() : PublicCoinSpend(Params().GetConsensus().Zerocoin_Params(false))
+    {
+        version = PUBSPEND_SCHNORR;
+        denomination = libzerocoin::ZQ_ONE;
+    }
+
+    // Spend of a v1 coin: a signature of the tx outputs with the coin randomness
+    TestPublicCoinSpend(const TestCoin& coin, const uint256& txOutHash) : TestPublicCoinSpend()
+    {
+        SetSerial(coin.bnSerial);
+        schnorrSig = libzerocoin::CoinRandomnessSchnorrSignature(Params().GetConsensus().Zerocoin_Params(true),
+                                                                 coin.bnRandomness, txOutHash);
+    }
+
+    void SetSerial(const CBigNum& bnSerial)
+    {
+        coinSerialNumber = bnSerial;
+        coinVersion = libzerocoin::ExtractVersionFromSerial(bnSerial);
+    }
+
+    // v2 coin: the serial is derived from the key signing the spend
+    void Sign(const CKey& key)
+    {
+        pubkey = key.GetPubKey();
+        SetSerial(libzerocoin::ExtractSerialFromPubKey(pubkey));
+        BOOST_REQUIRE(key.Sign(signatureHash(), vchSig));
+    }
+};
+
+static CMutableTransaction CreatePublicSpendTx(const TestCoin& coin)
+{
+    CMutableTransaction mtx;
+    mtx.vout.emplace_back(coin.mint.nValue, CScript() << OP_TRUE);
+    // the outputs are signed with the hash of the tx without inputs
+    TestPublicCoinSpend spend(coin, mtx.GetHash());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << spend;
+    CScript scriptSig = CScript() << OP_ZEROCOINPUBLICSPEND << ss.size();
+    scriptSig.insert(scriptSig.end(), ss.begin(), ss.end());
+    mtx.vin.emplace_back(coin.outpoint, scriptSig, libzerocoin::AmountToZerocoinDenomination(coin.mint.nValue));
+    return mtx;
+}
+
+// The mint with another denomination: the spend verification fails
+static CTxOut BadMint(const CTxOut& mint)
+{
+    CTxOut badMint(mint);
+    badMint.nValue = libzerocoin::ZerocoinDenominationToAmount(libzerocoin::ZQ_FIVE);
+    return badMint;
+}
+
+BOOST_AUTO_TEST_CASE(public_spend_check)
+{
+    const TestCoin& coin = MintTestCoin();
+    const CTransaction tx(CreatePublicSpendTx(coin));
+    BOOST_CHECK(CPublicCoinSpendCheck(tx, 0, coin.mint, false)());
+
+    // moved around by swap, as in the check queue
+    CPublicCoinSpendCheck check;
+    CPublicCoinSpendCheck(tx, 0, coin.mint, false).swap(check);
+    BOOST_CHECK(check());
+
+    // outputs changed after the signature
+    CMutableTransaction mtx(tx);
+    mtx.vout[0].nValue -= COIN / 2;
+    const CTransaction txBadOutputs(mtx);
+    BOOST_CHECK(!CPublicCoinSpendCheck(txBadOutputs, 0, coin.mint, false)());
+
+    // denomination different from the spent mint
+    mtx = CMutableTransaction(tx);
+    mtx.vin[0].nSequence = libzerocoin::ZQ_FIVE;
+    const CTransaction txBadDenom(mtx);
+    BOOST_CHECK(!CPublicCoinSpendCheck(txBadDenom, 0, coin.mint, false)());
+
+    // spend of another coin
+    const TestCoin& otherCoin = MintTestCoin();
+    BOOST_CHECK(!CPublicCoinSpendCheck(tx, 0, otherCoin.mint, false)());
+}
+
+BOOST_AUTO_TEST_CASE(public_spend_cache)
+{
+    // With the bad mint, the check passes only on a cache hit
+    const TestCoin& coin = MintTestCoin();
+    const CTxOut& badMint = BadMint(coin.mint);
+    const CTransaction tx(CreatePublicSpendTx(coin));
+
+    // Verified by a block: not stored
+    BOOST_CHECK(CPublicCoinSpendCheck(tx, 0, coin.mint, false)());
+    BOOST_CHECK(!CPublicCoinSpendCheck(tx, 0, badMint, false)());
+
+    // Verified by the mempool: stored, and erased by the block verification
+    BOOST_CHECK(CPublicCoinSpendCheck(tx, 0, coin.mint, true)());
+    BOOST_CHECK(CPublicCoinSpendCheck(tx, 0, badMint, true)());
+    BOOST_CHECK(CPublicCoinSpendCheck(tx, 0, badMint, false)());
+    BOOST_CHECK(!CPublicCoinSpendCheck(tx, 0, badMint, false)());
+
+    // Failed verifications are not stored
+    CMutableTransaction mtx(tx);
+    mtx.vout[0].nValue -= COIN / 2;
+    const CTransaction txBadOutputs(mtx);
+    BOOST_CHECK(!CPublicCoinSpendCheck(txBadOutputs, 0, coin.mint, true)());
+    BOOST_CHECK(!CPublicCoinSpendCheck(txBadOutputs, 0, coin.mint, false)());
+
+    // Entries are per input
+    const TestCoin& otherCoin = MintTestCoin();
+    const CTransaction otherTx(CreatePublicSpendTx(otherCoin));
+    BOOST_CHECK(CPublicCoinSpendCheck(otherTx, 0, otherCoin.mint, true)());
+    BOOST_CHECK(!CPublicCoinSpendCheck(tx, 0, badMint, false)());
+    BOOST_CHECK(CPublicCoinSpendCheck(otherTx, 0, otherCoin.mint, false)());
+}
+
+BOOST_AUTO_TEST_CASE(public_spends_block_checks)
+{
+    // Public spends accepted from the first block
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nPublicSpendHeight = consensus.vUpgrades[Consensus::UPGRADE_ZC_PUBLIC].nActivationHeight;
+    const int nV5Height = consensus.vUpgrades[Consensus::UPGRADE_V5_0].nActivationHeight;
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_ZC_PUBLIC, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+
+    std::vector<std::pair<COutPoint, CTxOut>> vMints;
+    std::vector<CTransactionRef> vSpends;
+    for (int i = 0; i < 8; i++) {
+        const TestCoin& coin = MintTestCoin();
+        vMints.emplace_back(coin.outpoint, coin.mint);
+        vSpends.emplace_back(MakeTransactionRef(CreatePublicSpendTx(coin)));
+    }
+    BOOST_REQUIRE(zerocoinDB->WriteMintOutputBatch(vMints));
+
+    CBlock block = BlockAssembler(Params(), false).CreateNewBlock(CScript() << OP_TRUE)->block;
+    block.vtx.insert(block.vtx.end(), vSpends.begin(), vSpends.end());
+    // with an invalid spend in the middle of the checks batch
+    CBlock badBlock(block);
+    CMutableTransaction mtx(*badBlock.vtx[5]);
+    mtx.vout[0].nValue -= COIN / 2;
+    badBlock.vtx[5] = MakeTransactionRef(mtx);
+
+    // Checked by the check queue, then serially
+    const int nThreads = nScriptCheckThreads;
+    BOOST_REQUIRE(nThreads > 0);
+    for (int n : {nThreads, 0}) {
+        nScriptCheckThreads = n;
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(ContextualCheckBlock(block, state, chainActive.Tip()));
+        BOOST_CHECK(state.IsValid());
+
+        // The failed batch is checked again serially, to report the invalid spend
+        int nDoS = 0;
+        BOOST_CHECK(!ContextualCheckBlock(badBlock, state, chainActive.Tip()));
+        BOOST_CHECK(state.IsInvalid(nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-invalid-zpiv");
+
+        // The block checks don't store the spends
+        BOOST_CHECK(!CPublicCoinSpendCheck(*block.vtx[1], 0, BadMint(vMints[0].second), false)());
+    }
+    nScriptCheckThreads = nThreads;
+
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_ZC_PUBLIC, nPublicSpendHeight);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, nV5Height);
+}
+
+static CZerocoinSpendRecord SerializeRoundTrip(const CZerocoinSpendRecord& record)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << record;
+    CZerocoinSpendRecord ret;
+    ss >> ret;
+    BOOST_CHECK(ss.empty());
+    return ret;
+}
+
+static void CheckRecordsEqual(const CZerocoinSpendRecord& a, const CZerocoinSpendRecord& b)
+{
+    BOOST_CHECK(a.bnSerial == b.bnSerial);
+    BOOST_CHECK_EQUAL(a.nDenom, b.nDenom);
+    BOOST_CHECK_EQUAL(a.nCoinVersion, b.nCoinVersion);
+    BOOST_CHECK_EQUAL(a.nPublicSpendVersion, b.nPublicSpendVersion);
+    BOOST_CHECK_EQUAL(a.nSpendType, b.nSpendType);
+    BOOST_CHECK_EQUAL(a.nSignature, b.nSignature);
+    BOOST_CHECK_EQUAL(a.fValidSerial, b.fValidSerial);
+}
+
+BOOST_AUTO_TEST_CASE(spend_record_serialization)
+{
+    CheckRecordsEqual(SerializeRoundTrip(CZerocoinSpendRecord()), CZerocoinSpendRecord());
+
+    CKey key;
+    key.MakeNewKey(true);
+    TestPublicCoinSpend spend;
+    spend.setDenom(libzerocoin::ZQ_ONE_THOUSAND);
+    spend.Sign(key);
+    const CZerocoinSpendRecord record(spend, PUBSPEND_SCHNORR);
+    CheckRecordsEqual(SerializeRoundTrip(record), record);
+    // private spend
+    const CZerocoinSpendRecord recordPrivate(spend);
+    CheckRecordsEqual(SerializeRoundTrip(recordPrivate), recordPrivate);
+
+    // negative signature flag
+    spend.SetSerial(CBigNum(1) << 300);
+    const CZerocoinSpendRecord recordInvalidSerial(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(recordInvalidSerial.nSignature, CZerocoinSpendRecord::SIG_INVALID_SERIAL);
+    CheckRecordsEqual(SerializeRoundTrip(recordInvalidSerial), recordInvalidSerial);
+}
+
+BOOST_AUTO_TEST_CASE(spend_record_flags)
+{
+    // v1 coin: no signature, the serial is in the group order range
+    const TestCoin& coin = MintTestCoin();
+    TestPublicCoinSpend spend(coin, GetRandHash());
+    CZerocoinSpendRecord record(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK(record.bnSerial == coin.bnSerial);
+    BOOST_CHECK_EQUAL(record.GetDenomination(), libzerocoin::ZQ_ONE);
+    BOOST_CHECK_EQUAL(record.nCoinVersion, 1);
+    BOOST_CHECK_EQUAL(record.nPublicSpendVersion, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(record.nSpendType, libzerocoin::SPEND);
+    BOOST_CHECK_EQUAL(record.nSignature, CZerocoinSpendRecord::SIG_VALID);
+    BOOST_CHECK(record.fValidSerial);
+
+    spend.SetSerial(CBigNum(0));
+    record = CZerocoinSpendRecord(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(record.nSignature, CZerocoinSpendRecord::SIG_VALID);
+    BOOST_CHECK(!record.fValidSerial);
+
+    // v2 coin: signed with the key of the serial
+    CKey key;
+    key.MakeNewKey(true);
+    spend.Sign(key);
+    record = CZerocoinSpendRecord(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(record.nCoinVersion, libzerocoin::PUBKEY_VERSION);
+    BOOST_CHECK_EQUAL(record.nSignature, CZerocoinSpendRecord::SIG_VALID);
+    BOOST_CHECK(record.fValidSerial);
+
+    // signature of other spend data
+    spend.setTxOutHash(GetRandHash());
+    record = CZerocoinSpendRecord(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(record.nSignature, CZerocoinSpendRecord::SIG_INVALID);
+    BOOST_CHECK(record.fValidSerial);
+
+    // serial of another key
+    spend.Sign(key);
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    spend.SetSerial(libzerocoin::ExtractSerialFromPubKey(otherKey.GetPubKey()));
+    record = CZerocoinSpendRecord(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(record.nSignature, CZerocoinSpendRecord::SIG_INVALID);
+    BOOST_CHECK(record.fValidSerial);
+
+    // serial longer than 256 bits
+    spend.SetSerial(CBigNum(1) << 300);
+    record = CZerocoinSpendRecord(spend, PUBSPEND_SCHNORR);
+    BOOST_CHECK_EQUAL(record.nCoinVersion, libzerocoin::PUBKEY_VERSION);
+    BOOST_CHECK_EQUAL(record.nSignature, CZerocoinSpendRecord::SIG_INVALID_SERIAL);
+    BOOST_CHECK(!record.fValidSerial);
+}
+
+BOOST_AUTO_TEST_CASE(disconnect_spend_record)
+{
+    // The spent mints are not in the zerocoinDB: the spends can't be parsed again
+    const TestCoin& coin = MintTestCoin();
+    const CTransaction tx(CreatePublicSpendTx(coin));
+    const COutPoint spendIn(tx.GetHash(), 0);
+    BOOST_REQUIRE(zerocoinDB->WriteCoinSpendBatch({{coin.bnSerial, tx.GetHash()}}, GetRandHash()));
+    BOOST_CHECK(!DisconnectZerocoinTx(tx, zerocoinDB));
+    uint256 txid;
+    BOOST_CHECK(zerocoinDB->ReadCoinSpend(coin.bnSerial, txid));
+
+    // Stored when the block was connected
+    TestPublicCoinSpend spend(coin, GetRandHash());
+    const CZerocoinSpendRecord record(spend, PUBSPEND_SCHNORR);
+    BOOST_REQUIRE(zerocoinSpendDB->WriteSpendRecords({{spendIn, record}}));
+    CZerocoinSpendRecord stored;
+    BOOST_CHECK(ReadZerocoinSpendRecord(spendIn, stored));
+    CheckRecordsEqual(stored, record);
+    BOOST_CHECK(!ReadZerocoinSpendRecord(COutPoint(tx.GetHash(), 1), stored));
+
+    BOOST_CHECK(DisconnectZerocoinTx(tx, zerocoinDB));
+    BOOST_CHECK(!zerocoinDB->ReadCoinSpend(coin.bnSerial, txid));
+
+    // Parsed by the validation of a block not connected yet
+    const TestCoin& otherCoin = MintTestCoin();
+    const CTransaction otherTx(CreatePublicSpendTx(otherCoin));
+    BOOST_REQUIRE(zerocoinDB->WriteCoinSpendBatch({{otherCoin.bnSerial, otherTx.GetHash()}}, GetRandHash()));
+    CacheZerocoinSpendRecord(COutPoint(otherTx.GetHash(), 0), CZerocoinSpendRecord(TestPublicCoinSpend(otherCoin, GetRandHash()), PUBSPEND_SCHNORR));
+    BOOST_CHECK(DisconnectZerocoinTx(otherTx, zerocoinDB));
+    BOOST_CHECK(!zerocoinDB->ReadCoinSpend(otherCoin.bnSerial, txid));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
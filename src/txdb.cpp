@@ -6,12 +6,19 @@
 
 #include "txdb.h"
 
+#include "checkqueue.h"
 #include "random.h"
 #include "pow.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util/system.h"
+#include "util/threadnames.h"
 #include "util/vector.h"
+#include "utiltime.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -19,7 +26,6 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -73,6 +79,125 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
+// Room reserved per dirty coin to serialize a shard (about the key and value of a P2PKH coin)
+static const size_t COINS_FLUSH_PREALLOC_ENTRY_SIZE = 64;
+
+namespace {
+
+/**
+ * The dirty coins of a flush whose txid starts with the same byte. The keys of
+ * the coins start with DB_COIN and the txid, so the shards, taken in order and
+ * each sorted, hand the coins to LevelDB in key order.
+ */
+struct CoinsFlushShard
+{
+    struct Record
+    {
+        uint32_t nKeyPos;
+        uint32_t nKeySize;
+        uint32_t nValuePos;
+        uint32_t nValueSize;
+        bool fErase;
+    };
+
+    std::vector<CCoinsMap::iterator> vEntries;
+    // Serialized keys and values of the entries, and where they are in the buffer
+    std::vector<unsigned char> vData;
+    std::vector<Record> vRecords;
+
+    leveldb::Slice Key(const Record& rec) const { return leveldb::Slice((const char*)vData.data() + rec.nKeyPos, rec.nKeySize); }
+    leveldb::Slice Value(const Record& rec) const { return leveldb::Slice((const char*)vData.data() + rec.nValuePos, rec.nValueSize); }
+
+    /** Serialize the entries and sort them by key. Doesn't touch the map, so it can run in any thread. */
+    void Serialize()
+    {
+        vRecords.reserve(vEntries.size());
+        vData.reserve(vEntries.size() * COINS_FLUSH_PREALLOC_ENTRY_SIZE);
+        CVectorWriter writer(SER_DISK, CLIENT_VERSION, vData, 0);
+        for (const CCoinsMap::iterator& it : vEntries) {
+            Record rec;
+            rec.nKeyPos = vData.size();
+            writer << CoinEntry(&it->first);
+            rec.nKeySize = vData.size() - rec.nKeyPos;
+            rec.nValuePos = vData.size();
+            rec.fErase = it->second.coin.IsSpent();
+            if (!rec.fErase) writer << it->second.coin;
+            rec.nValueSize = vData.size() - rec.nValuePos;
+            vRecords.push_back(rec);
+        }
+        std::sort(vRecords.begin(), vRecords.end(), [this](const Record& a, const Record& b) {
+            return Key(a).compare(Key(b)) < 0;
+        });
+    }
+
+    /** Release the memory of the shard */
+    void Clear()
+    {
+        std::vector<CCoinsMap::iterator>().swap(vEntries);
+        std::vector<Record>().swap(vRecords);
+        std::vector<unsigned char>().swap(vData);
+    }
+};
+
+/** Serialization of a shard, run by the coins flush workers */
+class CCoinsFlushCheck
+{
+private:
+    CoinsFlushShard* shard{nullptr};
+
+public:
+    CCoinsFlushCheck() {}
+    explicit CCoinsFlushCheck(CoinsFlushShard* shardIn) : shard(shardIn) {}
+
+    bool operator()()
+    {
+        shard->Serialize();
+        return true;
+    }
+
+    void swap(CCoinsFlushCheck& check) { std::swap(shard, check.shard); }
+};
+
+} // namespace
+
+// Number of shards of a flush, one per value of the first byte of the txid
+static const size_t COINS_FLUSH_SHARDS = 256;
+// Below this number of dirty coins, the flush is serialized in the calling thread
+static const size_t COINS_FLUSH_MIN_PARALLEL = 4096;
+
+static CCheckQueue<CCoinsFlushCheck> coinsFlushQueue(1);
+static Mutex cs_coinsFlushMaster;
+static std::atomic<int> nCoinsFlushThreads{0};
+
+void SetCoinsFlushThreads(int nThreads)
+{
+    nCoinsFlushThreads = nThreads;
+}
+
+void ThreadCoinsFlush()
+{
+    util::ThreadRename("pivx-coinsflush");
+    coinsFlushQueue.Thread();
+}
+
+static Mutex cs_coinsflushstats;
+static std::deque<CoinsFlushStats> dequeCoinsFlushStats GUARDED_BY(cs_coinsflushstats);
+
+static void RecordCoinsFlushStats(const CoinsFlushStats& stats)
+{
+    LOCK(cs_coinsflushstats);
+    dequeCoinsFlushStats.emplace_front(stats);
+    if (dequeCoinsFlushStats.size() > MAX_COINS_FLUSH_STATS)
+        dequeCoinsFlushStats.pop_back();
+}
+
+std::vector<CoinsFlushStats> GetCoinsFlushStats(size_t nFlushes)
+{
+    LOCK(cs_coinsflushstats);
+    nFlushes = std::min(nFlushes, dequeCoinsFlushStats.size());
+    return std::vector<CoinsFlushStats>(dequeCoinsFlushStats.begin(), dequeCoinsFlushStats.begin() + nFlushes);
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
                               const uint256& hashBlock,
                               const uint256& hashSaplingAnchor,
@@ -80,12 +205,15 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
                               CNullifiersMap& mapSaplingNullifiers)
 {
     CDBBatch batch;
-    size_t count = 0;
-    size_t changed = 0;
     size_t batch_size = (size_t) gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
+    CoinsFlushStats stats;
+    stats.hashBlock = hashBlock;
+    stats.nTime = GetTime();
+    const int64_t nTimeStart = GetTimeMicros();
+
     uint256 old_tip = GetBestBlock();
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
@@ -103,31 +231,79 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
+    // Drop the clean entries, and dispatch the dirty ones to their shard
+    std::vector<CoinsFlushShard> vShards(COINS_FLUSH_SHARDS);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        stats.nCoins++;
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
-            else
-                batch.Write(entry, it->second.coin);
-            changed++;
+            vShards[*it->first.hash.begin()].vEntries.push_back(it);
+            stats.nWritten++;
+            ++it;
+        } else {
+            it = mapCoins.erase(it);
+        }
+    }
+
+    // Serialize and sort the shards a group at a time (in parallel when worth it),
+    // so that only a few of them are held in memory, then write them in order.
+    const int nThreads = nCoinsFlushThreads;
+    const bool fParallel = nThreads > 1 && stats.nWritten >= COINS_FLUSH_MIN_PARALLEL;
+    stats.nThreads = fParallel ? nThreads : 1;
+    const size_t nGroupSize = (size_t) stats.nThreads * 4;
+    for (size_t nBegin = 0; nBegin < vShards.size(); nBegin += nGroupSize) {
+        const size_t nEnd = std::min(vShards.size(), nBegin + nGroupSize);
+
+        int64_t nTimeStep = GetTimeMicros();
+        if (fParallel) {
+            std::vector<CCoinsFlushCheck> vChecks;
+            vChecks.reserve(nEnd - nBegin);
+            for (size_t i = nBegin; i < nEnd; i++) {
+                if (!vShards[i].vEntries.empty()) vChecks.emplace_back(&vShards[i]);
+            }
+            LOCK(cs_coinsFlushMaster);
+            CCheckQueueControl<CCoinsFlushCheck> control(&coinsFlushQueue);
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            for (size_t i = nBegin; i < nEnd; i++) {
+                vShards[i].Serialize();
+            }
         }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
-        if (batch.SizeEstimate() > batch_size) {
-            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-            db.WriteBatch(batch);
-            batch.Clear();
-            if (crash_simulate) {
-                static FastRandomContext rng;
-                if (rng.randrange(crash_simulate) == 0) {
-                    LogPrintf("Simulating a crash. Goodbye.\n");
-                    _Exit(0);
+        stats.nSerializeTime += GetTimeMicros() - nTimeStep;
+
+        nTimeStep = GetTimeMicros();
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CoinsFlushShard& shard = vShards[i];
+            for (const CoinsFlushShard::Record& rec : shard.vRecords) {
+                if (rec.fErase) {
+                    batch.EraseSerialized(shard.Key(rec));
+                    stats.nErased++;
+                } else {
+                    batch.WriteSerialized(shard.Key(rec), shard.Value(rec));
+                }
+                if (batch.SizeEstimate() > batch_size) {
+                    LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+                    stats.nBytes += batch.SizeEstimate();
+                    stats.nBatches++;
+                    db.WriteBatch(batch);
+                    batch.Clear();
+                    if (crash_simulate) {
+                        static FastRandomContext rng;
+                        if (rng.randrange(crash_simulate) == 0) {
+                            LogPrintf("Simulating a crash. Goodbye.\n");
+                            _Exit(0);
+                        }
+                    }
                 }
             }
+            for (const CCoinsMap::iterator& it : shard.vEntries) {
+                mapCoins.erase(it);
+            }
+            shard.Clear();
         }
+        stats.nWriteTime += GetTimeMicros() - nTimeStep;
     }
+    assert(mapCoins.empty());
 
     // Write Sapling
     BatchWriteSapling(hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers, batch);
@@ -137,8 +313,17 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
     batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    const int64_t nTimeWrite = GetTimeMicros();
+    stats.nBytes += batch.SizeEstimate();
+    stats.nBatches++;
     bool ret = db.WriteBatch(batch);
-    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    const int64_t nTimeEnd = GetTimeMicros();
+    stats.nWriteTime += nTimeEnd - nTimeWrite;
+    stats.nTotalTime = nTimeEnd - nTimeStart;
+    RecordCoinsFlushStats(stats);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database in %.2fms (serialize %.2fms, %d threads, write %.2fms)...\n",
+             (unsigned int)stats.nWritten, (unsigned int)stats.nCoins, 0.001 * stats.nTotalTime,
+             0.001 * stats.nSerializeTime, stats.nThreads, 0.001 * stats.nWriteTime);
     return ret;
 }
 
@@ -247,19 +432,6 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
-{
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
-}
-
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -344,7 +516,12 @@ CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapp
 {
 }
 
-bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<CBigNum, uint256> >& spendInfo)
+// Zerocoin Database
+static const char ZC_SPEND_TX_BLOCK = 'h';
+static const char ZC_MINT_OUTPUT = 'm';
+static const char ZC_FLAG = 'F';
+
+bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<CBigNum, uint256> >& spendInfo, const uint256& hashBlock)
 {
     CDBBatch batch;
     size_t count = 0;
@@ -354,6 +531,7 @@ bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<CBigNum, uint2
         ss << bnSerial;
         uint256 hash = Hash(ss.begin(), ss.end());
         batch.Write(std::make_pair('s', hash), it->second);
+        batch.Write(std::make_pair(ZC_SPEND_TX_BLOCK, it->second), hashBlock);
         ++count;
     }
 
@@ -379,6 +557,50 @@ bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
     return Erase(std::make_pair('s', hash));
 }
 
+bool CZerocoinDB::ReadSpendTxBlock(const uint256& txHash, uint256& hashBlock)
+{
+    return Read(std::make_pair(ZC_SPEND_TX_BLOCK, txHash), hashBlock);
+}
+
+bool CZerocoinDB::EraseSpendTxBlock(const uint256& txHash)
+{
+    return Erase(std::make_pair(ZC_SPEND_TX_BLOCK, txHash));
+}
+
+bool CZerocoinDB::WriteMintOutputBatch(const std::vector<std::pair<COutPoint, CTxOut> >& vMints)
+{
+    CDBBatch batch;
+    for (const auto& it : vMints) {
+        batch.Write(std::make_pair(ZC_MINT_OUTPUT, it.first), it.second);
+    }
+    LogPrint(BCLog::COINDB, "Writing %u zerocoin mints to db.\n", (unsigned int)vMints.size());
+    return WriteBatch(batch, true);
+}
+
+bool CZerocoinDB::ReadMintOutput(const COutPoint& outpoint, CTxOut& out)
+{
+    return Read(std::make_pair(ZC_MINT_OUTPUT, outpoint), out);
+}
+
+bool CZerocoinDB::EraseMintOutput(const COutPoint& outpoint)
+{
+    return Erase(std::make_pair(ZC_MINT_OUTPUT, outpoint));
+}
+
+bool CZerocoinDB::WriteFlag(const std::string& name, bool fValue)
+{
+    return Write(std::make_pair(ZC_FLAG, name), fValue ? '1' : '0');
+}
+
+bool CZerocoinDB::ReadFlag(const std::string& name, bool& fValue)
+{
+    char ch;
+    if (!Read(std::make_pair(ZC_FLAG, name), ch))
+        return false;
+    fValue = ch == '1';
+    return true;
+}
+
 // Legacy Zerocoin Database
 static const char LZC_ACCUMCS = 'A';
 //static const char LZC_MAPSUPPLY = 'M'; // TODO: add removal for LZC_MAPSUPPLY key-value if is found in db
@@ -528,3 +750,25 @@ bool CCoinsViewDB::Upgrade() {
     db.WriteBatch(batch);
     return true;
 }
+
+static const char DB_ZC_SPEND_RECORD = 'r';
+
+CZerocoinSpendDB::CZerocoinSpendDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "zerocoinspends", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CZerocoinSpendDB::WriteSpendRecords(const std::vector<std::pair<COutPoint, CZerocoinSpendRecord>>& vRecords)
+{
+    CDBBatch batch;
+    for (const auto& it : vRecords) {
+        batch.Write(std::make_pair(DB_ZC_SPEND_RECORD, it.first), it.second);
+    }
+    LogPrint(BCLog::COINDB, "Writing %u zerocoin spend records to db.\n", (unsigned int)vRecords.size());
+    // Only a cache of the parsing: no need to sync
+    return WriteBatch(batch);
+}
+
+bool CZerocoinSpendDB::ReadSpendRecord(const COutPoint& spendIn, CZerocoinSpendRecord& record)
+{
+    return Read(std::make_pair(DB_ZC_SPEND_RECORD, spendIn), record);
+}
@@ -12,6 +12,7 @@
 #include "dbwrapper.h"
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
+#include "zpivchain.h"
 
 #include <map>
 #include <string>
@@ -31,12 +32,18 @@ static const int64_t nDefaultDbBatchSize = 16 << 20;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to the transaction index DB specific cache (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to the address index DB specific cache (MiB)
+static const int64_t nMaxAddressIndexCache = 1024;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t nMaxFilterIndexCache = 1024;
+//! Max memory allocated to the coinstats index DB specific cache (MiB)
+static const int64_t nMaxCoinStatsIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -66,6 +73,37 @@ struct CDiskTxPos : public FlatFilePos
     }
 };
 
+/** Metrics of a flush of the coins cache to the coin database (CCoinsViewDB::BatchWrite) */
+struct CoinsFlushStats
+{
+    uint256 hashBlock;
+    // Start of the flush (unix time)
+    int64_t nTime{0};
+    // Entries of the cache, dirty entries written (of which erased)
+    uint64_t nCoins{0};
+    uint64_t nWritten{0};
+    uint64_t nErased{0};
+    // Size of the batches written, and their number
+    uint64_t nBytes{0};
+    unsigned int nBatches{0};
+    int nThreads{0};
+    // Time spent serializing and sorting the dirty entries, writing the batches,
+    // and in total, in microseconds
+    int64_t nSerializeTime{0};
+    int64_t nWriteTime{0};
+    int64_t nTotalTime{0};
+};
+
+/** Number of chainstate flushes whose metrics are kept */
+static const size_t MAX_COINS_FLUSH_STATS = 100;
+/** Return the metrics of (up to) the last nFlushes chainstate flushes, latest first */
+std::vector<CoinsFlushStats> GetCoinsFlushStats(size_t nFlushes);
+
+/** Set the number of threads (including the caller) serializing the dirty coins of a flush */
+void SetCoinsFlushThreads(int nThreads);
+/** Run a coins flush worker */
+void ThreadCoinsFlush();
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
@@ -138,8 +176,6 @@ public:
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
-    bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -161,10 +197,22 @@ public:
     /** Write zPIV spends to the zerocoinDB in a batch
      * Pair of: CBigNum -> coinSerialNumber and uint256 -> txHash.
      */
-    bool WriteCoinSpendBatch(const std::vector<std::pair<CBigNum, uint256> >& spendInfo);
+    bool WriteCoinSpendBatch(const std::vector<std::pair<CBigNum, uint256> >& spendInfo, const uint256& hashBlock);
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
     bool EraseCoinSpend(const CBigNum& bnSerial);
 
+    /** Zc spend txid --> hash of the block including it (written together with the serials) **/
+    bool ReadSpendTxBlock(const uint256& txHash, uint256& hashBlock);
+    bool EraseSpendTxBlock(const uint256& txHash);
+
+    /** Zerocoin mints (never in the UTXO set): outpoint --> mint output, written when the block is connected **/
+    bool WriteMintOutputBatch(const std::vector<std::pair<COutPoint, CTxOut> >& vMints);
+    bool ReadMintOutput(const COutPoint& outpoint, CTxOut& out);
+    bool EraseMintOutput(const COutPoint& outpoint);
+
+    bool WriteFlag(const std::string& name, bool fValue);
+    bool ReadFlag(const std::string& name, bool& fValue);
+
     /** Accumulators (only for zPoS IBD): [checksum, denom] --> block height **/
     bool WriteAccChecksum(const uint32_t& nChecksum, const libzerocoin::CoinDenomination denom, const int nHeight);
     bool ReadAccChecksum(const uint32_t& nChecksum, const libzerocoin::CoinDenomination denom, int& nHeightRet);
@@ -172,4 +220,20 @@ public:
     bool WipeAccChecksums();
 };
 
+/** Access to the records of the parsed zerocoin spends (zerocoinspends/), kept across reindexes */
+class CZerocoinSpendDB : public CDBWrapper
+{
+public:
+    explicit CZerocoinSpendDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CZerocoinSpendDB(const CZerocoinSpendDB&);
+    void operator=(const CZerocoinSpendDB&);
+
+public:
+    /** Zc spend input (txid, input index) --> parsed spend record **/
+    bool WriteSpendRecords(const std::vector<std::pair<COutPoint, CZerocoinSpendRecord>>& vRecords);
+    bool ReadSpendRecord(const COutPoint& spendIn, CZerocoinSpendRecord& record);
+};
+
 #endif // BITCOIN_TXDB_H
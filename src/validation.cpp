@@ -12,6 +12,8 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockimport.h"
+#include "blockstore.h"
 #include "blocksignature.h"
 #include "budget/budgetmanager.h"
 #include "chainparams.h"
@@ -27,6 +29,8 @@
 #include "flatfile.h"
 #include "fs.h"
 #include "guiinterface.h"
+#include "index/coinstatsindex.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "invalid.h"
 #include "interfaces/handler.h"
@@ -38,6 +42,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterate.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "spork.h"
 #include "sporkdb.h"
@@ -94,7 +99,6 @@ int64_t g_best_block_time = 0;
 int nScriptCheckThreads = 0;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
-bool fTxIndex = true;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 size_t nCoinCacheUsage = 5000 * 300;
@@ -208,6 +212,7 @@ CBlockIndex* GetChainTip()
 CCoinsViewCache* pcoinsTip = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
+CZerocoinSpendDB* zerocoinSpendDB = NULL;
 CSporkDB* pSporkDB = NULL;
 
 enum FlushStateMode {
@@ -692,13 +697,26 @@ bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state,
     return true;
 }
 
+/** Height of the first block of the active chain not indexed yet by the txindex */
+static int GetFirstUnindexedHeight() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CBlockIndex* pindexFork = chainActive.FindFork(g_txindex->GetBestBlockIndex());
+    return pindexFork ? pindexFork->nHeight + 1 : 0;
+}
+
+bool IsTxIndexSyncing()
+{
+    if (!g_txindex) return false;
+    if (!g_txindex->IsSynced()) return true;
+    LOCK(cs_main);
+    return chainActive.Height() - GetFirstUnindexedHeight() >= MAX_TXINDEX_LAG_SCAN;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
     CBlockIndex* pindexSlow = blockIndex;
 
-    LOCK(cs_main);
-
     if (!blockIndex) {
 
         CTransactionRef ptx = mempool.get(hash);
@@ -707,31 +725,34 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        // The transaction index is written in the background, and can be behind
+        // the tip: callers not holding cs_main wait for it with
+        // g_txindex->BlockUntilSyncedToCurrentChain() first.
+        if (g_txindex && g_txindex->FindTx(hash, hashBlock, txOut)) {
+            return true;
+        }
+
+        // Look for it in the last blocks, not indexed yet (if only a few)
+        if (g_txindex && g_txindex->IsSynced()) {
+            LOCK(cs_main);
+            const int nFirstHeight = GetFirstUnindexedHeight();
+            if (chainActive.Height() - nFirstHeight < MAX_TXINDEX_LAG_SCAN) {
+                for (int nHeight = chainActive.Height(); nHeight >= nFirstHeight; nHeight--) {
+                    CBlock block;
+                    if (!ReadBlockFromDisk(block, chainActive[nHeight])) continue;
+                    for (const auto& tx : block.vtx) {
+                        if (tx->GetHash() == hash) {
+                            txOut = tx;
+                            hashBlock = block.GetHash();
+                            return true;
+                        }
+                    }
                 }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
             }
-
-            // transaction not found in the index, nothing more can be done
-            return false;
         }
 
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+        if (fAllowSlow) { // use coin database to locate block that contains transaction, and read it
+            LOCK(cs_main);
             const Coin& coin = AccessByTxid(*pcoinsTip, hash);
             if (!coin.IsSpent()) pindexSlow = chainActive[coin.nHeight];
         }
@@ -819,6 +840,60 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 }
 
 
+static CMappedBlockFiles mappedBlockFiles(MAX_MAPPED_BLOCK_FILES);
+static CRawBlockCache rawBlockCache(DEFAULT_RAW_BLOCK_CACHE_SIZE);
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const FlatFilePos& pos)
+{
+    // The block is preceded by the network magic and its size
+    unsigned char header[MESSAGE_START_SIZE + 4];
+    if (pos.IsNull() || pos.nPos < sizeof(header))
+        return error("%s : invalid position %s", __func__, pos.ToString());
+    if (!mappedBlockFiles.Read(FlatFilePos(pos.nFile, pos.nPos - sizeof(header)), sizeof(header), header))
+        return error("%s : failed to read block header at %s", __func__, pos.ToString());
+    if (memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE))
+        return error("%s : block magic mismatch at %s", __func__, pos.ToString());
+    const unsigned int nSize = ReadLE32(header + MESSAGE_START_SIZE);
+    if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+        return error("%s : invalid block size %u at %s", __func__, nSize, pos.ToString());
+
+    block.resize(nSize);
+    if (!mappedBlockFiles.Read(pos, nSize, block.data()))
+        return error("%s : failed to read block at %s", __func__, pos.ToString());
+    return true;
+}
+
+std::shared_ptr<const std::vector<unsigned char>> GetRawBlock(const CBlockIndex* pindex)
+{
+    const uint256& hash = pindex->GetBlockHash();
+    auto cached = rawBlockCache.Get(hash);
+    if (cached)
+        return cached;
+
+    FlatFilePos blockPos = WITH_LOCK(cs_main, return pindex->GetBlockPos(); );
+    auto block = std::make_shared<std::vector<unsigned char>>();
+    if (!ReadRawBlockFromDisk(*block, blockPos))
+        return nullptr;
+
+    // Check the header
+    try {
+        CBlockHeader header;
+        const char* pbegin = (const char*)block->data();
+        CDataStream ssHeader(pbegin, pbegin + std::min(block->size(), (size_t)256), SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+        if (header.GetHash() != hash) {
+            LogPrintf("%s : block=%s index=%s\n", __func__, header.GetHash().GetHex(), hash.GetHex());
+            return nullptr;
+        }
+    } catch (const std::exception& e) {
+        error("%s : Deserialize error - %s", __func__, e.what());
+        return nullptr;
+    }
+
+    rawBlockCache.Put(hash, block);
+    return block;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1250,6 +1325,15 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const FlatFilePos& pos, const uint2
 
 } // anon namespace
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    const FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || !pindex->pprev) {
+        return error("%s: no undo data available for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1420,12 +1504,31 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+// Script checks and Sapling proofs of the blocks are verified by the same worker threads
+static CWorkStealingCheckQueue<CBlockCheck> blockcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
 void ThreadScriptCheck()
 {
     util::ThreadRename("pivx-scriptch");
-    scriptcheckqueue.Thread();
+    blockcheckqueue.Thread();
+}
+
+static Mutex cs_blockcheckstats;
+static std::deque<BlockCheckStats> dequeBlockCheckStats GUARDED_BY(cs_blockcheckstats);
+
+static void RecordBlockCheckStats(const BlockCheckStats& stats)
+{
+    LOCK(cs_blockcheckstats);
+    dequeBlockCheckStats.emplace_front(stats);
+    if (dequeBlockCheckStats.size() > MAX_BLOCK_CHECK_STATS)
+        dequeBlockCheckStats.pop_back();
+}
+
+std::vector<BlockCheckStats> GetBlockCheckStats(size_t nBlocks)
+{
+    LOCK(cs_blockcheckstats);
+    nBlocks = std::min(nBlocks, dequeBlockCheckStats.size());
+    return std::vector<BlockCheckStats>(dequeBlockCheckStats.begin(), dequeBlockCheckStats.begin() + nBlocks);
 }
 
 static int64_t nTimeVerify = 0;
@@ -1516,16 +1619,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         fCLTVIsActivated = consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_BIP65);
     }
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    const bool fParallelChecks = fScriptChecks && nScriptCheckThreads;
+    CCheckQueueControl<CBlockCheck, CWorkStealingCheckQueue<CBlockCheck>> control(fParallelChecks ? &blockcheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<CBigNum, uint256> > vSpends;
-    vPos.reserve(block.vtx.size());
+    std::vector<std::pair<COutPoint, CTxOut> > vMints;
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
@@ -1563,6 +1665,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             return state.DoS(100, error("%s : v5 upgrade enforced, zerocoin disabled", __func__));
         }
 
+        if (tx.HasZerocoinMintOutputs()) {
+            for (unsigned int j = 0; j < tx.vout.size(); j++) {
+                if (tx.vout[j].IsZerocoinMint()) vMints.emplace_back(COutPoint(tx.GetHash(), j), tx.vout[j]);
+            }
+        }
+
         if (tx.HasZerocoinSpendInputs()) {
             auto opCoinSpendValues = ParseAndValidateZerocoinSpend(consensus, tx, pindex->nHeight, state);
             if (!opCoinSpendValues) {
@@ -1604,7 +1712,11 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
+            std::vector<CBlockCheck> vBlockChecks;
+            vBlockChecks.reserve(vChecks.size());
+            for (CScriptCheck& check : vChecks)
+                vBlockChecks.emplace_back(check);
+            control.Add(vBlockChecks);
         }
         nValueOut += tx.GetValueOut();
 
@@ -1621,9 +1733,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 sapling_tree.append(outputDescription.cmu);
             }
         }
-
-        vPos.emplace_back(tx.GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(tx, CLIENT_VERSION);
     }
 
     // Push new tree anchor
@@ -1680,6 +1789,23 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
+    if (!fJustCheck) {
+        BlockCheckStats checkStats;
+        checkStats.nHeight = pindex->nHeight;
+        checkStats.hash = hashBlock;
+        checkStats.nInputs = nInputs;
+        checkStats.nConnectTime = nTime1 - nTimeStart;
+        checkStats.nThreads = 1;
+        if (fParallelChecks) {
+            const CCheckQueueStats& queueStats = blockcheckqueue.GetLastStats();
+            checkStats.nChecks = queueStats.nChecks;
+            checkStats.nVerifyWallTime = queueStats.nWallTime;
+            checkStats.nVerifyBusyTime = queueStats.nBusyTime;
+            checkStats.nThreads = queueStats.nThreads;
+            checkStats.nSteals = queueStats.nSteals;
+        }
+        RecordBlockCheckStats(checkStats);
+    }
 
     if (!ProcessSpecialTxsInBlock(block, pindex, state, fJustCheck)) {
         return error("%s: Special tx processing failed with %s", __func__, FormatStateMessage(state));
@@ -1711,12 +1837,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
     // Flush spend/mint info to disk
-    if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends))
+    if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends, hashBlock))
         return AbortNode(state, "Failed to record coin serials to database");
-
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+    if (!vMints.empty() && !zerocoinDB->WriteMintOutputBatch(vMints))
+        return AbortNode(state, "Failed to record zerocoin mints to database");
+    if (!vSpends.empty() && !WriteZerocoinSpendRecords(block))
+        LogPrintf("%s: failed to store the zerocoin spend records of block %s\n", __func__, hashBlock.GetHex());
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -1832,7 +1958,9 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             }
             nLastFlush = nNow;
             // Update money supply on memory, reading data from disk
-            if (!ShutdownRequested() && !IsInitialBlockDownload()) {
+            // (unless the coinstats index, once in sync, keeps it up to date)
+            if (!ShutdownRequested() && !IsInitialBlockDownload() &&
+                    !(g_coin_stats_index && g_coin_stats_index->IsSynced())) {
                 MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainActive.Height());
             }
         }
@@ -2445,6 +2573,20 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+// Compute the stake modifier of a block (it needs the coinstake, and the modifiers of the previous blocks)
+static void SetBlockIndexStakeModifier(CBlockIndex* pindex, const CBlock& block)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    if (!consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V3_4)) {
+        // compute and set new V1 stake modifier (entropy bits)
+        pindex->SetNewStakeModifier();
+
+    } else {
+        // compute and set new V2 stake modifier (hash of prevout and prevModifier)
+        pindex->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
+    }
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2469,15 +2611,9 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
-        const Consensus::Params& consensus = Params().GetConsensus();
-        if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
-            // compute and set new V1 stake modifier (entropy bits)
-            pindexNew->SetNewStakeModifier();
-
-        } else {
-            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
-        }
+        // Headers received without their transactions get the stake modifier with the block (in AcceptBlock)
+        if (!block.vtx.empty())
+            SetBlockIndexStakeModifier(pindexNew, block);
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -2966,11 +3102,23 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
     const CChainParams& chainparams = Params();
 
+    // Sapling proofs, and zc public spends proofs, of the block txs are verified in parallel
+    // (when the verification threads are enabled)
+    const bool fIBD = IsInitialBlockDownload();
+    CCheckQueueControl<CBlockCheck, CWorkStealingCheckQueue<CBlockCheck>> control(nScriptCheckThreads ? &blockcheckqueue : nullptr);
+    std::vector<CSaplingProofCheck> vSaplingChecks;
+    std::vector<CPublicCoinSpendCheck> vZerocoinChecks;
+
+    // Read the mints spent by the block in one pass
+    ZPIVModule::PrefetchSpentMintOutputs(block.vtx);
+
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
         // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload())) {
+        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, fIBD,
+                                        nScriptCheckThreads ? &vSaplingChecks : nullptr,
+                                        nScriptCheckThreads ? &vZerocoinChecks : nullptr)) {
             return false;
         }
 
@@ -2979,6 +3127,25 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
         }
     }
 
+    std::vector<CBlockCheck> vBlockChecks;
+    vBlockChecks.reserve(vSaplingChecks.size() + vZerocoinChecks.size());
+    for (CSaplingProofCheck& check : vSaplingChecks)
+        vBlockChecks.emplace_back(check);
+    for (CPublicCoinSpendCheck& check : vZerocoinChecks)
+        vBlockChecks.emplace_back(check);
+    control.Add(vBlockChecks);
+    if (!control.Wait()) {
+        // Re-check the shielded and zc spend txs serially to find the invalid one and set the failure reason
+        for (const auto& tx : block.vtx) {
+            if ((tx->IsShieldedTx() || tx->HasZerocoinPublicSpendInputs()) &&
+                    !ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, fIBD)) {
+                return false;
+            }
+        }
+        return state.DoS(100, error("%s: proofs verification failed", __func__),
+                         REJECT_INVALID, "bad-txns-proofs-invalid");
+    }
+
     // Enforce block.nVersion=2 rule that the coinbase starts with serialized block height
     if (pindexPrev) { // pindexPrev is only null on the first block which is a version 1 block.
         CScript expect = CScript() << nHeight;
@@ -3059,6 +3226,65 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, CBlockIndex** ppindex)
+{
+    AssertLockNotHeld(cs_main);
+
+    // Hash the whole batch at once (outside cs_main)
+    const std::vector<uint256>& vHashes = GetBlockHeadersHashes(headers);
+
+    LOCK(cs_main);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CBlockIndex* pindexLast = nullptr;
+    // Headers after nEnd are too far ahead of the active chain
+    size_t nEnd = headers.size();
+    bool fCheckedPoSHeaders = false;
+    for (size_t n = 0; n < nEnd; n++) {
+        if (n > 0 && headers[n].hashPrevBlock != vHashes[n - 1])
+            return state.DoS(20, error("%s : non-continuous headers sequence", __func__), REJECT_INVALID, "bad-headers-sequence");
+
+        // Already known (and valid) header
+        BlockMap::iterator mi = mapBlockIndex.find(vHashes[n]);
+        if (mi != mapBlockIndex.end() && !(mi->second->nStatus & BLOCK_FAILED_MASK)) {
+            pindexLast = mi->second;
+            continue;
+        }
+
+        const CBlock block(headers[n]);
+        CBlockIndex* pindexPrev = nullptr;
+        if (!GetPrevIndex(block, &pindexPrev, state))
+            return false;
+        if (pindexPrev) {
+            if (!CheckWork(block, pindexPrev))
+                return state.DoS(100, false, REJECT_INVALID, "bad-diffbits", false, "incorrect difficulty");
+            if (!consensus.NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_POS)) {
+                if (!CheckProofOfWork(vHashes[n], block.nBits))
+                    return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
+            } else if (!fCheckedPoSHeaders) {
+                // The first new PoS header: bound the ones we accept before their proof can be checked
+                fCheckedPoSHeaders = true;
+                const int nAhead = std::max(0, chainActive.Height() + MAX_POS_HEADERS_AHEAD - pindexPrev->nHeight);
+                nEnd = std::min(nEnd, n + (size_t) nAhead);
+                if (n == nEnd) break;
+                arith_uint256 nChainWork = pindexPrev->nChainWork;
+                CBlockIndex indexWork;
+                for (size_t i = n; i < nEnd; i++) {
+                    indexWork.nBits = headers[i].nBits;
+                    nChainWork += GetBlockProof(indexWork);
+                }
+                if (nChainWork <= chainActive.Tip()->nChainWork)
+                    return state.DoS(0, false, REJECT_INVALID, "too-little-chainwork", false, "headers chain with too little work");
+            }
+        }
+        if (!AcceptBlockHeader(block, state, &pindexLast, pindexPrev))
+            return false;
+    }
+
+    if (ppindex)
+        *ppindex = pindexLast;
+    return true;
+}
+
 static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppindex, const FlatFilePos* dbp)
 {
     AssertLockHeld(cs_main);
@@ -3073,6 +3299,13 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     if (!GetPrevIndex(block, &pindexPrev, state))
         return false;
 
+    // The proof-of-stake and the stake modifiers are checked and computed in chain order:
+    // with headers-first sync, the blocks downloaded ahead of their parent must wait for it.
+    if (pindexPrev && !(pindexPrev->nStatus & BLOCK_HAVE_DATA)) {
+        return state.DoS(0, error("%s : prev block %s not available", __func__, block.hashPrevBlock.GetHex()), 0,
+                         "prevblk-not-available");
+    }
+
     if (block.GetHash() != consensus.hashGenesisBlock && !CheckWork(block, pindexPrev))
         return state.DoS(100, false, REJECT_INVALID);
 
@@ -3086,6 +3319,13 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
         return false;
 
+    // Header received first (headers-first sync): the index entry was created without the txes.
+    // Now that we have the coinstake, flag it as proof-of-stake and set the stake modifier.
+    if (isPoS && !pindex->IsProofOfStake())
+        pindex->SetProofOfStake();
+    if (pindex->pprev && pindex->vStakeModifier.empty())
+        SetBlockIndexStakeModifier(pindex, block);
+
     if (pindex->nStatus & BLOCK_HAVE_DATA) {
         // TODO: deal better with duplicate blocks.
         // return state.DoS(20, error("AcceptBlock() : already have block %d %s", pindex->nHeight, pindex->GetBlockHash().ToString()), REJECT_DUPLICATE, "duplicate");
@@ -3134,7 +3374,8 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
         std::vector<CBigNum> inBlockSerials;
         for (const auto& txIn : block.vtx) {
             const CTransaction& tx = *txIn;
-            for (const CTxIn& in: tx.vin) {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                const CTxIn& in = tx.vin[i];
                 if(consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_ZC)) {
                     bool isPublicSpend = in.IsZerocoinPublicSpend();
                     bool isPrivZerocoinSpend = in.IsZerocoinSpend();
@@ -3145,23 +3386,16 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
                             return false;
                         }
 
-                        libzerocoin::CoinSpend spend;
-                        if (isPublicSpend) {
-                            libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                            PublicCoinSpend publicSpend(params);
-                            if (!ZPIVModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                                return false;
-                            }
-                            spend = publicSpend;
-                        } else {
-                            spend = TxInToZerocoinSpend(in);
+                        CZerocoinSpendRecord spendRecord;
+                        if (!GetZerocoinSpendRecord(tx, i, spendRecord, state)) {
+                            return false;
                         }
                         // Check for serials double spending in the same block
-                        if (std::find(inBlockSerials.begin(), inBlockSerials.end(), spend.getCoinSerialNumber()) !=
+                        if (std::find(inBlockSerials.begin(), inBlockSerials.end(), spendRecord.bnSerial) !=
                             inBlockSerials.end()) {
                             return state.DoS(100, error("%s: serial double spent on the same block", __func__));
                         }
-                        inBlockSerials.push_back(spend.getCoinSerialNumber());
+                        inBlockSerials.push_back(spendRecord.bnSerial);
                     }
                 }
                 if(tx.IsCoinStake()) continue;
@@ -3523,9 +3757,6 @@ bool static LoadBlockIndexDB(std::string& strError)
     if (fReindexing) fReindex = true;
 
     // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
-
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3773,6 +4004,8 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    rawBlockCache.Clear();
+    mappedBlockFiles.Clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -3808,9 +4041,6 @@ bool LoadBlockIndex(std::string& strError)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -3852,62 +4082,43 @@ bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+    // Out of order blocks kept in memory (up to MAX_IMPORT_UNKNOWN_PARENT_SIZE bytes), connected with their parent
+    static std::multimap<uint256, CImportedBlock> mapImportedUnknownParent;
+    static size_t nImportedUnknownParentSize = 0;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // Reading, deserialization and hashing of the blocks run ahead of the validation
+        const int nWorkers = std::max(1, std::min(GetNumCores() - 1, MAX_BLOCK_IMPORT_THREADS));
+        CBlockFileImporter importer(fileIn, dbp, nWorkers);
+        CImportedBlock imported;
+        while (importer.Next(imported)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
             try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+                const CBlock& block = *imported.block;
+                const uint256& hash = imported.hash;
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = imported.pos.nPos;
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
                 if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
                             hash.GetHex(), block.hashPrevBlock.GetHex());
-                    if (dbp)
+                    if (nImportedUnknownParentSize + imported.nSize <= MAX_IMPORT_UNKNOWN_PARENT_SIZE) {
+                        nImportedUnknownParentSize += imported.nSize;
+                        mapImportedUnknownParent.emplace(block.hashPrevBlock, imported);
+                    } else if (dbp) {
                         mapBlocksUnknownParent.emplace(block.hashPrevBlock, *dbp);
+                    }
                     continue;
                 }
 
                 // process in case the block isn't known yet
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
                     CValidationState state;
-                    std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                    if (ProcessNewBlock(state, block_ptr, dbp))
+                    if (ProcessNewBlock(state, imported.block, dbp))
                         nLoaded++;
                     if (state.IsError())
                         break;
@@ -3921,17 +4132,35 @@ bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
                 while (!queue.empty()) {
                     uint256 head = queue.front();
                     queue.pop_front();
+                    // first the ones still in memory
+                    auto rangeMem = mapImportedUnknownParent.equal_range(head);
+                    while (rangeMem.first != rangeMem.second) {
+                        auto it = rangeMem.first;
+                        CImportedBlock& child = it->second;
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, child.hash.ToString(),
+                            head.ToString());
+                        CValidationState dummy;
+                        if (ProcessNewBlock(dummy, child.block, child.pos.IsNull() ? nullptr : &child.pos)) {
+                            nLoaded++;
+                            queue.push_back(child.hash);
+                        }
+                        nImportedUnknownParentSize -= child.nSize;
+                        rangeMem.first++;
+                        mapImportedUnknownParent.erase(it);
+                    }
+                    // then the ones that didn't fit in memory, read back from disk
                     std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
                     while (range.first != range.second) {
                         std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        CBlock blockChild;
+                        if (ReadBlockFromDisk(blockChild, it->second)) {
+                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
                                 head.ToString());
                             CValidationState dummy;
-                            std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
+                            std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(blockChild);
                             if (ProcessNewBlock(dummy, block_ptr, &it->second)) {
                                 nLoaded++;
-                                queue.push_back(block.GetHash());
+                                queue.push_back(blockChild.GetHash());
                             }
                         }
                         range.first++;
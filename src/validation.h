@@ -19,9 +19,11 @@
 #include "chain.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "consensus/zerocoin_verify.h"
 #include "fs.h"
 #include "moneysupply.h"
 #include "policy/feerate.h"
+#include "sapling/sapling_validation.h"
 #include "script/script_error.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -38,9 +40,11 @@
 #include <vector>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CBudgetManager;
 class CZerocoinDB;
+class CZerocoinSpendDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
@@ -66,6 +70,12 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 /** Default for -txindex */
 static const bool DEFAULT_TXINDEX = true;
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -blockfilterindex */
+static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
+/** Default for -coinstatsindex */
+static const bool DEFAULT_COINSTATSINDEX = false;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 /** The maximum size for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
@@ -89,6 +99,10 @@ static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Headers download timeout expressed in microseconds.
+ *  Timeout = base + per_header * (expected number of headers) */
+static const int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
+static const int64_t HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 1000; // 1ms/header
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached their tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -97,6 +111,11 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** How far ahead of the active chain are proof-of-stake headers accepted (without their block, their
+ *  proof can't be checked): enough to keep the download window full, with one getheaders in flight. */
+static const int MAX_POS_HEADERS_AHEAD = BLOCK_DOWNLOAD_WINDOW + MAX_HEADERS_RESULTS;
+/** Maximum number of blocks, connected but not indexed yet by the background txindex, scanned by GetTransaction */
+static const int MAX_TXINDEX_LAG_SCAN = 100;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -111,6 +130,8 @@ static const unsigned int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
 static const unsigned int DEFAULT_SHIELDEDTXFEE_K = 100;
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
+/** Serve the compact block filters (BIP157) */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 /** Maximum age of our tip in seconds for us to be considered current for fee estimation */
@@ -138,7 +159,6 @@ extern int64_t g_best_block_time;
 extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern size_t nCoinCacheUsage;
@@ -169,6 +189,22 @@ extern CBlockIndex* pindexBestHeader;
  */
 bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock> pblock, const FlatFilePos* dbp, bool* fAccepted = nullptr);
 
+/**
+ * Process incoming block headers (headers-first sync). The headers must be a
+ * continuous chain. The proof-of-stake of a block can only be checked with its
+ * transactions: here only the difficulty (and the proof-of-work, before PoS) is.
+ * So that fake PoS headers can't fill the block index, the PoS headers are only
+ * accepted up to MAX_POS_HEADERS_AHEAD blocks ahead of the active chain (the rest
+ * is left out, to be requested again later), and if they lead to more work than it
+ * (else the state is set to "too-little-chainwork", with no DoS score).
+ *
+ * @param[in]   headers    The headers, in chain order.
+ * @param[out]  state      This may be set to an Invalid state if a header is invalid.
+ * @param[out]  ppindex    If set, the pointer will be set to point to the last new block index object for the given headers
+ * @return True if the headers were accepted (or already known), up to *ppindex
+ */
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, CBlockIndex** ppindex = nullptr);
+
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos& pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
@@ -188,13 +224,15 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** See whether the protocol update is enforced for connected nodes */
 int ActiveProtocol();
-/** Run an instance of the script checking thread */
+/** Run an instance of the block verification thread (scripts and Sapling proofs) */
 void ThreadScriptCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
+/** Whether the background txindex is building, or too far behind the tip: GetTransaction can miss spent transactions */
+bool IsTxIndexSyncing();
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out);
 
@@ -312,11 +350,77 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * A verification of the parallel block validation: either a script check,
+ * the Sapling proofs of a transaction or the proof of a zc public spend.
+ * Lets the different kinds of checks share the same queue (and worker threads).
+ */
+class CBlockCheck
+{
+private:
+    enum Type : uint8_t { SCRIPT, SAPLING, ZC_PUBLIC_SPEND };
+    CScriptCheck scriptCheck;
+    CSaplingProofCheck saplingCheck;
+    CPublicCoinSpendCheck zcSpendCheck;
+    Type type{SCRIPT};
+
+public:
+    CBlockCheck() {}
+    explicit CBlockCheck(CScriptCheck& check) { scriptCheck.swap(check); }
+    explicit CBlockCheck(CSaplingProofCheck& check) : type(SAPLING) { saplingCheck.swap(check); }
+    explicit CBlockCheck(CPublicCoinSpendCheck& check) : type(ZC_PUBLIC_SPEND) { zcSpendCheck.swap(check); }
+
+    bool operator()()
+    {
+        switch (type) {
+            case SAPLING: return saplingCheck();
+            case ZC_PUBLIC_SPEND: return zcSpendCheck();
+            default: return scriptCheck();
+        }
+    }
+
+    void swap(CBlockCheck& check)
+    {
+        scriptCheck.swap(check.scriptCheck);
+        saplingCheck.swap(check.saplingCheck);
+        zcSpendCheck.swap(check.zcSpendCheck);
+        std::swap(type, check.type);
+    }
+};
+
+/** Verification metrics of a connected block */
+struct BlockCheckStats
+{
+    int nHeight{0};
+    uint256 hash;
+    // Inputs of the block, and checks verified by the check queue
+    unsigned int nInputs{0};
+    uint64_t nChecks{0};
+    // Time spent connecting the block / waiting for the checks, in microseconds
+    int64_t nConnectTime{0};
+    int64_t nVerifyWallTime{0};
+    int64_t nVerifyBusyTime{0};
+    int nThreads{0};
+    uint64_t nSteals{0};
+};
+
+/** Number of connected blocks whose verification metrics are kept */
+static const size_t MAX_BLOCK_CHECK_STATS = 1000;
+/** Return the verification metrics of (up to) the last nBlocks blocks connected, latest first */
+std::vector<BlockCheckStats> GetBlockCheckStats(size_t nBlocks);
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the undo data of a connected block */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Read the serialized bytes of the block stored at pos (through the memory mapped block files) */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const FlatFilePos& pos);
+/** Serialized bytes of a stored block, for serving it to peers, RPC and REST (nullptr if it can't be read).
+ *  The recently served blocks are kept in memory. */
+std::shared_ptr<const std::vector<unsigned char>> GetRawBlock(const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -368,6 +472,9 @@ extern CBlockTreeDB* pblocktree;
 /** Global variable that points to the zerocoin database (protected by cs_main) */
 extern CZerocoinDB* zerocoinDB;
 
+/** Global variable that points to the parsed zerocoin spends database */
+extern CZerocoinSpendDB* zerocoinSpendDB;
+
 /** Global variable that points to the spork database (protected by cs_main) */
 extern CSporkDB* pSporkDB;
 
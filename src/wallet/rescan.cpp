@@ -0,0 +1,113 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/rescan.h"
+
+#include "script/ismine.h"
+#include "util/system.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+CWalletRescanPipeline::CWalletRescanPipeline(const CWallet* pwalletIn, std::shared_ptr<const CWalletKeySnapshot> keysIn, int nWorkers) :
+        keys(std::move(keysIn)),
+        pwallet(pwalletIn)
+{
+    for (int i = 0; i < std::max(nWorkers, 1); i++) {
+        vWorkerThreads.emplace_back(&CWalletRescanPipeline::ThreadProcess, this);
+    }
+}
+
+CWalletRescanPipeline::~CWalletRescanPipeline()
+{
+    {
+        LOCK(cs);
+        fInterrupt = true;
+    }
+    condWorker.notify_all();
+    for (std::thread& t : vWorkerThreads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+void CWalletRescanPipeline::Push(CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    auto block = std::make_shared<CRescanBlock>();
+    block->pindex = pindex;
+    block->pos = pindex->GetBlockPos();
+    {
+        LOCK(cs);
+        queueBlocks.emplace_back(block);
+        queuePending.emplace_back(block);
+    }
+    condWorker.notify_one();
+}
+
+size_t CWalletRescanPipeline::Size()
+{
+    LOCK(cs);
+    return queueBlocks.size();
+}
+
+void CWalletRescanPipeline::SetKeys(std::shared_ptr<const CWalletKeySnapshot> keysIn)
+{
+    LOCK(cs);
+    keys = std::move(keysIn);
+}
+
+void CWalletRescanPipeline::MatchBlock(CRescanBlock& block, std::shared_ptr<const CWalletKeySnapshot> keysIn)
+{
+    block.keys = std::move(keysIn);
+    block.vMatches.assign(block.block->vtx.size(), false);
+    for (size_t i = 0; i < block.block->vtx.size(); i++) {
+        for (const CTxOut& txout : block.block->vtx[i]->vout) {
+            if (::IsMine(*block.keys, txout.scriptPubKey) != ISMINE_NO) {
+                block.vMatches[i] = true;
+                break;
+            }
+        }
+    }
+}
+
+void CWalletRescanPipeline::ThreadProcess()
+{
+    util::ThreadRename("pivx-rescan");
+    while (true) {
+        std::shared_ptr<CRescanBlock> block;
+        std::shared_ptr<const CWalletKeySnapshot> blockKeys;
+        {
+            WAIT_LOCK(cs, lock);
+            condWorker.wait(lock, [this]{ return fInterrupt || !queuePending.empty(); });
+            if (fInterrupt) return;
+            block = queuePending.front();
+            queuePending.pop_front();
+            blockKeys = keys;
+        }
+        auto pblock = std::make_shared<CBlock>();
+        // The caller of the rescan may hold cs_main: read the block from the position
+        if (ReadBlockFromDisk(*pblock, block->pos) && pblock->GetHash() == block->pindex->GetBlockHash()) {
+            block->block = pblock;
+            MatchBlock(*block, blockKeys);
+            // Trial-decrypt the shielded outputs of the whole block at once
+            if (pwallet->HasSaplingSPKM()) {
+                block->vSaplingNotes = pwallet->GetSaplingScriptPubKeyMan()->FindMySaplingNotes(pblock->vtx);
+            }
+        }
+        {
+            LOCK(cs);
+            block->fProcessed = true;
+        }
+        condConsumer.notify_all();
+    }
+}
+
+std::shared_ptr<CRescanBlock> CWalletRescanPipeline::Next()
+{
+    WAIT_LOCK(cs, lock);
+    if (queueBlocks.empty()) return nullptr;
+    condConsumer.wait(lock, [this]{ return queueBlocks.front()->fProcessed; });
+    std::shared_ptr<CRescanBlock> block = queueBlocks.front();
+    queueBlocks.pop_front();
+    return block;
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_WALLET_RESCAN_H
+#define PIVX_WALLET_RESCAN_H
+
+#include "flatfile.h"
+#include "keystore.h"
+#include "primitives/block.h"
+#include "sapling/saplingscriptpubkeyman.h"
+#include "sync.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+class CWallet;
+
+extern RecursiveMutex cs_main;
+
+/** Number of blocks read and matched ahead of the wallet during a rescan */
+static const size_t RESCAN_READAHEAD_BLOCKS = 32;
+/** Maximum number of threads reading and matching the blocks of a rescan */
+static const int MAX_RESCAN_THREADS = 4;
+
+/**
+ * Copy of the transparent keys (ids only), redeem scripts and watch-only
+ * scripts of a wallet, to run IsMine on the rescanned outputs without the
+ * wallet lock.
+ */
+class CWalletKeySnapshot : public CBasicKeyStore
+{
+private:
+    std::set<CKeyID> setKeyIDs;
+
+public:
+    //! CWallet::GetKeySetSize() when the snapshot was taken
+    const size_t nKeySetSize;
+
+    explicit CWalletKeySnapshot(size_t nKeySetSizeIn) : nKeySetSize(nKeySetSizeIn) {}
+
+    void AddKeyID(const CKeyID& keyID) { setKeyIDs.insert(keyID); }
+    bool HaveKey(const CKeyID& address) const override { return setKeyIDs.count(address) > 0; }
+};
+
+/** A block of the rescan, read and matched against the wallet keys ahead of the wallet */
+struct CRescanBlock
+{
+    CBlockIndex* pindex{nullptr};
+    // Read when the block is queued (with cs_main), so that the workers don't need it
+    FlatFilePos pos;
+    // nullptr if the block could not be read
+    std::shared_ptr<const CBlock> block;
+    // Txs with an output matching keys (and the keys snapshot used)
+    std::vector<bool> vMatches;
+    std::shared_ptr<const CWalletKeySnapshot> keys;
+    // Trial-decrypted shielded outputs
+    std::vector<SaplingNotesAndIVKs> vSaplingNotes;
+    bool fProcessed{false};
+};
+
+/**
+ * Staged wallet rescan (see CWallet::ScanForWalletTransactions).
+ * The caller pushes the blocks to scan, in chain order, a pool of workers
+ * reads them from disk, matches their outputs against a snapshot of the
+ * wallet keys and trial-decrypts their shielded outputs, and the caller
+ * of Next() gets them back in order, ready to be committed to the wallet.
+ * None of the work of the pool needs the chain or the wallet locks.
+ */
+class CWalletRescanPipeline
+{
+private:
+    // Protects all the members below
+    Mutex cs;
+    std::condition_variable condWorker;
+    std::condition_variable condConsumer;
+
+    // All the blocks pushed, in chain order (front is the next one returned)
+    std::deque<std::shared_ptr<CRescanBlock>> queueBlocks;
+    // Blocks waiting to be processed by the workers
+    std::deque<std::shared_ptr<CRescanBlock>> queuePending;
+    std::shared_ptr<const CWalletKeySnapshot> keys;
+    bool fInterrupt{false};
+
+    const CWallet* pwallet;
+    std::vector<std::thread> vWorkerThreads;
+
+    void ThreadProcess();
+
+public:
+    CWalletRescanPipeline(const CWallet* pwalletIn, std::shared_ptr<const CWalletKeySnapshot> keysIn, int nWorkers);
+    ~CWalletRescanPipeline();
+
+    /** Queues a block to scan */
+    void Push(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** Number of blocks queued (and not returned yet) */
+    size_t Size();
+    /** Waits for the next block queued. Returns nullptr when there are no more blocks. */
+    std::shared_ptr<CRescanBlock> Next();
+    /** Matches the blocks against a new snapshot of the wallet keys, from now on */
+    void SetKeys(std::shared_ptr<const CWalletKeySnapshot> keysIn);
+
+    /** Matches the outputs of the block against keys */
+    static void MatchBlock(CRescanBlock& block, std::shared_ptr<const CWalletKeySnapshot> keys);
+};
+
+#endif // PIVX_WALLET_RESCAN_H
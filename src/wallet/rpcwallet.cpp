@@ -4243,6 +4243,14 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"paytxfee\": x.xxxx                       (numeric) the transaction fee configuration, set in PIV/kB\n"
             "  \"hdseedid\": \"<hash160>\"                (string, optional) the Hash160 of the HD seed (only present when HD is enabled)\n"
             "  \"last_processed_block\": xxxxx,          (numeric) the last block processed block height\n"
+            "  \"scanning\":                             (json object) current scanning details, or false if no scan is in progress\n"
+            "    {\n"
+            "      \"duration\" : xxxx,                   (numeric) elapsed seconds since scan start\n"
+            "      \"progress\" : x.xxxx,                 (numeric) scanning progress percentage [0.0, 1.0]\n"
+            "      \"blocks\" : xxxx,                     (numeric) number of blocks scanned\n"
+            "      \"blocks_per_sec\" : x.xx,             (numeric) scanning speed\n"
+            "      \"eta\" : xxxx,                        (numeric, optional) estimated seconds left (once the progress is known)\n"
+            "    }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -4291,6 +4299,21 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
         obj.pushKV("unlocked_until", pwallet->nRelockTime);
     obj.pushKV("paytxfee", ValueFromAmount(payTxFee.GetFeePerK()));
     obj.pushKV("last_processed_block", pwallet->GetLastBlockHeight());
+    if (pwallet->IsScanning()) {
+        UniValue scanning(UniValue::VOBJ);
+        const int64_t nDuration = pwallet->ScanningDuration();
+        const double dProgress = pwallet->ScanningProgress();
+        scanning.pushKV("duration", nDuration / 1000);
+        scanning.pushKV("progress", dProgress);
+        scanning.pushKV("blocks", pwallet->ScanningBlocks());
+        scanning.pushKV("blocks_per_sec", pwallet->ScanningBlocks() * 1000.0 / std::max<int64_t>(1, nDuration));
+        if (dProgress > 0) {
+            scanning.pushKV("eta", (int64_t)(nDuration * (1 - dProgress) / dProgress / 1000));
+        }
+        obj.pushKV("scanning", scanning);
+    } else {
+        obj.pushKV("scanning", false);
+    }
     return obj;
 }
 
@@ -4643,6 +4666,7 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
                 "{\n"
                 "  start_height     (numeric) The block height where the rescan has started. If omitted, rescan started from the genesis block.\n"
                 "  stop_height      (numeric) The height of the last rescanned block. If omitted, rescan stopped at the chain tip.\n"
+                "  blocks_per_sec   (numeric) The scanning speed\n"
                 "}\n"
                 "\nExamples:\n"
                 + HelpExampleCli("rescanblockchain", "100000 120000")
@@ -4682,6 +4706,7 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
     }
 
     CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, reserver, true);
+    const double dBlocksPerSec = pwallet->ScanningBlocks() * 1000.0 / std::max<int64_t>(1, pwallet->ScanningDuration());
     if (!stopBlock) {
         if (pwallet->IsAbortingRescan()) {
             throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted.");
@@ -4696,6 +4721,7 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
     UniValue response(UniValue::VOBJ);
     response.pushKV("start_height", pindexStart->nHeight);
     response.pushKV("stop_height", stopBlock->nHeight);
+    response.pushKV("blocks_per_sec", dBlocksPerSec);
     return response;
 }
 
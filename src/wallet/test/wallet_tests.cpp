@@ -7,6 +7,7 @@
 
 #include "consensus/merkle.h"
 #include "rpc/server.h"
+#include "script/sign.h"
 #include "txmempool.h"
 #include "validation.h"
 #include "wallet/wallet.h"
@@ -398,6 +399,75 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// A block paying to the last key of the keypool, and then to the next derived key
+// (added by the keypool top up when the first tx is committed): the rescan must find both txs.
+BOOST_FIXTURE_TEST_CASE(rescan_keypool_topup, TestChain100Setup)
+{
+    gArgs.ForceSetArg("-keypool", "3");
+    CKey seed;
+    seed.MakeNewKey(true);
+    auto setupWallet = [&seed](CWallet& wallet) {
+        LOCK(wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+        wallet.SetupSPKM(false);
+        ScriptPubKeyMan* spk_man = wallet.GetScriptPubKeyMan();
+        spk_man->SetHDSeed(spk_man->DeriveNewSeed(seed), true);
+    };
+
+    // The first four external keys of the HD chain (the external pool is generated first)
+    std::vector<CKeyID> vKeys;
+    {
+        CWallet refWallet("dummy", CWalletDBWrapper::CreateDummy());
+        setupWallet(refWallet);
+        LOCK(refWallet.cs_wallet);
+        BOOST_CHECK(refWallet.GetScriptPubKeyMan()->TopUp(4));
+        std::map<int64_t, CKeyID> mapPoolKeys;
+        for (const auto& it : refWallet.GetScriptPubKeyMan()->GetAllReserveKeys()) {
+            mapPoolKeys.emplace(it.second, it.first);
+        }
+        for (const auto& it : mapPoolKeys) {
+            if (vKeys.size() == 4) break;
+            vKeys.push_back(it.second);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(vKeys.size(), 4U);
+
+    // Coinbase to the third (last) keypool key, then a tx to the fourth key
+    const CScript coinbaseScript = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(coinbaseTxns[0].GetHash(), 0));
+    spend.vout.emplace_back(10 * COIN, GetScriptForDestination(vKeys[3]));
+    std::vector<unsigned char> vchSig;
+    const uint256& hash = SignatureHash(coinbaseScript, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const CBlock& block = CreateAndProcessBlock({spend}, GetScriptForDestination(vKeys[2]));
+    CBlockIndex* tip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    BOOST_CHECK(tip->GetBlockHash() == block.GetHash());
+
+    CWallet wallet("dummy", CWalletDBWrapper::CreateDummy());
+    setupWallet(wallet);
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.GetScriptPubKeyMan()->TopUp());
+        BOOST_CHECK(wallet.HaveKey(vKeys[2]));
+        BOOST_CHECK(!wallet.HaveKey(vKeys[3]));
+        wallet.SetLastBlockProcessed(tip);
+    }
+    WalletRescanReserver reserver(&wallet);
+    reserver.reserve();
+    BOOST_CHECK(wallet.ScanForWalletTransactions(tip, nullptr, reserver) == nullptr);
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.HaveKey(vKeys[3]));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 2U);
+        BOOST_CHECK(wallet.mapWallet.count(block.vtx[0]->GetHash()));
+        BOOST_CHECK(wallet.mapWallet.count(block.vtx[1]->GetHash()));
+    }
+    gArgs.ForceSetArg("-keypool", std::to_string(DEFAULT_KEYPOOL_SIZE));
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -632,4 +702,81 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
 
 }
 
+/**
+ * Validates the index of the wallet txs with unspent outputs (CWallet::GetUnspentTxs)
+ * swept by the balance and coin availability calls:
+ *
+ * 1) Received txs are indexed, unconfirmed or not.
+ * 2) A confirmed tx stays indexed while one of its outputs is unspent (or spent in the mempool only).
+ * 3) Once all its outputs are spent in the chain, it is pruned (with the spending tx, paying to others).
+ * 4) It is indexed back when the spending tx is disconnected.
+ * 5) A pruned tx paying to a key added later (keypool top-up, HD derivation, import) is indexed back.
+ */
+BOOST_AUTO_TEST_CASE(unspent_txs_index_tests)
+{
+    CAmount nCredit = 20 * COIN;
+
+    // Setup wallet
+    CWallet wallet("testWallet1", CWalletDBWrapper::CreateMock());
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+    wallet.SetLastBlockProcessed(chainActive.Tip());
+
+    // 1) Receive balance from an external source
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CTxOut creditOut(nCredit/2, GetScriptForDestination(receivingAddr));
+    CWalletTx& wtxCredit = ReceiveBalanceWith({creditOut, creditOut}, wallet);
+    auto vTxs = wallet.GetUnspentTxs();
+    BOOST_CHECK_EQUAL(vTxs.size(), 1U);
+    BOOST_CHECK(vTxs[0] == &wtxCredit);
+
+    // 2) Confirm it (as AddToWallet does, marking it dirty) and spend its outputs
+    CBlockIndex* pindexCredit = SimpleFakeMine(wtxCredit, wallet);
+    wtxCredit.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.GetUnspentTxs().size(), 1U);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), nCredit);
+
+    CKey key;
+    key.MakeNewKey(true);
+    std::vector<CTxIn> vinDebit = {CTxIn(COutPoint(wtxCredit.GetHash(), 0)), CTxIn(COutPoint(wtxCredit.GetHash(), 1))};
+    std::vector<CTxOut> voutDebit = {CTxOut(nCredit, GetScriptForDestination(key.GetPubKey().GetID()))};
+    CWalletTx& wtxDebit = BuildAndLoadTxToWallet(vinDebit, voutDebit, wallet);
+    BOOST_CHECK_EQUAL(wallet.GetUnspentTxs().size(), 2U);
+
+    // 3) Confirm the spending tx (as BlockConnected does, marking the spent txs dirty)
+    SimpleFakeMine(wtxDebit, wallet, pindexCredit);
+    wtxDebit.MarkDirty();
+    wtxCredit.MarkDirty();
+    BOOST_CHECK(wallet.GetUnspentTxs().empty());
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 0);
+
+    // 4) Disconnect the spending tx (as BlockDisconnected does)
+    wtxDebit.m_confirm = CWalletTx::Confirmation();
+    WITH_LOCK(wallet.cs_wallet, wallet.SetLastBlockProcessed(pindexCredit));
+    wtxDebit.MarkDirty();
+    wtxCredit.MarkDirty();
+    vTxs = wallet.GetUnspentTxs();
+    BOOST_CHECK_EQUAL(vTxs.size(), 2U);
+    BOOST_CHECK(std::count(vTxs.begin(), vTxs.end(), &wtxCredit) == 1);
+    BOOST_CHECK(std::count(vTxs.begin(), vTxs.end(), &wtxDebit) == 1);
+
+    // 5) Confirm the spending tx again, then add the key it pays to
+    SimpleFakeMine(wtxDebit, wallet, pindexCredit);
+    wtxDebit.MarkDirty();
+    wtxCredit.MarkDirty();
+    BOOST_CHECK(wallet.GetUnspentTxs().empty());
+    BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    vTxs = wallet.GetUnspentTxs();
+    BOOST_CHECK_EQUAL(vTxs.size(), 1U);
+    BOOST_CHECK(vTxs[0] == &wtxDebit);
+    std::vector<COutput> vCoins;
+    wallet.AvailableCoins(&vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 1U);
+    BOOST_CHECK_EQUAL(vCoins[0].tx->GetHash(), wtxDebit.GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
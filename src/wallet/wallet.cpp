@@ -21,6 +21,7 @@
 #include "util/system.h"
 #include "utilmoneystr.h"
 #include "wallet/fees.h"
+#include "wallet/rescan.h"
 #include "zpivchain.h"
 
 #include  <init.h>    // for StartShutdown/ShutdownRequested
@@ -246,6 +247,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    MarkAllUnspentTxs();
 
     // TODO: Move the follow block entirely inside the spkm (including WriteKey to AddKeyPubKeyWithDB)
     // check if we need to remove from watch-only
@@ -273,6 +275,7 @@ bool CWallet::AddCryptedKey(const CPubKey& vchPubKey,
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    MarkAllUnspentTxs();
     {
         LOCK(cs_wallet);
         if (pwalletdbEncryption)
@@ -320,6 +323,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    MarkAllUnspentTxs();
     return CWalletDB(*dbw).WriteCScript(Hash160(redeemScript), redeemScript);
 }
 
@@ -342,6 +346,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    MarkAllUnspentTxs();
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     return CWalletDB(*dbw).WriteWatchOnly(dest);
@@ -960,6 +965,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
             fUpdated = true;
         }
     }
+    m_sspk_man->AddToSaplingNoteTxs(wtx);
 
     //// debug print
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
@@ -1027,6 +1033,7 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
     wtx.BindWallet(this);
     // Sapling
     m_sspk_man->UpdateNullifierNoteMapWithTx(wtx);
+    m_sspk_man->AddToSaplingNoteTxs(wtx);
     wtxOrdered.emplace(wtx.nOrderPos, &wtx);
     AddToSpends(hash);
     for (const CTxIn& txin : wtx.tx->vin) {
@@ -1041,11 +1048,12 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
     return true;
 }
 
-bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData)
+bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData,
+                                                      const SaplingNotesAndIVKs* pSaplingNotes)
 {
-    auto saplingNoteDataAndAddressesToAdd = m_sspk_man->FindMySaplingNotes(tx);
+    const SaplingNotesAndIVKs& saplingNoteDataAndAddressesToAdd = pSaplingNotes ? *pSaplingNotes : m_sspk_man->FindMySaplingNotes(tx);
     saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
-    auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
+    const auto& addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
     // Add my addresses
     for (const auto& addressToAdd : addressesToAdd) {
         if (!m_sspk_man->AddSaplingIncomingViewingKey(addressToAdd.second, addressToAdd.first)) {
@@ -1092,7 +1100,8 @@ void CWallet::AddExternalNotesDataToTx(CWalletTx& wtx) const
  * Abandoned state should probably be more carefully tracked via different
  * posInBlock signals or by checking mempool presence when necessary.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate,
+                                       const SaplingNotesAndIVKs* pSaplingNotes)
 {
     const CTransaction& tx = *ptx;
     {
@@ -1117,7 +1126,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWallet
         // Check tx for Sapling notes
         Optional<mapSaplingNoteData_t> saplingNoteData {nullopt};
         if (HasSaplingSPKM()) {
-            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData)) {
+            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData, pSaplingNotes)) {
                 return false; // error adding incoming viewing key.
             }
         }
@@ -1275,9 +1284,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
     }
 }
 
-void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm)
+void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, const SaplingNotesAndIVKs* pSaplingNotes)
 {
-    if (!AddToWalletIfInvolvingMe(ptx, confirm, true)) {
+    if (!AddToWalletIfInvolvingMe(ptx, confirm, true, pSaplingNotes)) {
         return; // Not one of ours
     }
 
@@ -1342,10 +1351,13 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         m_last_block_processed = pindex->GetBlockHash();
         m_last_block_processed_time = pindex->GetBlockTime();
         m_last_block_processed_height = pindex->nHeight;
+        // Trial-decrypt the shielded outputs of the whole block at once
+        std::vector<SaplingNotesAndIVKs> vSaplingNotes;
+        if (HasSaplingSPKM()) vSaplingNotes = m_sspk_man->FindMySaplingNotes(pblock->vtx);
         for (size_t index = 0; index < pblock->vtx.size(); index++) {
             CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, m_last_block_processed_height,
                                             m_last_block_processed, index);
-            SyncTransaction(pblock->vtx[index], confirm);
+            SyncTransaction(pblock->vtx[index], confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[index]);
             TransactionRemovedFromMempool(pblock->vtx[index], MemPoolRemovalReason::BLOCK);
         }
 
@@ -1878,10 +1890,53 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+size_t CWallet::GetKeySetSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+std::shared_ptr<const CWalletKeySnapshot> CWallet::GetKeySnapshot() const
+{
+    LOCK(cs_KeyStore);
+    auto keys = std::make_shared<CWalletKeySnapshot>(GetKeySetSize());
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (const CKeyID& keyID : setKeyIDs) {
+        keys->AddKeyID(keyID);
+    }
+    for (const auto& it : mapScripts) {
+        keys->AddCScript(it.second);
+    }
+    for (const CScript& script : setWatchOnly) {
+        keys->AddWatchOnly(script);
+    }
+    return keys;
+}
+
+bool CWallet::MayInvolveWallet(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+    // Sapling notes and ProRegTx collaterals are checked by AddToWalletIfInvolvingMe
+    if (tx.IsShieldedTx() || tx.IsSpecialTx() || mapWallet.count(tx.GetHash())) {
+        return true;
+    }
+    // Spending, or conflicting with, a wallet tx
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ * The blocks are read from disk, and their outputs matched against a snapshot of
+ * the wallet keys, ahead of the wallet by a pool of workers (CWalletRescanPipeline):
+ * the wallet (and chain) lock is only held to commit the txs that can involve it.
  *
  * Returns null if scan was successful. Otherwise, if a complete rescan was not
  * possible (due to pruning or corruption), returns pointer to the most recent
@@ -1916,36 +1971,82 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
             dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
         }
+        m_scanning_start = GetTimeMillis();
+        m_scanning_progress = 0;
+        m_scanning_blocks = 0;
+
+        std::shared_ptr<const CWalletKeySnapshot> keys = GetKeySnapshot();
+        CWalletRescanPipeline pipeline(this, keys, std::min(std::max(GetNumCores() - 1, 1), MAX_RESCAN_THREADS));
+        CBlockIndex* pindexNext = pindexStart; // next block to queue
 
         std::vector<uint256> myTxHashes;
-        while (pindex && !fAbortRescan) {
+        while (!fAbortRescan) {
+            {
+                LOCK(cs_main);
+                while (pindexNext && pipeline.Size() < RESCAN_READAHEAD_BLOCKS) {
+                    pipeline.Push(pindexNext);
+                    pindexNext = (pindexNext == pindexStop) ? nullptr : chainActive.Next(pindexNext);
+                }
+                if (tip != chainActive.Tip()) {
+                    tip = chainActive.Tip();
+                    // in case the tip has changed, update progress max
+                    dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
+                }
+            }
+            std::shared_ptr<CRescanBlock> scanned = pipeline.Next();
+            if (!scanned) {
+                // end of the chain (or of a reorged branch)
+                pindex = nullptr;
+                break;
+            }
+            pindex = scanned->pindex;
+
             double gvp = 0;
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
                 gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(pindex, false); );
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((gvp - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                m_scanning_progress = std::max(0.0, std::min(1.0, (gvp - dProgressStart) / (dProgressTip - dProgressStart)));
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(m_scanning_progress * 100))));
             }
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
+                LogPrintf("Still rescanning. At block %d. Progress=%f (%.1f blocks/s)\n", pindex->nHeight, gvp,
+                          ScanningBlocks() * 1000.0 / std::max<int64_t>(1, ScanningDuration()));
             }
             if (fromStartup && ShutdownRequested()) {
                 break;
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex)) {
+            if (scanned->block) {
+                const CBlock& block = *scanned->block;
                 LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
-                     // Abort scan if current block is no longer active, to prevent
-                     // marking transactions as coming from the wrong block.
-                     ret = pindex;
-                     break;
-                 }
+                if (!chainActive.Contains(pindex)) {
+                    // Abort scan if current block is no longer active, to prevent
+                    // marking transactions as coming from the wrong block.
+                    ret = pindex;
+                    break;
+                }
+                // The keys added by the previous blocks and txs (keypool top up) must be matched too
+                auto matchNewKeys = [&]() {
+                    const size_t nKeySetSize = GetKeySetSize();
+                    if (scanned->keys->nKeySetSize == nKeySetSize) return;
+                    if (keys->nKeySetSize != nKeySetSize) {
+                        keys = GetKeySnapshot();
+                        pipeline.SetKeys(keys);
+                    }
+                    CWalletRescanPipeline::MatchBlock(*scanned, keys);
+                };
+                matchNewKeys();
                 for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
                     const auto& tx = block.vtx[posInBlock];
+                    if (!scanned->vMatches[posInBlock] && !MayInvolveWallet(*tx)) {
+                        continue;
+                    }
                     CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
-                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate)) {
+                    const auto& vSaplingNotes = scanned->vSaplingNotes;
+                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[posInBlock])) {
                         myTxHashes.push_back(tx->GetHash());
+                        // It may have used a keypool key: the rest of the block must be matched with the new keys
+                        matchNewKeys();
                     }
                 }
 
@@ -1963,18 +2064,10 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             } else {
                 ret = pindex;
             }
+            m_scanning_blocks++;
             if (pindex == pindexStop) {
                 break;
             }
-            {
-                LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
-                if (tip != chainActive.Tip()) {
-                    tip = chainActive.Tip();
-                    // in case the tip has changed, update progress max
-                    dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
-                }
-            }
         }
 
         // Sapling
@@ -1993,6 +2086,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex, false));
         }
+        const int64_t nDuration = ScanningDuration();
+        LogPrintf("Rescanned %d blocks in %dms (%.1f blocks/s)\n", ScanningBlocks(), nDuration,
+                  ScanningBlocks() * 1000.0 / std::max<int64_t>(1, nDuration));
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
@@ -2120,8 +2216,8 @@ CWallet::Balance CWallet::GetBalance(const int min_depth) const
     {
         LOCK(cs_wallet);
         std::set<uint256> trusted_parents;
-        for (const auto& entry : mapWallet) {
-            const CWalletTx& wtx = entry.second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
+            const CWalletTx& wtx = *pcoin;
             const bool is_trusted{wtx.IsTrusted()};
             const int tx_depth{wtx.GetDepthInMainChain()};
             const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE_TRANSPARENT)};
@@ -2143,13 +2239,98 @@ CWallet::Balance CWallet::GetBalance(const int min_depth) const
     return ret;
 }
 
+void CWallet::MarkUnspentTx(const uint256& hash) const
+{
+    LOCK(cs_unspent_txs);
+    setUnspentTxs.emplace(hash);
+    setUnspentTxsToCheck.emplace(hash);
+}
+
+void CWallet::MarkAllUnspentTxs() const
+{
+    LOCK(cs_unspent_txs);
+    fCheckAllUnspentTxs = true;
+}
+
+/**
+ * Whether all the outputs of wtx are either not ours or spent by a tx in the chain.
+ * Such a tx can only get unspent outputs back by a reorg, which marks it dirty
+ * again, or by a new key or script (see MarkAllUnspentTxs).
+ * Txs with shielded notes of the wallet are never pruned.
+ */
+bool CWallet::IsSpentInChain(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!wtx.mapSaplingNoteData.empty() || wtx.GetDepthInMainChain() <= 0) {
+        return false;
+    }
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+        bool fSpent = false;
+        const auto range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (auto it = range.first; it != range.second && !fSpent; ++it) {
+            const auto mit = mapWallet.find(it->second);
+            fSpent = mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0;
+        }
+        if (!fSpent) return false;
+    }
+    return true;
+}
+
+std::vector<const CWalletTx*> CWallet::GetUnspentTxs() const
+{
+    AssertLockHeld(cs_wallet);
+    // Prune the txs that changed state since the last call (without holding
+    // cs_unspent_txs, as IsMine takes the keystore lock)
+    std::set<uint256> setToCheck;
+    {
+        LOCK(cs_unspent_txs);
+        setToCheck.swap(setUnspentTxsToCheck);
+        if (fCheckAllUnspentTxs) {
+            // A key or script was added: the pruned txs could pay to it
+            for (const auto& it : mapWallet) {
+                setUnspentTxs.emplace(it.first);
+                setToCheck.emplace(it.first);
+            }
+            fCheckAllUnspentTxs = false;
+        }
+    }
+    std::vector<uint256> vSpent;
+    for (const uint256& hash : setToCheck) {
+        const auto it = mapWallet.find(hash);
+        if (it == mapWallet.end() || IsSpentInChain(it->second)) {
+            vSpent.emplace_back(hash);
+        }
+    }
+
+    LOCK(cs_unspent_txs);
+    for (const uint256& hash : vSpent) {
+        // Unless marked again in the meantime
+        if (!setUnspentTxsToCheck.count(hash)) setUnspentTxs.erase(hash);
+    }
+    std::vector<const CWalletTx*> vTxs;
+    vTxs.reserve(setUnspentTxs.size());
+    for (auto it = setUnspentTxs.begin(); it != setUnspentTxs.end();) {
+        const auto mit = mapWallet.find(*it);
+        if (mit == mapWallet.end()) {
+            // Erased from the wallet
+            it = setUnspentTxs.erase(it);
+            continue;
+        }
+        vTxs.emplace_back(&mit->second);
+        ++it;
+    }
+    return vTxs;
+}
+
 CAmount CWallet::loopTxsBalance(const std::function<void(const uint256&, const CWalletTx&, CAmount&)>& method) const
 {
     CAmount nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (const auto& it : mapWallet) {
-            method(it.first, it.second, nTotal);
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
+            method(pcoin->GetHash(), *pcoin, nTotal);
         }
     }
     return nTotal;
@@ -2339,9 +2520,8 @@ void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
     vCoins.clear();
     {
         LOCK(cs_wallet);
-        for (const auto& it : mapWallet) {
-            const uint256& wtxid = it.first;
-            const CWalletTx* pcoin = &it.second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
+            const uint256& wtxid = pcoin->GetHash();
 
             bool fConflicted;
             int nDepth = pcoin->GetDepthAndMempool(fConflicted);
@@ -2548,9 +2728,8 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
     {
         LOCK(cs_wallet);
         CAmount nTotal = 0;
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
+            const uint256& wtxid = pcoin->GetHash();
 
             // Check if the tx is selectable
             int nDepth = 0;
@@ -2697,9 +2876,8 @@ bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
     if (pCoins) pCoins->clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& it : mapWallet) {
-        const uint256& wtxid = it.first;
-        const CWalletTx* pcoin = &(it).second;
+    for (const CWalletTx* pcoin : GetUnspentTxs()) {
+        const uint256& wtxid = pcoin->GetHash();
 
         // Check if the tx is selectable
         int nDepth = 0;
@@ -3267,47 +3445,64 @@ bool CWallet::CreateCoinStake(
     pStakerStatus->SetLastTip(pindexPrev);
     pStakerStatus->SetLastCoins((int) availableCoins->size());
 
+    // Kernel search snapshot (stake modifier, kernel prefix and target of each coin computed once).
+    // Keyed on the outpoints of the coins: a coin spent and another one received between two
+    // time slots leave the count unchanged, but must rebuild it.
+    CHashWriter ssCoins(SER_GETHASH, 0);
+    for (const CStakeableOutput& coin : *availableCoins) {
+        ssCoins << COutPoint(coin.tx->GetHash(), coin.i);
+    }
+    const uint256& hashCoins = ssCoins.GetHash();
+    LOCK(cs_kernel_search);
+    if (!m_kernel_search || m_kernel_search->GetTip() != pindexPrev || m_kernel_search->GetBits() != nBits ||
+            m_kernel_search->GetCoinsHash() != hashCoins) {
+        m_kernel_search = MakeUnique<CStakeKernelSearch>(pindexPrev, nBits, hashCoins);
+        for (const CStakeableOutput& coin : *availableCoins) {
+            m_kernel_search->AddStakeInput(MakeUnique<CPivStake>(coin.tx->tx->vout[coin.i],
+                                                                 COutPoint(coin.tx->GetHash(), coin.i),
+                                                                 coin.pindex));
+        }
+    }
+
+    // Get the new time slot (and verify it's not the same as previous block)
+    const bool fRegTest = Params().IsRegTestNet();
+    nTxNewTime = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
+    pStakerStatus->SetLastTime(nTxNewTime);
+    if (nTxNewTime <= pindexPrev->nTime && !fRegTest) return false;
+    const int nHeightTx = pindexPrev->nHeight + 1;
+
     // Kernel Search
     CAmount nCredit;
-    CScript scriptPubKeyKernel;
     bool fKernelFound = false;
     int nAttempts = 0;
-    for (auto it = availableCoins->begin(); it != availableCoins->end();) {
-        COutPoint outPoint = COutPoint(it->tx->GetHash(), it->i);
-        CPivStake stakeInput(it->tx->tx->vout[it->i],
-                             outPoint,
-                             it->pindex);
-
+    size_t nStart = 0;
+    while (nStart < m_kernel_search->Size()) {
         // New block came in, move on
         if (WITH_LOCK(cs_wallet, return m_last_block_processed_height) != pindexPrev->nHeight) return false;
 
         // Make sure the wallet is unlocked and shutdown hasn't been requested
         if (IsLocked() || ShutdownRequested()) return false;
 
-        // Make sure the stake input hasn't been spent since last check
-        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
-            // remove it from the available coins
-            it = availableCoins->erase(it);
-            continue;
-        }
+        const int nIndex = m_kernel_search->FindKernel((int) nTxNewTime, nStart);
+        nAttempts += (int) ((nIndex < 0 ? m_kernel_search->Size() : nIndex + 1) - nStart);
 
-        nCredit = 0;
+        // update staker status (attempts)
+        pStakerStatus->SetLastTries(nAttempts);
 
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+        if (nIndex < 0) break;
+        nStart = nIndex + 1;
+        CPivStake& stakeInput = *static_cast<CPivStake*>(m_kernel_search->GetStakeInput(nIndex));
+        const COutPoint& outPoint = stakeInput.GetTxIn().prevout;
 
-        // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
+        // Double check stake input contextual checks
+        if (!stakeInput.ContextCheck(nHeightTx, nTxNewTime)) continue;
 
-        if (!fKernelFound) {
-            it++;
-            continue;
-        }
+        // Make sure the stake input hasn't been spent since last check
+        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) continue;
 
         // Found a kernel
         LogPrintf("CreateCoinStake : kernel found\n");
-        nCredit += stakeInput.GetValue();
+        nCredit = stakeInput.GetValue();
 
         // Add block reward to the credit
         nCredit += GetBlockValue(pindexPrev->nHeight + 1);
@@ -3316,7 +3511,6 @@ bool CWallet::CreateCoinStake(
         std::vector<CTxOut> vout;
         if (!stakeInput.CreateTxOuts(this, vout, nCredit)) {
             LogPrintf("%s : failed to create output\n", __func__);
-            it++;
             continue;
         }
         txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
@@ -3344,6 +3538,7 @@ bool CWallet::CreateCoinStake(
         if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
             return error("%s : exceeded coinstake size limit", __func__);
 
+        fKernelFound = true;
         break;
     }
     LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
@@ -4676,6 +4871,7 @@ void CWalletTx::MarkDirty()
     nShieldedChangeCached = 0;
     fShieldedChangeCached = false;
     fStakeDelegationVoided = false;
+    if (pwallet && tx) pwallet->MarkUnspentTx(GetHash());
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
@@ -265,6 +265,7 @@ private:
 template <class T>
 using TxSpendMap = std::multimap<T, uint256>;
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
+typedef std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesAndIVKs;
 
 typedef std::map<std::string, std::string> mapValue_t;
 
@@ -564,6 +565,7 @@ public:
 
 
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
+class CWalletKeySnapshot;
 
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
@@ -576,6 +578,10 @@ private:
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet; //controlled by WalletRescanReserver
     std::mutex mutexScanning;
+    //! Progress of the running rescan (set by ScanForWalletTransactions)
+    std::atomic<int64_t> m_scanning_start{0};
+    std::atomic<double> m_scanning_progress{0};
+    std::atomic<int> m_scanning_blocks{0};
     friend class WalletRescanReserver;
 
 
@@ -622,6 +628,25 @@ private:
     int m_last_block_processed_height GUARDED_BY(cs_wallet) = -1;
     int64_t m_last_block_processed_time GUARDED_BY(cs_wallet) = 0;
 
+    /* Kernel search snapshot of the stakeable coins (rebuilt on new tip, target or coins) */
+    mutable Mutex cs_kernel_search;
+    mutable std::unique_ptr<CStakeKernelSearch> m_kernel_search GUARDED_BY(cs_kernel_search);
+
+    /**
+     * Wallet txs that can still have unspent outputs, swept by the balance and coin
+     * availability calls instead of the whole mapWallet. A tx is (re)added, and queued to
+     * be checked, every time its cached amounts are reset (CWalletTx::MarkDirty), which
+     * happens when it, or a tx spending it, changes state. It is pruned lazily, once all
+     * its outputs are spent by txs in the chain (see IsSpentInChain).
+     * A new key or script (keypool top-up, HD derivation, import) can make the outputs of
+     * any tx ours: all the wallet txs are then checked again (fCheckAllUnspentTxs).
+     */
+    mutable Mutex cs_unspent_txs;
+    mutable std::set<uint256> setUnspentTxs GUARDED_BY(cs_unspent_txs);
+    mutable std::set<uint256> setUnspentTxsToCheck GUARDED_BY(cs_unspent_txs);
+    mutable bool fCheckAllUnspentTxs GUARDED_BY(cs_unspent_txs){false};
+    bool IsSpentInChain(const CWalletTx& wtx) const;
+
     int64_t nNextResend;
     int64_t nLastResend;
 
@@ -643,7 +668,7 @@ private:
     void ChainTipAdded(const CBlockIndex *pindex, const CBlock *pblock, SaplingMerkleTree saplingTree);
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected */
-    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm);
+    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, const SaplingNotesAndIVKs* pSaplingNotes = nullptr);
 
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
@@ -855,6 +880,10 @@ public:
     void AbortRescan() { fAbortRescan = true; }
     bool IsAbortingRescan() { return fAbortRescan; }
     bool IsScanning() { return fScanningWallet; }
+    //! Time spent (ms), progress (from 0 to 1) and number of blocks scanned, of the running rescan
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - m_scanning_start : 0; }
+    double ScanningProgress() const { return fScanningWallet ? (double) m_scanning_progress : 0; }
+    int ScanningBlocks() const { return fScanningWallet ? (int) m_scanning_blocks : 0; }
 
     /*
      * Stake Split threshold
@@ -898,7 +927,9 @@ public:
     //////////// Sapling //////////////////
 
     // Search for notes and addresses from this wallet in the tx, and add the addresses --> IVK mapping to the keystore if missing.
-    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData);
+    // If pSaplingNotes is provided, use it instead of trial-decrypting the tx outputs again (e.g. batched for the whole block).
+    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData,
+                                                 const SaplingNotesAndIVKs* pSaplingNotes = nullptr);
     // Decrypt sapling output notes with the inputs ovk and updates saplingNoteDataMap
     void AddExternalNotesDataToTx(CWalletTx& wtx) const;
 
@@ -998,7 +1029,8 @@ public:
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
-    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate,
+                                  const SaplingNotesAndIVKs* pSaplingNotes = nullptr);
     void EraseFromWallet(const uint256& hash);
 
     /**
@@ -1008,6 +1040,15 @@ public:
     bool ActivateSaplingWallet(bool memOnly = false);
 
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
+    /**
+     * Number of keys, redeem scripts and watch-only scripts. Changes when a key is added
+     * (e.g. by the keypool top up), invalidating the key snapshots taken before.
+     */
+    size_t GetKeySetSize() const;
+    /** Copy of the keys ids, redeem scripts and watch-only scripts, to match outputs without the wallet lock */
+    std::shared_ptr<const CWalletKeySnapshot> GetKeySnapshot() const;
+    /** Whether tx, not paying to the wallet, can still involve it (see AddToWalletIfInvolvingMe) */
+    bool MayInvolveWallet(const CTransaction& tx) const;
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate = false, bool fromStartup = false);
     void TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason) override;
     void ReacceptWalletTransactions(bool fFirstLoad = false);
@@ -1023,6 +1064,12 @@ public:
     };
     Balance GetBalance(int min_depth = 0) const;
 
+    /** Marks a wallet tx as possibly having unspent outputs (see setUnspentTxs) */
+    void MarkUnspentTx(const uint256& hash) const;
+    /** Marks all the wallet txs as possibly having unspent outputs, after a new key or script */
+    void MarkAllUnspentTxs() const;
+    /** The wallet txs that can have unspent outputs, in txid order */
+    std::vector<const CWalletTx*> GetUnspentTxs() const;
     CAmount loopTxsBalance(const std::function<void(const uint256&, const CWalletTx&, CAmount&)>&method) const;
     CAmount GetAvailableBalance(bool fIncludeDelegated = true, bool fIncludeShielded = true) const;
     CAmount GetAvailableBalance(isminefilter& filter, bool useCache = false, int minDepth = 1) const;
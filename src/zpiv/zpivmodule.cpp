@@ -7,9 +7,26 @@
 #include "hash.h"
 #include "libzerocoin/Commitment.h"
 #include "libzerocoin/Coin.h"
+#include "sync.h"
+#include "txdb.h"
 #include "validation.h"
 #include "zpivchain.h"
 
+// Maximum number of mint outputs kept by GetSpentMintOutput
+static const size_t MAX_SPENT_MINT_OUTPUTS_CACHE = 10000;
+
+static Mutex cs_spentMintOutputs;
+static std::map<COutPoint, CTxOut> mapSpentMintOutputs GUARDED_BY(cs_spentMintOutputs);
+
+static void CacheSpentMintOutput(const COutPoint& prevout, const CTxOut& out)
+{
+    LOCK(cs_spentMintOutputs);
+    if (mapSpentMintOutputs.size() >= MAX_SPENT_MINT_OUTPUTS_CACHE) {
+        mapSpentMintOutputs.clear();
+    }
+    mapSpentMintOutputs.emplace(prevout, out);
+}
+
 template <typename Stream>
 PublicCoinSpend::PublicCoinSpend(libzerocoin::ZerocoinParams* params, Stream& strm): pubCoin(params) {
     strm >> *this;
@@ -145,10 +162,51 @@ namespace ZPIVModule {
         return publicSpend.Verify();
     }
 
+    bool GetSpentMintOutput(const COutPoint& prevout, CValidationState& state, CTxOut& out)
+    {
+        {
+            LOCK(cs_spentMintOutputs);
+            auto it = mapSpentMintOutputs.find(prevout);
+            if (it != mapSpentMintOutputs.end()) {
+                out = it->second;
+                return true;
+            }
+        }
+        // The mints are stored when their block is connected, so that the spends don't
+        // depend on the (asynchronous) tx index. Outputs never change: cache them as long as there is room.
+        if (!zerocoinDB->ReadMintOutput(prevout, out)) {
+            return state.DoS(100, error("%s: mint output %s not found", __func__, prevout.ToString()));
+        }
+        CacheSpentMintOutput(prevout, out);
+        return true;
+    }
+
+    void PrefetchSpentMintOutputs(const std::vector<CTransactionRef>& vtx)
+    {
+        // Sorted, so that the db is read in key order
+        std::set<COutPoint> setPrevouts;
+        {
+            LOCK(cs_spentMintOutputs);
+            for (const CTransactionRef& tx : vtx) {
+                for (const CTxIn& in : tx->vin) {
+                    if (in.IsZerocoinPublicSpend() && !mapSpentMintOutputs.count(in.prevout)) {
+                        setPrevouts.insert(in.prevout);
+                    }
+                }
+            }
+        }
+        for (const COutPoint& prevout : setPrevouts) {
+            CTxOut out;
+            if (zerocoinDB->ReadMintOutput(prevout, out)) {
+                CacheSpentMintOutput(prevout, out);
+            } // else reported by the checks
+        }
+    }
+
     bool ParseZerocoinPublicSpend(const CTxIn &txIn, const CTransaction& tx, CValidationState& state, PublicCoinSpend& publicSpend)
     {
         CTxOut prevOut;
-        if(!GetOutput(txIn.prevout.hash, txIn.prevout.n ,state, prevOut)){
+        if(!GetSpentMintOutput(txIn.prevout, state, prevOut)){
             return state.DoS(100, error("%s: public zerocoin spend prev output not found, prevTx %s, index %d",
                                         __func__, txIn.prevout.hash.GetHex(), txIn.prevout.n));
         }
@@ -77,6 +77,16 @@ namespace ZPIVModule {
      * @return true if everything went ok
      */
     bool ParseZerocoinPublicSpend(const CTxIn &in, const CTransaction& tx, CValidationState& state, PublicCoinSpend& publicCoinSpend);
+
+    /**
+     * Mint output spent by a public zc spend input, read from the mints stored in the
+     * zerocoinDB by the block connection. The outputs are kept in a bounded in-memory
+     * cache, as the spends of a block are parsed several times
+     * (contextual checks, double-spend checks, connection).
+     */
+    bool GetSpentMintOutput(const COutPoint& prevout, CValidationState& state, CTxOut& out);
+    // Fetch in one pass (in key order) the outputs spent by the public zc spends of vtx
+    void PrefetchSpentMintOutputs(const std::vector<CTransactionRef>& vtx);
 };
 
 
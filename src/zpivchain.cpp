@@ -5,8 +5,11 @@
 #include "zpivchain.h"
 
 #include "guiinterface.h"
+#include "init.h"
 #include "invalid.h"
+#include "sync.h"
 #include "txdb.h"
+#include "validation.h"
 #include "wallet/wallet.h"
 #include "zpiv/zpivmodule.h"
 
@@ -20,7 +23,24 @@ bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx)
     if (!zerocoinDB->ReadCoinSpend(bnSerial, txHash))
         return false;
 
-    return IsTransactionInChain(txHash, nHeightTx);
+    // the block of the spend is stored with the serial, don't wait for the tx index
+    uint256 hashBlock;
+    if (!zerocoinDB->ReadSpendTxBlock(txHash, hashBlock)) {
+        if (IsTransactionInChain(txHash, nHeightTx))
+            return true;
+        // the spend can't be located while the tx index is building: the serial, erased when
+        // its block is disconnected, is still recorded as spent, so don't accept it again
+        if (IsTxIndexSyncing()) {
+            nHeightTx = 0;
+            return true;
+        }
+        return false;
+    }
+
+    if (!IsBlockHashInChain(hashBlock))
+        return false;
+    nHeightTx = mapBlockIndex.at(hashBlock)->nHeight;
+    return true;
 }
 
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin)
@@ -48,4 +68,168 @@ bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CV
     return true;
 }
 
+CZerocoinSpendRecord::CZerocoinSpendRecord(const libzerocoin::CoinSpend& spend, uint8_t nPublicSpendVersionIn) :
+    bnSerial(spend.getCoinSerialNumber()),
+    nDenom(spend.getDenomination()),
+    nCoinVersion(spend.getCoinVersion()),
+    nPublicSpendVersion(nPublicSpendVersionIn),
+    nSpendType(spend.getSpendType())
+{
+    try {
+        nSignature = spend.HasValidSignature() ? SIG_VALID : SIG_INVALID;
+    } catch (const libzerocoin::InvalidSerialException& e) {
+        nSignature = SIG_INVALID_SERIAL;
+    }
+    const bool fUseV1Params = nCoinVersion < libzerocoin::PUBKEY_VERSION;
+    fValidSerial = spend.HasValidSerial(Params().GetConsensus().Zerocoin_Params(fUseV1Params));
+}
+
+// Maximum number of records of the spends parsed by the block validation, waiting for the block connection
+static const size_t MAX_PENDING_SPEND_RECORDS = 10000;
+
+static Mutex cs_pendingSpendRecords;
+static std::map<COutPoint, CZerocoinSpendRecord> mapPendingSpendRecords GUARDED_BY(cs_pendingSpendRecords);
+
+bool ReadZerocoinSpendRecord(const COutPoint& spendIn, CZerocoinSpendRecord& record)
+{
+    return zerocoinSpendDB && zerocoinSpendDB->ReadSpendRecord(spendIn, record);
+}
+
+void CacheZerocoinSpendRecord(const COutPoint& spendIn, const CZerocoinSpendRecord& record)
+{
+    LOCK(cs_pendingSpendRecords);
+    if (mapPendingSpendRecords.size() >= MAX_PENDING_SPEND_RECORDS) {
+        mapPendingSpendRecords.clear();
+    }
+    mapPendingSpendRecords.emplace(spendIn, record);
+}
+
+bool GetZerocoinSpendRecord(const CTransaction& tx, unsigned int nIn, CZerocoinSpendRecord& record, CValidationState& state)
+{
+    const COutPoint spendIn(tx.GetHash(), nIn);
+    if (ReadZerocoinSpendRecord(spendIn, record)) {
+        return true;
+    }
+    {
+        LOCK(cs_pendingSpendRecords);
+        auto it = mapPendingSpendRecords.find(spendIn);
+        if (it != mapPendingSpendRecords.end()) {
+            record = it->second;
+            return true;
+        }
+    }
+
+    const CTxIn& txin = tx.vin[nIn];
+    if (txin.IsZerocoinPublicSpend()) {
+        PublicCoinSpend publicSpend(Params().GetConsensus().Zerocoin_Params(false));
+        if (!ZPIVModule::ParseZerocoinPublicSpend(txin, tx, state, publicSpend)) {
+            return false;
+        }
+        record = CZerocoinSpendRecord(publicSpend, publicSpend.getCoinVersion());
+    } else {
+        record = CZerocoinSpendRecord(TxInToZerocoinSpend(txin));
+    }
+    CacheZerocoinSpendRecord(spendIn, record);
+    return true;
+}
+
+bool WriteZerocoinSpendRecords(const CBlock& block)
+{
+    if (!zerocoinSpendDB) return true;
+
+    std::vector<std::pair<COutPoint, CZerocoinSpendRecord>> vRecords;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->HasZerocoinSpendInputs()) continue;
+        for (unsigned int i = 0; i < tx->vin.size(); i++) {
+            const CTxIn& txin = tx->vin[i];
+            if (!txin.IsZerocoinSpend() && !txin.IsZerocoinPublicSpend()) continue;
+            const COutPoint spendIn(tx->GetHash(), i);
+            CZerocoinSpendRecord record;
+            if (zerocoinSpendDB->ReadSpendRecord(spendIn, record)) continue;
+            CValidationState state;
+            if (!GetZerocoinSpendRecord(*tx, i, record, state)) {
+                return error("%s: cannot parse zerocoin spend %s", __func__, spendIn.ToString());
+            }
+            vRecords.emplace_back(spendIn, record);
+        }
+    }
+    if (vRecords.empty()) return true;
+
+    {
+        LOCK(cs_pendingSpendRecords);
+        for (const auto& it : vRecords) mapPendingSpendRecords.erase(it.first);
+    }
+    return zerocoinSpendDB->WriteSpendRecords(vRecords);
+}
+
+static bool WriteMints(std::vector<std::pair<COutPoint, CTxOut>>& vMints)
+{
+    if (vMints.empty()) return true;
+    bool ret = zerocoinDB->WriteMintOutputBatch(vMints);
+    vMints.clear();
+    return ret;
+}
+
+bool UpgradeZerocoinDB()
+{
+    bool fUpgraded = false;
+    if (zerocoinDB->ReadFlag("mintoutputs", fUpgraded) && fUpgraded)
+        return true;
+
+    // Only a tip in the zerocoin era can still connect blocks spending the mints
+    const Consensus::Params& consensus = Params().GetConsensus();
+    int nStartHeight = consensus.vUpgrades[Consensus::UPGRADE_ZC].nActivationHeight;
+    int nTipHeight;
+    {
+        LOCK(cs_main);
+        nTipHeight = chainActive.Height();
+        if (nTipHeight < nStartHeight || consensus.NetworkUpgradeActive(nTipHeight + 1, Consensus::UPGRADE_V5_0)) {
+            nTipHeight = -1;
+        }
+    }
 
+    if (nTipHeight >= 0) {
+        LogPrintf("%s: storing the zerocoin mints and spends of blocks %d-%d\n", __func__, nStartHeight, nTipHeight);
+        uiInterface.InitMessage(_("Upgrading zerocoin database..."));
+    }
+    std::vector<std::pair<COutPoint, CTxOut>> vMints;
+    for (int nHeight = nStartHeight; nHeight <= nTipHeight; nHeight++) {
+        if (ShutdownRequested()) return false;
+        if (nHeight % 10000 == 0) LogPrintf("%s: block %d\n", __func__, nHeight);
+
+        const CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive[nHeight]);
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            return error("%s: cannot read block %d", __func__, nHeight);
+        }
+        std::vector<std::pair<CBigNum, uint256>> vSpends;
+        for (const CTransactionRef& tx : block.vtx) {
+            if (tx->HasZerocoinSpendInputs()) {
+                // the spends may be parsed again, their mints must be readable
+                if (!WriteMints(vMints)) return error("%s: cannot write the zerocoin mints", __func__);
+                for (unsigned int i = 0; i < tx->vin.size(); i++) {
+                    if (!tx->vin[i].IsZerocoinSpend() && !tx->vin[i].IsZerocoinPublicSpend()) continue;
+                    CZerocoinSpendRecord record;
+                    CValidationState state;
+                    if (!GetZerocoinSpendRecord(*tx, i, record, state)) {
+                        return error("%s: cannot parse zerocoin spend %s-%d", __func__, tx->GetHash().GetHex(), i);
+                    }
+                    vSpends.emplace_back(record.bnSerial, tx->GetHash());
+                }
+            }
+            for (unsigned int i = 0; i < tx->vout.size(); i++) {
+                if (tx->vout[i].IsZerocoinMint()) vMints.emplace_back(COutPoint(tx->GetHash(), i), tx->vout[i]);
+            }
+        }
+        if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends, block.GetHash())) {
+            return error("%s: cannot write the zerocoin spends", __func__);
+        }
+        if (vMints.size() >= 10000 && !WriteMints(vMints)) {
+            return error("%s: cannot write the zerocoin mints", __func__);
+        }
+    }
+    if (!WriteMints(vMints)) {
+        return error("%s: cannot write the zerocoin mints", __func__);
+    }
+    return zerocoinDB->WriteFlag("mintoutputs", true);
+}
@@ -15,6 +15,7 @@
 class CBlock;
 class CBlockIndex;
 class CBigNum;
+class COutPoint;
 class CTransaction;
 class CTxIn;
 class CTxOut;
@@ -25,4 +26,47 @@ bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx);
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 
+/**
+ * What the validation needs of a parsed zerocoin spend input: the serial, the
+ * denomination and the outcome of the context-free checks of the spend.
+ * It only depends on the spending tx (a txid commits to the spend and to the
+ * spent mint), so it is stored once, when the block is connected, and reused
+ * (by reindex, -checkblocks, disconnections) instead of parsing the spend again.
+ */
+class CZerocoinSpendRecord
+{
+public:
+    enum SignatureCheck : int8_t {
+        SIG_INVALID_SERIAL = -1,    // HasValidSignature threw InvalidSerialException
+        SIG_INVALID = 0,
+        SIG_VALID = 1,
+    };
+
+    CBigNum bnSerial;
+    int32_t nDenom{libzerocoin::ZQ_ERROR};
+    uint8_t nCoinVersion{0};
+    uint8_t nPublicSpendVersion{0};    // 0 for private spends
+    uint8_t nSpendType{libzerocoin::SPEND};
+    int8_t nSignature{SIG_INVALID};
+    bool fValidSerial{false};
+
+    CZerocoinSpendRecord() {}
+    explicit CZerocoinSpendRecord(const libzerocoin::CoinSpend& spend, uint8_t nPublicSpendVersionIn = 0);
+
+    libzerocoin::CoinDenomination GetDenomination() const { return libzerocoin::IntToZerocoinDenomination(nDenom); }
+
+    SERIALIZE_METHODS(CZerocoinSpendRecord, obj) { READWRITE(obj.bnSerial, obj.nDenom, obj.nCoinVersion, obj.nPublicSpendVersion, obj.nSpendType, obj.nSignature, obj.fValidSerial); }
+};
+
+/** Stored record of the zc spend input (txid, input index), if its block was connected (all the spend checks passed) */
+bool ReadZerocoinSpendRecord(const COutPoint& spendIn, CZerocoinSpendRecord& record);
+/** Keep the record of a spend parsed by the block validation, to be stored when the block is connected */
+void CacheZerocoinSpendRecord(const COutPoint& spendIn, const CZerocoinSpendRecord& record);
+/** Record of the zc spend input nIn of tx: stored, cached, or parsed from the tx */
+bool GetZerocoinSpendRecord(const CTransaction& tx, unsigned int nIn, CZerocoinSpendRecord& record, CValidationState& state);
+/** Store the records of the zc spends of a connected block */
+bool WriteZerocoinSpendRecords(const CBlock& block);
+/** Store the zerocoin mints, and the blocks of the zc spends, of a chain connected before they were kept in the zerocoinDB */
+bool UpgradeZerocoinDB();
+
 #endif //PIVX_ZPIVCHAIN_H
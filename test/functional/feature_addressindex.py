@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+"""Test the address index (-addressindex).
+
+1) getaddressbalance, getaddressutxos, getaddresstxids (with a height range)
+   and getspentinfo after funding and spending an address.
+2) The entries of a disconnected block are removed, and added back when the
+   block is connected again.
+3) The same queries through the REST interface.
+"""
+
+from decimal import Decimal
+import http.client
+import json
+import urllib.parse
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+COIN = 100000000
+
+
+class AddressIndexTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [[], ["-addressindex", "-rest"]]
+
+    def find_vout(self, node, txid, address):
+        tx = node.decoderawtransaction(node.gettransaction(txid)["hex"])
+        return [o["n"] for o in tx["vout"] if address in o["scriptPubKey"].get("addresses", [])][0]
+
+    def rest_get(self, path):
+        url = urllib.parse.urlparse(self.nodes[1].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request("GET", path)
+        resp = conn.getresponse()
+        assert_equal(resp.status, 200)
+        return json.loads(resp.read().decode("utf-8"))
+
+    def run_test(self):
+        index_node = self.nodes[1]
+        assert_raises_rpc_error(-1, "Address index not enabled", self.nodes[0].getaddressbalance, [self.nodes[0].getnewaddress()])
+
+        self.log.info("Fund an address")
+        address = index_node.getnewaddress()
+        txid1 = self.nodes[0].sendtoaddress(address, 10)
+        txid2 = self.nodes[0].sendtoaddress(address, 5)
+        self.nodes[0].generate(1)
+        height_funding = self.nodes[0].getblockcount()
+        self.sync_all()
+
+        assert_equal(index_node.getaddressbalance([address]), {"balance": 15 * COIN, "received": 15 * COIN})
+        utxos = index_node.getaddressutxos([address])
+        assert_equal(len(utxos), 2)
+        assert_equal(sorted(u["satoshis"] for u in utxos), [5 * COIN, 10 * COIN])
+        assert all(u["address"] == address and u["height"] == height_funding for u in utxos)
+        assert_equal(sorted(index_node.getaddresstxids([address])), sorted([txid1, txid2]))
+
+        self.log.info("Spend from the address")
+        dest = self.nodes[0].getnewaddress()
+        inputs = [{"txid": u["txid"], "vout": u["outputIndex"]} for u in utxos]
+        rawtx = index_node.createrawtransaction(inputs, {dest: Decimal("14.99")})
+        spend_txid = index_node.sendrawtransaction(index_node.signrawtransaction(rawtx)["hex"])
+        self.sync_mempools()
+        spend_block = self.nodes[0].generate(1)[0]
+        height_spend = self.nodes[0].getblockcount()
+        self.sync_all()
+
+        assert_equal(index_node.getaddressbalance([address]), {"balance": 0, "received": 15 * COIN})
+        assert_equal(index_node.getaddressutxos([address]), [])
+        txids = index_node.getaddresstxids([address])
+        assert_equal(len(txids), 3)
+        assert_equal(txids[-1], spend_txid)
+        # Height range pagination
+        assert_equal(index_node.getaddresstxids([address], height_spend, height_spend), [spend_txid])
+        assert_equal(sorted(index_node.getaddresstxids([address], 0, height_funding)), sorted([txid1, txid2]))
+        # Both addresses together
+        assert_equal(index_node.getaddressbalance([address, dest])["balance"], Decimal("14.99") * COIN)
+
+        vout1 = self.find_vout(self.nodes[0], txid1, address)
+        spent = index_node.getspentinfo(txid1, vout1)
+        assert_equal(spent["txid"], spend_txid)
+        assert_equal(spent["height"], height_spend)
+
+        self.log.info("Disconnect the spending block")
+        index_node.invalidateblock(spend_block)
+        assert_equal(index_node.getaddressbalance([address]), {"balance": 15 * COIN, "received": 15 * COIN})
+        assert_equal(len(index_node.getaddressutxos([address])), 2)
+        assert_equal(sorted(index_node.getaddresstxids([address])), sorted([txid1, txid2]))
+        assert_raises_rpc_error(-5, "Unable to get spent info", index_node.getspentinfo, txid1, vout1)
+
+        self.log.info("Connect it again")
+        index_node.reconsiderblock(spend_block)
+        assert_equal(index_node.getbestblockhash(), spend_block)
+        assert_equal(index_node.getaddressbalance([address]), {"balance": 0, "received": 15 * COIN})
+        assert_equal(index_node.getspentinfo(txid1, vout1)["txid"], spend_txid)
+
+        self.log.info("Query the index through REST")
+        assert_equal(self.rest_get("/rest/addressbalance/%s.json" % address), {"balance": 0, "received": 15 * COIN})
+        assert_equal(self.rest_get("/rest/addressutxos/%s,%s.json" % (address, dest))[0]["address"], dest)
+        assert_equal(self.rest_get("/rest/addresstxids/%s/%d/%d.json" % (address, height_spend, height_spend)), [spend_txid])
+
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020-2021 The Bitcoin Core developers
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+"""Test the coinstats index (-coinstatsindex).
+
+1) gettxoutsetinfo answered by the index matches the walk of the UTXO set
+   (muhash, txouts, bogosize, total_amount), at the tip and at past blocks
+   queried by height or hash.
+2) The block_info amounts of a block spending outputs.
+3) The index follows a disconnected and reconnected block.
+4) Parameter errors.
+"""
+
+from decimal import Decimal
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+class CoinStatsIndexTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [[], ["-coinstatsindex"]]
+
+    def sync_index_node(self):
+        self.sync_all()
+        index_node = self.nodes[1]
+        tip_height = index_node.getblockcount()
+        wait_until(lambda: index_node.gettxoutsetinfo("muhash")["height"] == tip_height and
+                           "block_info" in index_node.gettxoutsetinfo("muhash"))
+
+    def check_index_matches_walk(self):
+        index_res = self.nodes[1].gettxoutsetinfo("muhash")
+        walk_res = self.nodes[0].gettxoutsetinfo("muhash")
+        assert "block_info" in index_res
+        assert "transactions" not in index_res
+        assert "disk_size" not in index_res
+        assert_equal(index_res["height"], walk_res["height"])
+        assert_equal(index_res["bestblock"], walk_res["bestblock"])
+        for field in ["muhash", "txouts", "bogosize", "total_amount"]:
+            assert_equal(index_res[field], walk_res[field])
+        # The index node walks its own UTXO set when told not to use the index
+        no_index_res = self.nodes[1].gettxoutsetinfo("muhash", None, False)
+        assert "block_info" not in no_index_res
+        assert_equal(no_index_res["muhash"], index_res["muhash"])
+        return index_res
+
+    def run_test(self):
+        node = self.nodes[0]
+        index_node = self.nodes[1]
+
+        self.log.info("Test the index after the initial sync")
+        self.sync_index_node()
+        res_200 = self.check_index_matches_walk()
+        assert_equal(res_200["height"], 200)
+        assert_equal(res_200["total_amount"], Decimal("50000.00000000"))
+        # The default hash type keeps walking the UTXO set
+        res_default = index_node.gettxoutsetinfo()
+        assert_equal(res_default["transactions"], 200)
+        assert_equal(len(res_default["hash_serialized_2"]), 64)
+        assert "block_info" not in res_default
+        # The genesis block outputs are unspendable
+        res_genesis = index_node.gettxoutsetinfo("none", 0)
+        assert_equal(res_genesis["txouts"], 0)
+        assert_equal(res_genesis["total_unspendable_amount"], res_genesis["block_info"]["unspendable"])
+
+        self.log.info("Test block_info of a block spending outputs")
+        node.generate(1)
+        self.sync_index_node()
+        empty_block_info = index_node.gettxoutsetinfo("none")["block_info"]
+        assert_equal(empty_block_info["prevout_spent"], 0)
+        assert_equal(empty_block_info["minted"], empty_block_info["new_outputs"])
+        node.sendtoaddress(index_node.getnewaddress(), 10)
+        node.generate(1)
+        self.sync_index_node()
+        res = self.check_index_matches_walk()
+        block_info = res["block_info"]
+        assert block_info["prevout_spent"] > 0
+        assert_equal(block_info["minted"], empty_block_info["minted"])
+        assert_equal(block_info["minted"],
+                     block_info["new_outputs"] + block_info["unspendable"] + block_info["shielded"] - block_info["prevout_spent"])
+
+        self.log.info("Test querying past blocks by height and hash")
+        node.generate(5)
+        self.sync_index_node()
+        self.check_index_matches_walk()
+        res_height = index_node.gettxoutsetinfo("muhash", res["height"])
+        res_hash = index_node.gettxoutsetinfo("muhash", res["bestblock"])
+        assert_equal(res_height, res)
+        assert_equal(res_hash, res)
+        res_200_height = index_node.gettxoutsetinfo("muhash", 200)
+        for field in ["muhash", "txouts", "bogosize", "total_amount"]:
+            assert_equal(res_200_height[field], res_200[field])
+
+        self.log.info("Test the index follows a disconnected block")
+        tip = index_node.getbestblockhash()
+        res_tip = index_node.gettxoutsetinfo("muhash")
+        index_node.invalidateblock(tip)
+        wait_until(lambda: index_node.gettxoutsetinfo("muhash")["bestblock"] == index_node.getbestblockhash())
+        assert_equal(index_node.gettxoutsetinfo("muhash")["muhash"], index_node.gettxoutsetinfo("muhash", None, False)["muhash"])
+        # The disconnected block is still found by its hash
+        assert_equal(index_node.gettxoutsetinfo("muhash", tip), res_tip)
+        index_node.reconsiderblock(tip)
+        wait_until(lambda: index_node.gettxoutsetinfo("muhash")["bestblock"] == tip)
+        assert_equal(index_node.gettxoutsetinfo("muhash"), res_tip)
+
+        self.log.info("Test the parameter errors")
+        assert_raises_rpc_error(-8, "foo is not a valid hash_type", index_node.gettxoutsetinfo, "foo")
+        assert_raises_rpc_error(-8, "Querying specific block heights requires coinstatsindex", node.gettxoutsetinfo, "muhash", 100)
+        assert_raises_rpc_error(-8, "Querying specific block heights requires coinstatsindex", index_node.gettxoutsetinfo, "muhash", 100, False)
+        assert_raises_rpc_error(-8, "hash_serialized_2 hash type cannot be queried for a specific block", index_node.gettxoutsetinfo, "hash_serialized_2", 100)
+        assert_raises_rpc_error(-8, "Target block height 1000 after current tip", index_node.gettxoutsetinfo, "muhash", 1000)
+        assert_raises_rpc_error(-8, "Target block height -1 is negative", index_node.gettxoutsetinfo, "muhash", -1)
+        assert_raises_rpc_error(-5, "Block not found", index_node.gettxoutsetinfo, "muhash", "00" * 32)
+
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test compact block relay (BIP152).
+
+1) The nodes negotiate compact blocks (sendcmpct) after the handshake.
+2) A new block is relayed between two nodes with a cmpctblock message, requested
+   with a getdata (low bandwidth mode) or pushed directly (high bandwidth mode),
+   and the bytes received are compared with the size of the full block.
+3) A cmpctblock with a transaction missing from the mempool is completed with a
+   getblocktxn/blocktxn round trip.
+4) getdata(MSG_CMPCT_BLOCK) and getblocktxn requests are answered.
+"""
+
+from test_framework.blocktools import create_block, create_coinbase, create_transaction
+from test_framework.messages import (
+    BlockTransactions,
+    BlockTransactionsRequest,
+    CInv,
+    COIN,
+    HeaderAndShortIDs,
+    MSG_CMPCT_BLOCK,
+    msg_blocktxn,
+    msg_cmpctblock,
+    msg_getblocktxn,
+    msg_getdata,
+    msg_sendcmpct,
+)
+from test_framework.mininode import mininode_lock, P2PDataStore
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import assert_equal, wait_until
+
+
+class CompactBlocksTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def peer_bytes(self, node, inbound):
+        """Bytes received per message from the other node"""
+        ret = {}
+        for peer in node.getpeerinfo():
+            if peer["inbound"] == inbound and "MiniNode" not in peer["subver"]:
+                for k, v in peer["bytesrecv_per_msg"].items():
+                    ret[k] = ret.get(k, 0) + v
+        return ret
+
+    def relay_block(self, miner, receiver, inbound):
+        """Fill the mempools, mine a block and check that it reaches the receiver as a cmpctblock"""
+        for _ in range(20):
+            self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1)
+        self.sync_mempools()
+        before = self.peer_bytes(receiver, inbound)
+        blockhash = miner.generate(1)[0]
+        self.sync_blocks()
+        after = self.peer_bytes(receiver, inbound)
+        delta = {k: after.get(k, 0) - before.get(k, 0) for k in after}
+
+        block_size = len(miner.getblock(blockhash, False)) // 2
+        cmpct_size = delta.get("cmpctblock", 0) + delta.get("blocktxn", 0)
+        self.log.info("Block of %d txes (%d bytes) relayed with %d bytes" %
+                      (len(miner.getblock(blockhash)["tx"]), block_size, cmpct_size))
+        assert_equal(delta.get("block", 0), 0)
+        assert cmpct_size > 0
+        assert cmpct_size * 5 < block_size
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.add_p2p_connection(P2PDataStore())
+        node.p2p.wait_for_verack()
+
+        self.log.info("Check that compact blocks are negotiated")
+        # The mininode is an inbound peer: no high bandwidth mode
+        node.p2p.wait_until(lambda: "sendcmpct" in node.p2p.last_message)
+        with mininode_lock:
+            assert_equal(node.p2p.last_message["sendcmpct"].version, 1)
+            assert_equal(node.p2p.last_message["sendcmpct"].announce, False)
+
+        # An anyone-can-spend coinbase, to build blocks with transactions unknown to the node
+        best_block = node.getblock(node.getbestblockhash())
+        block1 = create_block(int(best_block["hash"], 16), create_coinbase(1), best_block["time"] + 1)
+        block1.solve()
+        node.p2p.send_blocks_and_test([block1], node, success=True)
+        node.generate(110)
+        self.sync_blocks()
+
+        self.log.info("Relay a block in low bandwidth mode (inv, getdata cmpctblock)")
+        # node0 is an inbound peer of node1, which didn't ask it for high bandwidth mode
+        self.relay_block(self.nodes[0], self.nodes[1], True)
+
+        self.log.info("Relay a block in high bandwidth mode (cmpctblock pushed)")
+        # node0 connected to node1 and asked it to announce the blocks with cmpctblock messages
+        self.relay_block(self.nodes[1], self.nodes[0], False)
+
+        self.log.info("Complete a cmpctblock with getblocktxn/blocktxn")
+        best_block = node.getblock(node.getbestblockhash())
+        block = create_block(int(best_block["hash"], 16), create_coinbase(best_block["height"] + 1), best_block["time"] + 1)
+        tx = create_transaction(block1.vtx[0], 0, b"", block1.vtx[0].vout[0].nValue - COIN, CScript([OP_TRUE]))
+        block.vtx.append(tx)
+        block.hashMerkleRoot = block.calc_merkle_root()
+        block.solve()
+
+        comp_block = HeaderAndShortIDs()
+        comp_block.initialize_from_block(block, prefill_list=[0])
+        with mininode_lock:
+            node.p2p.last_message.pop("getblocktxn", None)
+        node.p2p.send_message(msg_cmpctblock(comp_block.to_p2p()))
+        node.p2p.wait_until(lambda: "getblocktxn" in node.p2p.last_message)
+        with mininode_lock:
+            req = node.p2p.last_message["getblocktxn"].block_txn_request
+            assert_equal(req.blockhash, block.sha256)
+            assert_equal(req.to_absolute(), [1])
+        msg = msg_blocktxn()
+        msg.block_transactions = BlockTransactions(block.sha256, [tx])
+        node.p2p.send_message(msg)
+        wait_until(lambda: node.getbestblockhash() == block.hash, timeout=30)
+        self.sync_blocks()
+
+        self.log.info("Serve getdata(cmpctblock) and getblocktxn")
+        for _ in range(5):
+            node.sendtoaddress(node.getnewaddress(), 1)
+        blockhash = node.generate(1)[0]
+        block_txids = node.getblock(blockhash)["tx"]
+        with mininode_lock:
+            node.p2p.last_message.pop("cmpctblock", None)
+        node.p2p.send_message(msg_getdata([CInv(MSG_CMPCT_BLOCK, int(blockhash, 16))]))
+        node.p2p.wait_until(lambda: "cmpctblock" in node.p2p.last_message)
+        with mininode_lock:
+            comp_block = HeaderAndShortIDs(node.p2p.last_message["cmpctblock"].header_and_shortids)
+            comp_block.header.calc_sha256()
+            assert_equal(comp_block.header.hash, blockhash)
+            # The coinbase is prefilled, the other transactions are short ids
+            assert_equal(len(comp_block.prefilled_txn), 1)
+            assert_equal(comp_block.prefilled_txn[0].index, 0)
+            assert_equal(len(comp_block.shortids), len(block_txids) - 1)
+
+        msg = msg_getblocktxn()
+        msg.block_txn_request = BlockTransactionsRequest(int(blockhash, 16), [])
+        msg.block_txn_request.from_absolute(list(range(1, len(block_txids))))
+        with mininode_lock:
+            node.p2p.last_message.pop("blocktxn", None)
+        node.p2p.send_message(msg)
+        node.p2p.wait_until(lambda: "blocktxn" in node.p2p.last_message)
+        with mininode_lock:
+            txs = node.p2p.last_message["blocktxn"].block_transactions.transactions
+            for tx in txs:
+                tx.calc_sha256()
+            assert_equal([tx.hash for tx in txs], block_txids[1:])
+
+        self.log.info("Ask for high bandwidth mode and get the new blocks pushed")
+        node.p2p.send_and_ping(msg_sendcmpct())
+        with mininode_lock:
+            node.p2p.last_message.pop("cmpctblock", None)
+        msg = msg_sendcmpct()
+        msg.announce = True
+        node.p2p.send_and_ping(msg)
+        blockhash = self.nodes[1].generate(1)[0]
+        self.sync_blocks()
+        node.p2p.wait_until(lambda: "cmpctblock" in node.p2p.last_message)
+        with mininode_lock:
+            header = node.p2p.last_message["cmpctblock"].header_and_shortids.header
+            header.calc_sha256()
+            assert_equal(header.hash, blockhash)
+
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
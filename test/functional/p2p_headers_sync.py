@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test headers-first block sync.
+
+1) A fresh node connected to three synced peers downloads the headers first,
+   then the blocks in parallel from more than one peer.
+2) A peer that sent "sendheaders" gets the new blocks announced with a headers
+   message instead of an inv.
+3) A getheaders request is answered with the headers after the locator.
+"""
+
+from test_framework.messages import CBlockHeader, msg_getheaders, msg_sendheaders
+from test_framework.mininode import mininode_lock, P2PInterface
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import assert_equal, connect_nodes, wait_until
+
+
+class HeadersSyncTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 4
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        self.setup_nodes()
+        # node3 stays disconnected until the chain is built
+        connect_nodes(self.nodes[0], 1)
+        connect_nodes(self.nodes[1], 2)
+        self.sync_all(self.nodes[:3])
+
+    def run_test(self):
+        self.log.info("Mine a chain on the first three nodes")
+        self.nodes[0].generate(200)
+        self.sync_blocks(self.nodes[:3])
+        assert_equal(self.nodes[3].getblockcount(), 0)
+
+        self.log.info("Sync a fresh node from three peers")
+        for i in range(3):
+            connect_nodes(self.nodes[3], i)
+        self.sync_blocks()
+        assert_equal(self.nodes[3].getbestblockhash(), self.nodes[0].getbestblockhash())
+        peers = self.nodes[3].getpeerinfo()
+        assert any(p["bytesrecv_per_msg"].get("headers", 0) > 0 for p in peers)
+        block_peers = [p for p in peers if p["bytesrecv_per_msg"].get("block", 0) > 0]
+        self.log.info("Blocks downloaded from %d peers" % len(block_peers))
+        assert len(block_peers) > 1
+
+        self.log.info("Announce the new blocks with headers after sendheaders")
+        node = self.nodes[0]
+        conn = node.add_p2p_connection(P2PInterface())
+        conn.wait_for_verack()
+        # The mininode speaks an older protocol: the node doesn't ask it for headers announcements
+        with mininode_lock:
+            assert "sendheaders" not in conn.last_message
+        conn.send_and_ping(msg_sendheaders())
+        msg = msg_getheaders()
+        msg.locator.vHave = [int(node.getbestblockhash(), 16)]
+        conn.send_and_ping(msg)
+        blockhash = self.nodes[1].generate(1)[0]
+        self.sync_blocks()
+        wait_until(lambda: "headers" in conn.last_message and len(conn.last_message["headers"].headers) > 0, timeout=30, lock=mininode_lock)
+        with mininode_lock:
+            header = conn.last_message["headers"].headers[-1]
+            header.calc_sha256()
+            assert_equal(header.hash, blockhash)
+
+        self.log.info("Answer getheaders with the headers after the locator")
+        with mininode_lock:
+            conn.last_message.pop("headers", None)
+        msg = msg_getheaders()
+        msg.locator.vHave = [int(node.getblockhash(190), 16)]
+        conn.send_message(msg)
+        wait_until(lambda: "headers" in conn.last_message, timeout=30, lock=mininode_lock)
+        with mininode_lock:
+            headers = [CBlockHeader(h) for h in conn.last_message["headers"].headers]
+            for h in headers:
+                h.calc_sha256()
+            assert_equal([h.hash for h in headers], [node.getblockhash(i) for i in range(191, node.getblockcount() + 1)])
+
+
+if __name__ == '__main__':
+    HeadersSyncTest().main()
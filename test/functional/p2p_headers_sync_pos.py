@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test headers-first sync of proof-of-stake blocks.
+
+A node that was offline while its peers staked blocks (across the V1 to V2
+stake modifier upgrade) syncs them headers-first. Its index entries, created
+from the headers, must get the proof-of-stake flag and the same stake
+modifiers as the peers' ones, so that it can stake on top of them.
+"""
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+)
+
+
+class HeadersSyncPoSTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        # PoS from 201, V2 stake modifiers from 251 (PIVX_v3.4)
+        self.extra_args = [['-nuparams=PoS:201', '-nuparams=PoS_v2:201']] * self.num_nodes
+
+    def setup_chain(self):
+        self.log.info("Initializing test directory " + self.options.tmpdir)
+        self._initialize_chain()
+        self.enable_mocktime()
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes(self.nodes[0], 1)
+        connect_nodes(self.nodes[1], 2)
+        self.sync_all()
+
+    def run_test(self):
+        self.log.info("Stake 60 blocks with node 0 and node 1, while node 2 is offline")
+        disconnect_nodes(self.nodes[1], 2)
+        disconnect_nodes(self.nodes[2], 1)
+        for i in range(60):
+            self.mocktime = self.generate_pos(i % 2, self.mocktime)
+        self.sync_blocks(self.nodes[:2])
+        assert_equal(self.nodes[0].getblockcount(), 260)
+        assert_equal(self.nodes[2].getblockcount(), 200)
+
+        self.log.info("Sync node 2 headers-first")
+        connect_nodes(self.nodes[2], 0)
+        connect_nodes(self.nodes[2], 1)
+        self.sync_blocks()
+        peers = self.nodes[2].getpeerinfo()
+        assert any(p["bytesrecv_per_msg"].get("headers", 0) > 0 for p in peers)
+
+        self.log.info("Check the stake modifiers of the synced blocks")
+        for height in range(201, 261):
+            blockhash = self.nodes[0].getblockhash(height)
+            block = self.nodes[2].getblock(blockhash)
+            assert "stakeModifier" in block
+            assert_equal(block["stakeModifier"], self.nodes[0].getblock(blockhash)["stakeModifier"])
+
+        self.log.info("Stake on top of the synced chain with node 2")
+        for i in range(5):
+            self.mocktime = self.generate_pos(2, self.mocktime)
+        self.sync_blocks()
+        assert_equal(self.nodes[0].getbestblockhash(), self.nodes[2].getbestblockhash())
+        assert_equal(self.nodes[0].getblockcount(), 265)
+
+
+if __name__ == '__main__':
+    HeadersSyncPoSTest().main()
@@ -29,7 +29,7 @@ from .siphash import siphash256
 from .util import hex_str_to_bytes, bytes_to_hex_str
 
 MIN_VERSION_SUPPORTED = 60001
-MY_VERSION = 70922
+MY_VERSION = 70923
 MY_SUBVERSION = "/python-mininode-tester:0.0.3/"
 MY_RELAY = 1 # from version 70001 onwards, fRelay should be appended to version messages (BIP37)
 
@@ -45,6 +45,7 @@ NODE_BLOOM = (1 << 2)
 
 MSG_TX = 1
 MSG_BLOCK = 2
+MSG_CMPCT_BLOCK = 17
 MSG_TYPE_MASK = 0xffffffff >> 2
 
 # Serialization/deserialization tools
@@ -687,6 +688,7 @@ class P2PHeaderAndShortIDs():
         self.shortids = []
         self.prefilled_txn_length = 0
         self.prefilled_txn = []
+        self.vchBlockSig = b""
 
     def deserialize(self, f):
         self.header.deserialize(f)
@@ -698,6 +700,7 @@ class P2PHeaderAndShortIDs():
             self.shortids.append(struct.unpack("<Q", f.read(6) + b'\x00\x00')[0])
         self.prefilled_txn = deser_vector(f, PrefilledTransaction)
         self.prefilled_txn_length = len(self.prefilled_txn)
+        self.vchBlockSig = deser_string(f)
 
     # When using version 2 compact blocks, we must serialize with_witness.
     def serialize(self, with_witness=False):
@@ -712,6 +715,7 @@ class P2PHeaderAndShortIDs():
             r += ser_vector(self.prefilled_txn, "serialize_with_witness")
         else:
             r += ser_vector(self.prefilled_txn, "serialize_without_witness")
+        r += ser_string(self.vchBlockSig)
         return r
 
     def __repr__(self):
@@ -737,12 +741,14 @@ class HeaderAndShortIDs():
         self.nonce = 0
         self.shortids = []
         self.prefilled_txn = []
+        self.vchBlockSig = b""
         self.use_witness = False
 
         if p2pheaders_and_shortids is not None:
             self.header = p2pheaders_and_shortids.header
             self.nonce = p2pheaders_and_shortids.nonce
             self.shortids = p2pheaders_and_shortids.shortids
+            self.vchBlockSig = p2pheaders_and_shortids.vchBlockSig
             last_index = -1
             for x in p2pheaders_and_shortids.prefilled_txn:
                 self.prefilled_txn.append(PrefilledTransaction(x.index + last_index + 1, x.tx))
@@ -758,6 +764,7 @@ class HeaderAndShortIDs():
         ret.shortids_length = len(self.shortids)
         ret.shortids = self.shortids
         ret.prefilled_txn_length = len(self.prefilled_txn)
+        ret.vchBlockSig = self.vchBlockSig
         ret.prefilled_txn = []
         last_index = -1
         for x in self.prefilled_txn:
@@ -778,6 +785,7 @@ class HeaderAndShortIDs():
         self.header = CBlockHeader(block)
         self.nonce = nonce
         self.prefilled_txn = [ PrefilledTransaction(i, block.vtx[i]) for i in prefill_list ]
+        self.vchBlockSig = getattr(block, 'vchBlockSig', b"")
         self.shortids = []
         self.use_witness = use_witness
         [k0, k1] = self.get_siphash_keys()
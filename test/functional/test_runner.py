@@ -71,6 +71,12 @@ BASE_SCRIPTS= [
     'wallet_import_rescan.py',                  # ~ 204 sec
     'p2p_invalid_block.py',                     # ~ 213 sec
     'p2p_invalid_messages.py',
+    'p2p_compactblocks.py',
+    'p2p_headers_sync.py',
+    'p2p_headers_sync_pos.py',
+    'feature_addressindex.py',
+    'feature_coinstatsindex.py',
+    'rpc_getblockfilter.py',
     'feature_reindex.py',                       # ~ 205 sec
     'feature_logging.py',                       # ~ 195 sec
     'wallet_multiwallet.py',                    # ~ 190 sec